@@ -1,8 +1,23 @@
+#define _POSIX_C_SOURCE 200809L  // mmap, open, fstat under -std=c23
+
 #include <string.h>
 #include <stdlib.h>
 #include <stdio.h>  // FILE operations
+#include <stdalign.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <pthread.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include "bitarray.h"
 #include "hashing.h"
+#include "crc32c.h"
+#include "checkpoint.h"
+#include "uring.h"
+#include "pilot_table.h"
 #include "bbhash.h"
 
 constexpr size_t MIN_BITARRAY_SIZE = 64;
@@ -14,49 +29,56 @@ struct BBHashLevel {
     uint64_t *popcounts;
     size_t seed;
     size_t level_offset;
+    uint8_t *block_seeds;    // seed of each block (weighted level 0), or NULL
+    size_t num_blocks;
     BBHashLevel *next;
 };
 
-BBHashLevel *bbhash_level_new() {
-    BBHashLevel *level = malloc(sizeof(BBHashLevel));
+BBHashLevel *bbhash_level_new(const BBHashAllocator *a) {
+    BBHashLevel *level = bbhash_alloc(a, sizeof(BBHashLevel), alignof(BBHashLevel));
     if (!level) return NULL;
     level->seed = 0;
     level->level_offset = 0;
     level->collision_free_set = NULL;
     level->popcounts = NULL;
+    level->block_seeds = NULL;
+    level->num_blocks = 0;
     level->next = NULL;
     return level;
 }
 
-void bbhash_level_free(BBHashLevel *level) {
+void bbhash_level_free(BBHashLevel *level, const BBHashAllocator *a) {
     if (level == NULL) {
         return;
     }
     if (level->collision_free_set != NULL) {
-        bitarray_free(level->collision_free_set);
+        bitarray_free_with(level->collision_free_set, a);
     }
     if (level->popcounts != NULL) {
-        free(level->popcounts);
+        bbhash_dealloc(a, level->popcounts);
     }
+    bbhash_dealloc(a, level->block_seeds);
     if (level->next) {
-        bbhash_level_free(level->next);
+        bbhash_level_free(level->next, a);
     }
-    free(level);
+    bbhash_dealloc(a, level);
 }
 
 constexpr size_t BLOCK_SIZE_IN_WORDS = 8;
 constexpr size_t BLOCK_SIZE_IN_BITS = BLOCK_SIZE_IN_WORDS * 64; // 512 bits = 8*64
 
-bool bbhash_build_rank_checkpoints(BBHashLevel *level) {
-    if (level == NULL || level->collision_free_set == NULL) return false;
-
-    Bitarray* ba = level->collision_free_set;
+/**
+ * @brief Computes the cumulative popcount at the start of every 512-bit block.
+ * @return A checkpoint table from `a`, or NULL on allocation failure.
+ */
+static uint64_t *build_popcounts(const Bitarray *ba, const BBHashAllocator *a) {
     size_t num_words = (ba->nbits + 63) / 64;
     size_t num_checkpoints = (num_words + BLOCK_SIZE_IN_WORDS - 1) / BLOCK_SIZE_IN_WORDS;
 
-    level->popcounts = malloc(sizeof(uint64_t) * num_checkpoints);
-    if (!level->popcounts) {
-        return false; // error
+    uint64_t *popcounts = bbhash_alloc(a, sizeof(uint64_t) * (num_checkpoints ? num_checkpoints : 1),
+                                       alignof(uint64_t));
+    if (!popcounts) {
+        return NULL; // error
     }
 
     uint64_t total_popcount = 0;
@@ -64,14 +86,24 @@ bool bbhash_build_rank_checkpoints(BBHashLevel *level) {
 
     for (size_t i = 0; i < num_words; ++i) {
         if (i % BLOCK_SIZE_IN_WORDS == 0) {
-            level->popcounts[checkpoint_idx++] = total_popcount;
+            popcounts[checkpoint_idx++] = total_popcount;
         }
         total_popcount += stdc_count_ones(ba->bits[i]);
     }
+    return popcounts;
+}
+
+bool bbhash_build_rank_checkpoints(BBHashLevel *level, const BBHashAllocator *a) {
+    if (level == NULL || level->collision_free_set == NULL) return false;
+
+    level->popcounts = build_popcounts(level->collision_free_set, a);
+    if (!level->popcounts) {
+        return false; // error
+    }
 
     if (level->next) {
-        if (!bbhash_build_rank_checkpoints(level->next)) {
-            free(level->popcounts);
+        if (!bbhash_build_rank_checkpoints(level->next, a)) {
+            bbhash_dealloc(a, level->popcounts);
             level->popcounts = NULL;
             return false;
         }
@@ -79,13 +111,162 @@ bool bbhash_build_rank_checkpoints(BBHashLevel *level) {
     return true;
 }
 
+/*
+ * Hash schemes.
+ *
+ * BBHASH_HASH_SEEDED hashes the key again at every level, with that level's
+ * seed. BBHASH_HASH_BASE128 follows the original BBHash: a key is hashed once
+ * into a 128-bit pair (a, b), level 0 uses a, level 1 uses b, and each deeper
+ * level advances the pair by one xorshift128+ step. Both halves are fmix64 of
+ * the key, which is a bijection, so distinct keys have distinct pairs. b is
+ * only computed for keys that miss level 0.
+ */
+constexpr uint64_t BASE_SEED_A = 0x9e3779b97f4a7c15;
+constexpr uint64_t BASE_SEED_B = 0xbf58476d1ce4e5b9;
+
+// Advances a pair to the next level and returns that level's hash, which is
+// a + b of the new pair.
+static inline uint64_t xorshift_step(uint64_t *a, uint64_t *b) {
+    uint64_t s1 = *a;
+    const uint64_t s0 = *b;
+    s1 ^= s1 << 23;
+    *a = s0;
+    *b = s1 ^ s0 ^ (s1 >> 17) ^ (s0 >> 26);
+    return *b + s0;
+}
+
+// Per-key hash state of a query, which visits the levels in order.
+typedef struct {
+    uint64_t key;
+    uint64_t key_hi;   // high half of a 128-bit key
+    uint64_t a, b;
+    size_t level;      // level whose hash comes next
+} KeyHasher;
+
+// Returns the key's hash for the next level, which has seed `seed`.
+static inline uint64_t key_hasher_next(KeyHasher *h, BBHashScheme scheme, uint64_t seed) {
+    if (scheme == BBHASH_HASH_SEEDED) return hash_with_seed(h->key, seed);
+    if (scheme == BBHASH_HASH_KEY128) return hash128_with_seed(h->key, h->key_hi, seed);
+    switch (h->level++) {
+    case 0:
+        return h->a = hash_with_seed(h->key, BASE_SEED_A);
+    case 1:
+        return h->b = hash_with_seed(h->key, BASE_SEED_B);
+    default:
+        return xorshift_step(&h->a, &h->b);
+    }
+}
+
+/*
+ * Weighted level 0.
+ *
+ * When the build gets per-key weights, level 0 is split into blocks of
+ * HOT_BLOCK_SLOTS slots. The level hash of a key picks its block, and the
+ * slot within the block mixes the level hash with the block's own seed. The
+ * builder tries several seeds per block and keeps the one that places the
+ * most weight, so frequently queried keys are mostly found by the first
+ * probe. Every key still goes through level 0, so a set bit still means that
+ * exactly one key hashed to the slot.
+ */
+constexpr size_t HOT_BLOCK_SLOTS = 256;
+constexpr unsigned HOT_SEED_TRIES_DEFAULT = 16;
+constexpr double HOT_KEY_WEIGHT = 1e9;  // outweighs any number of cold keys in a block
+
+// Seeds 8k to 8k + 7 take the bytes of one fmix64 of the level hash, so the
+// builder gets eight seeds out of every hash it computes.
+static inline size_t block_slot(uint64_t hash, size_t block, uint8_t seed) {
+    uint64_t mixed = hash_with_seed(hash, seed / 8);
+    return block * HOT_BLOCK_SLOTS + ((mixed >> (seed % 8 * 8)) & (HOT_BLOCK_SLOTS - 1));
+}
+
+// Slot of a level hash in a level of `nbits` slots, blocked if block_seeds is set.
+static inline size_t slot_of(uint64_t hash, size_t nbits, const uint8_t *block_seeds, size_t num_blocks) {
+    if (block_seeds == NULL) return hash % nbits;
+    size_t block = hash % num_blocks;
+    return block_slot(hash, block, block_seeds[block]);
+}
+
+static inline size_t level_slot(const BBHashLevel *level, uint64_t hash) {
+    return slot_of(hash, level->collision_free_set->nbits, level->block_seeds, level->num_blocks);
+}
+
+/*
+ * Compact encoding for the deep levels.
+ *
+ * Deep levels hold few keys, yet each one is padded to MIN_BITARRAY_SIZE and
+ * carries its own popcount table and header. The tail stores all levels from
+ * some depth on back to back in one bit array with one rank directory, and
+ * nothing else per level:
+ *
+ * - Tail level l uses seed first_seed + l (or continues the base hash steps).
+ * - Levels are stored in placement order, so rank over the tail bit array is
+ *   the number of tail keys placed before a position. Level offsets follow.
+ * - Level sizes are recomputed the way the builder chose them: the size of a
+ *   level depends only on the number of keys still unplaced, which is
+ *   num_keys minus the rank at the level's start.
+ *
+ * The levels before the tail keep the usual layout, so the level 0/1 query
+ * path is unchanged.
+ */
+constexpr size_t TAIL_MIN_LEVEL_SIZE = 8;
+
+typedef struct {
+    size_t num_levels;
+    uint64_t first_seed;
+    size_t offset;           // global index of the first key placed in the tail
+    size_t num_keys;         // keys placed in the tail
+    double gamma;
+    Bitarray *bits;          // all tail levels, concatenated
+    uint64_t *popcounts;     // rank checkpoints over bits
+} BBHashTail;
+
+static void bbhash_tail_free(BBHashTail *tail, const BBHashAllocator *a) {
+    if (tail == NULL) {
+        return;
+    }
+    if (tail->bits) bitarray_free_with(tail->bits, a);
+    bbhash_dealloc(a, tail->popcounts);
+    bbhash_dealloc(a, tail);
+}
+
 typedef struct BBHash {
     size_t num_keys;             // number of elements the MPHF was built for.
     struct BBHashLevel *levels;  // linked list
+    BBHashTail *tail;            // compact deep levels, or NULL
+    bool borrowed;               // bit arrays point into memory owned elsewhere
+    void *mapping;               // file mapping to unmap on free, or NULL
+    size_t mapping_len;
+    BBHashScheme hash_scheme;
+    PilotTable *pilots;          // BBHASH_ENGINE_PILOTS: the whole MPHF, with
+                                 // no levels or tail; otherwise NULL
+    BBHashAllocator allocator;   // where all of the above came from; zero = malloc
+    uint32_t shard, num_shards;  // partition of a sharded build; 0/0 = none
 } BBHash;
 
+constexpr double PILOT_C_DEFAULT = 6.0;
+
+BBHashConfig bbhash_config_default(void) {
+    return (BBHashConfig) {
+        .gamma = 2.0,
+        .verbose = false,
+        .compact_from_level = SIZE_MAX,
+        .threads = 1,
+        .memory_budget = 0,
+        .hash_scheme = BBHASH_HASH_SEEDED,
+        .weights = NULL,
+        .hot_keys = NULL,
+        .num_hot_keys = 0,
+        .hot_seed_tries = HOT_SEED_TRIES_DEFAULT,
+        .checkpoint_dir = NULL,
+        .engine = BBHASH_ENGINE_LEVELS,
+        .pilot_c = PILOT_C_DEFAULT,
+        .allocator = NULL,
+        .shard = 0,
+        .num_shards = 0,
+    };
+}
 
-size_t calc_level_size(size_t unplaced, double gamma) {
+size_t calc_level_size(size_t unplaced, double gamma, size_t min_size) {
     assert(gamma>0);
     if (unplaced > SIZE_MAX / gamma) {
         fprintf(stderr, "Overflow - gamma is too big");
@@ -93,319 +274,2361 @@ size_t calc_level_size(size_t unplaced, double gamma) {
     }
     
     size_t n = (size_t)(unplaced * gamma);
-    return n < MIN_BITARRAY_SIZE ? MIN_BITARRAY_SIZE : n;
+    return n < min_size ? min_size : n;
 }
 
-BBHash *bbhash_mphf_create(const uint64_t data[], size_t unplaced, double gamma, bool verbose) {
-    BBHash *mphf = malloc(sizeof(BBHash));
-    if (!mphf) return NULL;
-    mphf->levels = NULL;
-    mphf->num_keys = unplaced;
-    uint64_t *key_buffer = NULL;
-    BBHashLevel *level0 = NULL;
-    Bitarray *used_slots = NULL;
-
-    size_t *bucket_indexes = malloc(sizeof(size_t) * unplaced);
-    if (bucket_indexes == NULL) {
-        goto failure;
-    }
-
-    key_buffer = malloc(sizeof(uint64_t) * unplaced);
-    if (key_buffer == NULL) {
-        goto failure;
+/**
+ * @brief Moves the levels from index `from` on into a compact tail.
+ *
+ * Levels are left unchanged if there is nothing to pack.
+ * @return false on allocation failure.
+ */
+static bool bbhash_pack_tail(BBHash *mphf, size_t from, double gamma) {
+    BBHashLevel *prev = NULL, *first = mphf->levels;
+    for (size_t idx = 0; first != NULL && idx < from; idx++) {
+        prev = first;
+        first = first->next;
     }
+    if (first == NULL) return true;
 
-    uint64_t *next_data = key_buffer;
-
-    BBHashLevel *current_level = NULL;
-    size_t placed = 0;  // number of keys perfectly mapped
-    uint64_t current_seed = INITIAL_SEED;
-    size_t level_size = calc_level_size(unplaced, gamma);
-    used_slots = bitarray_new(level_size);
-
-    while (unplaced > 0) {
-        // --- Setup for the current level ---
-        BBHashLevel *new_level = bbhash_level_new();
-        if (!new_level) goto failure;
-        new_level->level_offset = placed;
-        new_level->seed = ++current_seed;
-        if (level0 == NULL) {
-            level0 = new_level;
-        } else {
-            current_level->next = new_level;
-        }
-        current_level = new_level;
-
-        size_t level_size = calc_level_size(unplaced, gamma);
-        bitarray_shrink(used_slots, level_size);
-        bitarray_clear_all(used_slots);
-        Bitarray* colliding_slots = bitarray_new(level_size); // collisions
-
-        for (size_t i = 0; i < unplaced; i++) {
-            uint64_t hash = hash_with_seed(data[i], current_level->seed);
-            size_t idx = hash % level_size;
-            bucket_indexes[i] = idx;
-            if (bitarray_get(used_slots, idx) == 1) {
-                bitarray_set(colliding_slots, idx);
-            } else {
-                bitarray_set(used_slots, idx);
-            }
-        }
+    const BBHashAllocator *a = &mphf->allocator;
+    BBHashTail *tail = bbhash_zalloc(a, sizeof(BBHashTail), alignof(BBHashTail));
+    if (!tail) return false;
+    tail->first_seed = first->seed;
+    tail->offset = first->level_offset;
+    tail->num_keys = mphf->num_keys - first->level_offset;
+    tail->gamma = gamma;
 
-        bitarray_andnot(colliding_slots, used_slots, colliding_slots);
-        current_level->collision_free_set = colliding_slots;
+    size_t total = 0;
+    for (BBHashLevel *level = first; level != NULL; level = level->next) {
+        total += level->collision_free_set->nbits;
+        tail->num_levels++;
+    }
 
-        size_t rank = 0;
-        size_t next_level_unplaced = 0;
-        for (size_t i = 0; i < unplaced ; i++) {
-            size_t idx = bucket_indexes[i];
-            if (bitarray_get(current_level->collision_free_set, idx) == 1) {
-                rank++;
-            } else {
-                next_data[next_level_unplaced++] = data[i];
-            }
+    tail->bits = bitarray_new_with(total, a);
+    if (!tail->bits) goto failure;
+    size_t start = 0;
+    for (BBHashLevel *level = first; level != NULL; level = level->next) {
+        const Bitarray *ba = level->collision_free_set;
+        for (size_t i = 0; i < ba->nbits; i++) {
+            if (bitarray_get(ba, i)) bitarray_set(tail->bits, start + i);
         }
-        data = next_data;
-        unplaced = next_level_unplaced;
-        placed += rank;
-
-        if (verbose)
-            printf("Level %llu; placed %zu; offset %zu\n",
-                   current_level->seed - INITIAL_SEED - 1,
-                   rank,
-                   current_level->level_offset);
+        start += ba->nbits;
     }
-    bitarray_free(used_slots);
-    free(key_buffer);
-    free(bucket_indexes);
-    mphf->levels = level0;
+    tail->popcounts = build_popcounts(tail->bits, a);
+    if (!tail->popcounts) goto failure;
 
-    if (bbhash_build_rank_checkpoints(level0))
-        return mphf;
+    if (prev) {
+        prev->next = NULL;
+    } else {
+        mphf->levels = NULL;
+    }
+    bbhash_level_free(first, a);
+    mphf->tail = tail;
+    return true;
 
 failure:
-    if (bucket_indexes) free(bucket_indexes);
-    if (mphf) free(mphf);
-    if (key_buffer) free(key_buffer);
-    if (used_slots) bitarray_free(used_slots);
-    if (level0) bbhash_level_free(level0);
-    return NULL;
+    bbhash_tail_free(tail, a);
+    return false;
 }
 
-/**
- * @brief Calculate the total memory footprint of the MPHF in bits.
- *
- * This function computes the actual memory usage of the BBHash data structure,
- * including both the bit arrays used for collision detection and the auxiliary
- * rank checkpoint tables used for fast queries.
- *
- * The calculation includes:
- * - Bit arrays for each level (rounded up to 64-bit word boundaries)
- * - Popcount/rank checkpoint tables for each level
- * - Does NOT include the overhead of struct pointers and metadata
+/*
+ * Filter pass: keep the keys whose slot did not make it into the collision
+ * free set. About a third of the keys are placed at every level, so the
+ * obvious `if` mispredicts all the time; the kernels below are branch free.
+ * All of them only write out[j] with j <= i after reading keys[i], so out may
+ * alias keys.
  *
+ * The SIMD kernels are selected at run time, so the default build needs no
+ * -march flags. Define BBHASH_NO_SIMD to use the scalar kernel only.
  */
-size_t bbhash_size_in_bits(const BBHash *mphf) {
-    if (mphf == NULL) {
-        return 0;
-    }
-
-    size_t total_bits = 0;
-    struct BBHashLevel *current_level = mphf->levels;
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__)) && !defined(BBHASH_NO_SIMD)
+#define BBHASH_X86_SIMD 1
+#include <immintrin.h>
+#endif
 
-    while (current_level != NULL) {
-        if (current_level->collision_free_set) {
-            size_t nbits = current_level->collision_free_set->nbits;
+static size_t compact_unplaced_scalar(const uint64_t *keys, const size_t *slots, size_t n,
+                                      const uint64_t *placed, uint64_t *out) {
+    size_t j = 0;
+    for (size_t i = 0; i < n; i++) {
+        size_t idx = slots[i];
+        uint64_t bit = (placed[idx >> 6] >> (idx & 63)) & 1;
+        out[j] = keys[i];
+        j += 1 - bit;
+    }
+    return j;
+}
 
-            // Stored in 64-bit words, so its allocated size is rounded up.
-            size_t bitarray_storage_bits = ((nbits + 63) / 64) * 64;
+#ifdef BBHASH_X86_SIMD
+// Eight keys per step: gather the bit words, then vpcompressq the losers.
+// A full-width store is fine since j + 8 <= i + 8 and those keys are loaded.
+__attribute__((target("avx512f")))
+static size_t compact_unplaced_avx512(const uint64_t *keys, const size_t *slots, size_t n,
+                                      const uint64_t *placed, uint64_t *out) {
+    const __m512i low6 = _mm512_set1_epi64(63);
+    const __m512i one = _mm512_set1_epi64(1);
+    size_t i = 0, j = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m512i idx = _mm512_loadu_si512((const void *)(slots + i));
+        __m512i words = _mm512_i64gather_epi64(_mm512_srli_epi64(idx, 6), (const void *)placed, 8);
+        __m512i bits = _mm512_and_si512(_mm512_srlv_epi64(words, _mm512_and_si512(idx, low6)), one);
+        __mmask8 keep = _mm512_cmpeq_epi64_mask(bits, _mm512_setzero_si512());
+        __m512i k = _mm512_loadu_si512((const void *)(keys + i));
+        _mm512_storeu_si512((void *)(out + j), _mm512_maskz_compress_epi64(keep, k));
+        j += stdc_count_ones((uint64_t)keep);
+    }
+    return j + compact_unplaced_scalar(keys + i, slots + i, n - i, placed, out + j);
+}
 
-            // Size of the popcounts checkpoint table.
-            // One checkpoint (a size_t) for every `block_size_in_bits`.
-            size_t num_checkpoints = (nbits + BLOCK_SIZE_IN_BITS - 1) / BLOCK_SIZE_IN_BITS;
-            size_t popcounts_storage_bits = num_checkpoints * sizeof(current_level->popcounts[0]) * 8;
-            total_bits += bitarray_storage_bits + popcounts_storage_bits;
-        }
-        current_level = current_level->next;
+// Four keys per step: gather the bit words and left-pack the losers with a
+// 16-entry permutation table.
+__attribute__((target("avx2")))
+static size_t compact_unplaced_avx2(const uint64_t *keys, const size_t *slots, size_t n,
+                                    const uint64_t *placed, uint64_t *out) {
+    static const uint32_t perm[16][8] = {
+        {0, 1, 2, 3, 4, 5, 6, 7}, {0, 1, 0, 0, 0, 0, 0, 0}, {2, 3, 0, 0, 0, 0, 0, 0}, {0, 1, 2, 3, 0, 0, 0, 0},
+        {4, 5, 0, 0, 0, 0, 0, 0}, {0, 1, 4, 5, 0, 0, 0, 0}, {2, 3, 4, 5, 0, 0, 0, 0}, {0, 1, 2, 3, 4, 5, 0, 0},
+        {6, 7, 0, 0, 0, 0, 0, 0}, {0, 1, 6, 7, 0, 0, 0, 0}, {2, 3, 6, 7, 0, 0, 0, 0}, {0, 1, 2, 3, 6, 7, 0, 0},
+        {4, 5, 6, 7, 0, 0, 0, 0}, {0, 1, 4, 5, 6, 7, 0, 0}, {2, 3, 4, 5, 6, 7, 0, 0}, {0, 1, 2, 3, 4, 5, 6, 7},
+    };
+    const __m256i low6 = _mm256_set1_epi64x(63);
+    const __m256i one = _mm256_set1_epi64x(1);
+    size_t i = 0, j = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m256i idx = _mm256_loadu_si256((const __m256i *)(slots + i));
+        __m256i words = _mm256_i64gather_epi64((const long long *)placed, _mm256_srli_epi64(idx, 6), 8);
+        __m256i bits = _mm256_and_si256(_mm256_srlv_epi64(words, _mm256_and_si256(idx, low6)), one);
+        __m256i lost = _mm256_cmpeq_epi64(bits, _mm256_setzero_si256());
+        unsigned keep = (unsigned)_mm256_movemask_pd(_mm256_castsi256_pd(lost));
+        __m256i k = _mm256_loadu_si256((const __m256i *)(keys + i));
+        __m256i p = _mm256_loadu_si256((const __m256i *)perm[keep]);
+        _mm256_storeu_si256((__m256i *)(out + j), _mm256_permutevar8x32_epi32(k, p));
+        j += stdc_count_ones((uint64_t)keep);
     }
+    return j + compact_unplaced_scalar(keys + i, slots + i, n - i, placed, out + j);
+}
+#endif
 
-    return total_bits;
+static size_t compact_unplaced(const uint64_t *keys, const size_t *slots, size_t n,
+                               const Bitarray *placed, uint64_t *out) {
+#ifdef BBHASH_X86_SIMD
+    if (__builtin_cpu_supports("avx512f")) return compact_unplaced_avx512(keys, slots, n, placed->bits, out);
+    if (__builtin_cpu_supports("avx2")) return compact_unplaced_avx2(keys, slots, n, placed->bits, out);
+#endif
+    return compact_unplaced_scalar(keys, slots, n, placed->bits, out);
 }
 
-/**
- * @brief Queries the BBHash MPHF for the unique integer hash of a key.
+/*
+ * 128-bit keys.
  *
- * @param level0 The pointer to the first level of the BBHash structure.
- * @param key    The key to query.
- * @return The unique hash value (from 0 to nelem-1) if the key was in the
- * original set. Otherwise, the behavior is undefined (it will
- * likely return an incorrect value or a "random" index).
+ * The builder keeps them as (lo, hi) word pairs. Their level hashes are
+ * computed for runs of keys at once: the AVX-512 kernel splits eight pairs
+ * into a vector of low and a vector of high halves and runs both fmix64
+ * rounds on all eight lanes (vpmullq needs AVX-512DQ).
  */
-size_t bbhash_mphf_query(const BBHash *mphf, uint64_t key) {
-    BBHashLevel *current_level = mphf->levels;
-
-    while (current_level != NULL) {
-        size_t level_size = current_level->collision_free_set->nbits;
-        uint64_t hash = hash_with_seed(key, current_level->seed);
-        size_t idx = hash % level_size;
-        if (bitarray_get(current_level->collision_free_set, idx) == 1) {
-            size_t rank = bitarray_rank(current_level->collision_free_set, current_level->popcounts, idx);
-            return current_level->level_offset + rank;
-        }
-        current_level = current_level->next;
+static void hash128_keys_scalar(const uint64_t *pairs, size_t n, uint64_t seed, uint64_t *out) {
+    for (size_t i = 0; i < n; i++) {
+        out[i] = hash128_with_seed(pairs[2 * i], pairs[2 * i + 1], seed);
     }
+}
 
-    // Should not happen if the key was in the original set.
-    // This indicates the key was not part of the set used to build the MPHF.
-    // Returning (size_t)-1 (which is SIZE_MAX) is a common C idiom.
-    return (size_t) -1;
+#ifdef BBHASH_X86_SIMD
+__attribute__((target("avx512f,avx512dq")))
+static inline __m512i fmix64_x8(__m512i k) {
+    k = _mm512_xor_si512(k, _mm512_srli_epi64(k, 33));
+    k = _mm512_mullo_epi64(k, _mm512_set1_epi64((long long)0xff51afd7ed558ccd));
+    k = _mm512_xor_si512(k, _mm512_srli_epi64(k, 33));
+    k = _mm512_mullo_epi64(k, _mm512_set1_epi64((long long)0xc4ceb9fe1a85ec53));
+    return _mm512_xor_si512(k, _mm512_srli_epi64(k, 33));
 }
 
-void bbhash_free(BBHash *mphf) {
-    if (mphf == NULL) {
-        return;
+__attribute__((target("avx512f,avx512dq")))
+static void hash128_keys_avx512(const uint64_t *pairs, size_t n, uint64_t seed, uint64_t *out) {
+    const __m512i lo_lanes = _mm512_set_epi64(14, 12, 10, 8, 6, 4, 2, 0);
+    const __m512i hi_lanes = _mm512_set_epi64(15, 13, 11, 9, 7, 5, 3, 1);
+    const __m512i s = _mm512_set1_epi64((long long)seed);
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m512i first = _mm512_loadu_si512((const void *)(pairs + 2 * i));
+        __m512i second = _mm512_loadu_si512((const void *)(pairs + 2 * i + 8));
+        __m512i lo = _mm512_permutex2var_epi64(first, lo_lanes, second);
+        __m512i hi = _mm512_permutex2var_epi64(first, hi_lanes, second);
+        __m512i h = fmix64_x8(_mm512_xor_si512(hi, s));
+        _mm512_storeu_si512((void *)(out + i), fmix64_x8(_mm512_xor_si512(lo, h)));
     }
-    bbhash_level_free(mphf->levels);
-    free(mphf);
+    hash128_keys_scalar(pairs + 2 * i, n - i, seed, out + i);
 }
+#endif
 
-int bbhash_mphf_save(const BBHash *mphf, const char *filename) {
-    if (!mphf || !filename) return -1;
-
-    FILE *fp = fopen(filename, "wb");
-    if (!fp) {
-        perror("bbhash_mphf_save: fopen");
-        return -1;
+static void hash128_keys(const uint64_t *pairs, size_t n, uint64_t seed, uint64_t *out) {
+#ifdef BBHASH_X86_SIMD
+    if (__builtin_cpu_supports("avx512dq")) {
+        hash128_keys_avx512(pairs, n, seed, out);
+        return;
     }
+#endif
+    hash128_keys_scalar(pairs, n, seed, out);
+}
 
-    // --- 1. Count levels ---
-    size_t num_levels = 0;
-    for (BBHashLevel *level = mphf->levels; level != NULL; level = level->next) {
-        num_levels++;
+// Keeps the pairs whose slot is not placed; out may be pairs itself.
+static size_t compact_unplaced_wide(const uint64_t *pairs, const size_t *slots, size_t n, uint64_t seed,
+                                    size_t level_size, const Bitarray *placed, uint64_t *out) {
+    size_t j = 0;
+    for (size_t i = 0; i < n; i++) {
+        size_t idx = slots ? slots[i] : hash128_with_seed(pairs[2 * i], pairs[2 * i + 1], seed) % level_size;
+        uint64_t bit = (placed->bits[idx >> 6] >> (idx & 63)) & 1;
+        uint64_t lo = pairs[2 * i], hi = pairs[2 * i + 1];
+        out[2 * j] = lo;
+        out[2 * j + 1] = hi;
+        j += 1 - bit;
     }
+    return j;
+}
 
-    // --- 2. Write Header ---
-    const char magic[4] = {'B', 'B', 'H', '1'};
-    if (fwrite(magic, sizeof(char), 4, fp) != 4) goto write_error;
+/*
+ * The keys of one level as the builder sees them: plain keys hashed with a
+ * seed, or (BBHASH_HASH_BASE128 after level 0) base hash pairs, where level 1
+ * uses b as is and deeper levels step the pairs in place.
+ */
+typedef struct {
+    enum { HASH_SEEDED, HASH_WIDE, HASH_PAIR_B, HASH_PAIR_STEP } kind;
+    const uint64_t *keys;      // HASH_SEEDED, or (lo, hi) pairs for HASH_WIDE
+    uint64_t seed;
+    uint64_t *a, *b;           // the pairs
+} LevelKeys;
 
-    uint64_t num_keys_u64 = mphf->num_keys;
-    if (fwrite(&num_keys_u64, sizeof(uint64_t), 1, fp) != 1) goto write_error;
+// Hashes key i for this level; steps its pair first if needed.
+static inline uint64_t level_keys_hash(const LevelKeys *lk, size_t i) {
+    switch (lk->kind) {
+    case HASH_SEEDED:
+        return hash_with_seed(lk->keys[i], lk->seed);
+    case HASH_WIDE:
+        return hash128_with_seed(lk->keys[2 * i], lk->keys[2 * i + 1], lk->seed);
+    case HASH_PAIR_B:
+        return lk->b[i];
+    default:
+        return xorshift_step(&lk->a[i], &lk->b[i]);
+    }
+}
 
-    uint64_t num_levels_u64 = num_levels;
-    if (fwrite(&num_levels_u64, sizeof(uint64_t), 1, fp) != 1) goto write_error;
+// The hash of key i again, once level_keys_hash() has run on it.
+static inline uint64_t level_keys_rehash(const LevelKeys *lk, size_t i) {
+    return lk->kind == HASH_PAIR_STEP ? lk->a[i] + lk->b[i] : level_keys_hash(lk, i);
+}
 
-    // --- 3. Write Levels Data ---
-    for (BBHashLevel *level = mphf->levels; level != NULL; level = level->next) {
-        // Write metadata
-        uint64_t seed_u64 = level->seed;
-        uint64_t offset_u64 = level->level_offset;
-        if (fwrite(&seed_u64, sizeof(uint64_t), 1, fp) != 1) goto write_error;
-        if (fwrite(&offset_u64, sizeof(uint64_t), 1, fp) != 1) goto write_error;
-
-        // Write bit array
-        Bitarray *ba = level->collision_free_set;
-        uint64_t nbits_u64 = ba->nbits;
-        size_t n_words = (ba->nbits + 63) / 64;
-        if (fwrite(&nbits_u64, sizeof(uint64_t), 1, fp) != 1) goto write_error;
-        if (fwrite(ba->bits, sizeof(uint64_t), n_words, fp) != n_words) goto write_error;
-
-        // Write popcounts table
-        size_t num_checkpoints = (ba->nbits + BLOCK_SIZE_IN_BITS - 1) / BLOCK_SIZE_IN_BITS;
-        uint64_t num_checkpoints_u64 = num_checkpoints;
-        if (fwrite(&num_checkpoints_u64, sizeof(uint64_t), 1, fp) != 1) goto write_error;
-        if (fwrite(level->popcounts, sizeof(uint64_t), num_checkpoints, fp) != num_checkpoints) goto write_error;
+// Budget mode: recompute the slots instead of storing them.
+static size_t compact_unplaced_rehash(const uint64_t *keys, size_t n, uint64_t seed, size_t level_size,
+                                      const Bitarray *placed, uint64_t *out) {
+    size_t j = 0;
+    for (size_t i = 0; i < n; i++) {
+        size_t idx = hash_with_seed(keys[i], seed) % level_size;
+        uint64_t bit = (placed->bits[idx >> 6] >> (idx & 63)) & 1;
+        out[j] = keys[i];
+        j += 1 - bit;
     }
+    return j;
+}
 
-    fclose(fp);
-    return 0;
+// Level 0 of BBHASH_HASH_BASE128: turn the keys that miss into base hash
+// pairs. b is computed in a second pass, over the survivors only.
+static size_t compact_unplaced_to_pairs(const uint64_t *keys, const size_t *slots, size_t n, size_t level_size,
+                                        const Bitarray *placed, uint64_t *out_a, uint64_t *out_b) {
+    size_t j = 0;
+    for (size_t i = 0; i < n; i++) {
+        uint64_t a = hash_with_seed(keys[i], BASE_SEED_A);
+        size_t idx = slots ? slots[i] : a % level_size;
+        uint64_t bit = (placed->bits[idx >> 6] >> (idx & 63)) & 1;
+        out_a[j] = a;
+        out_b[j] = keys[i];
+        j += 1 - bit;
+    }
+    for (size_t i = 0; i < j; i++) {
+        out_b[i] = hash_with_seed(out_b[i], BASE_SEED_B);
+    }
+    return j;
+}
 
-write_error:
-    fprintf(stderr, "Error writing to MPHF file.\n");
-    fclose(fp);
-    return -1;
+// Budget mode for pairs, compacting in place.
+static size_t compact_pairs_rehash(const LevelKeys *lk, size_t n, size_t level_size, const Bitarray *placed) {
+    size_t j = 0;
+    for (size_t i = 0; i < n; i++) {
+        size_t idx = level_keys_rehash(lk, i) % level_size;
+        uint64_t bit = (placed->bits[idx >> 6] >> (idx & 63)) & 1;
+        lk->a[j] = lk->a[i];
+        lk->b[j] = lk->b[i];
+        j += 1 - bit;
+    }
+    return j;
 }
 
+// Levels with fewer keys per thread than this are hashed on one thread.
+constexpr size_t MIN_KEYS_PER_THREAD = 1 << 16;
 
-BBHash *bbhash_mphf_load(const char *filename) {
-    if (!filename) return NULL;
+typedef struct {
+    const LevelKeys *keys;
+    size_t begin, end;         // slice of the keys hashed by this thread
+    size_t level_size;
+    const uint8_t *block_seeds; // weighted level 0, or NULL
+    size_t num_blocks;
+    size_t *slots;             // NULL when the filter pass recomputes them
+    Bitarray *used, *colliding; // shared, updated atomically
+} HashTask;
 
-    FILE *fp = fopen(filename, "rb");
-    if (!fp) {
-        perror("bbhash_mphf_load: fopen");
-        return NULL;
+// Keys per run of 128-bit level hashes.
+constexpr size_t WIDE_RUN = 64;
+
+// 128-bit keys: hash each run of keys in one call, then set their slots.
+static void hash_wide_range(const HashTask *task, bool shared) {
+    uint64_t hashes[WIDE_RUN];
+    for (size_t first = task->begin; first < task->end; first += WIDE_RUN) {
+        size_t count = task->end - first < WIDE_RUN ? task->end - first : WIDE_RUN;
+        hash128_keys(task->keys->keys + 2 * first, count, task->keys->seed, hashes);
+        for (size_t k = 0; k < count; k++) {
+            size_t idx = slot_of(hashes[k], task->level_size, task->block_seeds, task->num_blocks);
+            if (task->slots) task->slots[first + k] = idx;
+            if (shared) {
+                if (bitarray_set_atomic(task->used, idx)) bitarray_set_atomic(task->colliding, idx);
+            } else if (bitarray_get(task->used, idx) == 1) {
+                bitarray_set(task->colliding, idx);
+            } else {
+                bitarray_set(task->used, idx);
+            }
+        }
     }
+}
 
-    // Read and Validate Header ---
-    char magic[4];
-    if (fread(magic, sizeof(char), 4, fp) != 4) goto read_error;
-    if (magic[0] != 'B' || magic[1] != 'B' || magic[2] != 'H' || magic[3] != '1') {
-        fprintf(stderr, "Error: Invalid MPHF file format or version.\n");
-        fclose(fp);
+static void *hash_worker(void *arg) {
+    HashTask *task = arg;
+    if (task->keys->kind == HASH_WIDE) {
+        hash_wide_range(task, true);
         return NULL;
     }
+    for (size_t i = task->begin; i < task->end; i++) {
+        size_t idx = slot_of(level_keys_hash(task->keys, i), task->level_size, task->block_seeds, task->num_blocks);
+        if (task->slots) task->slots[i] = idx;
+        if (bitarray_set_atomic(task->used, idx)) {
+            bitarray_set_atomic(task->colliding, idx);
+        }
+    }
+    return NULL;
+}
 
-    uint64_t num_keys_u64, num_levels_u64;
-    if (fread(&num_keys_u64, sizeof(uint64_t), 1, fp) != 1) goto read_error;
-    if (fread(&num_levels_u64, sizeof(uint64_t), 1, fp) != 1) goto read_error;
+/**
+ * @brief Hashes the keys of one level into the used and colliding slot sets.
+ *
+ * The result is the same for any number of threads: a slot ends up in
+ * `colliding` iff two or more keys hash to it.
+ */
+static void hash_level(const LevelKeys *keys, size_t n, size_t level_size, const uint8_t *block_seeds,
+                       size_t num_blocks, size_t *slots, Bitarray *used, Bitarray *colliding, unsigned threads) {
+    if (threads > n / MIN_KEYS_PER_THREAD) threads = (unsigned)(n / MIN_KEYS_PER_THREAD);
+    HashTask *tasks = NULL;
+    pthread_t *tids = NULL;
+    bool *started = NULL;
+    if (threads > 1) {
+        tasks = malloc(sizeof(HashTask) * threads);
+        tids = malloc(sizeof(pthread_t) * threads);
+        started = malloc(sizeof(bool) * threads);
+    }
+    if (!tasks || !tids || !started) {
+        // One thread (or no memory for more): plain bit operations.
+        free(tasks);
+        free(tids);
+        free(started);
+        if (keys->kind == HASH_WIDE) {
+            HashTask task = {
+                .keys = keys, .begin = 0, .end = n, .level_size = level_size, .block_seeds = block_seeds,
+                .num_blocks = num_blocks, .slots = slots, .used = used, .colliding = colliding,
+            };
+            hash_wide_range(&task, false);
+            return;
+        }
+        for (size_t i = 0; i < n; i++) {
+            size_t idx = slot_of(level_keys_hash(keys, i), level_size, block_seeds, num_blocks);
+            if (slots) slots[i] = idx;
+            if (bitarray_get(used, idx) == 1) {
+                bitarray_set(colliding, idx);
+            } else {
+                bitarray_set(used, idx);
+            }
+        }
+        return;
+    }
 
-    // Allocate and Reconstruct MPHF ---
-    BBHash *mphf = malloc(sizeof(BBHash));
-    if (!mphf) goto alloc_error;
-    mphf->num_keys = num_keys_u64;
-    mphf->levels = NULL;
+    size_t chunk = (n + threads - 1) / threads;
+    for (unsigned t = 0; t < threads; t++) {
+        size_t begin = t * chunk < n ? t * chunk : n;
+        tasks[t] = (HashTask) {
+            .keys = keys, .begin = begin, .end = begin + chunk < n ? begin + chunk : n,
+            .level_size = level_size, .block_seeds = block_seeds, .num_blocks = num_blocks, .slots = slots,
+            .used = used, .colliding = colliding,
+        };
+    }
+    // The last slice runs on the calling thread.
+    for (unsigned t = 0; t + 1 < threads; t++) {
+        started[t] = pthread_create(&tids[t], NULL, hash_worker, &tasks[t]) == 0;
+        if (!started[t]) hash_worker(&tasks[t]);
+    }
+    hash_worker(&tasks[threads - 1]);
+    for (unsigned t = 0; t + 1 < threads; t++) {
+        if (started[t]) pthread_join(tids[t], NULL);
+    }
+    free(tasks);
+    free(tids);
+    free(started);
+}
 
-    BBHashLevel *current_level_tail = NULL;
-    for (size_t i = 0; i < num_levels_u64; ++i) {
-        BBHashLevel *level = bbhash_level_new();
-        if (!level) {
-            bbhash_free(mphf); // Clean up partially loaded structure
-            goto alloc_error;
+typedef struct {
+    uint64_t hash;                // level hash
+    double weight;
+} WeightedHash;
+
+// Keys are grouped by block in two passes: first into this many ranges of
+// blocks, then into blocks within each range, which stays in cache.
+constexpr size_t HOT_BLOCK_RANGES = 1024;
+
+typedef struct {
+    const size_t *block_start;    // where each block's keys start in keys[]
+    const WeightedHash *keys;     // grouped by block
+    size_t first_block, end_block;
+    unsigned tries;
+    uint8_t *block_seeds;
+    uint64_t *mixed;              // scratch for the largest block
+} SeedTask;
+
+static void *seed_worker(void *arg) {
+    SeedTask *task = arg;
+    uint64_t seen[HOT_BLOCK_SLOTS / 64], multi[HOT_BLOCK_SLOTS / 64];
+    for (size_t b = task->first_block; b < task->end_block; b++) {
+        const WeightedHash *keys = task->keys + task->block_start[b];
+        size_t m = task->block_start[b + 1] - task->block_start[b];
+        double total = 0;
+        for (size_t k = 0; k < m; k++) {
+            total += keys[k].weight;
         }
 
-        // Link the new level into the list
-        if (current_level_tail == NULL) {
-            mphf->levels = level;
-        } else {
-            current_level_tail->next = level;
+        // Keep the first seed that places the most weight; stop early once
+        // every key of the block is placed. Whether a key is placed is about
+        // a coin flip, so both loops are branch free.
+        uint8_t best_seed = 0;
+        double best_weight = -1;
+        for (unsigned seed = 0; seed < task->tries && best_weight < total; seed++) {
+            const unsigned shift = seed % 8 * 8;
+            if (shift == 0) {
+                for (size_t k = 0; k < m; k++) {
+                    task->mixed[k] = hash_with_seed(keys[k].hash, seed / 8);
+                }
+            }
+            memset(seen, 0, sizeof(seen));
+            memset(multi, 0, sizeof(multi));
+            for (size_t k = 0; k < m; k++) {
+                size_t slot = (task->mixed[k] >> shift) & (HOT_BLOCK_SLOTS - 1);
+                uint64_t bit = 1ull << (slot & 63);
+                multi[slot >> 6] |= seen[slot >> 6] & bit;
+                seen[slot >> 6] |= bit;
+            }
+            double weight = 0;
+            for (size_t k = 0; k < m; k++) {
+                size_t slot = (task->mixed[k] >> shift) & (HOT_BLOCK_SLOTS - 1);
+                uint64_t lost = (multi[slot >> 6] >> (slot & 63)) & 1;
+                weight += keys[k].weight * (double)(1 - lost);
+            }
+            if (weight > best_weight) {
+                best_weight = weight;
+                best_seed = (uint8_t)seed;
+            }
         }
-        current_level_tail = level;
+        task->block_seeds[b] = best_seed;
+    }
+    return NULL;
+}
 
-        // Read metadata
-        uint64_t seed_u64, offset_u64;
-        if (fread(&seed_u64, sizeof(uint64_t), 1, fp) != 1) goto read_error_cleanup;
-        if (fread(&offset_u64, sizeof(uint64_t), 1, fp) != 1) goto read_error_cleanup;
-        level->seed = seed_u64;
-        level->level_offset = offset_u64;
+/**
+ * @brief Picks the seed of every block of a weighted level.
+ *
+ * The level hashes and weights are first grouped by block, so the search
+ * reads them sequentially. Blocks are independent and split over the
+ * threads; the seeds do not depend on the thread count.
+ * @param scratch Room for n entries; overwritten.
+ * @param a Allocator for the grouped keys.
+ * @return false on allocation failure.
+ */
+static bool choose_block_seeds(const LevelKeys *keys, size_t n, const double *weights, size_t num_blocks,
+                               unsigned tries, unsigned threads, uint8_t *block_seeds, size_t *scratch,
+                               const BBHashAllocator *a) {
+    bool ok = false;
+    const size_t blocks_per_range = (num_blocks + HOT_BLOCK_RANGES - 1) / HOT_BLOCK_RANGES;
+    const size_t num_ranges = (num_blocks + blocks_per_range - 1) / blocks_per_range;
+    size_t *block_start = bbhash_zalloc(a, sizeof(size_t) * (num_blocks + 1), alignof(size_t));
+    size_t *range_next = bbhash_alloc(a, sizeof(size_t) * num_ranges, alignof(size_t));
+    WeightedHash *grouped = bbhash_alloc(a, sizeof(WeightedHash) * (n ? n : 1), alignof(WeightedHash));
+    WeightedHash *range_copy = NULL;
+    SeedTask *tasks = NULL;
+    pthread_t *tids = NULL;
+    bool *started = NULL;
+    if (!block_start || !range_next || !grouped) goto cleanup;
 
-        // Read bit array
-        uint64_t nbits_u64;
-        if (fread(&nbits_u64, sizeof(uint64_t), 1, fp) != 1) goto read_error_cleanup;
-        level->collision_free_set = bitarray_new(nbits_u64);
-        if (!level->collision_free_set) goto read_error_cleanup;
-        size_t n_words = (nbits_u64 + 63) / 64;
-        if (fread(level->collision_free_set->bits, sizeof(uint64_t), n_words, fp) != n_words) goto read_error_cleanup;
+    // Count the keys of every block; scratch[] holds each key's block.
+    for (size_t i = 0; i < n; i++) {
+        size_t b = level_keys_hash(keys, i) % num_blocks;
+        scratch[i] = b;
+        block_start[b + 1]++;
+    }
+    size_t largest = 1;
+    for (size_t b = 0; b < num_blocks; b++) {
+        if (block_start[b + 1] > largest) largest = block_start[b + 1];
+        block_start[b + 1] += block_start[b];
+    }
 
-        // Read popcounts table
-        uint64_t num_checkpoints_u64;
-        if (fread(&num_checkpoints_u64, sizeof(uint64_t), 1, fp) != 1) goto read_error_cleanup;
-        level->popcounts = malloc(sizeof(size_t) * num_checkpoints_u64);
-        if (!level->popcounts) goto read_error_cleanup;
-        if (fread(level->popcounts, sizeof(uint64_t), num_checkpoints_u64, fp) != num_checkpoints_u64) goto read_error_cleanup;
+    // Pass 1: scatter into ranges of blocks, few enough to keep one cache
+    // line per range hot.
+    size_t largest_range = 1;
+    for (size_t r = 0; r < num_ranges; r++) {
+        size_t end = (r + 1) * blocks_per_range < num_blocks ? (r + 1) * blocks_per_range : num_blocks;
+        range_next[r] = block_start[r * blocks_per_range];
+        if (block_start[end] - range_next[r] > largest_range) largest_range = block_start[end] - range_next[r];
+    }
+    for (size_t i = 0; i < n; i++) {
+        size_t pos = range_next[scratch[i] / blocks_per_range]++;
+        grouped[pos] = (WeightedHash) {level_keys_hash(keys, i), weights[i]};
     }
 
-    fclose(fp);
-    return mphf;
+    // Pass 2: within each range, which fits in cache, scatter into blocks.
+    range_copy = bbhash_alloc(a, sizeof(WeightedHash) * largest_range, alignof(WeightedHash));
+    if (!range_copy) goto cleanup;
+    for (size_t r = 0; r < num_ranges; r++) {
+        size_t first_block = r * blocks_per_range;
+        size_t end_block = first_block + blocks_per_range < num_blocks ? first_block + blocks_per_range : num_blocks;
+        size_t begin = block_start[first_block], count = block_start[end_block] - begin;
+        memcpy(range_copy, grouped + begin, sizeof(WeightedHash) * count);
+        for (size_t k = 0; k < count; k++) {
+            grouped[block_start[range_copy[k].hash % num_blocks]++] = range_copy[k];
+        }
+    }
+    // Each block_start[b] has moved to the start of block b + 1.
+    for (size_t b = num_blocks; b > 0; b--) {
+        block_start[b] = block_start[b - 1];
+    }
+    block_start[0] = 0;
 
-alloc_error:
-    fprintf(stderr, "Memory allocation failed during MPHF load.\n");
-    fclose(fp);
-    return NULL;
+    if (threads > n / MIN_KEYS_PER_THREAD) threads = n >= MIN_KEYS_PER_THREAD ? (unsigned)(n / MIN_KEYS_PER_THREAD) : 1;
+    tasks = calloc(threads, sizeof(SeedTask));
+    tids = malloc(sizeof(pthread_t) * threads);
+    started = calloc(threads, sizeof(bool));
+    if (!tasks || !tids || !started) goto cleanup;
+    size_t chunk = (num_blocks + threads - 1) / threads;
+    for (unsigned t = 0; t < threads; t++) {
+        size_t first = t * chunk < num_blocks ? t * chunk : num_blocks;
+        tasks[t] = (SeedTask) {
+            .block_start = block_start, .keys = grouped,
+            .first_block = first, .end_block = first + chunk < num_blocks ? first + chunk : num_blocks,
+            .tries = tries, .block_seeds = block_seeds,
+            .mixed = bbhash_alloc(a, sizeof(uint64_t) * largest, alignof(uint64_t)),
+        };
+        if (!tasks[t].mixed) goto cleanup;
+    }
 
-read_error_cleanup:
-    bbhash_free(mphf); // Free everything allocated so far
+    // The last range runs on the calling thread.
+    for (unsigned t = 0; t + 1 < threads; t++) {
+        started[t] = pthread_create(&tids[t], NULL, seed_worker, &tasks[t]) == 0;
+        if (!started[t]) seed_worker(&tasks[t]);
+    }
+    seed_worker(&tasks[threads - 1]);
+    for (unsigned t = 0; t + 1 < threads; t++) {
+        if (started[t]) pthread_join(tids[t], NULL);
+    }
+    ok = true;
 
-read_error:
+cleanup:
+    for (unsigned t = 0; tasks && t < threads; t++) {
+        bbhash_dealloc(a, tasks[t].mixed);
+    }
+    free(tasks);
+    free(tids);
+    free(started);
+    bbhash_dealloc(a, block_start);
+    bbhash_dealloc(a, range_next);
+    bbhash_dealloc(a, grouped);
+    bbhash_dealloc(a, range_copy);
+    return ok;
+}
+
+// Weights for a hot key list: hot keys outweigh everything else. The hot
+// keys go into an open addressing set at most half full.
+static double *hot_key_weights(const uint64_t data[], size_t n, const uint64_t hot_keys[], size_t num_hot,
+                               const BBHashAllocator *a) {
+    size_t capacity = 16;
+    while (capacity < 2 * num_hot) capacity *= 2;
+    double *weights = bbhash_alloc(a, sizeof(double) * (n ? n : 1), alignof(double));
+    uint64_t *set = bbhash_alloc(a, sizeof(uint64_t) * capacity, alignof(uint64_t));
+    Bitarray *occupied = bitarray_new_with(capacity, a);
+    if (!weights || !set || !occupied) {
+        bbhash_dealloc(a, weights);
+        bbhash_dealloc(a, set);
+        if (occupied) bitarray_free_with(occupied, a);
+        return NULL;
+    }
+    for (size_t i = 0; i < num_hot; i++) {
+        size_t pos = hash_with_seed(hot_keys[i], 0) & (capacity - 1);
+        while (bitarray_get(occupied, pos) && set[pos] != hot_keys[i]) pos = (pos + 1) & (capacity - 1);
+        set[pos] = hot_keys[i];
+        bitarray_set(occupied, pos);
+    }
+    for (size_t i = 0; i < n; i++) {
+        size_t pos = hash_with_seed(data[i], 0) & (capacity - 1);
+        while (bitarray_get(occupied, pos) && set[pos] != data[i]) pos = (pos + 1) & (capacity - 1);
+        weights[i] = bitarray_get(occupied, pos) ? HOT_KEY_WEIGHT : 1.0;
+    }
+    bbhash_dealloc(a, set);
+    bitarray_free_with(occupied, a);
+    return weights;
+}
+
+BBHash *bbhash_mphf_create(const uint64_t data[], size_t unplaced, double gamma, bool verbose) {
+    BBHashConfig config = bbhash_config_default();
+    config.gamma = gamma;
+    config.verbose = verbose;
+    return bbhash_mphf_create_ex(data, unplaced, &config);
+}
+
+/*
+ * Construction scratch. A build takes what it needs from here and leaves it
+ * for the next build; nothing is zeroed unless the build reads it as zero.
+ */
+struct BBHashBuilder {
+    size_t *bucket_indexes;      // slot of each key at the current level
+    size_t bucket_cap;
+    uint64_t *key_buffer;        // keys left after level 0 (first halves of pairs)
+    size_t key_cap;              // in words
+    uint64_t *pair_b;            // second halves of the base hash pairs
+    size_t pair_cap;
+    Bitarray *used_slots;
+    size_t used_cap;             // in bits
+    Bitarray *colliding_slots;
+    size_t colliding_cap;
+    BBHashAllocator allocator;   // for all of the above; zero = malloc
+};
+
+// Returns a buffer of at least `count` elements: `buf` if it is large
+// enough, else a fresh one (the contents are not kept). NULL on failure.
+static void *scratch_reserve(const BBHashAllocator *a, void *buf, size_t *cap, size_t count, size_t size) {
+    if (buf && *cap >= count) return buf;
+    bbhash_dealloc(a, buf);
+    *cap = 0;
+    buf = bbhash_alloc(a, size * (count ? count : 1), alignof(uint64_t));
+    if (buf) *cap = count;
+    return buf;
+}
+
+// As scratch_reserve() for a bit array; sets it to `nbits` bits, uncleared.
+static Bitarray *scratch_bits(const BBHashAllocator *a, Bitarray *ba, size_t *cap, size_t nbits) {
+    if (!ba || *cap < nbits) {
+        bitarray_free_with(ba, a);
+        *cap = 0;
+        ba = bitarray_new_uninit_with(nbits, a);
+        if (!ba) return NULL;
+        *cap = nbits;
+    }
+    ba->nbits = nbits;
+    return ba;
+}
+
+static void builder_release(BBHashBuilder *b) {
+    const BBHashAllocator *a = &b->allocator;
+    bbhash_dealloc(a, b->bucket_indexes);
+    bbhash_dealloc(a, b->key_buffer);
+    bbhash_dealloc(a, b->pair_b);
+    bitarray_free_with(b->used_slots, a);
+    bitarray_free_with(b->colliding_slots, a);
+    *b = (BBHashBuilder) {.allocator = b->allocator};
+}
+
+// The allocator of a config, by value; zero if there is none.
+static BBHashAllocator config_allocator(const BBHashConfig *config) {
+    return config->allocator ? *config->allocator : (BBHashAllocator) {0};
+}
+
+static bool restore_checkpoint(const char *dir, const CheckpointState *state, BBHashLevel **level0,
+                               BBHashLevel **last, BBHashBuilder *b, LevelKeys *keys, const BBHashAllocator *a) {
+    for (size_t l = 0; l < state->num_levels; l++) {
+        BBHashLevel *level = bbhash_level_new(a);
+        if (!level) return false;
+        if (*last) (*last)->next = level;
+        else *level0 = level;
+        *last = level;
+        uint64_t seed, offset;
+        if (!checkpoint_read_level(dir, l, &seed, &offset, &level->collision_free_set, &level->block_seeds,
+                                   &level->num_blocks, a)) {
+            return false;
+        }
+        if (seed != INITIAL_SEED + 1 + l || offset > state->placed) {
+            fprintf(stderr, "Error: checkpoint level %zu does not belong to this build.\n", l);
+            return false;
+        }
+        level->seed = seed;
+        level->level_offset = offset;
+    }
+    // Room for one full-width SIMD store past the end, as in the build.
+    b->key_buffer = scratch_reserve(&b->allocator, b->key_buffer, &b->key_cap,
+                                    state->unplaced * state->words_per_key + 8, sizeof(uint64_t));
+    if (state->num_arrays > 1) {
+        b->pair_b = scratch_reserve(&b->allocator, b->pair_b, &b->pair_cap, state->unplaced + 8, sizeof(uint64_t));
+    }
+    if (!b->key_buffer || (state->num_arrays > 1 && !b->pair_b)) return false;
+    uint64_t *const arrays[2] = {b->key_buffer, state->num_arrays > 1 ? b->pair_b : NULL};
+    if (!checkpoint_read_keys(dir, state, arrays)) return false;
+    *keys = (LevelKeys) {.kind = state->key_form, .keys = b->key_buffer, .a = b->key_buffer, .b = arrays[1]};
+    return true;
+}
+
+// BBHASH_ENGINE_PILOTS: one pilot table, built without the builder's scratch.
+static BBHash *create_pilot_mphf(const uint64_t data[], size_t n, const BBHashConfig *config, bool wide,
+                                 bool resume) {
+    if (wide || resume || config->hash_scheme != BBHASH_HASH_SEEDED || config->weights || config->hot_keys
+        || config->checkpoint_dir) {
+        fprintf(stderr, "The pilot engine takes 64-bit keys with the seeded hash scheme, "
+                        "and no weights, hot keys or checkpoints.\n");
+        return NULL;
+    }
+    BBHashAllocator allocator = config_allocator(config);
+    BBHash *mphf = bbhash_zalloc(&allocator, sizeof(BBHash), alignof(BBHash));
+    if (!mphf) return NULL;
+    mphf->num_keys = n;
+    mphf->hash_scheme = BBHASH_HASH_SEEDED;
+    mphf->allocator = allocator;
+    mphf->shard = config->shard;
+    mphf->num_shards = config->num_shards;
+    mphf->pilots = pilot_table_build(data, n, config->pilot_c, config->verbose, &allocator);
+    if (!mphf->pilots) {
+        bbhash_dealloc(&allocator, mphf);
+        return NULL;
+    }
+    return mphf;
+}
+
+// Builds over 64-bit keys, or over (lo, hi) pairs if `wide`, or continues
+// the build saved in config->checkpoint_dir if `resume`. Scratch memory
+// comes from `b` and stays there.
+static BBHash *create_mphf(BBHashBuilder *b, const uint64_t data[], size_t unplaced, const BBHashConfig *config,
+                           bool wide, bool resume) {
+    if (config->num_shards != 0 && config->shard >= config->num_shards) {
+        fprintf(stderr, "Shard %u is out of range for %u shards.\n", config->shard, config->num_shards);
+        return NULL;
+    }
+    if (config->engine == BBHASH_ENGINE_PILOTS) return create_pilot_mphf(data, unplaced, config, wide, resume);
+    if (config->engine != BBHASH_ENGINE_LEVELS) {
+        fprintf(stderr, "Unknown construction engine %d.\n", (int)config->engine);
+        return NULL;
+    }
+    CheckpointState saved;
+    if (resume && !checkpoint_read_state(config->checkpoint_dir, &saved)) return NULL;
+    if (resume && saved.key_form > HASH_PAIR_STEP) {
+        fprintf(stderr, "Error: checkpoint keys are in an unknown form.\n");
+        return NULL;
+    }
+    // A resumed build keeps the shape it was started with.
+    const double gamma = resume ? saved.gamma : config->gamma;
+    const bool verbose = config->verbose;
+    const unsigned threads = config->threads ? config->threads : 1;
+    const BBHashScheme scheme = resume ? (BBHashScheme)saved.hash_scheme
+                                : wide ? BBHASH_HASH_KEY128 : config->hash_scheme;
+    if (scheme != BBHASH_HASH_SEEDED && scheme != BBHASH_HASH_BASE128 && scheme != BBHASH_HASH_KEY128) {
+        fprintf(stderr, "Unknown hash scheme %d.\n", (int)scheme);
+        return NULL;
+    }
+    wide = scheme == BBHASH_HASH_KEY128;
+    // A weighted level 0 keeps its block seeds, so it is never packed.
+    const bool weighted = !resume && (config->weights != NULL || config->hot_keys != NULL);
+    const size_t compact_from = resume ? saved.compact_from
+                                : weighted && config->compact_from_level == 0 ? 1 : config->compact_from_level;
+    unsigned hot_seed_tries = config->hot_seed_tries ? config->hot_seed_tries : HOT_SEED_TRIES_DEFAULT;
+    if (hot_seed_tries > 256) hot_seed_tries = 256;
+    BBHashAllocator allocator = config_allocator(config);
+    BBHash *mphf = bbhash_zalloc(&allocator, sizeof(BBHash), alignof(BBHash));
+    if (!mphf) return NULL;
+    mphf->allocator = allocator;
+    mphf->shard = config->shard;
+    mphf->num_shards = config->num_shards;
+    const BBHashAllocator *a = &mphf->allocator;     // for the MPHF
+    const BBHashAllocator *scratch = &b->allocator;  // for what the builder keeps
+    mphf->num_keys = resume ? saved.num_keys : unplaced;
+    mphf->hash_scheme = scheme;
+    if (resume) unplaced = saved.unplaced;
+    uint64_t *key_buffer = NULL;
+    uint64_t *pair_b = NULL;    // second halves of the base hash pairs
+    BBHashLevel *level0 = NULL;
+    Bitarray *used_slots = NULL;
+    Bitarray *colliding_slots = NULL;
+    size_t *bucket_indexes = NULL;
+    double *hot_weights = NULL;  // made from config->hot_keys
+    CheckpointWriter *writer = NULL;
+    double checkpoint_wait_ms = 0;  // time the builder waited for the writer
+
+    size_t level_size = calc_level_size(unplaced, gamma, MIN_BITARRAY_SIZE);
+    if (weighted) level_size = (level_size + HOT_BLOCK_SLOTS - 1) / HOT_BLOCK_SLOTS * HOT_BLOCK_SLOTS;
+
+    // Scratch memory estimate: the keys that survive level 0 (at most n / gamma,
+    // since 1 - e^-x <= x), the used and colliding sets of level 0 plus the
+    // levels kept (under four level 0 bit arrays), and optionally the slot of
+    // every key, which the filter pass can recompute instead. Base hash pairs
+    // take two words per surviving key. A weighted level 0 always stores the
+    // slots and also groups the hashes and weights by block. 128-bit keys
+    // are copied as they are, two words each.
+    size_t survivors_bound = gamma > 1.0 && !resume ? (size_t)(unplaced / gamma) : unplaced;
+    size_t words_per_survivor = scheme == BBHASH_HASH_SEEDED ? 1 : 2;
+    size_t min_scratch = survivors_bound * words_per_survivor * sizeof(uint64_t) + level_size / 2;
+    if (weighted) min_scratch += unplaced * 2 * sizeof(size_t);
+    bool keep_slots = true;
+    if (config->memory_budget) {
+        if (min_scratch > config->memory_budget) {
+            fprintf(stderr, "Memory budget of %zu bytes is too small for %zu keys (need about %zu).\n",
+                    config->memory_budget, unplaced, min_scratch);
+            goto failure;
+        }
+        keep_slots = weighted || min_scratch + unplaced * sizeof(size_t) <= config->memory_budget;
+        if (verbose && !keep_slots) printf("Memory budget: recomputing slots in the filter pass.\n");
+    }
+    if (keep_slots) {
+        bucket_indexes = b->bucket_indexes = scratch_reserve(scratch, b->bucket_indexes, &b->bucket_cap, unplaced,
+                                                             sizeof(size_t));
+        if (bucket_indexes == NULL) {
+            goto failure;
+        }
+    }
+
+    BBHashLevel *current_level = NULL;
+    size_t placed = 0;  // number of keys perfectly mapped
+    uint64_t current_seed = INITIAL_SEED;
+    used_slots = b->used_slots = scratch_bits(scratch, b->used_slots, &b->used_cap, level_size);
+    colliding_slots = b->colliding_slots = scratch_bits(scratch, b->colliding_slots, &b->colliding_cap, level_size);
+    if (!used_slots || !colliding_slots) goto failure;
+    LevelKeys keys = {
+        .kind = wide ? HASH_WIDE : HASH_SEEDED,
+        .keys = data,
+        .seed = scheme == BBHASH_HASH_BASE128 ? BASE_SEED_A : 0,
+    };
+    if (resume) {
+        if (!restore_checkpoint(config->checkpoint_dir, &saved, &level0, &current_level, b, &keys, a)) {
+            goto failure;
+        }
+        key_buffer = b->key_buffer;
+        pair_b = saved.num_arrays > 1 ? b->pair_b : NULL;
+        placed = saved.placed;
+        current_seed = INITIAL_SEED + saved.num_levels;
+        if (verbose) printf("Resumed after level %zu; %zu keys left.\n", (size_t)saved.num_levels - 1, unplaced);
+    }
+    if (config->checkpoint_dir) {
+        writer = checkpoint_writer_start(config->checkpoint_dir);
+        if (!writer) goto failure;
+    }
+
+    while (unplaced > 0) {
+        // --- Setup for the current level ---
+        BBHashLevel *new_level = bbhash_level_new(a);
+        if (!new_level) goto failure;
+        new_level->level_offset = placed;
+        new_level->seed = ++current_seed;
+        if (level0 == NULL) {
+            level0 = new_level;
+        } else {
+            current_level->next = new_level;
+        }
+        current_level = new_level;
+
+        // Tail levels are not padded, so they can be smaller.
+        size_t level_no = current_seed - INITIAL_SEED - 1;
+        size_t min_size = level_no >= compact_from ? TAIL_MIN_LEVEL_SIZE : MIN_BITARRAY_SIZE;
+        size_t level_size = calc_level_size(unplaced, gamma, min_size);
+        if (weighted && level_no == 0) {
+            level_size = (level_size + HOT_BLOCK_SLOTS - 1) / HOT_BLOCK_SLOTS * HOT_BLOCK_SLOTS;
+        }
+        bitarray_shrink(used_slots, level_size);
+        bitarray_clear_all(used_slots);
+        bitarray_shrink(colliding_slots, level_size);
+        bitarray_clear_all(colliding_slots);
+
+        if (scheme != BBHASH_HASH_BASE128) keys.seed = current_level->seed;
+        if (weighted && level_no == 0) {
+            const double *weights = config->weights;
+            if (!weights) {
+                weights = hot_weights = hot_key_weights(data, unplaced, config->hot_keys, config->num_hot_keys,
+                                                           scratch);
+            }
+            current_level->num_blocks = level_size / HOT_BLOCK_SLOTS;
+            current_level->block_seeds = bbhash_alloc(a, current_level->num_blocks, 1);
+            if (!weights || !current_level->block_seeds ||
+                !choose_block_seeds(&keys, unplaced, weights, current_level->num_blocks, hot_seed_tries,
+                                    threads, current_level->block_seeds, bucket_indexes, scratch)) {
+                goto failure;
+            }
+            bbhash_dealloc(scratch, hot_weights);
+            hot_weights = NULL;
+        }
+        // The writer may still be reading the keys: hashing steps base hash
+        // pairs in place, and the filter pass below compacts the keys.
+        struct timespec w0, w1;
+        timespec_get(&w0, TIME_UTC);
+        if (writer && keys.kind == HASH_PAIR_STEP) checkpoint_writer_wait(writer);
+        timespec_get(&w1, TIME_UTC);
+        checkpoint_wait_ms += (double)(w1.tv_sec - w0.tv_sec) * 1e3 + (w1.tv_nsec - w0.tv_nsec) * 1e-6;
+        hash_level(&keys, unplaced, level_size, current_level->block_seeds, current_level->num_blocks,
+                   bucket_indexes, used_slots, colliding_slots, threads);
+        timespec_get(&w0, TIME_UTC);
+        if (writer) checkpoint_writer_wait(writer);
+        timespec_get(&w1, TIME_UTC);
+        checkpoint_wait_ms += (double)(w1.tv_sec - w0.tv_sec) * 1e3 + (w1.tv_nsec - w0.tv_nsec) * 1e-6;
+
+        // The level keeps a fresh array; andnot writes all of it.
+        Bitarray *free_set = bitarray_new_uninit_with(level_size, a);
+        if (!free_set) goto failure;
+        bitarray_andnot(free_set, used_slots, colliding_slots);
+        current_level->collision_free_set = free_set;
+
+        if (key_buffer == NULL) {
+            // Only the keys that missed level 0 are copied, so size the buffer
+            // now, plus room for one full-width SIMD store past the end.
+            size_t survivors = unplaced - bitarray_count(free_set);
+            key_buffer = b->key_buffer = scratch_reserve(scratch, b->key_buffer, &b->key_cap,
+                                                         survivors * (wide ? 2 : 1) + 8, sizeof(uint64_t));
+            if (key_buffer == NULL) {
+                goto failure;
+            }
+            if (scheme == BBHASH_HASH_BASE128) {
+                pair_b = b->pair_b = scratch_reserve(scratch, b->pair_b, &b->pair_cap, survivors + 8,
+                                                     sizeof(uint64_t));
+                if (pair_b == NULL) goto failure;
+            }
+        }
+
+        struct timespec t0, t1;
+        timespec_get(&t0, TIME_UTC);
+        size_t next_level_unplaced;
+        if (keys.kind == HASH_WIDE) {
+            next_level_unplaced = compact_unplaced_wide(keys.keys, bucket_indexes, unplaced, keys.seed, level_size,
+                                                        free_set, key_buffer);
+            keys.keys = key_buffer;
+        } else if (keys.kind == HASH_SEEDED && scheme == BBHASH_HASH_SEEDED) {
+            next_level_unplaced = bucket_indexes
+                                  ? compact_unplaced(keys.keys, bucket_indexes, unplaced, free_set, key_buffer)
+                                  : compact_unplaced_rehash(keys.keys, unplaced, keys.seed, level_size,
+                                          free_set, key_buffer);
+            keys.keys = key_buffer;
+        } else if (keys.kind == HASH_SEEDED) {
+            next_level_unplaced = compact_unplaced_to_pairs(keys.keys, bucket_indexes, unplaced, level_size,
+                                                            free_set, key_buffer, pair_b);
+            keys = (LevelKeys) {.kind = HASH_PAIR_B, .a = key_buffer, .b = pair_b};
+        } else {
+            if (bucket_indexes) {
+                next_level_unplaced = compact_unplaced(keys.a, bucket_indexes, unplaced, free_set, keys.a);
+                compact_unplaced(keys.b, bucket_indexes, unplaced, free_set, keys.b);
+            } else {
+                next_level_unplaced = compact_pairs_rehash(&keys, unplaced, level_size, free_set);
+            }
+            keys.kind = HASH_PAIR_STEP;
+        }
+        timespec_get(&t1, TIME_UTC);
+        size_t rank = unplaced - next_level_unplaced;
+        unplaced = next_level_unplaced;
+        placed += rank;
+
+        if (writer) {
+            // Written while the next level is hashed.
+            bool pairs = keys.kind == HASH_PAIR_B || keys.kind == HASH_PAIR_STEP;
+            CheckpointState state = {
+                .num_keys = mphf->num_keys, .num_levels = level_no + 1, .placed = placed, .unplaced = unplaced,
+                .compact_from = compact_from, .gamma = gamma, .hash_scheme = scheme, .key_form = keys.kind,
+                .num_arrays = pairs ? 2 : 1, .words_per_key = keys.kind == HASH_WIDE ? 2 : 1,
+            };
+            CheckpointLevel level = {
+                .seed = current_level->seed, .offset = current_level->level_offset,
+                .bits = current_level->collision_free_set,
+                .block_seeds = current_level->block_seeds, .num_blocks = current_level->num_blocks,
+            };
+            const uint64_t *const arrays[2] = {pairs ? keys.a : keys.keys, keys.b};
+            checkpoint_writer_submit(writer, &state, &level, arrays);
+        }
+
+        if (verbose)
+            printf("Level %llu; placed %zu; offset %zu; filter %.3f ms\n",
+                   (unsigned long long)(current_level->seed - INITIAL_SEED - 1),
+                   rank,
+                   current_level->level_offset,
+                   (double)(t1.tv_sec - t0.tv_sec) * 1e3 + (t1.tv_nsec - t0.tv_nsec) * 1e-6);
+    }
+    if (writer && !checkpoint_writer_finish(writer)) {
+        fprintf(stderr, "Warning: writing a checkpoint failed; the build went on without them.\n");
+    } else if (writer && verbose) {
+        printf("Checkpoints: the builder waited %.3f ms for the writer.\n", checkpoint_wait_ms);
+    }
+    writer = NULL;
+    mphf->levels = level0;
+    level0 = NULL;
+
+    if (!bbhash_pack_tail(mphf, compact_from, gamma)) goto failure;
+    if (mphf->levels == NULL || bbhash_build_rank_checkpoints(mphf->levels, a))
+        return mphf;
+
+failure:
+    checkpoint_writer_finish(writer);  // before the builder reuses the keys it may be reading
+    bbhash_dealloc(scratch, hot_weights);
+    if (level0) bbhash_level_free(level0, a);
+    bbhash_free(mphf);
+    return NULL;
+}
+
+BBHash *bbhash_mphf_create_ex(const uint64_t data[], size_t unplaced, const BBHashConfig *config) {
+    BBHashBuilder scratch = {.allocator = config_allocator(config)};
+    BBHash *mphf = bbhash_builder_build(&scratch, data, unplaced, config);
+    builder_release(&scratch);
+    return mphf;
+}
+
+BBHash *bbhash_mphf_create128(const BBHashKey128 keys[], size_t n, const BBHashConfig *config) {
+    BBHashBuilder scratch = {.allocator = config_allocator(config)};
+    BBHash *mphf = bbhash_builder_build128(&scratch, keys, n, config);
+    builder_release(&scratch);
+    return mphf;
+}
+
+BBHash *bbhash_mphf_resume(const BBHashConfig *config) {
+    if (!config->checkpoint_dir) {
+        fprintf(stderr, "bbhash_mphf_resume needs config->checkpoint_dir.\n");
+        return NULL;
+    }
+    BBHashBuilder scratch = {.allocator = config_allocator(config)};
+    BBHash *mphf = create_mphf(&scratch, NULL, 0, config, false, true);
+    builder_release(&scratch);
+    return mphf;
+}
+
+BBHashBuilder *bbhash_builder_create(void) {
+    return bbhash_builder_create_ex(NULL);
+}
+
+BBHashBuilder *bbhash_builder_create_ex(const BBHashAllocator *allocator) {
+    BBHashAllocator a = allocator ? *allocator : (BBHashAllocator) {0};
+    BBHashBuilder *builder = bbhash_zalloc(&a, sizeof(BBHashBuilder), alignof(BBHashBuilder));
+    if (builder) builder->allocator = a;
+    return builder;
+}
+
+BBHash *bbhash_builder_build(BBHashBuilder *builder, const uint64_t data[], size_t n, const BBHashConfig *config) {
+    if (config->hash_scheme == BBHASH_HASH_KEY128) {
+        fprintf(stderr, "MPHFs over 128-bit keys are built with bbhash_mphf_create128().\n");
+        return NULL;
+    }
+    return create_mphf(builder, data, n, config, false, false);
+}
+
+BBHash *bbhash_builder_build128(BBHashBuilder *builder, const BBHashKey128 keys[], size_t n,
+                                const BBHashConfig *config) {
+    if (config->hash_scheme != BBHASH_HASH_SEEDED || config->hot_keys != NULL) {
+        fprintf(stderr, "128-bit keys take neither a hash scheme nor a hot key list (use weights).\n");
+        return NULL;
+    }
+    static_assert(sizeof(BBHashKey128) == 2 * sizeof(uint64_t));
+    return create_mphf(builder, (const uint64_t *)keys, n, config, true, false);
+}
+
+size_t bbhash_builder_scratch_bytes(const BBHashBuilder *builder) {
+    return builder->bucket_cap * sizeof(size_t)
+           + (builder->key_cap + builder->pair_cap) * sizeof(uint64_t)
+           + (builder->used_cap + 63) / 64 * sizeof(uint64_t)
+           + (builder->colliding_cap + 63) / 64 * sizeof(uint64_t);
+}
+
+void bbhash_builder_trim(BBHashBuilder *builder) {
+    builder_release(builder);
+}
+
+void bbhash_builder_free(BBHashBuilder *builder) {
+    if (!builder) return;
+    BBHashAllocator a = builder->allocator;
+    builder_release(builder);
+    bbhash_dealloc(&a, builder);
+}
+
+int bbhash_checkpoint_remove(const char *dir) {
+    return checkpoint_remove(dir);
+}
+
+void bbhash_mphf_stats(const BBHash *mphf, BBHashStats *stats) {
+    *stats = (BBHashStats) {
+        .num_keys = mphf->num_keys,
+        .size_in_bits = bbhash_size_in_bits(mphf),
+        .mapped = mphf->borrowed,
+        .hash_scheme = mphf->hash_scheme,
+        .engine = mphf->pilots ? BBHASH_ENGINE_PILOTS : BBHASH_ENGINE_LEVELS,
+        .num_buckets = mphf->pilots ? mphf->pilots->num_buckets : 0,
+        .shard = mphf->shard,
+        .num_shards = mphf->num_shards,
+    };
+    for (const BBHashLevel *level = mphf->levels; level != NULL; level = level->next) {
+        stats->num_levels++;
+    }
+    if (mphf->tail) {
+        stats->tail_levels = mphf->tail->num_levels;
+        stats->tail_keys = mphf->tail->num_keys;
+    }
+}
+
+bool bbhash_mphf_level_info(const BBHash *mphf, size_t level_no, BBHashLevelInfo *info) {
+    const BBHashLevel *level = mphf->levels;
+    for (size_t i = 0; level != NULL && i < level_no; i++) {
+        level = level->next;
+    }
+    if (level == NULL) return false;
+
+    size_t end = level->next ? level->next->level_offset
+                 : mphf->tail ? mphf->tail->offset : mphf->num_keys;
+    size_t nbits = level->collision_free_set->nbits;
+    size_t num_checkpoints = (nbits + BLOCK_SIZE_IN_BITS - 1) / BLOCK_SIZE_IN_BITS;
+    *info = (BBHashLevelInfo) {
+        .seed = level->seed,
+        .offset = level->level_offset,
+        .num_keys = end - level->level_offset,
+        .num_slots = nbits,
+        .size_in_bits = ((nbits + 63) / 64) * 64 + num_checkpoints * 64 + level->num_blocks * 8,
+        .num_blocks = level->num_blocks,
+    };
+    return true;
+}
+
+/**
+ * @brief Calculate the total memory footprint of the MPHF in bits.
+ *
+ * This function computes the actual memory usage of the BBHash data structure,
+ * including both the bit arrays used for collision detection and the auxiliary
+ * rank checkpoint tables used for fast queries.
+ *
+ * The calculation includes:
+ * - Bit arrays for each level (rounded up to 64-bit word boundaries)
+ * - Popcount/rank checkpoint tables for each level
+ * - Does NOT include the overhead of struct pointers and metadata
+ *
+ */
+size_t bbhash_size_in_bits(const BBHash *mphf) {
+    if (mphf == NULL) {
+        return 0;
+    }
+
+    size_t total_bits = 0;
+    struct BBHashLevel *current_level = mphf->levels;
+
+    while (current_level != NULL) {
+        if (current_level->collision_free_set) {
+            size_t nbits = current_level->collision_free_set->nbits;
+
+            // Stored in 64-bit words, so its allocated size is rounded up.
+            size_t bitarray_storage_bits = ((nbits + 63) / 64) * 64;
+
+            // Size of the popcounts checkpoint table.
+            // One checkpoint (a size_t) for every `block_size_in_bits`.
+            size_t num_checkpoints = (nbits + BLOCK_SIZE_IN_BITS - 1) / BLOCK_SIZE_IN_BITS;
+            size_t popcounts_storage_bits = num_checkpoints * sizeof(current_level->popcounts[0]) * 8;
+            total_bits += bitarray_storage_bits + popcounts_storage_bits;
+            total_bits += current_level->num_blocks * 8;  // block seeds
+        }
+        current_level = current_level->next;
+    }
+
+    const BBHashTail *tail = mphf->tail;
+    if (tail) {
+        size_t nbits = tail->bits->nbits;
+        size_t num_checkpoints = (nbits + BLOCK_SIZE_IN_BITS - 1) / BLOCK_SIZE_IN_BITS;
+        total_bits += ((nbits + 63) / 64) * 64;
+        total_bits += num_checkpoints * sizeof(tail->popcounts[0]) * 8;
+    }
+    if (mphf->pilots) total_bits += pilot_table_size_in_bits(mphf->pilots);
+
+    return total_bits;
+}
+
+// Looks a key up in the compact tail, after it missed all normal levels.
+// Adds the number of tail levels probed before the hit to *depth, if given.
+static size_t query_tail(const BBHash *mphf, KeyHasher *hasher, size_t *depth) {
+    const BBHashTail *tail = mphf->tail;
+    if (tail) {
+        size_t start = 0, unplaced = tail->num_keys;
+        for (size_t l = 0; l < tail->num_levels; l++) {
+            size_t level_size = calc_level_size(unplaced, tail->gamma, TAIL_MIN_LEVEL_SIZE);
+            uint64_t hash = key_hasher_next(hasher, mphf->hash_scheme, tail->first_seed + l);
+            size_t idx = start + hash % level_size;
+            if (bitarray_get(tail->bits, idx) == 1) {
+                if (depth) *depth += l;
+                return tail->offset + bitarray_rank(tail->bits, tail->popcounts, idx);
+            }
+            start += level_size;
+            if (start >= tail->bits->nbits) break;
+            unplaced = tail->num_keys - bitarray_rank(tail->bits, tail->popcounts, start);
+        }
+    }
+
+    // Should not happen if the key was in the original set.
+    // This indicates the key was not part of the set used to build the MPHF.
+    // Returning (size_t)-1 (which is SIZE_MAX) is a common C idiom.
+    return (size_t) -1;
+}
+
+/**
+ * @brief Queries the BBHash MPHF for the unique integer hash of a key.
+ *
+ * @param level0 The pointer to the first level of the BBHash structure.
+ * @param key    The key to query.
+ * @return The unique hash value (from 0 to nelem-1) if the key was in the
+ * original set. Otherwise, the behavior is undefined (it will
+ * likely return an incorrect value or a "random" index).
+ */
+size_t bbhash_mphf_query(const BBHash *mphf, uint64_t key) {
+    if (mphf->pilots) return pilot_table_query(mphf->pilots, key);
+    BBHashLevel *current_level = mphf->levels;
+    KeyHasher hasher = {.key = key};
+
+    while (current_level != NULL) {
+        uint64_t hash = key_hasher_next(&hasher, mphf->hash_scheme, current_level->seed);
+        size_t idx = level_slot(current_level, hash);
+        if (bitarray_get(current_level->collision_free_set, idx) == 1) {
+            size_t rank = bitarray_rank(current_level->collision_free_set, current_level->popcounts, idx);
+            return current_level->level_offset + rank;
+        }
+        current_level = current_level->next;
+    }
+    return query_tail(mphf, &hasher, NULL);
+}
+
+size_t bbhash_mphf_query_level(const BBHash *mphf, uint64_t key) {
+    if (mphf->pilots) return 0;
+    KeyHasher hasher = {.key = key};
+    size_t depth = 0;
+    for (const BBHashLevel *level = mphf->levels; level != NULL; level = level->next, depth++) {
+        uint64_t hash = key_hasher_next(&hasher, mphf->hash_scheme, level->seed);
+        if (bitarray_get(level->collision_free_set, level_slot(level, hash)) == 1) return depth;
+    }
+    return query_tail(mphf, &hasher, &depth) == (size_t) -1 ? (size_t) -1 : depth;
+}
+
+// Keys per group in bbhash_mphf_query_batch().
+constexpr size_t QUERY_GROUP_SIZE = 32;
+
+// Batch queries over 64-bit keys, or over (lo, hi) pairs if `wide`. The
+// group is too small for the SIMD hash kernel to pay off: the probes are
+// bound by cache misses, and 128-bit keys cost about 10% more that way.
+static inline void query_batch(const BBHash *mphf, const uint64_t keys[], size_t n, bool wide, size_t out[]) {
+    KeyHasher hashers[QUERY_GROUP_SIZE];
+    size_t slots[QUERY_GROUP_SIZE];
+    uint8_t pending[QUERY_GROUP_SIZE];  // group members not placed yet
+
+    for (size_t first = 0; first < n; first += QUERY_GROUP_SIZE) {
+        size_t count = n - first < QUERY_GROUP_SIZE ? n - first : QUERY_GROUP_SIZE;
+        for (size_t i = 0; i < count; i++) {
+            hashers[i] = wide ? (KeyHasher) {.key = keys[2 * (first + i)], .key_hi = keys[2 * (first + i) + 1]}
+                              : (KeyHasher) {.key = keys[first + i]};
+            pending[i] = (uint8_t)i;
+        }
+
+        size_t num_pending = count;
+        for (const BBHashLevel *level = mphf->levels; level != NULL && num_pending > 0; level = level->next) {
+            const Bitarray *ba = level->collision_free_set;
+            // Hash the whole group and start loading the words it needs...
+            for (size_t p = 0; p < num_pending; p++) {
+                size_t i = pending[p];
+                size_t idx = level_slot(level, key_hasher_next(&hashers[i], mphf->hash_scheme, level->seed));
+                slots[i] = idx;
+                __builtin_prefetch(&ba->bits[idx >> 6]);
+                __builtin_prefetch(&level->popcounts[idx / BLOCK_SIZE_IN_BITS]);
+            }
+            // ...then test them; the keys that miss go on to the next level.
+            size_t still_pending = 0;
+            for (size_t p = 0; p < num_pending; p++) {
+                size_t i = pending[p];
+                if (bitarray_get(ba, slots[i]) == 1) {
+                    out[first + i] = level->level_offset + bitarray_rank(ba, level->popcounts, slots[i]);
+                } else {
+                    pending[still_pending++] = (uint8_t)i;
+                }
+            }
+            num_pending = still_pending;
+        }
+        for (size_t p = 0; p < num_pending; p++) {
+            out[first + pending[p]] = query_tail(mphf, &hashers[pending[p]], NULL);
+        }
+    }
+}
+
+void bbhash_mphf_query_batch(const BBHash *mphf, const uint64_t keys[], size_t n, size_t out[]) {
+    if (mphf->pilots) {
+        pilot_table_query_batch(mphf->pilots, keys, n, out);
+        return;
+    }
+    query_batch(mphf, keys, n, false, out);
+}
+
+size_t bbhash_mphf_query128(const BBHash *mphf, BBHashKey128 key) {
+    KeyHasher hasher = {.key = key.lo, .key_hi = key.hi};
+    for (const BBHashLevel *level = mphf->levels; level != NULL; level = level->next) {
+        uint64_t hash = key_hasher_next(&hasher, mphf->hash_scheme, level->seed);
+        size_t idx = level_slot(level, hash);
+        if (bitarray_get(level->collision_free_set, idx) == 1) {
+            return level->level_offset + bitarray_rank(level->collision_free_set, level->popcounts, idx);
+        }
+    }
+    return query_tail(mphf, &hasher, NULL);
+}
+
+void bbhash_mphf_query128_batch(const BBHash *mphf, const BBHashKey128 keys[], size_t n, size_t out[]) {
+    query_batch(mphf, (const uint64_t *)keys, n, true, out);
+}
+
+typedef struct {
+    const BBHash *mphf;
+    const uint64_t *keys;
+    size_t num_keys;
+    size_t begin, end;         // slice of keys[] checked by this thread
+    Bitarray *seen;            // shared, one bit per index, updated atomically
+    _Atomic size_t *first_bad; // smallest key position that failed so far
+} VerifyTask;
+
+static void *verify_worker(void *arg) {
+    VerifyTask *task = arg;
+    for (size_t i = task->begin; i < task->end; i++) {
+        size_t idx = bbhash_mphf_query(task->mphf, task->keys[i]);
+        if (idx < task->num_keys && bitarray_set_atomic(task->seen, idx) == 0) {
+            continue;
+        }
+        // Out of range or already taken: keep the smallest failing position.
+        size_t cur = atomic_load(task->first_bad);
+        while (i < cur && !atomic_compare_exchange_weak(task->first_bad, &cur, i)) {}
+    }
+    return NULL;
+}
+
+int bbhash_mphf_verify(const BBHash *mphf, const uint64_t keys[], size_t n, unsigned threads) {
+    if (!mphf || (!keys && n > 0)) return -1;
+    if (mphf->num_keys != n) {
+        fprintf(stderr, "Verification failed: MPHF built for %zu keys, got %zu.\n", mphf->num_keys, n);
+        return -1;
+    }
+    if (threads == 0) threads = 1;
+    if (threads > n) threads = n > 0 ? (unsigned)n : 1;
+
+    Bitarray *seen = bitarray_new_with(n > 0 ? n : 1, &mphf->allocator);
+    VerifyTask *tasks = malloc(sizeof(VerifyTask) * threads);
+    pthread_t *tids = malloc(sizeof(pthread_t) * threads);
+    if (!seen || !tasks || !tids) {
+        fprintf(stderr, "Memory allocation failed during MPHF verification.\n");
+        if (seen) bitarray_free_with(seen, &mphf->allocator);
+        free(tasks);
+        free(tids);
+        return -1;
+    }
+
+    _Atomic size_t first_bad = SIZE_MAX;
+    size_t chunk = (n + threads - 1) / threads;
+    for (unsigned t = 0; t < threads; t++) {
+        size_t begin = t * chunk < n ? t * chunk : n;
+        size_t end = begin + chunk < n ? begin + chunk : n;
+        tasks[t] = (VerifyTask) {
+            .mphf = mphf, .keys = keys, .num_keys = n, .begin = begin, .end = end,
+            .seen = seen, .first_bad = &first_bad,
+        };
+    }
+    // The calling thread takes the last slice, and any slice whose thread fails to start.
+    bool *running = calloc(threads, sizeof(bool));
+    for (unsigned t = 0; t < threads; t++) {
+        if (running && t + 1 < threads && pthread_create(&tids[t], NULL, verify_worker, &tasks[t]) == 0) {
+            running[t] = true;
+        } else {
+            verify_worker(&tasks[t]);
+        }
+    }
+    for (unsigned t = 0; running && t < threads; t++) {
+        if (running[t]) pthread_join(tids[t], NULL);
+    }
+    free(running);
+
+    int result = 0;
+    size_t bad = atomic_load(&first_bad);
+    if (bad != SIZE_MAX) {
+        // n distinct indexes in [0, n) cover the whole range, so a missing
+        // index can only exist when some key failed.
+        size_t idx = bbhash_mphf_query(mphf, keys[bad]);
+        fprintf(stderr, "Verification failed! Key #%zu (%" PRIu64 ") -> index %zu (%s).\n",
+                bad, keys[bad], idx, idx < n ? "duplicate" : "out of range");
+        for (size_t i = 0; i < n; i++) {
+            if (!bitarray_get(seen, i)) {
+                fprintf(stderr, "Verification failed! Index %zu is not mapped.\n", i);
+                break;
+            }
+        }
+        result = -1;
+    }
+
+    bitarray_free_with(seen, &mphf->allocator);
+    free(tasks);
+    free(tids);
+    return result;
+}
+
+static uint64_t *clone_popcounts(const uint64_t *popcounts, const Bitarray *ba, const BBHashAllocator *a) {
+    size_t num_checkpoints = (ba->nbits + BLOCK_SIZE_IN_BITS - 1) / BLOCK_SIZE_IN_BITS;
+    uint64_t *copy = bbhash_alloc(a, sizeof(uint64_t) * (num_checkpoints ? num_checkpoints : 1), alignof(uint64_t));
+    if (!copy) return NULL;
+    memcpy(copy, popcounts, sizeof(uint64_t) * num_checkpoints);
+    return copy;
+}
+
+BBHash *bbhash_mphf_clone(const BBHash *mphf) {
+    if (!mphf) return NULL;
+
+    const BBHashAllocator *a = &mphf->allocator;
+    BBHash *copy = bbhash_zalloc(a, sizeof(BBHash), alignof(BBHash));
+    if (!copy) return NULL;
+    copy->num_keys = mphf->num_keys;
+    copy->hash_scheme = mphf->hash_scheme;
+    copy->allocator = mphf->allocator;
+    copy->shard = mphf->shard;
+    copy->num_shards = mphf->num_shards;
+
+    BBHashLevel **link = &copy->levels;
+    for (const BBHashLevel *level = mphf->levels; level != NULL; level = level->next) {
+        BBHashLevel *new_level = bbhash_level_new(a);
+        if (!new_level) goto failure;
+        *link = new_level;
+        link = &new_level->next;
+
+        new_level->seed = level->seed;
+        new_level->level_offset = level->level_offset;
+        new_level->collision_free_set = bitarray_clone_with(level->collision_free_set, a);
+        if (!new_level->collision_free_set) goto failure;
+        new_level->popcounts = clone_popcounts(level->popcounts, level->collision_free_set, a);
+        if (!new_level->popcounts) goto failure;
+        if (level->block_seeds) {
+            new_level->block_seeds = bbhash_alloc(a, level->num_blocks, 1);
+            if (!new_level->block_seeds) goto failure;
+            memcpy(new_level->block_seeds, level->block_seeds, level->num_blocks);
+            new_level->num_blocks = level->num_blocks;
+        }
+    }
+
+    if (mphf->tail) {
+        BBHashTail *tail = bbhash_alloc(a, sizeof(BBHashTail), alignof(BBHashTail));
+        if (!tail) goto failure;
+        *tail = *mphf->tail;
+        tail->bits = NULL;
+        tail->popcounts = NULL;
+        copy->tail = tail;
+        tail->bits = bitarray_clone_with(mphf->tail->bits, a);
+        if (!tail->bits) goto failure;
+        tail->popcounts = clone_popcounts(mphf->tail->popcounts, mphf->tail->bits, a);
+        if (!tail->popcounts) goto failure;
+    }
+    if (mphf->pilots) {
+        copy->pilots = pilot_table_clone(mphf->pilots, a);
+        if (!copy->pilots) goto failure;
+    }
+    return copy;
+
+failure:
+    fprintf(stderr, "Memory allocation failed during MPHF clone.\n");
+    bbhash_free(copy);
+    return NULL;
+}
+
+void bbhash_free(BBHash *mphf) {
+    if (mphf == NULL) {
+        return;
+    }
+    if (mphf->borrowed) {
+        // Bit arrays and rank tables point into a buffer or mapping we don't own.
+        for (BBHashLevel *level = mphf->levels; level != NULL; level = level->next) {
+            level->collision_free_set = NULL;
+            level->popcounts = NULL;
+            level->block_seeds = NULL;
+        }
+        if (mphf->tail) {
+            mphf->tail->bits = NULL;
+            mphf->tail->popcounts = NULL;
+        }
+    }
+    BBHashAllocator a = mphf->allocator;  // the struct goes back through it too
+    bbhash_level_free(mphf->levels, &a);
+    bbhash_tail_free(mphf->tail, &a);
+    pilot_table_free(mphf->pilots, &a);  // knows whether its arrays are borrowed
+    if (mphf->mapping) munmap(mphf->mapping, mphf->mapping_len);
+    bbhash_dealloc(&a, mphf);
+}
+
+/*
+ * File format
+ *
+ * Version 1 ('BBH1'): magic, num_keys, num_levels, then per level:
+ *   seed, level_offset, nbits, bit words, num_checkpoints, popcounts.
+ * Version 2 ('BBH2'): version 1 followed by the compact tail:
+ *   num_levels, first_seed, offset, num_keys, gamma (double),
+ *   nbits, bit words, num_checkpoints, popcounts.
+ * Version 3 ('BBH3'): the same sections, but
+ *   - the magic is followed by a 32-bit flags word, so all later fields are
+ *     8-byte aligned. A mapped file can then be used in place (an `nbits`
+ *     field followed by its words has the layout of a Bitarray).
+ *   - the header, each level and the tail are each followed by the CRC-32C
+ *     of the section's bytes, stored in a 64-bit field.
+ *   - bits 1-3 of the flags hold the hash scheme. Older versions always
+ *     use BBHASH_HASH_SEEDED.
+ *   - with FILE_FLAG_BLOCKED, the level 0 section ends with num_blocks and
+ *     one seed byte per block, zero padded to 8 bytes.
+ *   - with FILE_FLAG_PILOTS, there are no levels and no tail; a pilot table
+ *     section follows the header: seed, table_size, num_buckets,
+ *     dense_buckets, pilot_width, remap_width, then the packed pilots and
+ *     remap entries, each as a word count and the words.
+ *   - with FILE_FLAG_SHARD, the header ends with the shard index and the
+ *     shard count of a sharded build.
+ * All integers are little-endian 64-bit unless noted.
+ */
+enum {
+    FILE_FLAG_TAIL = 1u << 0,   // a compact tail section follows the levels
+    FILE_FLAG_SCHEME_SHIFT = 1,
+    FILE_FLAG_SCHEME_MASK = 7u << FILE_FLAG_SCHEME_SHIFT,
+    FILE_FLAG_BLOCKED = 1u << 4,  // level 0 has per-block seeds
+    FILE_FLAG_PILOTS = 1u << 5,   // a pilot table replaces the levels
+    FILE_FLAG_SHARD = 1u << 6,    // the header records the shard
+};
+
+typedef struct {
+    FILE *fp;
+    int version;
+    uint32_t crc;      // CRC of the current section so far
+    bool ok;
+} Sink;
+
+static void sink_write(Sink *sink, const void *data, size_t size) {
+    if (!sink->ok) return;
+    if (fwrite(data, 1, size, sink->fp) != size) {
+        sink->ok = false;
+        return;
+    }
+    if (sink->version >= 3) sink->crc = crc32c(sink->crc, data, size);
+}
+
+static void sink_u64(Sink *sink, uint64_t value) {
+    sink_write(sink, &value, sizeof(value));
+}
+
+// Version 3 closes every section with its checksum.
+static void sink_end_section(Sink *sink) {
+    if (sink->version < 3) return;
+    uint64_t crc = sink->crc;
+    sink_write(sink, &crc, sizeof(crc));
+    sink->crc = 0;
+}
+
+static void sink_bitarray(Sink *sink, const Bitarray *ba, const uint64_t *popcounts) {
+    size_t n_words = (ba->nbits + 63) / 64;
+    size_t num_checkpoints = (ba->nbits + BLOCK_SIZE_IN_BITS - 1) / BLOCK_SIZE_IN_BITS;
+    sink_u64(sink, ba->nbits);
+    sink_write(sink, ba->bits, n_words * sizeof(uint64_t));
+    sink_u64(sink, num_checkpoints);
+    sink_write(sink, popcounts, num_checkpoints * sizeof(uint64_t));
+}
+
+static int write_mphf(FILE *fp, const BBHash *mphf, int version) {
+    const BBHashTail *tail = mphf->tail;
+    if (version < 1 || version > 3) {
+        fprintf(stderr, "Unsupported MPHF file format version %d.\n", version);
+        return -1;
+    }
+    if (version == 1 && tail) {
+        fprintf(stderr, "MPHF file format version 1 cannot store a compact tail.\n");
+        return -1;
+    }
+    if (version < 3 && mphf->hash_scheme != BBHASH_HASH_SEEDED) {
+        fprintf(stderr, "MPHF file format version %d cannot store the hash scheme.\n", version);
+        return -1;
+    }
+    const bool blocked = mphf->levels && mphf->levels->block_seeds;
+    if (version < 3 && blocked) {
+        fprintf(stderr, "MPHF file format version %d cannot store a weighted level 0.\n", version);
+        return -1;
+    }
+    const PilotTable *pilots = mphf->pilots;
+    if (version < 3 && pilots) {
+        fprintf(stderr, "MPHF file format version %d cannot store a pilot table.\n", version);
+        return -1;
+    }
+    const bool shard = mphf->num_shards != 0;
+    if (version < 3 && shard) {
+        fprintf(stderr, "MPHF file format version %d cannot record a shard.\n", version);
+        return -1;
+    }
+    // A version 2 file without a tail is a version 1 file.
+    if (version == 2 && !tail) version = 1;
+
+    Sink sink = {.fp = fp, .version = version, .crc = 0, .ok = true};
+
+    size_t num_levels = 0;
+    for (BBHashLevel *level = mphf->levels; level != NULL; level = level->next) {
+        num_levels++;
+    }
+
+    // --- Header ---
+    const char magic[4] = {'B', 'B', 'H', (char)('0' + version)};
+    sink_write(&sink, magic, 4);
+    if (version >= 3) {
+        uint32_t flags = tail ? FILE_FLAG_TAIL : 0;
+        flags |= (uint32_t)mphf->hash_scheme << FILE_FLAG_SCHEME_SHIFT;
+        if (blocked) flags |= FILE_FLAG_BLOCKED;
+        if (pilots) flags |= FILE_FLAG_PILOTS;
+        if (shard) flags |= FILE_FLAG_SHARD;
+        sink_write(&sink, &flags, sizeof(flags));
+    }
+    sink_u64(&sink, mphf->num_keys);
+    sink_u64(&sink, num_levels);
+    if (shard) {
+        sink_u64(&sink, mphf->shard);
+        sink_u64(&sink, mphf->num_shards);
+    }
+    sink_end_section(&sink);
+
+    // --- Levels ---
+    for (BBHashLevel *level = mphf->levels; level != NULL; level = level->next) {
+        sink_u64(&sink, level->seed);
+        sink_u64(&sink, level->level_offset);
+        sink_bitarray(&sink, level->collision_free_set, level->popcounts);
+        if (level->block_seeds) {
+            static const uint8_t zeros[8];
+            sink_u64(&sink, level->num_blocks);
+            sink_write(&sink, level->block_seeds, level->num_blocks);
+            sink_write(&sink, zeros, (8 - level->num_blocks % 8) % 8);
+        }
+        sink_end_section(&sink);
+    }
+
+    // --- Compact Tail ---
+    if (tail) {
+        sink_u64(&sink, tail->num_levels);
+        sink_u64(&sink, tail->first_seed);
+        sink_u64(&sink, tail->offset);
+        sink_u64(&sink, tail->num_keys);
+        sink_write(&sink, &tail->gamma, sizeof(double));
+        sink_bitarray(&sink, tail->bits, tail->popcounts);
+        sink_end_section(&sink);
+    }
+
+    // --- Pilot Table ---
+    if (pilots) {
+        size_t pilot_words = pilot_packed_words(pilots->num_buckets, pilots->pilot_width);
+        size_t remap_words = pilot_packed_words(pilots->table_size - pilots->num_keys, pilots->remap_width);
+        sink_u64(&sink, pilots->seed);
+        sink_u64(&sink, pilots->table_size);
+        sink_u64(&sink, pilots->num_buckets);
+        sink_u64(&sink, pilots->dense_buckets);
+        sink_u64(&sink, pilots->pilot_width);
+        sink_u64(&sink, pilots->remap_width);
+        sink_u64(&sink, pilot_words);
+        sink_write(&sink, pilots->pilots, pilot_words * sizeof(uint64_t));
+        sink_u64(&sink, remap_words);
+        sink_write(&sink, pilots->remap, remap_words * sizeof(uint64_t));
+        sink_end_section(&sink);
+    }
+
+    if (!sink.ok) {
+        fprintf(stderr, "Error writing to MPHF file.\n");
+        return -1;
+    }
+    return 0;
+}
+
+int bbhash_mphf_save(const BBHash *mphf, const char *filename) {
+    return bbhash_mphf_save_ex(mphf, filename, BBHASH_FORMAT_VERSION);
+}
+
+int bbhash_mphf_save_ex(const BBHash *mphf, const char *filename, int version) {
+    if (!mphf || !filename) return -1;
+
+    FILE *fp = fopen(filename, "wb");
+    if (!fp) {
+        perror("bbhash_mphf_save: fopen");
+        return -1;
+    }
+    int result = write_mphf(fp, mphf, version);
+    if (fclose(fp) != 0) result = -1;
+    return result;
+}
+
+int bbhash_mphf_write(const BBHash *mphf, FILE *fp) {
+    if (!mphf || !fp) return -1;
+    return write_mphf(fp, mphf, BBHASH_FORMAT_VERSION);
+}
+
+/*
+ * Loading reads from a stream (copying into fresh allocations) or from a
+ * buffer. Version 3 data in an 8-byte aligned buffer is used in place.
+ */
+typedef struct {
+    FILE *fp;              // stream source, or NULL for a buffer
+    const uint8_t *buf;
+    size_t len, pos;
+    int version;
+    bool borrow;           // point into buf instead of copying
+    bool verify;           // check the section checksums
+    uint32_t crc;          // CRC of the current section so far
+    bool skip_level_bits;  // stream only: leave the level bit words in the file
+    uint64_t *level_words_at;  // with skip_level_bits: file offset of each
+                               // level's words, allocated by parse_mphf()
+    const BBHashAllocator *allocator;  // for everything copied out, or NULL
+} Source;
+
+static bool src_read(Source *src, void *dst, size_t size) {
+    if (src->fp) {
+        if (fread(dst, 1, size, src->fp) != size) return false;
+    } else {
+        if (size > src->len - src->pos) return false;
+        memcpy(dst, src->buf + src->pos, size);
+        src->pos += size;
+    }
+    // Checksum right after reading, while the bytes are still in cache.
+    if (src->verify) src->crc = crc32c(src->crc, dst, size);
+    return true;
+}
+
+static const void *src_borrow(Source *src, size_t size) {
+    if (size > src->len - src->pos) return NULL;
+    const void *p = src->buf + src->pos;
+    src->pos += size;
+    if (src->verify) src->crc = crc32c(src->crc, p, size);
+    return p;
+}
+
+static bool src_end_section(Source *src) {
+    if (src->version < 3) return true;
+    bool verify = src->verify;
+    uint32_t computed = src->crc;
+    uint64_t stored;
+    src->verify = false;
+    bool ok = src_read(src, &stored, sizeof(stored));
+    src->verify = verify;
+    src->crc = 0;
+    if (ok && verify && stored != computed) {
+        fprintf(stderr, "Error: MPHF file checksum mismatch.\n");
+        return false;
+    }
+    return ok;
+}
+
+// Reads `nbits` and the words that follow it.
+static Bitarray *src_bitarray(Source *src) {
+    uint64_t nbits;
+    if (src->borrow) {
+        if (src->len - src->pos < sizeof(uint64_t)) return NULL;
+        memcpy(&nbits, src->buf + src->pos, sizeof(uint64_t));
+        if (nbits == 0 || (nbits + 63) / 64 > (src->len - src->pos) / 8 - 1) return NULL;
+        // Read-only data; queries never write to it.
+        return (Bitarray *)src_borrow(src, sizeof(uint64_t) * (1 + (nbits + 63) / 64));
+    }
+    if (!src_read(src, &nbits, sizeof(uint64_t)) || nbits == 0) return NULL;
+    if (!src->fp && (nbits + 63) / 64 > (src->len - src->pos) / 8) return NULL;
+    Bitarray *ba = bitarray_new_uninit_with(nbits, src->allocator);
+    if (!ba) return NULL;
+    if (!src_read(src, ba->bits, sizeof(uint64_t) * ((nbits + 63) / 64))) {
+        bitarray_free_with(ba, src->allocator);
+        return NULL;
+    }
+    return ba;
+}
+
+// Reads `nbits` and records where the words that follow it start, without
+// reading them unless they are verified. Returns a header-only bit array.
+static Bitarray *src_skip_bitarray(Source *src, uint64_t *words_at) {
+    uint64_t nbits;
+    if (!src_read(src, &nbits, sizeof(uint64_t)) || nbits == 0) return NULL;
+    long at = ftell(src->fp);
+    if (at < 0) return NULL;
+    *words_at = (uint64_t)at;
+    uint64_t left = (nbits + 63) / 64 * sizeof(uint64_t);
+    if (src->verify) {
+        uint64_t chunk[512];
+        while (left > 0) {
+            size_t size = left < sizeof(chunk) ? left : sizeof(chunk);
+            if (!src_read(src, chunk, size)) return NULL;
+            left -= size;
+        }
+    } else if (left > LONG_MAX || fseek(src->fp, (long)left, SEEK_CUR) != 0) {
+        return NULL;
+    }
+    Bitarray *ba = bbhash_alloc(src->allocator, sizeof(Bitarray), alignof(Bitarray));
+    if (ba) ba->nbits = nbits;
+    return ba;
+}
+
+// Reads a rank checkpoint table, which must match the bit array it belongs to.
+static uint64_t *src_popcounts(Source *src, const Bitarray *ba) {
+    uint64_t count;
+    if (!src_read(src, &count, sizeof(count))) return NULL;
+    if (count != (ba->nbits + BLOCK_SIZE_IN_BITS - 1) / BLOCK_SIZE_IN_BITS) return NULL;
+    if (src->borrow) {
+        return (uint64_t *)src_borrow(src, sizeof(uint64_t) * count);
+    }
+    uint64_t *popcounts = bbhash_alloc(src->allocator, sizeof(uint64_t) * count, alignof(uint64_t));
+    if (!popcounts) return NULL;
+    if (!src_read(src, popcounts, sizeof(uint64_t) * count)) {
+        bbhash_dealloc(src->allocator, popcounts);
+        return NULL;
+    }
+    return popcounts;
+}
+
+// Reads the block seeds of a weighted level, with their padding.
+static uint8_t *src_block_seeds(Source *src, const Bitarray *ba, size_t *num_blocks) {
+    uint64_t count;
+    if (!src_read(src, &count, sizeof(count))) return NULL;
+    if (count == 0 || count != ba->nbits / HOT_BLOCK_SLOTS || ba->nbits % HOT_BLOCK_SLOTS != 0) return NULL;
+    size_t padded = (count + 7) / 8 * 8;
+    *num_blocks = count;
+    if (src->borrow) {
+        return (uint8_t *)src_borrow(src, padded);
+    }
+    uint8_t *seeds = bbhash_alloc(src->allocator, padded, alignof(uint64_t));
+    if (!seeds) return NULL;
+    if (!src_read(src, seeds, padded)) {
+        bbhash_dealloc(src->allocator, seeds);
+        return NULL;
+    }
+    return seeds;
+}
+
+// Reads a word count, which must be `words`, and the packed words after it.
+static uint64_t *src_packed(Source *src, uint64_t words) {
+    uint64_t count;
+    if (!src_read(src, &count, sizeof(count)) || count != words) return NULL;
+    if (src->borrow) {
+        return (uint64_t *)src_borrow(src, sizeof(uint64_t) * count);
+    }
+    if (!src->fp && count > (src->len - src->pos) / 8) return NULL;
+    uint64_t *packed = bbhash_alloc(src->allocator, sizeof(uint64_t) * (count + 1), alignof(uint64_t));
+    if (!packed) return NULL;
+    if (!src_read(src, packed, sizeof(uint64_t) * count)) {
+        bbhash_dealloc(src->allocator, packed);
+        return NULL;
+    }
+    return packed;
+}
+
+// Reads a pilot table section, checking the shape so that queries stay
+// inside the arrays.
+static PilotTable *src_pilot_table(Source *src, uint64_t num_keys) {
+    uint64_t header[6];
+    if (!src_read(src, header, sizeof(header))) return NULL;
+    PilotTable *t = bbhash_alloc(src->allocator, sizeof(PilotTable), alignof(PilotTable));
+    if (!t) return NULL;
+    *t = (PilotTable) {
+        .seed = header[0], .num_keys = num_keys, .table_size = header[1],
+        .num_buckets = header[2], .dense_buckets = header[3],
+        .pilot_width = header[4], .remap_width = header[5],
+        .borrowed = src->borrow,
+    };
+    constexpr uint64_t MAX_COUNT = UINT64_C(1) << 56;  // keeps count * width in 64 bits
+    if (t->table_size <= num_keys || t->table_size - num_keys > MAX_COUNT
+        || t->num_buckets > MAX_COUNT || t->dense_buckets == 0 || t->dense_buckets >= t->num_buckets
+        || t->pilot_width == 0 || t->pilot_width > 64 || t->remap_width == 0 || t->remap_width > 64) {
+        goto failure;
+    }
+    t->pilots = src_packed(src, pilot_packed_words(t->num_buckets, t->pilot_width));
+    if (!t->pilots) goto failure;
+    t->remap = src_packed(src, pilot_packed_words(t->table_size - num_keys, t->remap_width));
+    if (!t->remap) goto failure;
+    return t;
+
+failure:
+    pilot_table_free(t, src->allocator);
+    return NULL;
+}
+
+static BBHash *parse_mphf(Source *src) {
+    // Read and Validate Header ---
+    char magic[4];
+    if (!src_read(src, magic, 4)) goto read_error;
+    if (magic[0] != 'B' || magic[1] != 'B' || magic[2] != 'H' || magic[3] < '1' || magic[3] > '3') {
+        fprintf(stderr, "Error: Invalid MPHF file format or version.\n");
+        return NULL;
+    }
+    src->version = magic[3] - '0';
+    if (src->version < 3) src->borrow = false; // unaligned layout
+
+    uint32_t flags = src->version == 2 ? FILE_FLAG_TAIL : 0;
+    if (src->version >= 3 && !src_read(src, &flags, sizeof(flags))) goto read_error;
+
+    uint64_t num_keys_u64, num_levels_u64;
+    if (!src_read(src, &num_keys_u64, sizeof(uint64_t))) goto read_error;
+    if (!src_read(src, &num_levels_u64, sizeof(uint64_t))) goto read_error;
+    uint64_t shard[2] = {0, 0};  // index and count
+    if ((flags & FILE_FLAG_SHARD) && !src_read(src, shard, sizeof(shard))) goto read_error;
+    if (!src_end_section(src)) goto read_error;
+    if ((flags & FILE_FLAG_SHARD) && (shard[1] == 0 || shard[1] > UINT32_MAX || shard[0] >= shard[1])) {
+        fprintf(stderr, "Error: MPHF file records an invalid shard.\n");
+        return NULL;
+    }
+    uint32_t scheme = (flags & FILE_FLAG_SCHEME_MASK) >> FILE_FLAG_SCHEME_SHIFT;
+    if (scheme > BBHASH_HASH_KEY128) {
+        fprintf(stderr, "Error: MPHF file uses unknown hash scheme %u.\n", scheme);
+        return NULL;
+    }
+
+    // Allocate and Reconstruct MPHF ---
+    const BBHashAllocator *a = src->allocator;
+    BBHash *mphf = bbhash_zalloc(a, sizeof(BBHash), alignof(BBHash));
+    if (!mphf) {
+        fprintf(stderr, "Memory allocation failed during MPHF load.\n");
+        return NULL;
+    }
+    if (a) mphf->allocator = *a;
+    mphf->num_keys = num_keys_u64;
+    mphf->borrowed = src->borrow;
+    if (src->skip_level_bits) {
+        size_t count = num_levels_u64 ? num_levels_u64 : 1;
+        if (count > SIZE_MAX / sizeof(uint64_t)) goto read_error_cleanup;
+        src->level_words_at = bbhash_zalloc(a, count * sizeof(uint64_t), alignof(uint64_t));
+        if (!src->level_words_at) goto read_error_cleanup;
+    }
+    mphf->hash_scheme = (BBHashScheme)scheme;
+    mphf->shard = (uint32_t)shard[0];
+    mphf->num_shards = (uint32_t)shard[1];
+
+    BBHashLevel *current_level_tail = NULL;
+    for (size_t i = 0; i < num_levels_u64; ++i) {
+        BBHashLevel *level = bbhash_level_new(a);
+        if (!level) goto read_error_cleanup;
+
+        // Link the new level into the list
+        if (current_level_tail == NULL) {
+            mphf->levels = level;
+        } else {
+            current_level_tail->next = level;
+        }
+        current_level_tail = level;
+
+        uint64_t seed_u64, offset_u64;
+        if (!src_read(src, &seed_u64, sizeof(uint64_t))) goto read_error_cleanup;
+        if (!src_read(src, &offset_u64, sizeof(uint64_t))) goto read_error_cleanup;
+        level->seed = seed_u64;
+        level->level_offset = offset_u64;
+
+        level->collision_free_set = src->skip_level_bits ? src_skip_bitarray(src, &src->level_words_at[i])
+                                    : src_bitarray(src);
+        if (!level->collision_free_set) goto read_error_cleanup;
+        level->popcounts = src_popcounts(src, level->collision_free_set);
+        if (!level->popcounts) goto read_error_cleanup;
+        if (i == 0 && (flags & FILE_FLAG_BLOCKED)) {
+            level->block_seeds = src_block_seeds(src, level->collision_free_set, &level->num_blocks);
+            if (!level->block_seeds) goto read_error_cleanup;
+        }
+        if (!src_end_section(src)) goto read_error_cleanup;
+    }
+
+    if (flags & FILE_FLAG_TAIL) {
+        BBHashTail *tail = bbhash_zalloc(a, sizeof(BBHashTail), alignof(BBHashTail));
+        if (!tail) goto read_error_cleanup;
+        mphf->tail = tail;
+
+        uint64_t header[4];
+        if (!src_read(src, header, sizeof(header))) goto read_error_cleanup;
+        if (!src_read(src, &tail->gamma, sizeof(double))) goto read_error_cleanup;
+        tail->num_levels = header[0];
+        tail->first_seed = header[1];
+        tail->offset = header[2];
+        tail->num_keys = header[3];
+        if (!(tail->gamma > 0) || tail->offset + tail->num_keys != mphf->num_keys) goto read_error_cleanup;
+
+        tail->bits = src_bitarray(src);
+        if (!tail->bits) goto read_error_cleanup;
+        tail->popcounts = src_popcounts(src, tail->bits);
+        if (!tail->popcounts) goto read_error_cleanup;
+        if (!src_end_section(src)) goto read_error_cleanup;
+    }
+
+    if (flags & FILE_FLAG_PILOTS) {
+        if (num_levels_u64 != 0 || (flags & (FILE_FLAG_TAIL | FILE_FLAG_BLOCKED)) || scheme != BBHASH_HASH_SEEDED) {
+            goto read_error_cleanup;
+        }
+        mphf->pilots = src_pilot_table(src, num_keys_u64);
+        if (!mphf->pilots) goto read_error_cleanup;
+        if (!src_end_section(src)) goto read_error_cleanup;
+    }
+
+    return mphf;
+
+read_error_cleanup:
+    bbhash_free(mphf); // Free everything allocated so far
+    bbhash_dealloc(a, src->level_words_at);
+    src->level_words_at = NULL;
+
+read_error:
     fprintf(stderr, "Error reading from MPHF file (file may be corrupt or truncated).\n");
+    return NULL;
+}
+
+BBHash *bbhash_mphf_load(const char *filename) {
+    return bbhash_mphf_load_ex(filename, 0);
+}
+
+BBHash *bbhash_mphf_load_ex(const char *filename, unsigned flags) {
+    return bbhash_mphf_load_with(filename, flags, NULL);
+}
+
+BBHash *bbhash_mphf_load_with(const char *filename, unsigned flags, const BBHashAllocator *allocator) {
+    if (!filename) return NULL;
+
+    FILE *fp = fopen(filename, "rb");
+    if (!fp) {
+        perror("bbhash_mphf_load: fopen");
+        return NULL;
+    }
+    Source src = {.fp = fp, .verify = (flags & BBHASH_LOAD_VERIFY) != 0, .allocator = allocator};
+    BBHash *mphf = parse_mphf(&src);
+    fclose(fp);
+    return mphf;
+}
+
+BBHash *bbhash_mphf_from_buffer(const void *buf, size_t len, unsigned flags) {
+    return bbhash_mphf_from_buffer_with(buf, len, flags, NULL);
+}
+
+BBHash *bbhash_mphf_from_buffer_with(const void *buf, size_t len, unsigned flags,
+                                     const BBHashAllocator *allocator) {
+    if (!buf) return NULL;
+    Source src = {
+        .buf = buf, .len = len,
+        .borrow = ((uintptr_t)buf % alignof(uint64_t)) == 0,
+        .verify = (flags & BBHASH_LOAD_VERIFY) != 0,
+        .allocator = allocator,
+    };
+    return parse_mphf(&src);
+}
+
+BBHash *bbhash_mphf_mmap(const char *filename, unsigned flags) {
+    return bbhash_mphf_mmap_with(filename, flags, NULL);
+}
+
+BBHash *bbhash_mphf_mmap_with(const char *filename, unsigned flags, const BBHashAllocator *allocator) {
+    if (!filename) return NULL;
+
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0) {
+        perror("bbhash_mphf_mmap: open");
+        return NULL;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+        fprintf(stderr, "Error: cannot map empty or unreadable MPHF file.\n");
+        close(fd);
+        return NULL;
+    }
+    size_t len = (size_t)st.st_size;
+    void *map = mmap(NULL, len, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        perror("bbhash_mphf_mmap: mmap");
+        return NULL;
+    }
+
+    BBHash *mphf = bbhash_mphf_from_buffer_with(map, len, flags, allocator);
+    if (mphf && mphf->borrowed) {
+        mphf->mapping = map;
+        mphf->mapping_len = len;
+    } else {
+        // Failed, or an older format that was copied out of the mapping.
+        munmap(map, len);
+    }
+    return mphf;
+}
+
+/*
+ * On-disk queries.
+ *
+ * The file is parsed with the level bit words left in place (see
+ * src_skip_bitarray()), so every level keeps its seed, offset, rank
+ * checkpoints and a header-only bit array, which is all level_slot() needs.
+ * A probe then reads the 512-bit rank block holding its slot: the bit and
+ * the words below it in the block give the rank together with the
+ * checkpoint. Cached levels get their words read into a full bit array and
+ * are probed as usual.
+ */
+constexpr unsigned DISK_QUEUE_DEPTH_DEFAULT = 64;
+constexpr size_t DISK_BLOCK_BYTES = BLOCK_SIZE_IN_WORDS * sizeof(uint64_t);
+
+typedef struct {
+    BBHashLevel *level;
+    uint64_t words_at;       // file offset of the level's bit words
+    bool cached;
+} DiskLevel;
+
+struct BBHashDisk {
+    BBHash *mphf;            // descriptors; cached levels own their words
+    DiskLevel *levels;
+    size_t num_levels;
+    size_t cached_levels;
+    int fd;
+    bool direct_io;
+    Uring *uring;            // or NULL for pread()
+    unsigned queue_depth;
+    size_t slot_bytes;       // read buffer per key of a group
+    uint8_t *buffers;
+    UringRead *reads;
+    KeyHasher *hashers;
+    size_t *slots;
+    size_t *pending;
+    size_t memory_bytes;
+    size_t disk_bytes;
+    size_t num_reads;
+    BBHashAllocator allocator;   // for the handle and everything it holds
+};
+
+BBHashDiskConfig bbhash_disk_config_default(void) {
+    return (BBHashDiskConfig) {
+        .cache_bytes = 0,
+        .queue_depth = DISK_QUEUE_DEPTH_DEFAULT,
+        .direct_io = true,
+        .use_uring = true,
+        .load_flags = 0,
+        .allocator = NULL,
+    };
+}
+
+void bbhash_disk_close(BBHashDisk *disk) {
+    if (!disk) return;
+    BBHashAllocator a = disk->allocator;
+    bbhash_free(disk->mphf);
+    bbhash_dealloc(&a, disk->levels);
+    if (disk->fd >= 0) close(disk->fd);
+    uring_free(disk->uring);
+    bbhash_dealloc(&a, disk->buffers);
+    bbhash_dealloc(&a, disk->reads);
+    bbhash_dealloc(&a, disk->hashers);
+    bbhash_dealloc(&a, disk->slots);
+    bbhash_dealloc(&a, disk->pending);
+    bbhash_dealloc(&a, disk);
+}
+
+// Reads the words of a level into memory, replacing its header-only bit array.
+static bool disk_cache_level(FILE *fp, DiskLevel *dl, const BBHashAllocator *a) {
+    size_t nbits = dl->level->collision_free_set->nbits;
+    size_t bytes = (nbits + 63) / 64 * sizeof(uint64_t);
+    Bitarray *ba = bitarray_new_uninit_with(nbits, a);
+    if (!ba) return false;
+    if (dl->words_at > LONG_MAX || fseek(fp, (long)dl->words_at, SEEK_SET) != 0
+            || fread(ba->bits, 1, bytes, fp) != bytes) {
+        bitarray_free_with(ba, a);
+        return false;
+    }
+    bitarray_free_with(dl->level->collision_free_set, a);
+    dl->level->collision_free_set = ba;
+    dl->cached = true;
+    return true;
+}
+
+BBHashDisk *bbhash_disk_open(const char *filename, const BBHashDiskConfig *config) {
+    BBHashDiskConfig defaults = bbhash_disk_config_default();
+    if (!config) config = &defaults;
+    if (!filename || config->queue_depth == 0) return NULL;
+
+    FILE *fp = fopen(filename, "rb");
+    if (!fp) {
+        perror("bbhash_disk_open: fopen");
+        return NULL;
+    }
+    BBHashAllocator allocator = config->allocator ? *config->allocator : (BBHashAllocator) {0};
+    BBHashDisk *disk = bbhash_zalloc(&allocator, sizeof(BBHashDisk), alignof(BBHashDisk));
+    if (!disk) {
+        fclose(fp);
+        return NULL;
+    }
+    disk->fd = -1;
+    disk->allocator = allocator;
+    const BBHashAllocator *a = &disk->allocator;
+    Source src = {
+        .fp = fp, .verify = (config->load_flags & BBHASH_LOAD_VERIFY) != 0, .skip_level_bits = true,
+        .allocator = a,
+    };
+    disk->mphf = parse_mphf(&src);
+    if (!disk->mphf) goto failure;
+    if (disk->mphf->pilots) {
+        fprintf(stderr, "bbhash_disk_open: '%s' holds a pilot table, which is queried in memory.\n", filename);
+        goto failure;
+    }
+    if (disk->mphf->hash_scheme == BBHASH_HASH_KEY128) {
+        fprintf(stderr, "bbhash_disk_open: '%s' is over 128-bit keys, which are queried in memory.\n", filename);
+        goto failure;
+    }
+    if (fseek(fp, 0, SEEK_END) != 0) goto failure;
+    long file_size = ftell(fp);
+
+    for (BBHashLevel *level = disk->mphf->levels; level != NULL; level = level->next) disk->num_levels++;
+    disk->levels = bbhash_zalloc(a, sizeof(DiskLevel) * (disk->num_levels ? disk->num_levels : 1),
+                                 alignof(DiskLevel));
+    if (!disk->levels) goto failure;
+    size_t l = 0;
+    for (BBHashLevel *level = disk->mphf->levels; level != NULL; level = level->next, l++) {
+        uint64_t bytes = (level->collision_free_set->nbits + 63) / 64 * sizeof(uint64_t);
+        disk->levels[l] = (DiskLevel) {.level = level, .words_at = src.level_words_at[l]};
+        // The words were skipped, so a truncated file only shows here.
+        if (file_size < 0 || src.level_words_at[l] + bytes > (uint64_t)file_size) {
+            fprintf(stderr, "Error reading from MPHF file (file may be corrupt or truncated).\n");
+            goto failure;
+        }
+        disk->disk_bytes += bytes;
+    }
+
+    // The deepest levels are the smallest; cache whole levels from the last up.
+    size_t budget = config->cache_bytes;
+    for (size_t i = disk->num_levels; i-- > 0;) {
+        size_t bytes = (disk->levels[i].level->collision_free_set->nbits + 63) / 64 * sizeof(uint64_t);
+        if (bytes > budget) break;
+        if (!disk_cache_level(fp, &disk->levels[i], a)) {
+            fprintf(stderr, "Error reading from MPHF file (file may be corrupt or truncated).\n");
+            goto failure;
+        }
+        budget -= bytes;
+        disk->disk_bytes -= bytes;
+        disk->cached_levels++;
+    }
     fclose(fp);
+    fp = NULL;
+
+    disk->direct_io = config->direct_io;
+    disk->fd = uring_open(filename, &disk->direct_io);
+    if (disk->fd < 0) {
+        perror("bbhash_disk_open: open");
+        goto failure;
+    }
+    if (config->use_uring) disk->uring = uring_create(config->queue_depth);
+    disk->queue_depth = config->queue_depth;
+    // With direct I/O, a block may straddle two pages.
+    disk->slot_bytes = disk->direct_io ? 2 * URING_DIRECT_ALIGN : DISK_BLOCK_BYTES;
+    size_t qd = disk->queue_depth;
+    size_t buffer_bytes = (qd * disk->slot_bytes + URING_DIRECT_ALIGN - 1) / URING_DIRECT_ALIGN * URING_DIRECT_ALIGN;
+    disk->buffers = bbhash_alloc(a, buffer_bytes, URING_DIRECT_ALIGN);
+    disk->reads = bbhash_alloc(a, sizeof(UringRead) * qd, alignof(UringRead));
+    disk->hashers = bbhash_alloc(a, sizeof(KeyHasher) * qd, alignof(KeyHasher));
+    disk->slots = bbhash_alloc(a, sizeof(size_t) * qd, alignof(size_t));
+    disk->pending = bbhash_alloc(a, sizeof(size_t) * qd, alignof(size_t));
+    if (!disk->buffers || !disk->reads || !disk->hashers || !disk->slots || !disk->pending) goto failure;
+    disk->memory_bytes = bbhash_size_in_bits(disk->mphf) / 8 - disk->disk_bytes + sizeof(BBHashDisk)
+                         + disk->num_levels * (sizeof(DiskLevel) + sizeof(BBHashLevel) + sizeof(Bitarray))
+                         + buffer_bytes + qd * (sizeof(UringRead) + sizeof(KeyHasher) + 2 * sizeof(size_t));
+    bbhash_dealloc(a, src.level_words_at);
+    return disk;
+
+failure:
+    if (fp) fclose(fp);
+    bbhash_dealloc(a, src.level_words_at);
+    bbhash_disk_close(disk);
     return NULL;
 }
+
+// File offset of the rank block holding `slot`.
+static inline uint64_t disk_block_at(const DiskLevel *dl, size_t slot) {
+    return dl->words_at + slot / BLOCK_SIZE_IN_BITS * DISK_BLOCK_BYTES;
+}
+
+// The read of the rank block holding `slot` into `buf`.
+static UringRead disk_block_read(const BBHashDisk *disk, const DiskLevel *dl, size_t slot, uint8_t *buf) {
+    size_t nwords = (dl->level->collision_free_set->nbits + 63) / 64;
+    size_t first = slot / BLOCK_SIZE_IN_BITS * BLOCK_SIZE_IN_WORDS;
+    size_t len = (nwords - first < BLOCK_SIZE_IN_WORDS ? nwords - first : BLOCK_SIZE_IN_WORDS) * sizeof(uint64_t);
+    uint64_t at = disk_block_at(dl, slot);
+    if (!disk->direct_io) return (UringRead) {.buf = buf, .len = len, .offset = at};
+    uint64_t start = at / URING_DIRECT_ALIGN * URING_DIRECT_ALIGN;
+    uint64_t end = (at + len + URING_DIRECT_ALIGN - 1) / URING_DIRECT_ALIGN * URING_DIRECT_ALIGN;
+    return (UringRead) {.buf = buf, .len = end - start, .offset = start};
+}
+
+// Tests `slot` in the rank block read into `buf`; on a hit, stores the index.
+static bool disk_block_test(const BBHashDisk *disk, const DiskLevel *dl, size_t slot, const uint8_t *buf,
+                            size_t *index) {
+    const uint8_t *words = buf + (disk->direct_io ? disk_block_at(dl, slot) % URING_DIRECT_ALIGN : 0);
+    size_t w = slot % BLOCK_SIZE_IN_BITS / 64;
+    uint64_t word;
+    memcpy(&word, words + w * sizeof(uint64_t), sizeof(word));  // older formats are not 8-byte aligned
+    if (((word >> (slot % 64)) & 1) == 0) return false;
+    size_t rank = dl->level->popcounts[slot / BLOCK_SIZE_IN_BITS];
+    rank += stdc_count_ones(word & ((UINT64_C(1) << (slot % 64)) - 1));
+    for (size_t k = 0; k < w; k++) {
+        memcpy(&word, words + k * sizeof(uint64_t), sizeof(word));
+        rank += stdc_count_ones(word);
+    }
+    *index = dl->level->level_offset + rank;
+    return true;
+}
+
+int bbhash_disk_query_batch(BBHashDisk *disk, const uint64_t keys[], size_t n, size_t out[]) {
+    const BBHash *mphf = disk->mphf;
+    bool ok = true;
+    for (size_t first = 0; first < n; first += disk->queue_depth) {
+        size_t count = n - first < disk->queue_depth ? n - first : disk->queue_depth;
+        KeyHasher *hashers = disk->hashers;
+        size_t *slots = disk->slots, *pending = disk->pending;
+        for (size_t i = 0; i < count; i++) {
+            hashers[i] = (KeyHasher) {.key = keys[first + i]};
+            pending[i] = i;
+        }
+
+        size_t num_pending = count;
+        for (size_t l = 0; l < disk->num_levels && num_pending > 0; l++) {
+            const DiskLevel *dl = &disk->levels[l];
+            const BBHashLevel *level = dl->level;
+            for (size_t p = 0; p < num_pending; p++) {
+                size_t i = pending[p];
+                slots[i] = level_slot(level, key_hasher_next(&hashers[i], mphf->hash_scheme, level->seed));
+            }
+            // One round of reads for the whole group; key p reads into buffer p.
+            if (!dl->cached) {
+                for (size_t p = 0; p < num_pending; p++) {
+                    disk->reads[p] = disk_block_read(disk, dl, slots[pending[p]], disk->buffers + p * disk->slot_bytes);
+                }
+                disk->num_reads += num_pending;
+                if (uring_read_all(disk->uring, disk->fd, disk->reads, num_pending) != 0) {
+                    fprintf(stderr, "bbhash_disk_query: read failed.\n");
+                    for (size_t p = 0; p < num_pending; p++) out[first + pending[p]] = (size_t) -1;
+                    num_pending = 0;
+                    ok = false;
+                    break;
+                }
+            }
+            size_t still_pending = 0;
+            for (size_t p = 0; p < num_pending; p++) {
+                size_t i = pending[p];
+                const Bitarray *ba = level->collision_free_set;
+                if (dl->cached) {
+                    if (bitarray_get(ba, slots[i]) == 1) {
+                        out[first + i] = level->level_offset + bitarray_rank(ba, level->popcounts, slots[i]);
+                        continue;
+                    }
+                } else if (disk_block_test(disk, dl, slots[i], disk->buffers + p * disk->slot_bytes, &out[first + i])) {
+                    continue;
+                }
+                pending[still_pending++] = i;
+            }
+            num_pending = still_pending;
+        }
+        for (size_t p = 0; p < num_pending; p++) {
+            out[first + pending[p]] = query_tail(mphf, &hashers[pending[p]], NULL);
+        }
+    }
+    return ok ? 0 : -1;
+}
+
+size_t bbhash_disk_query(BBHashDisk *disk, uint64_t key) {
+    size_t index;
+    return bbhash_disk_query_batch(disk, &key, 1, &index) == 0 ? index : (size_t) -1;
+}
+
+void bbhash_disk_stats(const BBHashDisk *disk, BBHashDiskStats *stats) {
+    *stats = (BBHashDiskStats) {
+        .num_keys = disk->mphf->num_keys,
+        .num_levels = disk->num_levels,
+        .cached_levels = disk->cached_levels,
+        .memory_bytes = disk->memory_bytes,
+        .disk_bytes = disk->disk_bytes,
+        .reads = disk->num_reads,
+        .direct_io = disk->direct_io,
+        .uring = disk->uring != NULL,
+    };
+}
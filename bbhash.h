@@ -1,26 +1,440 @@
 #ifndef BBHASH_H
 #define BBHASH_H
 
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include "bbhash_alloc.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
 typedef struct BBHash BBHash;
 
+/**
+ * @brief How the slot of a key is hashed at each level.
+ *
+ * The scheme is part of the MPHF and is stored in the file (format version 3).
+ */
+typedef enum {
+    BBHASH_HASH_SEEDED = 0,   // fmix64 of the key with each level's seed
+    BBHASH_HASH_BASE128 = 1,  // one 128-bit hash per key; every deeper level
+                              // takes one xorshift128+ step of it
+    BBHASH_HASH_KEY128 = 2,   // 128-bit keys (bbhash_mphf_create128); each level
+                              // mixes both halves with its seed
+} BBHashScheme;
+
+/**
+ * @brief How an MPHF is constructed, see BBHashConfig::engine.
+ *
+ * Both kinds share the query, save/load and size API.
+ */
+typedef enum {
+    BBHASH_ENGINE_LEVELS = 0,  // BBHash levels: fast to build, queries probe
+                               // about 1.6 levels on average
+    BBHASH_ENGINE_PILOTS = 1,  // bucketed pilot search after PTHash: slower to
+                               // build, every query reads one pilot and
+                               // about 1% of them a remap entry too
+} BBHashEngine;
+
+/** @brief A 128-bit key such as a UUID or a truncated digest. */
+typedef struct {
+    uint64_t lo, hi;
+} BBHashKey128;
+
+/**
+ * @brief Build options for bbhash_mphf_create_ex().
+ *
+ * Always start from bbhash_config_default() so that fields added later get
+ * sensible values.
+ */
+typedef struct {
+    double gamma;               // bits per key in each level (>= 1.0); default 2.0
+    bool verbose;               // print per-level statistics
+    size_t compact_from_level;  // pack this level and all deeper ones into a compact
+                                // tail without padding or per-level rank tables;
+                                // SIZE_MAX (the default) disables it
+    unsigned threads;           // threads hashing each large level; default 1.
+                                // The MPHF does not depend on the thread count.
+    size_t memory_budget;       // cap on construction scratch memory in bytes
+                                // (input keys not included); 0 = no limit.
+                                // A tight budget recomputes hashes instead of
+                                // storing 8 bytes per key.
+    BBHashScheme hash_scheme;   // default BBHASH_HASH_SEEDED. BBHASH_HASH_BASE128
+                                // hashes each key once and needs 16 instead of
+                                // 8 bytes of scratch per key missing level 0.
+    const double *weights;      // query frequency of each key, parallel to data,
+                                // or NULL. Level 0 is then built in blocks of 256
+                                // slots, each with the seed (out of
+                                // hot_seed_tries) that places the most weight.
+    const uint64_t *hot_keys;   // alternatively, keys to place at level 0 first;
+    size_t num_hot_keys;        // the rest of the keys count as cold
+    unsigned hot_seed_tries;    // seeds tried per block, 1 to 256; default 16
+    const char *checkpoint_dir; // if set, each finished level and the keys left
+                                // after it are saved here, in the background;
+                                // see bbhash_mphf_resume()
+    BBHashEngine engine;        // default BBHASH_ENGINE_LEVELS. The pilot engine
+                                // takes 64-bit keys and the seeded scheme, no
+                                // weights, hot keys or checkpoints, and ignores
+                                // the other options above except verbose
+    double pilot_c;             // pilot engine: c * n / log2(n) buckets; default
+                                // 6.0. Larger builds faster, smaller is smaller
+    const BBHashAllocator *allocator;  // memory for the MPHF and, unless a
+                                // BBHashBuilder supplies it, the build scratch;
+                                // NULL (the default) = malloc. The MPHF keeps
+                                // a copy of *allocator to free itself with.
+    uint32_t shard;             // with num_shards > 0, the keys are partition
+    uint32_t num_shards;        // `shard` of num_shards (see bbhash_shard.h).
+                                // Saved in the file, so that merging can check
+                                // it; default 0/0, not a shard
+} BBHashConfig;
+
+BBHashConfig bbhash_config_default(void);
+
 BBHash *bbhash_mphf_create(const uint64_t data[], size_t unplaced, double gamma, bool verbose);
+BBHash *bbhash_mphf_create_ex(const uint64_t data[], size_t unplaced, const BBHashConfig *config);
 size_t bbhash_size_in_bits(const BBHash *mphf);
 size_t bbhash_mphf_query(const BBHash *level, uint64_t key);
 void bbhash_free(BBHash *mphf);
 
+/**
+ * @brief Queries many keys at once.
+ *
+ * Same results as calling bbhash_mphf_query() on every key, but the keys are
+ * processed in small groups: all slots of a group are hashed and their bit
+ * words prefetched before any is tested, so cache misses overlap.
+ * @param mphf The MPHF to query.
+ * @param keys The keys to look up.
+ * @param n Number of keys.
+ * @param out Receives one index per key, (size_t)-1 for keys not found.
+ */
+void bbhash_mphf_query_batch(const BBHash *mphf, const uint64_t keys[], size_t n, size_t out[]);
+
+/**
+ * @brief Continues a build from the last level saved in config->checkpoint_dir.
+ *
+ * The build that wrote the checkpoint may have crashed or been stopped at
+ * any point. gamma, hash_scheme and compact_from_level are taken from the
+ * checkpoint; threads, memory_budget and verbose from `config`. The resumed
+ * build keeps checkpointing into the same directory. A checkpoint of a
+ * finished build yields that MPHF again without hashing any key.
+ * @return The MPHF, or NULL on failure.
+ */
+BBHash *bbhash_mphf_resume(const BBHashConfig *config);
+
+/** @brief Deletes the checkpoint in `dir`, and `dir` itself if nothing else is in it. */
+int bbhash_checkpoint_remove(const char *dir);
+
+/**
+ * @brief Builds an MPHF over 128-bit keys without folding them to 64 bits.
+ *
+ * The keys must be distinct (see dedup_pairs()); no two of them collide at
+ * every level, however similar. The builder copies the keys that miss
+ * level 0 as they are, 16 bytes each, plus 8 bytes per key for their slots
+ * unless config->memory_budget asks it to recompute them. The level hashes
+ * are computed eight keys at a time with AVX-512 where available.
+ * @param config As for bbhash_mphf_create_ex(); hash_scheme and hot_keys
+ *        must be left at their defaults. The MPHF gets BBHASH_HASH_KEY128.
+ * @return The MPHF, or NULL on failure.
+ */
+BBHash *bbhash_mphf_create128(const BBHashKey128 keys[], size_t n, const BBHashConfig *config);
+
+/**
+ * @brief Queries an MPHF built by bbhash_mphf_create128().
+ *
+ * bbhash_mphf_query(mphf, k) on such an MPHF looks up the key {k, 0}.
+ */
+size_t bbhash_mphf_query128(const BBHash *mphf, BBHashKey128 key);
+
+/** @brief As bbhash_mphf_query_batch(), for 128-bit keys. */
+void bbhash_mphf_query128_batch(const BBHash *mphf, const BBHashKey128 keys[], size_t n, size_t out[]);
+
+/**
+ * @brief Construction scratch kept across builds.
+ *
+ * Every build needs the slot of each key, a copy of the keys that miss
+ * level 0, and the used and colliding slot sets of the largest level. A
+ * builder keeps these buffers after a build and grows them when a later
+ * build needs more, so back-to-back builds of similar size allocate and
+ * fault in only the MPHF itself. Scratch is never zeroed, except for the
+ * slot sets of each level. A builder runs one build at a time.
+ */
+typedef struct BBHashBuilder BBHashBuilder;
+
+/** @brief Creates a builder with no scratch yet. @return NULL on failure. */
+BBHashBuilder *bbhash_builder_create(void);
+
+/**
+ * @brief Creates a builder whose scratch, and the builder itself, come from
+ *        `allocator` (copied; NULL = malloc).
+ *
+ * The MPHFs it builds are allocated as config->allocator says.
+ * @return NULL on failure.
+ */
+BBHashBuilder *bbhash_builder_create_ex(const BBHashAllocator *allocator);
+
+/** @brief As bbhash_mphf_create_ex(), with scratch from the builder. */
+BBHash *bbhash_builder_build(BBHashBuilder *builder, const uint64_t data[], size_t n, const BBHashConfig *config);
+
+/** @brief As bbhash_mphf_create128(), with scratch from the builder. */
+BBHash *bbhash_builder_build128(BBHashBuilder *builder, const BBHashKey128 keys[], size_t n,
+                                const BBHashConfig *config);
+
+/** @brief Bytes of scratch the builder holds. */
+size_t bbhash_builder_scratch_bytes(const BBHashBuilder *builder);
+
+/** @brief Frees the builder's scratch; the builder stays usable. */
+void bbhash_builder_trim(BBHashBuilder *builder);
+
+void bbhash_builder_free(BBHashBuilder *builder);
+
+/**
+ * @brief Returns the level a key is placed at (0 = first), counting compact
+ *        tail levels after the normal ones.
+ *
+ * A query for the key probes this many levels plus one. MPHFs built with
+ * BBHASH_ENGINE_PILOTS have no levels and always return 0.
+ * @return The level, or (size_t)-1 if the key misses every level.
+ */
+size_t bbhash_mphf_query_level(const BBHash *mphf, uint64_t key);
+
+/**
+ * @brief Checks that the MPHF maps the keys one-to-one onto [0, n).
+ *
+ * Needs one bit per key of scratch memory and splits the queries over
+ * `threads` threads. The first conflicting key and the first unmapped index
+ * are reported on stderr.
+ *
+ * @param mphf The MPHF to verify.
+ * @param keys The keys the MPHF was built for.
+ * @param n Number of keys.
+ * @param threads Number of threads to use (0 means 1).
+ * @return 0 if valid, -1 otherwise.
+ */
+int bbhash_mphf_verify(const BBHash *mphf, const uint64_t keys[], size_t n, unsigned threads);
+
+/** @brief Summary of an MPHF's shape, see bbhash_mphf_stats(). */
+typedef struct {
+    size_t num_keys;
+    size_t num_levels;     // levels in the normal layout
+    size_t tail_levels;    // levels packed into the compact tail
+    size_t tail_keys;      // keys placed in the compact tail
+    size_t size_in_bits;   // as bbhash_size_in_bits()
+    bool mapped;           // reads a buffer or file mapping in place
+    BBHashScheme hash_scheme;
+    BBHashEngine engine;
+    size_t num_buckets;    // pilot engine: buckets, one pilot each; else 0
+    uint32_t shard;        // as BBHashConfig; num_shards 0 = not a shard
+    uint32_t num_shards;
+} BBHashStats;
+
+/** @brief One level in the normal layout, see bbhash_mphf_level_info(). */
+typedef struct {
+    uint64_t seed;
+    size_t offset;         // index of the first key placed at this level
+    size_t num_keys;       // keys placed at this level
+    size_t num_slots;      // bits in the level's bit array
+    size_t size_in_bits;   // bit array, rank checkpoints and block seeds
+    size_t num_blocks;     // blocks with their own seed (weighted level 0), or 0
+} BBHashLevelInfo;
+
+/** @brief Fills `stats` for an MPHF. */
+void bbhash_mphf_stats(const BBHash *mphf, BBHashStats *stats);
+
+/**
+ * @brief Describes level `level` (0 = first) of the normal layout.
+ * @return false if there is no such level.
+ */
+bool bbhash_mphf_level_info(const BBHash *mphf, size_t level, BBHashLevelInfo *info);
+
+/**
+ * @brief Makes an independent deep copy of an MPHF.
+ *
+ * The copy owns its memory, even if `mphf` was loaded from a buffer or
+ * mapping, and takes it from the allocator `mphf` was made with. Its pages
+ * are first touched by the calling thread, so calling this from a thread
+ * pinned to a NUMA node places the copy on that node.
+ * @param mphf The MPHF to copy.
+ * @return The copy, or NULL on allocation failure. Free with bbhash_free().
+ */
+BBHash *bbhash_mphf_clone(const BBHash *mphf);
+
 /**
  * @brief Saves a constructed BBHash MPHF to a file.
+ *
+ * Writes format version 3: 8-byte aligned sections, each followed by its
+ * CRC-32C, so the file can be verified on load and mapped with
+ * bbhash_mphf_mmap().
  * @param mphf The MPHF to save.
  * @param filename The path to the output file.
  * @return 0 on success, -1 on failure.
  */
 int bbhash_mphf_save(const BBHash *mphf, const char *filename);
 
+/** @brief The format version written by bbhash_mphf_save(). */
+enum { BBHASH_FORMAT_VERSION = 3 };
+
+/**
+ * @brief Saves an MPHF in a given file format version.
+ *
+ * Version 1 cannot hold a compact tail; version 2 is written as version 1
+ * when there is no tail. Only version 3 has checksums and can record a hash
+ * scheme other than BBHASH_HASH_SEEDED, a weighted level 0 or a pilot table.
+ * @param mphf The MPHF to save.
+ * @param filename The path to the output file.
+ * @param version File format version, 1 to BBHASH_FORMAT_VERSION.
+ * @return 0 on success, -1 on failure.
+ */
+int bbhash_mphf_save_ex(const BBHash *mphf, const char *filename, int version);
+
+/**
+ * @brief Writes an MPHF in the current format to an open stream.
+ *
+ * For embedding the image in a larger file. The image is a multiple of 8
+ * bytes long; start it at an 8-byte aligned file offset so that the file
+ * can be mapped and the image passed to bbhash_mphf_from_buffer().
+ * @return 0 on success, -1 on failure.
+ */
+int bbhash_mphf_write(const BBHash *mphf, FILE *fp);
+
 /**
  * @brief Loads a BBHash MPHF from a file.
+ *
+ * Reads all format versions. Same as bbhash_mphf_load_ex(filename, 0).
  * @param filename The path to the file to load.
  * @return A pointer to the loaded BBHash structure, or NULL on failure.
  */
 BBHash *bbhash_mphf_load(const char *filename);
 
+/** @brief Flags for the bbhash_mphf_load_ex() family. */
+enum {
+    BBHASH_LOAD_VERIFY = 1u << 0,   // check the per-section CRC-32C (version 3 files)
+};
+
+/**
+ * @brief Loads a BBHash MPHF from a file, optionally verifying checksums.
+ *
+ * With BBHASH_LOAD_VERIFY each section's checksum is computed as it is read,
+ * so corruption is reported (and NULL returned) instead of producing wrong
+ * query results later.
+ * @param filename The path to the file to load.
+ * @param flags Zero or more BBHASH_LOAD_* flags.
+ * @return A pointer to the loaded BBHash structure, or NULL on failure.
+ */
+BBHash *bbhash_mphf_load_ex(const char *filename, unsigned flags);
+
+/**
+ * @brief Builds an MPHF over a serialized image in memory.
+ *
+ * If `buf` is 8-byte aligned and holds a version 3 image, the bit arrays and
+ * rank tables are used in place and the buffer must outlive the MPHF.
+ * Otherwise the data is copied.
+ * @param buf The serialized MPHF, as written by bbhash_mphf_save().
+ * @param len Size of the buffer in bytes.
+ * @param flags Zero or more BBHASH_LOAD_* flags.
+ * @return A pointer to the BBHash structure, or NULL on failure.
+ */
+BBHash *bbhash_mphf_from_buffer(const void *buf, size_t len, unsigned flags);
+
+/**
+ * @brief Maps an MPHF file into memory and queries it in place.
+ *
+ * Loading is constant time apart from the optional checksum pass; pages are
+ * read on demand by queries. Older format versions are loaded by copying.
+ * The mapping is released by bbhash_free().
+ * @param filename The path to the file to map.
+ * @param flags Zero or more BBHASH_LOAD_* flags.
+ * @return A pointer to the BBHash structure, or NULL on failure.
+ */
+BBHash *bbhash_mphf_mmap(const char *filename, unsigned flags);
+
+/**
+ * @brief As bbhash_mphf_load_ex(), bbhash_mphf_from_buffer() and
+ *        bbhash_mphf_mmap(), with the MPHF's memory from `allocator`.
+ *
+ * The allocator is copied into the MPHF; NULL means malloc. A mapping itself
+ * is not allocated, only the level descriptors and any copied data.
+ */
+BBHash *bbhash_mphf_load_with(const char *filename, unsigned flags, const BBHashAllocator *allocator);
+BBHash *bbhash_mphf_from_buffer_with(const void *buf, size_t len, unsigned flags, const BBHashAllocator *allocator);
+BBHash *bbhash_mphf_mmap_with(const char *filename, unsigned flags, const BBHashAllocator *allocator);
+
+/**
+ * @brief An MPHF file queried on disk.
+ *
+ * Only the level descriptors, the rank checkpoints, the level 0 block seeds
+ * and the compact tail are loaded, about 1/64 of the bit arrays. The bit
+ * words are read from the file as queries need them: one 64-byte rank block
+ * (a 4 KiB page with direct I/O) per probed level. A batch query probes a
+ * whole group of keys at each level with one round of reads through
+ * io_uring, so the device serves them in parallel. The deepest levels can be
+ * kept in memory: they are the smallest, and the keys that reach them would
+ * otherwise pay one more round each.
+ *
+ * A BBHashDisk holds its own ring and read buffers, so it is not
+ * thread-safe; open the file once per thread.
+ */
+typedef struct BBHashDisk BBHashDisk;
+
+/** @brief Options for bbhash_disk_open(); start from bbhash_disk_config_default(). */
+typedef struct {
+    size_t cache_bytes;       // memory for the bit arrays of the deepest levels,
+                              // filled whole levels at a time; default 0
+    unsigned queue_depth;     // keys per group, and so reads in flight; default 64
+    bool direct_io;           // bypass the OS page cache (O_DIRECT) so reads
+                              // cost the same however often the file is
+                              // queried; default true where supported
+    bool use_uring;           // default true; false (or no io_uring in the
+                              // kernel) reads with one pread() at a time
+    unsigned load_flags;      // BBHASH_LOAD_* flags; VERIFY reads the whole file once
+    const BBHashAllocator *allocator;  // memory for the handle, its cache and
+                              // read buffers (copied); NULL = malloc
+} BBHashDiskConfig;
+
+BBHashDiskConfig bbhash_disk_config_default(void);
+
+/**
+ * @brief Opens an MPHF file of any format version for on-disk queries.
+ *
+ * Only MPHFs built with BBHASH_ENGINE_LEVELS over 64-bit keys can be
+ * queried on disk.
+ * @param config Options, or NULL for the defaults.
+ * @return The handle, or NULL on failure.
+ */
+BBHashDisk *bbhash_disk_open(const char *filename, const BBHashDiskConfig *config);
+
+/**
+ * @brief Queries one key, as bbhash_mphf_query() on the loaded file.
+ * @return The index, or (size_t)-1 for a non-member or a read error.
+ */
+size_t bbhash_disk_query(BBHashDisk *disk, uint64_t key);
+
+/**
+ * @brief Queries keys[i] into out[i], as bbhash_mphf_query_batch().
+ * @return 0 on success, -1 if a read failed.
+ */
+int bbhash_disk_query_batch(BBHashDisk *disk, const uint64_t keys[], size_t n, size_t out[]);
+
+/** @brief Shape and I/O counts of a BBHashDisk, see bbhash_disk_stats(). */
+typedef struct {
+    size_t num_keys;
+    size_t num_levels;        // levels in the normal layout
+    size_t cached_levels;     // deepest levels held in memory
+    size_t memory_bytes;      // everything held in memory, buffers included
+    size_t disk_bytes;        // bit arrays left in the file
+    size_t reads;             // reads issued so far
+    bool direct_io;
+    bool uring;               // reads go through io_uring
+} BBHashDiskStats;
+
+void bbhash_disk_stats(const BBHashDisk *disk, BBHashDiskStats *stats);
+
+void bbhash_disk_close(BBHashDisk *disk);
+
+#ifdef __cplusplus
+}
+#endif
+
 #endif
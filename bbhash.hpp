@@ -0,0 +1,233 @@
+#ifndef BBHASH_HPP
+#define BBHASH_HPP
+
+#include <algorithm>
+#include <concepts>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <span>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include "bbhash.h"
+#include "hashing.h"
+
+/*
+ * Header-only C++20 layer over bbhash.h.
+ *
+ * bbhash::Mphf<Key> owns one BBHash and frees it when destroyed. It can be
+ * moved but not copied. A KeyAdaptor picks, at compile time, how a Key
+ * becomes one of the keys the C library takes:
+ *   - integers and enums: the value, as a 64-bit key;
+ *   - anything convertible to std::string_view: murmur3_bytes() with seed 0,
+ *     the hash `bbhash build -f text` applies to each line, so the two agree;
+ *   - other trivially copyable types without padding: their bytes, as a
+ *     64-bit key if they fit, as a 128-bit key if they are 16 bytes long,
+ *     hashed with murmur3_bytes() otherwise.
+ * Specialize bbhash::KeyAdaptor for other key types. Keys must stay distinct
+ * after adaptation; hashed keys are distinct in practice.
+ *
+ * Everything here is inline and non-virtual. Queries convert keys on the
+ * stack; only building allocates, once, to hold the converted key set.
+ * Factories return an empty Mphf, which tests false, on failure.
+ */
+namespace bbhash {
+
+/** @brief Seed of the string hash, the same as the CLI's text keys. */
+inline constexpr uint64_t text_key_seed = 0;
+
+template <class T>
+concept TextKey = std::convertible_to<const T &, std::string_view>;
+
+template <class T>
+concept IntegerKey = std::integral<T> || std::is_enum_v<T>;
+
+template <class T>
+concept BytesKey = !TextKey<T> && !IntegerKey<T> && std::is_trivially_copyable_v<T>
+                   && std::has_unique_object_representations_v<T>;
+
+/**
+ * @brief Maps a key type onto a C key.
+ *
+ * A specialization defines `type` (uint64_t or BBHashKey128) and
+ * `static type convert(const T &) noexcept`.
+ */
+template <class T>
+struct KeyAdaptor;
+
+template <IntegerKey T>
+struct KeyAdaptor<T> {
+    using type = uint64_t;
+    static constexpr uint64_t convert(T key) noexcept {
+        if constexpr (std::is_enum_v<T>) {
+            return static_cast<uint64_t>(static_cast<std::underlying_type_t<T>>(key));
+        } else {
+            return static_cast<uint64_t>(key);
+        }
+    }
+};
+
+template <TextKey T>
+struct KeyAdaptor<T> {
+    using type = uint64_t;
+    static uint64_t convert(const T &key) noexcept {
+        std::string_view text(key);
+        return murmur3_bytes(text.data(), text.size(), text_key_seed);
+    }
+};
+
+template <BytesKey T>
+struct KeyAdaptor<T> {
+    using type = std::conditional_t<sizeof(T) == sizeof(BBHashKey128), BBHashKey128, uint64_t>;
+    static type convert(const T &key) noexcept {
+        if constexpr (sizeof(T) == sizeof(BBHashKey128)) {
+            BBHashKey128 wide;
+            std::memcpy(&wide, &key, sizeof(wide));
+            return wide;
+        } else if constexpr (sizeof(T) <= sizeof(uint64_t)) {
+            uint64_t word = 0;
+            std::memcpy(&word, &key, sizeof(T));
+            return word;
+        } else {
+            return murmur3_bytes(&key, sizeof(T), text_key_seed);
+        }
+    }
+};
+
+/** @brief A minimal perfect hash function over keys of type Key. */
+template <class Key, class Adaptor = KeyAdaptor<Key>>
+class Mphf {
+public:
+    using key_type = Key;
+    using c_key_type = typename Adaptor::type;
+    static constexpr bool wide = std::same_as<c_key_type, BBHashKey128>;
+    static_assert(wide || std::same_as<c_key_type, uint64_t>, "KeyAdaptor::type must be uint64_t or BBHashKey128");
+
+    Mphf() noexcept = default;
+
+    /** @brief Takes ownership of a BBHash from the C API (may be NULL). */
+    explicit Mphf(BBHash *mphf) noexcept : mphf_(mphf) {}
+
+    Mphf(Mphf &&other) noexcept : mphf_(std::exchange(other.mphf_, nullptr)) {}
+
+    Mphf &operator=(Mphf &&other) noexcept {
+        if (this != &other) {
+            bbhash_free(mphf_);
+            mphf_ = std::exchange(other.mphf_, nullptr);
+        }
+        return *this;
+    }
+
+    Mphf(const Mphf &) = delete;
+    Mphf &operator=(const Mphf &) = delete;
+
+    ~Mphf() { bbhash_free(mphf_); }
+
+    /**
+     * @brief Builds an MPHF over distinct keys.
+     *
+     * 128-bit keys are built with bbhash_mphf_create128(), so the config must
+     * keep the default hash scheme and no hot keys. Weights, if any, follow
+     * the order of `keys`.
+     */
+    static Mphf build(std::span<const Key> keys, const BBHashConfig &config = bbhash_config_default()) {
+        if constexpr (std::same_as<Key, c_key_type>) {
+            return Mphf(create(keys.data(), keys.size(), config));
+        } else {
+            std::vector<c_key_type> converted(keys.size());
+            std::ranges::transform(keys, converted.begin(), [](const Key &key) { return Adaptor::convert(key); });
+            return Mphf(create(converted.data(), converted.size(), config));
+        }
+    }
+
+    /** @brief Reads an MPHF file, see bbhash_mphf_load_ex(). */
+    static Mphf load(const char *filename, unsigned flags = 0) {
+        return Mphf(bbhash_mphf_load_ex(filename, flags));
+    }
+
+    /** @brief Maps an MPHF file and queries it in place, see bbhash_mphf_mmap(). */
+    static Mphf map(const char *filename, unsigned flags = 0) {
+        return Mphf(bbhash_mphf_mmap(filename, flags));
+    }
+
+    /** @brief Uses a serialized image, see bbhash_mphf_from_buffer(); the buffer may have to outlive the MPHF. */
+    static Mphf from_buffer(std::span<const std::byte> buf, unsigned flags = 0) {
+        return Mphf(bbhash_mphf_from_buffer(buf.data(), buf.size(), flags));
+    }
+
+    /** @brief Saves in the current format. @return false on failure. */
+    bool save(const char *filename) const { return bbhash_mphf_save(mphf_, filename) == 0; }
+
+    /**
+     * @brief Returns the index of a key in [0, size()).
+     * @return As bbhash_mphf_query(): arbitrary or (size_t)-1 for non-members.
+     */
+    size_t operator()(const Key &key) const noexcept {
+        if constexpr (wide) {
+            return bbhash_mphf_query128(mphf_, Adaptor::convert(key));
+        } else {
+            return bbhash_mphf_query(mphf_, Adaptor::convert(key));
+        }
+    }
+
+    size_t query(const Key &key) const noexcept { return (*this)(key); }
+
+    /** @brief Queries keys[i] into out[i]; `out` must be at least as long as `keys`. */
+    void query(std::span<const Key> keys, std::span<size_t> out) const noexcept {
+        if constexpr (std::same_as<Key, c_key_type>) {
+            query_c(keys.data(), keys.size(), out.data());
+        } else {
+            // Converted a chunk at a time on the stack, so the C batch query
+            // still overlaps the memory accesses of many keys.
+            constexpr size_t chunk = 256;
+            c_key_type converted[chunk];
+            for (size_t i = 0; i < keys.size(); i += chunk) {
+                size_t n = std::min(chunk, keys.size() - i);
+                for (size_t j = 0; j < n; j++) converted[j] = Adaptor::convert(keys[i + j]);
+                query_c(converted, n, out.data() + i);
+            }
+        }
+    }
+
+    /** @brief Number of keys the MPHF was built for. */
+    size_t size() const noexcept {
+        BBHashStats stats;
+        bbhash_mphf_stats(mphf_, &stats);
+        return stats.num_keys;
+    }
+
+    size_t size_in_bits() const noexcept { return bbhash_size_in_bits(mphf_); }
+
+    explicit operator bool() const noexcept { return mphf_ != nullptr; }
+
+    /** @brief The underlying C handle, still owned by this object. */
+    BBHash *get() const noexcept { return mphf_; }
+
+    /** @brief Gives up ownership; free the result with bbhash_free(). */
+    BBHash *release() noexcept { return std::exchange(mphf_, nullptr); }
+
+private:
+    static BBHash *create(const c_key_type *keys, size_t n, const BBHashConfig &config) {
+        if constexpr (wide) {
+            return bbhash_mphf_create128(keys, n, &config);
+        } else {
+            return bbhash_mphf_create_ex(keys, n, &config);
+        }
+    }
+
+    void query_c(const c_key_type *keys, size_t n, size_t *out) const noexcept {
+        if constexpr (wide) {
+            bbhash_mphf_query128_batch(mphf_, keys, n, out);
+        } else {
+            bbhash_mphf_query_batch(mphf_, keys, n, out);
+        }
+    }
+
+    BBHash *mphf_ = nullptr;
+};
+
+} // namespace bbhash
+
+#endif // BBHASH_HPP
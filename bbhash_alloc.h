@@ -0,0 +1,67 @@
+#ifndef BBHASH_ALLOC_H
+#define BBHASH_ALLOC_H
+
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdalign.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Allocator hooks.
+ *
+ * Builds, loads and clones take an optional allocator, and the MPHF they
+ * return keeps a copy of it, so that its memory goes back the same way on
+ * bbhash_free(). This routes index memory into an arena, a huge-page pool or
+ * a per-tenant account. A NULL allocator, or one without an alloc hook, uses
+ * malloc(), calloc() and free() as before.
+ *
+ * Every allocation whose size grows with the keys goes through the hooks:
+ * the index itself, construction scratch and load buffers. Per-thread
+ * bookkeeping (a few dozen bytes per thread) still uses malloc().
+ */
+typedef struct {
+    // Returns `size` bytes aligned to `alignment` (a power of two), or NULL.
+    void *(*alloc)(void *ctx, size_t size, size_t alignment);
+    // The same, zero-filled. Optional: without it, alloc() is followed by memset().
+    void *(*zalloc)(void *ctx, size_t size, size_t alignment);
+    // Releases a block from alloc() or zalloc(); never called with NULL.
+    // Optional, for arenas that are released all at once.
+    void (*free)(void *ctx, void *ptr);
+    void *ctx;  // passed to every hook
+} BBHashAllocator;
+
+/** @brief Allocates through `a`, or malloc() if it has no hooks. */
+static inline void *bbhash_alloc(const BBHashAllocator *a, size_t size, size_t alignment) {
+    if (a && a->alloc) return a->alloc(a->ctx, size, alignment);
+    if (alignment <= alignof(max_align_t)) return malloc(size);
+    return aligned_alloc(alignment, (size + alignment - 1) / alignment * alignment);
+}
+
+/** @brief As bbhash_alloc(), zero-filled. */
+static inline void *bbhash_zalloc(const BBHashAllocator *a, size_t size, size_t alignment) {
+    if (a && a->alloc && a->zalloc) return a->zalloc(a->ctx, size, alignment);
+    if (!(a && a->alloc) && alignment <= alignof(max_align_t)) return calloc(1, size);
+    void *ptr = bbhash_alloc(a, size, alignment);
+    if (ptr) memset(ptr, 0, size);
+    return ptr;
+}
+
+/** @brief Releases a block from bbhash_alloc() or bbhash_zalloc() with the same `a`. */
+static inline void bbhash_dealloc(const BBHashAllocator *a, void *ptr) {
+    if (!ptr) return;
+    if (!(a && a->alloc)) {
+        free(ptr);
+    } else if (a->free) {
+        a->free(a->ctx, ptr);
+    }
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // BBHASH_ALLOC_H
@@ -0,0 +1,276 @@
+/* bbhash_alloc_test.c - tests for the allocator hooks.
+ *
+ */
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdatomic.h>
+#include "mt64.h"
+#include "dedup.h"
+#include "bbhash.h"
+
+constexpr size_t NUM_KEYS = 100000;
+
+// Counts what is live, and fails every allocation after the first `budget`.
+typedef struct {
+    _Atomic size_t live_blocks;
+    _Atomic size_t live_bytes;
+    _Atomic size_t allocs;
+    _Atomic size_t zallocs;
+    _Atomic size_t max_alignment;
+    size_t budget;
+} Counter;
+
+// A block is preceded by its base pointer and size.
+static void *counting_alloc(void *ctx, size_t size, size_t alignment) {
+    Counter *c = ctx;
+    assert(alignment != 0 && (alignment & (alignment - 1)) == 0);
+    if (atomic_fetch_add(&c->allocs, 1) >= c->budget) return NULL;
+    size_t pad = alignment < 16 ? 16 : alignment;
+    uint8_t *base = aligned_alloc(pad, (pad + size + pad - 1) / pad * pad);
+    if (!base) return NULL;
+    void **header = (void **)(base + pad);
+    header[-2] = base;
+    header[-1] = (void *)(uintptr_t)size;
+    atomic_fetch_add(&c->live_blocks, 1);
+    atomic_fetch_add(&c->live_bytes, size);
+    size_t max = atomic_load(&c->max_alignment);
+    while (alignment > max && !atomic_compare_exchange_weak(&c->max_alignment, &max, alignment)) {}
+    return base + pad;
+}
+
+static void *counting_zalloc(void *ctx, size_t size, size_t alignment) {
+    Counter *c = ctx;
+    atomic_fetch_add(&c->zallocs, 1);
+    void *ptr = counting_alloc(ctx, size, alignment);
+    if (ptr) memset(ptr, 0, size);
+    return ptr;
+}
+
+static void counting_free(void *ctx, void *ptr) {
+    Counter *c = ctx;
+    assert(ptr != NULL);
+    void **header = ptr;
+    size_t size = (size_t)(uintptr_t)header[-1];
+    assert(atomic_load(&c->live_blocks) > 0 && atomic_load(&c->live_bytes) >= size);
+    atomic_fetch_sub(&c->live_blocks, 1);
+    atomic_fetch_sub(&c->live_bytes, size);
+    free(header[-2]);
+}
+
+static BBHashAllocator counting_allocator(Counter *c) {
+    *c = (Counter) {.budget = SIZE_MAX};
+    return (BBHashAllocator) {
+        .alloc = counting_alloc, .zalloc = counting_zalloc, .free = counting_free, .ctx = c,
+    };
+}
+
+// A bump arena: no zalloc hook (the library clears the memory) and no free
+// hook (it is dropped all at once).
+typedef struct {
+    uint8_t *base;
+    size_t used, cap;
+} Arena;
+
+static void *arena_alloc(void *ctx, size_t size, size_t alignment) {
+    Arena *arena = ctx;
+    size_t at = (arena->used + alignment - 1) / alignment * alignment;
+    if (at > arena->cap || size > arena->cap - at) return NULL;
+    arena->used = at + size;
+    memset(arena->base + at, 0xa5, size);  // the library must not expect zeros
+    return arena->base + at;
+}
+
+static void check_mphf(const BBHash *mphf, const uint64_t keys[], size_t n) {
+    assert(mphf != NULL);
+    assert(bbhash_mphf_verify(mphf, keys, n, 2) == 0);
+}
+
+static void assert_same(const BBHash *a, const BBHash *b, const uint64_t keys[], size_t n) {
+    for (size_t i = 0; i < n; i++) assert(bbhash_mphf_query(a, keys[i]) == bbhash_mphf_query(b, keys[i]));
+}
+
+// Builds through the hooks, checks that the MPHF holds all that is still live
+// and gives all of it back.
+static void check_build(const BBHashConfig *base, const uint64_t keys[], size_t n, const char *what) {
+    Counter c;
+    BBHashAllocator allocator = counting_allocator(&c);
+    BBHashConfig config = *base;
+    config.allocator = &allocator;
+    BBHash *mphf = bbhash_mphf_create_ex(keys, n, &config);
+    check_mphf(mphf, keys, n);
+    BBHash *plain = bbhash_mphf_create_ex(keys, n, base);
+    assert_same(mphf, plain, keys, n);  // the hooks change nothing else
+    bbhash_free(plain);
+    size_t live = atomic_load(&c.live_bytes);
+    printf("  %-14s %6zu allocations, %zu blocks live (%zu bytes, index %zu)\n", what, atomic_load(&c.allocs),
+           atomic_load(&c.live_blocks), live, bbhash_size_in_bits(mphf) / 8);
+    assert(live >= bbhash_size_in_bits(mphf) / 8 && live <= bbhash_size_in_bits(mphf) / 8 + 4096);
+
+    BBHash *copy = bbhash_mphf_clone(mphf);
+    assert(copy != NULL && atomic_load(&c.live_bytes) == 2 * live);
+    assert_same(mphf, copy, keys, n);
+    bbhash_free(mphf);
+    assert(atomic_load(&c.live_bytes) == live);
+    bbhash_free(copy);
+    assert(atomic_load(&c.live_blocks) == 0 && atomic_load(&c.live_bytes) == 0);
+}
+
+int main(void) {
+    printf("bbhash_alloc_test\n");
+    size_t buffer_size = NUM_KEYS + NUM_KEYS / 100 + 100;
+    uint64_t *keys = malloc(sizeof(uint64_t) * buffer_size);
+    mt64_fill_u64_parallel(50, keys, buffer_size, 1);
+    size_t n = dedup(keys, buffer_size);
+    if (n > NUM_KEYS) n = NUM_KEYS;
+
+    // Every construction path.
+    BBHashConfig config = bbhash_config_default();
+    assert(config.allocator == NULL);
+    check_build(&config, keys, n, "levels");
+    config.threads = 4;
+    config.compact_from_level = 2;
+    check_build(&config, keys, n, "compact tail");
+    config = bbhash_config_default();
+    config.hot_keys = keys;
+    config.num_hot_keys = 100;
+    check_build(&config, keys, n, "hot keys");
+    config = bbhash_config_default();
+    config.hash_scheme = BBHASH_HASH_BASE128;
+    check_build(&config, keys, n, "base128");
+    config = bbhash_config_default();
+    config.memory_budget = n * 8;
+    check_build(&config, keys, n, "memory budget");
+    config = bbhash_config_default();
+    config.engine = BBHASH_ENGINE_PILOTS;
+    check_build(&config, keys, n, "pilots");
+
+    // 128-bit keys.
+    Counter c;
+    BBHashAllocator allocator = counting_allocator(&c);
+    config = bbhash_config_default();
+    config.allocator = &allocator;
+    BBHashKey128 *wide = malloc(sizeof(BBHashKey128) * n);
+    for (size_t i = 0; i < n; i++) wide[i] = (BBHashKey128) {keys[i], ~keys[i]};
+    BBHash *mphf = bbhash_mphf_create128(wide, n, &config);
+    assert(mphf != NULL && atomic_load(&c.live_blocks) > 0);
+    bbhash_free(mphf);
+    assert(atomic_load(&c.live_blocks) == 0);
+    free(wide);
+
+    // A builder keeps its scratch in its own allocator, apart from the MPHFs.
+    Counter scratch;
+    BBHashAllocator scratch_allocator = counting_allocator(&scratch);
+    BBHashBuilder *builder = bbhash_builder_create_ex(&scratch_allocator);
+    assert(builder != NULL && atomic_load(&scratch.live_blocks) == 1);
+    for (int round = 0; round < 2; round++) {
+        mphf = bbhash_builder_build(builder, keys, n, &config);
+        check_mphf(mphf, keys, n);
+        assert(atomic_load(&scratch.live_bytes) >= bbhash_builder_scratch_bytes(builder));
+        bbhash_free(mphf);
+        assert(atomic_load(&c.live_blocks) == 0);
+    }
+    size_t reused = atomic_load(&scratch.allocs);
+    mphf = bbhash_builder_build(builder, keys, n / 2, &config);
+    assert(mphf != NULL && atomic_load(&scratch.allocs) == reused);  // no new scratch
+    bbhash_free(mphf);
+    bbhash_builder_trim(builder);
+    assert(atomic_load(&scratch.live_blocks) == 1);
+    bbhash_builder_free(builder);
+    assert(atomic_load(&scratch.live_blocks) == 0);
+
+    // Every loader.
+    const char *file = "bbhash_alloc_test.bbh";
+    BBHash *reference = bbhash_mphf_create_ex(keys, n, &config);
+    assert(reference && bbhash_mphf_save(reference, file) == 0);
+    size_t index_blocks = atomic_load(&c.live_blocks);
+    BBHash *loaded = bbhash_mphf_load_with(file, BBHASH_LOAD_VERIFY, &allocator);
+    check_mphf(loaded, keys, n);
+    assert(atomic_load(&c.live_blocks) == 2 * index_blocks);
+    bbhash_free(loaded);
+    BBHash *mapped = bbhash_mphf_mmap_with(file, 0, &allocator);
+    check_mphf(mapped, keys, n);
+    size_t descriptors = atomic_load(&c.live_blocks) - index_blocks;
+    assert(descriptors > 0 && descriptors < index_blocks);  // the bit arrays stay in the mapping
+    bbhash_free(mapped);
+
+    FILE *fp = fopen(file, "rb");
+    assert(fp != NULL);
+    fseek(fp, 0, SEEK_END);
+    size_t len = (size_t)ftell(fp);
+    rewind(fp);
+    uint64_t *buffer = malloc(len + sizeof(uint64_t));
+    assert(fread(buffer, 1, len, fp) == len);
+    fclose(fp);
+    BBHash *borrowed = bbhash_mphf_from_buffer_with(buffer, len, 0, &allocator);
+    check_mphf(borrowed, keys, n);
+    bbhash_free(borrowed);
+    memmove((uint8_t *)buffer + 1, buffer, len);  // unaligned: copied out
+    BBHash *copied = bbhash_mphf_from_buffer_with((uint8_t *)buffer + 1, len, 0, &allocator);
+    check_mphf(copied, keys, n);
+    assert(atomic_load(&c.live_blocks) == 2 * index_blocks);
+    bbhash_free(copied);
+    free(buffer);
+
+    // On-disk queries, with buffers at the direct I/O alignment.
+    BBHashDiskConfig disk_config = bbhash_disk_config_default();
+    disk_config.allocator = &allocator;
+    disk_config.cache_bytes = 4096;
+    atomic_store(&c.max_alignment, 0);
+    BBHashDisk *disk = bbhash_disk_open(file, &disk_config);
+    assert(disk != NULL);
+    assert(atomic_load(&c.max_alignment) >= 4096);
+    for (size_t i = 0; i < n; i += 101) {
+        assert(bbhash_disk_query(disk, keys[i]) == bbhash_mphf_query(reference, keys[i]));
+    }
+    bbhash_disk_close(disk);
+    assert(atomic_load(&c.live_blocks) == index_blocks);
+
+    // Every failed allocation is cleaned up after, whichever it is.
+    Counter f;
+    size_t failures = 0;
+    for (size_t budget = 0;; budget++) {
+        BBHashAllocator failing = counting_allocator(&f);
+        f.budget = budget;
+        BBHashConfig small = bbhash_config_default();
+        small.allocator = &failing;
+        small.compact_from_level = 2;
+        BBHash *m = bbhash_mphf_create_ex(keys, 2000, &small);
+        BBHash *l = m ? NULL : bbhash_mphf_load_with(file, BBHASH_LOAD_VERIFY, &failing);
+        if (m) {
+            bbhash_free(m);
+            assert(atomic_load(&f.live_blocks) == 0);
+            break;
+        }
+        assert(l == NULL && atomic_load(&f.live_blocks) == 0);
+        failures++;
+    }
+    printf("  %zu failing allocations cleaned up\n", failures);
+    assert(failures > 0);
+
+    // An arena without zalloc or free hooks.
+    Arena arena = {.cap = 64u << 20};
+    arena.base = malloc(arena.cap);
+    BBHashAllocator bump = {.alloc = arena_alloc, .ctx = &arena};
+    config = bbhash_config_default();
+    config.allocator = &bump;
+    mphf = bbhash_mphf_create_ex(keys, n, &config);
+    check_mphf(mphf, keys, n);
+    assert_same(mphf, reference, keys, n);
+    bbhash_free(mphf);
+    loaded = bbhash_mphf_load_with(file, 0, &bump);
+    assert_same(loaded, reference, keys, n);
+    bbhash_free(loaded);
+    assert(arena.used > 0);
+    free(arena.base);
+
+    bbhash_free(reference);
+    assert(atomic_load(&c.live_blocks) == 0);
+    remove(file);
+    free(keys);
+    printf("All tests passed.\n");
+    return 0;
+}
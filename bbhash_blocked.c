@@ -0,0 +1,256 @@
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include "bitarray.h"
+#include "hashing.h"
+#include "bbhash_blocked.h"
+
+/*
+ * Superblock layout: word 0 is the index of the block's first key; words 1
+ * to 7 hold the in-block levels back to back, level l starting at bit
+ * level_start[l] of that 448-bit area. The rank of a hit is the popcount of
+ * the area below it.
+ */
+enum {
+    BLOCK_WORDS = 8,
+    BLOCK_LEVEL_BITS = (BLOCK_WORDS - 1) * 64,
+    MAX_BLOCK_LEVELS = 16,
+};
+constexpr size_t BLOCK_BYTES = BLOCK_WORDS * sizeof(uint64_t);
+constexpr uint64_t BLOCK_SEED = 0x3c6ef372fe94f82b;   // picks the superblock
+constexpr uint64_t LEVEL_FIRST_SEED = 42;             // level l uses LEVEL_FIRST_SEED + l
+constexpr size_t BATCH_GROUP = 16;
+
+struct BBHashBlocked {
+    size_t num_keys;
+    size_t num_blocks;
+    size_t keys_per_block;
+    size_t in_block_keys;      // keys placed inside superblocks; overflow indexes follow
+    unsigned num_levels;
+    uint16_t level_start[MAX_BLOCK_LEVELS];
+    uint16_t level_bits[MAX_BLOCK_LEVELS];
+    uint64_t *blocks;          // num_blocks * BLOCK_WORDS, 64-byte aligned
+    BBHash *overflow;          // or NULL
+    size_t overflow_keys;
+};
+
+static inline size_t block_of(const BBHashBlocked *b, uint64_t key) {
+    return hash_with_seed(key, BLOCK_SEED) % b->num_blocks;
+}
+
+// Slot of a key in in-block level l. The levels are small, so the high
+// half of the hash is scaled instead of taking a 64-bit modulo.
+static inline size_t block_slot(const BBHashBlocked *b, uint64_t key, unsigned l) {
+    uint64_t hash = hash_with_seed(key, LEVEL_FIRST_SEED + l);
+    return b->level_start[l] + (size_t)(((hash >> 32) * b->level_bits[l]) >> 32);
+}
+
+// Number of set level bits below `pos` in a superblock.
+static inline size_t block_rank(const uint64_t *block, size_t pos) {
+    const uint64_t *bits = block + 1;
+    size_t rank = 0;
+    for (size_t w = 0; w < pos / 64; w++) rank += stdc_count_ones(bits[w]);
+    if (pos & 63) rank += stdc_count_ones(bits[pos / 64] & ((UINT64_C(1) << (pos & 63)) - 1));
+    return rank;
+}
+
+// Looks a key up in its superblock; returns false if no level has it.
+static inline bool block_lookup(const BBHashBlocked *b, const uint64_t *block, uint64_t key, size_t *index) {
+    for (unsigned l = 0; l < b->num_levels; l++) {
+        size_t pos = block_slot(b, key, l);
+        if ((block[1 + pos / 64] >> (pos % 64)) & 1) {
+            *index = block[0] + block_rank(block, pos);
+            return true;
+        }
+    }
+    return false;
+}
+
+size_t bbhash_blocked_query(const BBHashBlocked *b, uint64_t key) {
+    size_t index;
+    if (block_lookup(b, b->blocks + block_of(b, key) * BLOCK_WORDS, key, &index)) return index;
+    if (!b->overflow) return (size_t)-1;
+    size_t idx = bbhash_mphf_query(b->overflow, key);
+    return idx == (size_t)-1 ? idx : b->in_block_keys + idx;
+}
+
+void bbhash_blocked_query_batch(const BBHashBlocked *b, const uint64_t keys[], size_t n, size_t out[]) {
+    const uint64_t *blocks[BATCH_GROUP];
+    for (size_t first = 0; first < n; first += BATCH_GROUP) {
+        size_t count = n - first < BATCH_GROUP ? n - first : BATCH_GROUP;
+        // Start loading every block of the group before reading any of them.
+        for (size_t i = 0; i < count; i++) {
+            blocks[i] = b->blocks + block_of(b, keys[first + i]) * BLOCK_WORDS;
+            __builtin_prefetch(blocks[i]);
+        }
+        for (size_t i = 0; i < count; i++) {
+            if (!block_lookup(b, blocks[i], keys[first + i], &out[first + i])) {
+                out[first + i] = bbhash_blocked_query(b, keys[first + i]);
+            }
+        }
+    }
+}
+
+// e^-x for the small x used here, by its series, so the library needs no libm.
+static double exp_neg(double x) {
+    double term = 1.0, sum = 1.0;
+    for (int k = 1; k < 20; k++) {
+        term *= -x / k;
+        sum += term;
+    }
+    return sum;
+}
+
+/*
+ * Plans the in-block levels for gamma: level l gets gamma bits per key
+ * expected to reach it, and a fraction e^(-1/gamma) of those is expected
+ * to land alone. The plan uses the largest average load whose levels fit
+ * in the block; leftover bits go to the last level. Returns false if even
+ * one key per block does not fit, i.e. gamma is above about 448.
+ */
+static bool plan_levels(BBHashBlocked *b, double gamma) {
+    for (size_t load = BLOCK_LEVEL_BITS; load > 0; load--) {
+        double reaching = (double)load;
+        size_t start = 0;
+        unsigned levels = 0;
+        while (reaching >= 0.5 && levels < MAX_BLOCK_LEVELS) {
+            size_t bits = (size_t)(gamma * reaching + 0.5);
+            if (bits == 0) bits = 1;
+            if (start + bits > BLOCK_LEVEL_BITS) break;
+            b->level_start[levels] = (uint16_t)start;
+            b->level_bits[levels] = (uint16_t)bits;
+            start += bits;
+            levels++;
+            reaching *= 1.0 - exp_neg(reaching / (double)bits);
+        }
+        if (reaching < 0.5 || levels == MAX_BLOCK_LEVELS) {
+            b->level_bits[levels - 1] += (uint16_t)(BLOCK_LEVEL_BITS - start);
+            b->num_levels = levels;
+            b->keys_per_block = load;
+            return true;
+        }
+    }
+    return false;
+}
+
+// Places a superblock's keys level by level. The keys left over are moved
+// to the front of `keys`; returns how many there are.
+static size_t build_block(const BBHashBlocked *b, uint64_t *block, uint64_t keys[], size_t n) {
+    uint64_t seen[BLOCK_WORDS - 1], multi[BLOCK_WORDS - 1];
+    for (unsigned l = 0; l < b->num_levels && n > 0; l++) {
+        memset(seen, 0, sizeof(seen));
+        memset(multi, 0, sizeof(multi));
+        for (size_t i = 0; i < n; i++) {
+            size_t pos = block_slot(b, keys[i], l);
+            uint64_t bit = UINT64_C(1) << (pos % 64);
+            multi[pos / 64] |= seen[pos / 64] & bit;
+            seen[pos / 64] |= bit;
+        }
+        size_t kept = 0;
+        for (size_t i = 0; i < n; i++) {
+            size_t pos = block_slot(b, keys[i], l);
+            if ((multi[pos / 64] >> (pos % 64)) & 1) {
+                keys[kept++] = keys[i];
+            } else {
+                block[1 + pos / 64] |= UINT64_C(1) << (pos % 64);
+            }
+        }
+        n = kept;
+    }
+    return n;
+}
+
+BBHashBlocked *bbhash_blocked_create(const uint64_t keys[], size_t n, const BBHashConfig *config) {
+    if (!(config->gamma >= 1.0)) {
+        fprintf(stderr, "bbhash_blocked_create: gamma must be at least 1.0.\n");
+        return NULL;
+    }
+    BBHashBlocked *b = calloc(1, sizeof(BBHashBlocked));
+    size_t *block_start = NULL;
+    uint64_t *sorted = NULL;
+    if (!b) return NULL;
+    if (!plan_levels(b, config->gamma)) {
+        fprintf(stderr, "bbhash_blocked_create: gamma %.1f leaves no room for a key in a superblock.\n",
+                config->gamma);
+        free(b);
+        return NULL;
+    }
+    b->num_keys = n;
+    b->num_blocks = n / b->keys_per_block + 1;
+    b->blocks = aligned_alloc(BLOCK_BYTES, b->num_blocks * BLOCK_BYTES);
+    block_start = calloc(b->num_blocks + 1, sizeof(size_t));
+    sorted = malloc(sizeof(uint64_t) * (n ? n : 1));
+    if (!b->blocks || !block_start || !sorted) goto failure;
+    memset(b->blocks, 0, b->num_blocks * BLOCK_BYTES);
+
+    // Group the keys by superblock (counting sort).
+    for (size_t i = 0; i < n; i++) block_start[block_of(b, keys[i]) + 1]++;
+    for (size_t k = 0; k < b->num_blocks; k++) block_start[k + 1] += block_start[k];
+    for (size_t i = 0; i < n; i++) sorted[block_start[block_of(b, keys[i])]++] = keys[i];
+    for (size_t k = b->num_blocks; k > 0; k--) block_start[k] = block_start[k - 1];
+    block_start[0] = 0;
+
+    // Build each block; its leftover keys are packed at the front of `sorted`.
+    size_t placed = 0, overflow = 0;
+    for (size_t k = 0; k < b->num_blocks; k++) {
+        uint64_t *block = b->blocks + k * BLOCK_WORDS;
+        size_t count = block_start[k + 1] - block_start[k];
+        uint64_t *block_keys = sorted + block_start[k];
+        size_t left = build_block(b, block, block_keys, count);
+        block[0] = placed;
+        placed += count - left;
+        memmove(sorted + overflow, block_keys, left * sizeof(uint64_t));
+        overflow += left;
+    }
+    b->in_block_keys = placed;
+    b->overflow_keys = overflow;
+    if (overflow > 0) {
+        // The overflow keys are a reordered subset, so per-key options do not
+        // carry over; it is a plain in-memory BBHash.
+        BBHashConfig overflow_config = *config;
+        overflow_config.weights = NULL;
+        overflow_config.hot_keys = NULL;
+        overflow_config.num_hot_keys = 0;
+        overflow_config.checkpoint_dir = NULL;
+        overflow_config.engine = BBHASH_ENGINE_LEVELS;
+        overflow_config.shard = overflow_config.num_shards = 0;
+        b->overflow = bbhash_mphf_create_ex(sorted, overflow, &overflow_config);
+        if (!b->overflow) goto failure;
+    }
+    if (config->verbose) {
+        printf("Blocked: %zu superblocks of %zu keys, %u levels each; %zu keys (%.2f%%) overflow.\n",
+               b->num_blocks, b->keys_per_block, b->num_levels, overflow, n ? 100.0 * overflow / n : 0.0);
+    }
+    free(block_start);
+    free(sorted);
+    return b;
+
+failure:
+    free(block_start);
+    free(sorted);
+    bbhash_blocked_free(b);
+    return NULL;
+}
+
+size_t bbhash_blocked_size_in_bits(const BBHashBlocked *b) {
+    return b->num_blocks * BLOCK_BYTES * 8 + (b->overflow ? bbhash_size_in_bits(b->overflow) : 0);
+}
+
+void bbhash_blocked_stats(const BBHashBlocked *b, BBHashBlockedStats *stats) {
+    *stats = (BBHashBlockedStats) {
+        .num_keys = b->num_keys,
+        .num_blocks = b->num_blocks,
+        .keys_per_block = b->keys_per_block,
+        .block_levels = b->num_levels,
+        .overflow_keys = b->overflow_keys,
+        .size_in_bits = bbhash_blocked_size_in_bits(b),
+    };
+}
+
+void bbhash_blocked_free(BBHashBlocked *b) {
+    if (!b) return;
+    free(b->blocks);
+    bbhash_free(b->overflow);
+    free(b);
+}
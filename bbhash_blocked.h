@@ -0,0 +1,67 @@
+#ifndef BBHASH_BLOCKED_H
+#define BBHASH_BLOCKED_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "bbhash.h"
+
+/*
+ * Locality-blocked BBHash (experimental).
+ *
+ * A query on a BBHash probes one independently placed bit per level and
+ * reads a rank checkpoint for the hit, so a key placed at level 3 costs
+ * about four cache misses. Here each key first hashes to a superblock: one
+ * 64-byte, cache-line aligned region. The first word holds the index of the
+ * superblock's first key. The other 448 bits hold a small BBHash over the
+ * keys of that superblock, with fixed level sizes planned from gamma for
+ * the average load. Every level probe and the rank lie in that one cache
+ * line, so a query costs one memory access.
+ *
+ * Superblock loads vary, so keys that no in-block level places go to an
+ * ordinary BBHash kept beside the blocks. Their indexes follow all the
+ * in-block keys. With gamma 2 this is about 2% of the keys.
+ *
+ * The layout is built and queried in memory only; it has no file format.
+ */
+typedef struct BBHashBlocked BBHashBlocked;
+
+/** @brief Shape of a blocked MPHF, see bbhash_blocked_stats(). */
+typedef struct {
+    size_t num_keys;
+    size_t num_blocks;
+    size_t keys_per_block;     // average load the levels are planned for
+    size_t block_levels;       // levels inside each superblock
+    size_t overflow_keys;      // keys placed by the overflow BBHash
+    size_t size_in_bits;       // superblocks plus the overflow BBHash
+} BBHashBlockedStats;
+
+/**
+ * @brief Builds a blocked MPHF over distinct keys.
+ * @param config Build options; gamma plans the in-block levels and must
+ *        leave room for a key per superblock (at most about 448). The
+ *        overflow BBHash uses the rest of the config, except that it is
+ *        built with BBHASH_ENGINE_LEVELS and without weights, hot keys,
+ *        checkpoints or a shard tag.
+ * @return The MPHF, or NULL on failure.
+ */
+BBHashBlocked *bbhash_blocked_create(const uint64_t keys[], size_t n, const BBHashConfig *config);
+
+/**
+ * @brief Returns the index of a key in [0, n).
+ * @return As bbhash_mphf_query(): arbitrary or (size_t)-1 for non-members.
+ */
+size_t bbhash_blocked_query(const BBHashBlocked *b, uint64_t key);
+
+/**
+ * @brief Queries keys[i] into out[i], prefetching the superblocks of the
+ *        following keys so that their misses overlap.
+ */
+void bbhash_blocked_query_batch(const BBHashBlocked *b, const uint64_t keys[], size_t n, size_t out[]);
+
+void bbhash_blocked_stats(const BBHashBlocked *b, BBHashBlockedStats *stats);
+
+size_t bbhash_blocked_size_in_bits(const BBHashBlocked *b);
+
+void bbhash_blocked_free(BBHashBlocked *b);
+
+#endif // BBHASH_BLOCKED_H
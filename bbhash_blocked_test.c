@@ -0,0 +1,83 @@
+/* bbhash_blocked_test.c - tests for the locality-blocked MPHF.
+ *
+ */
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "mt64.h"
+#include "dedup.h"
+#include "bitarray.h"
+#include "bbhash_blocked.h"
+
+static void check_bijection(const BBHashBlocked *b, const uint64_t keys[], size_t n) {
+    BBHashBlockedStats stats;
+    bbhash_blocked_stats(b, &stats);
+    assert(stats.num_keys == n && stats.overflow_keys <= n);
+    size_t *out = malloc(sizeof(size_t) * (n ? n : 1));
+    bbhash_blocked_query_batch(b, keys, n, out);
+    Bitarray *seen = bitarray_new(n ? n : 1);
+    for (size_t i = 0; i < n; i++) {
+        size_t idx = bbhash_blocked_query(b, keys[i]);
+        assert(idx < n && idx == out[i]);
+        assert(bitarray_get(seen, idx) == 0);
+        bitarray_set(seen, idx);
+    }
+    bitarray_free(seen);
+    free(out);
+}
+
+int main(void) {
+    printf("bbhash_blocked_test\n");
+    size_t n = 1000000;
+    Mt64 *rng = mt64_create(47);
+    uint64_t *keys = malloc(sizeof(uint64_t) * n);
+    for (size_t i = 0; i < n; i++) keys[i] = mt64_gen_int64(rng);
+    mt64_destroy(rng);
+    n = dedup(keys, n);
+
+    const double gammas[] = {1.0, 1.5, 2.0, 4.0};
+    for (size_t g = 0; g < sizeof(gammas) / sizeof(gammas[0]); g++) {
+        BBHashConfig config = bbhash_config_default();
+        config.gamma = gammas[g];
+        BBHashBlocked *b = bbhash_blocked_create(keys, n, &config);
+        assert(b != NULL);
+        check_bijection(b, keys, n);
+        BBHashBlockedStats stats;
+        bbhash_blocked_stats(b, &stats);
+        printf("  gamma %.1f: %zu keys/block, %zu levels, %.2f%% overflow, %.3f bits/key\n", gammas[g],
+               stats.keys_per_block, stats.block_levels, 100.0 * stats.overflow_keys / n,
+               (double)stats.size_in_bits / n);
+        bbhash_blocked_free(b);
+    }
+
+    // Tiny sets: one superblock, possibly with no overflow at all.
+    BBHashConfig config = bbhash_config_default();
+    for (size_t small = 0; small < 300; small += 37) {
+        BBHashBlocked *b = bbhash_blocked_create(keys, small, &config);
+        assert(b != NULL);
+        check_bijection(b, keys, small);
+        bbhash_blocked_free(b);
+    }
+    config.gamma = 0.5;
+    assert(bbhash_blocked_create(keys, n, &config) == NULL);
+    config.gamma = 500.0;  // not even one key fits in a superblock
+    assert(bbhash_blocked_create(keys, n, &config) == NULL);
+
+    // Per-key options and checkpoints are not passed on to the overflow.
+    double *weights = malloc(sizeof(double) * n);
+    for (size_t i = 0; i < n; i++) weights[i] = i < 1000 ? 100.0 : 1.0;
+    config = bbhash_config_default();
+    config.weights = weights;
+    config.checkpoint_dir = "/nonexistent/bbhash_blocked_test";
+    config.engine = BBHASH_ENGINE_PILOTS;
+    BBHashBlocked *b = bbhash_blocked_create(keys, n, &config);
+    assert(b != NULL);
+    check_bijection(b, keys, n);
+    bbhash_blocked_free(b);
+    free(weights);
+
+    free(keys);
+    printf("All tests passed.\n");
+    return 0;
+}
@@ -0,0 +1,648 @@
+#define _POSIX_C_SOURCE 200809L  // mmap, open, fstat under -std=c23
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "dedup.h"
+#include "ingest.h"
+#include "bbhash.h"
+#include "bbhash_shard.h"
+
+/*
+ * bbhash - build, query, inspect and convert MPHF files.
+ *
+ * Key files are read through mmap. Formats:
+ *   bin   raw little-endian uint64_t keys
+ *   dec   one integer per line (decimal, or hex with 0x)
+ *   text  one string per line, hashed to 64 bits with murmur3 (seed 0) by
+ *         the parallel ingestion stage; empty lines are skipped and a
+ *         trailing '\r' is ignored
+ */
+
+typedef enum { KEYS_BIN, KEYS_DEC, KEYS_TEXT } KeyFormat;
+
+constexpr uint64_t TEXT_KEY_SEED = 0;
+constexpr size_t MAX_LINE = 1 << 16;
+
+typedef struct {
+    uint64_t *keys;
+    size_t n;
+    void *map;         // mapping that holds the keys, or NULL if malloc'ed
+    size_t map_len;
+} KeySet;
+
+static double seconds_since(const struct timespec *t0) {
+    struct timespec t1;
+    timespec_get(&t1, TIME_UTC);
+    return (double)(t1.tv_sec - t0->tv_sec) + (t1.tv_nsec - t0->tv_nsec) * 1e-9;
+}
+
+static bool parse_format(const char *name, KeyFormat *fmt) {
+    if (strcmp(name, "bin") == 0) *fmt = KEYS_BIN;
+    else if (strcmp(name, "dec") == 0) *fmt = KEYS_DEC;
+    else if (strcmp(name, "text") == 0) *fmt = KEYS_TEXT;
+    else {
+        fprintf(stderr, "Error: Unknown key format '%s' (use bin, dec or text).\n", name);
+        return false;
+    }
+    return true;
+}
+
+// Parses a byte count with an optional K, M or G suffix.
+static size_t parse_size(const char *arg) {
+    char *end;
+    double v = strtod(arg, &end);
+    switch (*end) {
+    case 'k': case 'K': v *= 1 << 10; break;
+    case 'm': case 'M': v *= 1 << 20; break;
+    case 'g': case 'G': v *= 1 << 30; break;
+    default: break;
+    }
+    return v > 0 ? (size_t)v : 0;
+}
+
+/**
+ * @brief Maps a whole file. A writable mapping is private (copy on write).
+ * @return 0 on success, -1 on failure. Empty files give len 0 and addr NULL.
+ */
+static int map_file(const char *path, bool writable, void **addr, size_t *len) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        perror(path);
+        return -1;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        perror(path);
+        close(fd);
+        return -1;
+    }
+    *len = (size_t)st.st_size;
+    *addr = NULL;
+    if (*len > 0) {
+        int prot = writable ? PROT_READ | PROT_WRITE : PROT_READ;
+        void *p = mmap(NULL, *len, prot, MAP_PRIVATE, fd, 0);
+        if (p == MAP_FAILED) {
+            perror(path);
+            close(fd);
+            return -1;
+        }
+        *addr = p;
+    }
+    close(fd);
+    return 0;
+}
+
+// Reads all of a stream into a malloc'ed buffer.
+static char *read_stream(FILE *fp, size_t *len) {
+    size_t cap = 1 << 20, n = 0;
+    char *buf = malloc(cap);
+    while (buf) {
+        n += fread(buf + n, 1, cap - n, fp);
+        if (n < cap) break;
+        char *bigger = realloc(buf, cap * 2);
+        if (!bigger) {
+            free(buf);
+            buf = NULL;
+            break;
+        }
+        buf = bigger;
+        cap *= 2;
+    }
+    if (!buf) fprintf(stderr, "Error: Out of memory reading input.\n");
+    *len = n;
+    return buf;
+}
+
+// Parses newline-delimited integers into ks->keys.
+static int parse_integers(const char *data, size_t len, KeySet *ks) {
+    size_t lines = 0;
+    for (const char *p = data; p && p < data + len; lines++) {
+        const char *nl = memchr(p, '\n', data + len - p);
+        p = nl ? nl + 1 : NULL;
+    }
+    ks->keys = malloc(sizeof(uint64_t) * (lines ? lines : 1));
+    if (!ks->keys) {
+        fprintf(stderr, "Error: Out of memory for %zu keys.\n", lines);
+        return -1;
+    }
+
+    char line[MAX_LINE + 1];
+    size_t line_no = 0;
+    ks->n = 0;
+    for (const char *p = data; p < data + len;) {
+        const char *nl = memchr(p, '\n', data + len - p);
+        const char *end = nl ? nl : data + len;
+        size_t n = (size_t)(end - p);
+        line_no++;
+        if (n > 0 && p[n - 1] == '\r') n--;
+        if (n >= MAX_LINE) {
+            fprintf(stderr, "Error: Line %zu is longer than %zu bytes.\n", line_no, MAX_LINE);
+            return -1;
+        }
+        memcpy(line, p, n);
+        line[n] = '\0';
+        p = end + 1;
+        if (n == 0) continue;
+
+        // Decimal, or hex after 0x; base 0 would read a leading 0 as octal.
+        int base = line[0] == '0' && (line[1] == 'x' || line[1] == 'X') ? 16 : 10;
+        char *rest;
+        ks->keys[ks->n++] = strtoull(line, &rest, base);
+        if (rest == line || *rest != '\0') {
+            fprintf(stderr, "Error: Line %zu is not an integer: '%s'.\n", line_no, line);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+// Hashes text lines with the ingestion stage.
+static int hash_lines(const char *path, const char *data, size_t len, unsigned threads, KeySet *ks) {
+    TextKeys tk;
+    int status = data ? ingest_text_buffer(data, len, TEXT_KEY_SEED, threads, false, &tk)
+                 : ingest_text_file(path, TEXT_KEY_SEED, threads, false, &tk);
+    if (status != 0) return -1;
+    fprintf(stderr, "Hashed %zu lines (%.1f MB) in %.3f s: %.2f GB/s.\n", tk.num_keys,
+            tk.num_bytes / 1e6, tk.seconds, tk.seconds > 0 ? tk.num_bytes / tk.seconds / 1e9 : 0.0);
+    ks->keys = tk.keys;
+    ks->n = tk.num_keys;
+    return 0;
+}
+
+/**
+ * @brief Loads keys from a file, or from stdin if path is "-".
+ *
+ * Binary files are mapped copy-on-write, so they can be sorted in place for
+ * deduplication without a second copy in memory.
+ */
+static int read_keys(const char *path, KeyFormat fmt, unsigned threads, KeySet *ks) {
+    memset(ks, 0, sizeof(*ks));
+    bool from_stdin = strcmp(path, "-") == 0;
+    if (fmt == KEYS_TEXT && !from_stdin) return hash_lines(path, NULL, 0, threads, ks);
+    char *data = NULL;
+    size_t len = 0;
+    void *map = NULL;
+
+    if (from_stdin) {
+        data = read_stream(stdin, &len);
+        if (!data) return -1;
+    } else {
+        if (map_file(path, fmt == KEYS_BIN, &map, &len) != 0) return -1;
+        data = map;
+    }
+
+    int status = 0;
+    if (fmt == KEYS_BIN) {
+        if (len % sizeof(uint64_t) != 0) {
+            fprintf(stderr, "Error: %s: size %zu is not a multiple of 8 bytes.\n", path, len);
+            status = -1;
+        } else {
+            ks->keys = (uint64_t *)data;
+            ks->n = len / sizeof(uint64_t);
+            ks->map = map;
+            ks->map_len = len;
+            return 0;
+        }
+    } else if (fmt == KEYS_TEXT) {
+        status = hash_lines(path, data, len, threads, ks);
+    } else {
+        status = parse_integers(data, len, ks);
+    }
+
+    if (map) munmap(map, len);
+    else free(data);
+    return status;
+}
+
+static void free_keys(KeySet *ks) {
+    if (ks->map) munmap(ks->map, ks->map_len);
+    else free(ks->keys);
+    memset(ks, 0, sizeof(*ks));
+}
+
+// The format version from the magic at the start of an MPHF file, or 0.
+static int file_version(const char *path) {
+    FILE *fp = fopen(path, "rb");
+    if (!fp) return 0;
+    char magic[4];
+    int version = 0;
+    if (fread(magic, 1, 4, fp) == 4 && memcmp(magic, "BBH", 3) == 0) version = magic[3] - '0';
+    fclose(fp);
+    return version;
+}
+
+// True for a merged file written by bbhash_shard_merge().
+static bool is_sharded_file(const char *path) {
+    FILE *fp = fopen(path, "rb");
+    if (!fp) return false;
+    char magic[4];
+    bool sharded = fread(magic, 1, 4, fp) == 4 && memcmp(magic, "BBS1", 4) == 0;
+    fclose(fp);
+    return sharded;
+}
+
+// Parses "i/N" with i < N.
+static bool parse_shard(const char *arg, uint32_t *shard, uint32_t *num_shards) {
+    char *end;
+    unsigned long i = strtoul(arg, &end, 10);
+    if (*end != '/') return false;
+    unsigned long count = strtoul(end + 1, &end, 10);
+    if (*end != '\0' || count == 0 || count > UINT32_MAX || i >= count) return false;
+    *shard = (uint32_t)i;
+    *num_shards = (uint32_t)count;
+    return true;
+}
+
+static int cmd_build(int argc, char *argv[]) {
+    BBHashConfig config = bbhash_config_default();
+    KeyFormat fmt = KEYS_BIN;
+    int version = BBHASH_FORMAT_VERSION;
+    bool do_dedup = true, verify = false;
+    const char *paths[2];
+    const char *hot_path = NULL;
+    int npaths = 0;
+    uint32_t shard = 0, num_shards = 0;
+
+    for (int i = 0; i < argc; i++) {
+        const char *value = i + 1 < argc ? argv[i + 1] : NULL;
+        bool takes_value = true;
+        if (strcmp(argv[i], "-f") == 0 || strcmp(argv[i], "--format") == 0) {
+            if (value && !parse_format(value, &fmt)) return EXIT_FAILURE;
+        } else if (strcmp(argv[i], "-g") == 0 || strcmp(argv[i], "--gamma") == 0) {
+            if (value) config.gamma = strtod(value, NULL);
+        } else if (strcmp(argv[i], "-t") == 0 || strcmp(argv[i], "--threads") == 0) {
+            if (value) config.threads = (unsigned)strtoul(value, NULL, 0);
+        } else if (strcmp(argv[i], "-m") == 0 || strcmp(argv[i], "--memory") == 0) {
+            if (value) config.memory_budget = parse_size(value);
+        } else if (strcmp(argv[i], "-c") == 0 || strcmp(argv[i], "--compact-from") == 0) {
+            if (value) config.compact_from_level = strtoul(value, NULL, 0);
+        } else if (strcmp(argv[i], "-V") == 0 || strcmp(argv[i], "--version") == 0) {
+            if (value) version = atoi(value);
+        } else if (strcmp(argv[i], "--hot") == 0) {
+            hot_path = value;
+        } else if (strcmp(argv[i], "--checkpoint") == 0) {
+            config.checkpoint_dir = value;
+        } else if (strcmp(argv[i], "--shard") == 0) {
+            if (value && !parse_shard(value, &shard, &num_shards)) {
+                fprintf(stderr, "Error: --shard needs i/N with i < N.\n");
+                return EXIT_FAILURE;
+            }
+        } else if (strcmp(argv[i], "-H") == 0 || strcmp(argv[i], "--hash") == 0) {
+            if (value && strcmp(value, "seeded") == 0) config.hash_scheme = BBHASH_HASH_SEEDED;
+            else if (value && strcmp(value, "base128") == 0) config.hash_scheme = BBHASH_HASH_BASE128;
+            else if (value) {
+                fprintf(stderr, "Error: Unknown hash scheme '%s' (seeded or base128).\n", value);
+                return EXIT_FAILURE;
+            }
+        } else if (strcmp(argv[i], "-e") == 0 || strcmp(argv[i], "--engine") == 0) {
+            if (value && strcmp(value, "levels") == 0) config.engine = BBHASH_ENGINE_LEVELS;
+            else if (value && strcmp(value, "pilots") == 0) config.engine = BBHASH_ENGINE_PILOTS;
+            else if (value) {
+                fprintf(stderr, "Error: Unknown engine '%s' (levels or pilots).\n", value);
+                return EXIT_FAILURE;
+            }
+        } else {
+            takes_value = false;
+            if (strcmp(argv[i], "--no-dedup") == 0) do_dedup = false;
+            else if (strcmp(argv[i], "--verify") == 0) verify = true;
+            else if (strcmp(argv[i], "-v") == 0 || strcmp(argv[i], "--verbose") == 0) config.verbose = true;
+            else if (argv[i][0] == '-' && argv[i][1] != '\0') {
+                fprintf(stderr, "Error: Unknown build option '%s'.\n", argv[i]);
+                return EXIT_FAILURE;
+            } else if (npaths < 2) paths[npaths++] = argv[i];
+            else {
+                fprintf(stderr, "Error: Unexpected argument '%s'.\n", argv[i]);
+                return EXIT_FAILURE;
+            }
+        }
+        if (takes_value) {
+            if (!value) {
+                fprintf(stderr, "Error: Missing value for '%s'.\n", argv[i]);
+                return EXIT_FAILURE;
+            }
+            i++;
+        }
+    }
+    if (npaths != 2) {
+        fprintf(stderr, "Error: build needs <keys> and <index>.\n");
+        return EXIT_FAILURE;
+    }
+    if (!(config.gamma >= 1.0)) {
+        fprintf(stderr, "Error: gamma must be at least 1.0.\n");
+        return EXIT_FAILURE;
+    }
+
+    struct timespec t0;
+    timespec_get(&t0, TIME_UTC);
+    KeySet ks;
+    if (read_keys(paths[0], fmt, config.threads, &ks) != 0) return EXIT_FAILURE;
+    size_t n = ks.n;
+    if (do_dedup) n = dedup(ks.keys, ks.n);
+    fprintf(stderr, "Read %zu keys (%zu duplicates%s removed) in %.2f s.\n", ks.n, ks.n - n,
+            fmt == KEYS_TEXT ? " or hash collisions" : "", seconds_since(&t0));
+    if (num_shards) {
+        // In place: the selection never overtakes the read position.
+        n = bbhash_shard_select(ks.keys, n, shard, num_shards, ks.keys);
+        fprintf(stderr, "Kept %zu keys of shard %u/%u.\n", n, shard, num_shards);
+        config.shard = shard;  // recorded in the file for merge
+        config.num_shards = num_shards;
+    }
+
+    // Hot keys are read in the same format, so text lines hash the same way.
+    KeySet hot = {0};
+    if (hot_path) {
+        if (read_keys(hot_path, fmt, config.threads, &hot) != 0) {
+            free_keys(&ks);
+            return EXIT_FAILURE;
+        }
+        config.hot_keys = hot.keys;
+        config.num_hot_keys = hot.n;
+        fprintf(stderr, "Read %zu hot keys.\n", hot.n);
+    }
+
+    timespec_get(&t0, TIME_UTC);
+    BBHash *mphf = NULL;
+    char state_path[4096];
+    snprintf(state_path, sizeof(state_path), "%s/state", config.checkpoint_dir ? config.checkpoint_dir : ".");
+    if (config.checkpoint_dir && access(state_path, F_OK) == 0) {
+        fprintf(stderr, "Resuming from the checkpoint in %s.\n", config.checkpoint_dir);
+        mphf = bbhash_mphf_resume(&config);
+        BBHashStats stats;
+        if (mphf) bbhash_mphf_stats(mphf, &stats);
+        if (mphf && stats.num_keys != n) {
+            fprintf(stderr, "Error: the checkpoint is for %zu keys, not %zu.\n", stats.num_keys, n);
+            bbhash_free(mphf);
+            mphf = NULL;
+        }
+    } else {
+        mphf = bbhash_mphf_create_ex(ks.keys, n, &config);
+    }
+    free_keys(&hot);
+    if (!mphf) {
+        fprintf(stderr, "Error: Failed to build the MPHF.\n");
+        free_keys(&ks);
+        return EXIT_FAILURE;
+    }
+    fprintf(stderr, "Built MPHF for %zu keys in %.2f s (%u threads): %.3f bits/key.\n",
+            n, seconds_since(&t0), config.threads, n ? (double)bbhash_size_in_bits(mphf) / n : 0.0);
+
+    int status = EXIT_SUCCESS;
+    if (verify && bbhash_mphf_verify(mphf, ks.keys, n, config.threads) != 0) status = EXIT_FAILURE;
+    if (status == EXIT_SUCCESS && bbhash_mphf_save_ex(mphf, paths[1], version) != 0) status = EXIT_FAILURE;
+    // The checkpoint is kept until the index is safely saved.
+    if (status == EXIT_SUCCESS && config.checkpoint_dir) bbhash_checkpoint_remove(config.checkpoint_dir);
+    bbhash_free(mphf);
+    free_keys(&ks);
+    return status;
+}
+
+// Queries a merged file: one dispatch to the key's shard per key.
+static int query_sharded(const char *index, const char *input, KeyFormat fmt, unsigned threads, bool use_mmap,
+                         unsigned flags) {
+    BBHashSharded *s = use_mmap ? bbhash_sharded_mmap(index, flags) : bbhash_sharded_load(index, flags);
+    if (!s) return EXIT_FAILURE;
+    KeySet ks;
+    if (read_keys(input, fmt, threads, &ks) != 0) {
+        bbhash_sharded_free(s);
+        return EXIT_FAILURE;
+    }
+    static char out_buf[1 << 16];
+    setvbuf(stdout, out_buf, _IOFBF, sizeof(out_buf));
+    size_t num_keys = bbhash_sharded_num_keys(s);
+    for (size_t i = 0; i < ks.n; i++) {
+        size_t idx = bbhash_sharded_query(s, ks.keys[i]);
+        if (idx < num_keys) printf("%zu\n", idx);
+        else fputs("-1\n", stdout);
+    }
+    fflush(stdout);
+    free_keys(&ks);
+    bbhash_sharded_free(s);
+    return EXIT_SUCCESS;
+}
+
+static int cmd_query(int argc, char *argv[]) {
+    KeyFormat fmt = KEYS_BIN;
+    unsigned threads = 1;
+    bool use_mmap = true;
+    unsigned flags = 0;
+    const char *index = NULL, *input = "-";
+
+    for (int i = 0; i < argc; i++) {
+        if (strcmp(argv[i], "-f") == 0 || strcmp(argv[i], "--format") == 0) {
+            if (i + 1 >= argc) {
+                fprintf(stderr, "Error: Missing value for '%s'.\n", argv[i]);
+                return EXIT_FAILURE;
+            }
+            if (!parse_format(argv[++i], &fmt)) return EXIT_FAILURE;
+        } else if (strcmp(argv[i], "-t") == 0 || strcmp(argv[i], "--threads") == 0) {
+            if (i + 1 >= argc) {
+                fprintf(stderr, "Error: Missing value for '%s'.\n", argv[i]);
+                return EXIT_FAILURE;
+            }
+            threads = (unsigned)strtoul(argv[++i], NULL, 0);
+        } else if (strcmp(argv[i], "--no-mmap") == 0) {
+            use_mmap = false;
+        } else if (strcmp(argv[i], "--verify") == 0) {
+            flags |= BBHASH_LOAD_VERIFY;
+        } else if (argv[i][0] == '-' && argv[i][1] != '\0') {
+            fprintf(stderr, "Error: Unknown query option '%s'.\n", argv[i]);
+            return EXIT_FAILURE;
+        } else if (!index) {
+            index = argv[i];
+        } else {
+            input = argv[i];
+        }
+    }
+    if (!index) {
+        fprintf(stderr, "Error: query needs <index>.\n");
+        return EXIT_FAILURE;
+    }
+
+    if (is_sharded_file(index)) return query_sharded(index, input, fmt, threads, use_mmap, flags);
+    BBHash *mphf = use_mmap ? bbhash_mphf_mmap(index, flags) : bbhash_mphf_load_ex(index, flags);
+    if (!mphf) return EXIT_FAILURE;
+    KeySet ks;
+    if (read_keys(input, fmt, threads, &ks) != 0) {
+        bbhash_free(mphf);
+        return EXIT_FAILURE;
+    }
+
+    // Keys outside the set usually map to some index anyway; only a miss on
+    // every level is reported, as -1.
+    BBHashStats stats;
+    bbhash_mphf_stats(mphf, &stats);
+    static char out_buf[1 << 16];
+    setvbuf(stdout, out_buf, _IOFBF, sizeof(out_buf));
+    static size_t indexes[4096];
+    for (size_t first = 0; first < ks.n; first += 4096) {
+        size_t count = ks.n - first < 4096 ? ks.n - first : 4096;
+        bbhash_mphf_query_batch(mphf, ks.keys + first, count, indexes);
+        for (size_t i = 0; i < count; i++) {
+            if (indexes[i] < stats.num_keys) printf("%zu\n", indexes[i]);
+            else fputs("-1\n", stdout);
+        }
+    }
+    fflush(stdout);
+
+    free_keys(&ks);
+    bbhash_free(mphf);
+    return EXIT_SUCCESS;
+}
+
+static int stats_sharded(const char *path) {
+    BBHashSharded *s = bbhash_sharded_mmap(path, BBHASH_LOAD_VERIFY);
+    if (!s) return EXIT_FAILURE;
+    size_t num_keys = bbhash_sharded_num_keys(s), total_bits = 0;
+    printf("file:          %s\n", path);
+    printf("format:        BBS1 (checksums verified)\n");
+    printf("keys:          %zu\n", num_keys);
+    printf("shards:        %zu\n\n", bbhash_sharded_num_shards(s));
+    printf("%5s %12s %12s %8s %8s\n", "shard", "key offset", "keys", "levels", "bits/key");
+    for (size_t i = 0; i < bbhash_sharded_num_shards(s); i++) {
+        size_t offset;
+        BBHashStats stats;
+        bbhash_mphf_stats(bbhash_sharded_shard(s, i, &offset), &stats);
+        printf("%5zu %12zu %12zu %8zu %8.3f\n", i, offset, stats.num_keys, stats.num_levels + stats.tail_levels,
+               stats.num_keys ? (double)stats.size_in_bits / stats.num_keys : 0.0);
+        total_bits += stats.size_in_bits;
+    }
+    printf("\nsize:          %zu bits (%.2f MB), %.3f bits/key\n", total_bits, total_bits / (8.0 * 1024 * 1024),
+           num_keys ? (double)total_bits / num_keys : 0.0);
+    bbhash_sharded_free(s);
+    return EXIT_SUCCESS;
+}
+
+static int cmd_stats(int argc, char *argv[]) {
+    if (argc != 1) {
+        fprintf(stderr, "Error: stats needs exactly one <index>.\n");
+        return EXIT_FAILURE;
+    }
+    if (is_sharded_file(argv[0])) return stats_sharded(argv[0]);
+    int version = file_version(argv[0]);
+    BBHash *mphf = bbhash_mphf_mmap(argv[0], BBHASH_LOAD_VERIFY);
+    if (!mphf) return EXIT_FAILURE;
+
+    BBHashStats stats;
+    bbhash_mphf_stats(mphf, &stats);
+    printf("file:          %s\n", argv[0]);
+    printf("format:        BBH%d (%s)\n", version, version >= 3 ? "checksums verified" : "no checksums");
+    printf("keys:          %zu\n", stats.num_keys);
+    static const char *const scheme_names[] = {"seeded", "base128", "key128"};
+    printf("hash scheme:   %s\n", scheme_names[stats.hash_scheme]);
+    if (stats.num_shards) printf("shard:         %u/%u\n", stats.shard, stats.num_shards);
+    printf("size:          %zu bits (%.2f MB), %.3f bits/key\n", stats.size_in_bits,
+           stats.size_in_bits / (8.0 * 1024 * 1024), stats.num_keys ? (double)stats.size_in_bits / stats.num_keys : 0.0);
+    if (stats.engine == BBHASH_ENGINE_PILOTS) {
+        printf("engine:        pilots, %zu buckets\n", stats.num_buckets);
+        bbhash_free(mphf);
+        return EXIT_SUCCESS;
+    }
+    printf("levels:        %zu", stats.num_levels);
+    if (stats.tail_levels) printf(" + %zu in compact tail (%zu keys)", stats.tail_levels, stats.tail_keys);
+    printf("\n\n%5s %8s %12s %12s %12s %8s\n", "level", "seed", "offset", "keys", "slots", "bits/key");
+
+    BBHashLevelInfo info;
+    for (size_t l = 0; bbhash_mphf_level_info(mphf, l, &info); l++) {
+        printf("%5zu %8llu %12zu %12zu %12zu %8.2f%s\n", l, (unsigned long long)info.seed, info.offset,
+               info.num_keys, info.num_slots, info.num_keys ? (double)info.size_in_bits / info.num_keys : 0.0,
+               info.num_blocks ? "  (weighted blocks)" : "");
+    }
+    bbhash_free(mphf);
+    return EXIT_SUCCESS;
+}
+
+static int cmd_convert(int argc, char *argv[]) {
+    int version = BBHASH_FORMAT_VERSION;
+    const char *paths[2];
+    int npaths = 0;
+    for (int i = 0; i < argc; i++) {
+        if (strcmp(argv[i], "-V") == 0 || strcmp(argv[i], "--version") == 0) {
+            if (i + 1 >= argc) {
+                fprintf(stderr, "Error: Missing value for '%s'.\n", argv[i]);
+                return EXIT_FAILURE;
+            }
+            version = atoi(argv[++i]);
+        } else if (npaths < 2) {
+            paths[npaths++] = argv[i];
+        } else {
+            fprintf(stderr, "Error: Unexpected argument '%s'.\n", argv[i]);
+            return EXIT_FAILURE;
+        }
+    }
+    if (npaths != 2) {
+        fprintf(stderr, "Error: convert needs <in> and <out>.\n");
+        return EXIT_FAILURE;
+    }
+
+    BBHash *mphf = bbhash_mphf_load_ex(paths[0], BBHASH_LOAD_VERIFY);
+    if (!mphf) return EXIT_FAILURE;
+    int status = bbhash_mphf_save_ex(mphf, paths[1], version) == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+    bbhash_free(mphf);
+    return status;
+}
+
+static int cmd_merge(int argc, char *argv[]) {
+    if (argc < 2) {
+        fprintf(stderr, "Error: merge needs <out> and at least one shard.\n");
+        return EXIT_FAILURE;
+    }
+    if (bbhash_shard_merge((const char *const *)argv + 1, (size_t)argc - 1, argv[0]) != 0) return EXIT_FAILURE;
+    fprintf(stderr, "Merged %d shards into %s.\n", argc - 1, argv[0]);
+    return EXIT_SUCCESS;
+}
+
+void print_usage(const char* prog_name);
+
+int main(int argc, char* argv[]) {
+    if (argc < 2 || strcmp(argv[1], "-h") == 0 || strcmp(argv[1], "--help") == 0) {
+        print_usage(argv[0]);
+        return argc < 2 ? EXIT_FAILURE : EXIT_SUCCESS;
+    }
+    if (strcmp(argv[1], "build") == 0) return cmd_build(argc - 2, argv + 2);
+    if (strcmp(argv[1], "query") == 0) return cmd_query(argc - 2, argv + 2);
+    if (strcmp(argv[1], "stats") == 0) return cmd_stats(argc - 2, argv + 2);
+    if (strcmp(argv[1], "convert") == 0) return cmd_convert(argc - 2, argv + 2);
+    if (strcmp(argv[1], "merge") == 0) return cmd_merge(argc - 2, argv + 2);
+
+    fprintf(stderr, "Error: Unknown command '%s'.\n", argv[1]);
+    print_usage(argv[0]);
+    return EXIT_FAILURE;
+}
+
+void print_usage(const char* prog_name) {
+    fprintf(stderr, "Usage: %s <command> [options]\n\n", prog_name);
+    fprintf(stderr, "Commands:\n");
+    fprintf(stderr, "  build [options] <keys> <index>   Build an MPHF from a key file ('-' for stdin).\n");
+    fprintf(stderr, "      -f, --format <fmt>      Key format: bin (uint64_t), dec or text lines. Default: bin\n");
+    fprintf(stderr, "      -g, --gamma <f>         Bits per key in each level. Default: 2.0\n");
+    fprintf(stderr, "      -t, --threads <n>       Threads for text ingestion, hashing and --verify. Default: 1\n");
+    fprintf(stderr, "      -m, --memory <bytes>    Construction scratch memory budget (K/M/G suffix).\n");
+    fprintf(stderr, "      -c, --compact-from <l>  Pack level l and deeper into a compact tail.\n");
+    fprintf(stderr, "      -V, --version <v>       File format version (1-%d). Default: %d\n",
+            BBHASH_FORMAT_VERSION, BBHASH_FORMAT_VERSION);
+    fprintf(stderr, "      --hot <keys>            Keys to place at level 0 first, in the same format.\n");
+    fprintf(stderr, "      -H, --hash <scheme>     seeded (rehash per level) or base128 (hash once). Default: seeded\n");
+    fprintf(stderr, "      -e, --engine <e>        levels (BBHash) or pilots (one probe, slower build). Default: levels\n");
+    fprintf(stderr, "      --shard <i/N>           Keep only the keys of shard i of N (see merge).\n");
+    fprintf(stderr, "      --checkpoint <dir>      Save each finished level in dir; resume from it if present.\n");
+    fprintf(stderr, "      --no-dedup              Trust that the keys are unique.\n");
+    fprintf(stderr, "      --verify                Check the MPHF before saving it.\n");
+    fprintf(stderr, "      -v, --verbose           Print per-level statistics.\n");
+    fprintf(stderr, "  query [options] <index> [keys]   Print the index of each key (default: stdin).\n");
+    fprintf(stderr, "      -f, --format <fmt>      Key format, as for build. Default: bin\n");
+    fprintf(stderr, "      -t, --threads <n>       Threads for text ingestion. Default: 1\n");
+    fprintf(stderr, "      --no-mmap               Load the index instead of mapping it.\n");
+    fprintf(stderr, "      --verify                Check the index checksums first.\n");
+    fprintf(stderr, "  stats <index>                    Verify an index and print its levels or shards.\n");
+    fprintf(stderr, "  convert [-V <v>] <in> <out>      Rewrite an index in another format version.\n");
+    fprintf(stderr, "  merge <out> <shard>...           Combine shard indexes, in shard order, into one file.\n");
+}
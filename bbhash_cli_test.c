@@ -0,0 +1,60 @@
+/* bbhash_cli_test.c - tests for the command-line tool's key parsing.
+ *
+ * Includes the tool itself, with its main() renamed, to reach the static
+ * helpers.
+ */
+
+#define main bbhash_cli_main
+#include "bbhash_cli.c"
+#undef main
+
+#include <assert.h>
+
+static const char *const KEY_FILE = "bbhash_cli_test.txt";
+static const char *const INDEX_FILE = "bbhash_cli_test.bbh";
+
+static void write_text(const char *path, const char *text) {
+    FILE *fp = fopen(path, "w");
+    assert(fp && fputs(text, fp) >= 0);
+    fclose(fp);
+}
+
+int main(void) {
+    printf("bbhash_cli_test\n");
+
+    // Zero-padded lines are decimal; only 0x or 0X switches to hex.
+    write_text(KEY_FILE, "08\n09\n010\n0x10\n0X1f\n00000000000000000042\r\n\n7\n");
+    const uint64_t expected[] = {8, 9, 10, 16, 31, 42, 7};
+    const size_t n = sizeof(expected) / sizeof(expected[0]);
+    KeySet ks;
+    assert(read_keys(KEY_FILE, KEYS_DEC, 1, &ks) == 0);
+    assert(ks.n == n);
+    for (size_t i = 0; i < n; i++) assert(ks.keys[i] == expected[i]);
+    free_keys(&ks);
+
+    // A build over the same file holds exactly those keys.
+    char *build_argv[] = {"bbhash", "build", "-f", "dec", (char *)KEY_FILE, (char *)INDEX_FILE};
+    assert(bbhash_cli_main(6, build_argv) == EXIT_SUCCESS);
+    BBHash *mphf = bbhash_mphf_load(INDEX_FILE);
+    assert(mphf != NULL);
+    bool seen[sizeof(expected) / sizeof(expected[0])] = {false};
+    for (size_t i = 0; i < n; i++) {
+        size_t idx = bbhash_mphf_query(mphf, expected[i]);
+        assert(idx < n && !seen[idx]);
+        seen[idx] = true;
+    }
+    bbhash_free(mphf);
+
+    // Malformed lines are refused: no hex digits after 0x, hex without 0x.
+    write_text(KEY_FILE, "10\n0x\n");
+    assert(read_keys(KEY_FILE, KEYS_DEC, 1, &ks) != 0);
+    free_keys(&ks);
+    write_text(KEY_FILE, "1f\n");
+    assert(read_keys(KEY_FILE, KEYS_DEC, 1, &ks) != 0);
+    free_keys(&ks);
+
+    remove(KEY_FILE);
+    remove(INDEX_FILE);
+    printf("All tests passed.\n");
+    return 0;
+}
@@ -0,0 +1,119 @@
+/* bbhash_disk_test.c - tests for on-disk queries of saved MPHF files.
+ *
+ */
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "mt64.h"
+#include "dedup.h"
+#include "bbhash.h"
+
+constexpr size_t NUM_KEYS = 200000;
+
+// Every key gets the same index on disk as in memory, one by one and in batches.
+static void check_disk(const BBHash *mphf, const char *file, const BBHashDiskConfig *config,
+                       const uint64_t keys[], size_t n, size_t *out) {
+    BBHashDisk *disk = bbhash_disk_open(file, config);
+    assert(disk != NULL);
+    assert(bbhash_disk_query_batch(disk, keys, n, out) == 0);
+    for (size_t i = 0; i < n; i++) assert(out[i] == bbhash_mphf_query(mphf, keys[i]));
+    for (size_t i = 0; i < n; i += 97) assert(bbhash_disk_query(disk, keys[i]) == out[i]);
+
+    BBHashDiskStats stats;
+    bbhash_disk_stats(disk, &stats);
+    assert(stats.num_keys == n);
+    assert(stats.reads > 0 || stats.cached_levels == stats.num_levels);
+    bbhash_disk_close(disk);
+}
+
+int main(void) {
+    printf("bbhash_disk_test\n");
+    size_t buffer_size = NUM_KEYS + NUM_KEYS / 100 + 100;
+    uint64_t *keys = malloc(sizeof(uint64_t) * buffer_size);
+    size_t *out = malloc(sizeof(size_t) * NUM_KEYS);
+    mt64_fill_u64_parallel(48, keys, buffer_size, 1);
+    size_t n = dedup(keys, buffer_size);
+    if (n > NUM_KEYS) n = NUM_KEYS;
+    const char *file = "bbhash_disk_test.bbh";
+
+    BBHashConfig config = bbhash_config_default();
+    BBHash *mphf = bbhash_mphf_create_ex(keys, n, &config);
+    assert(mphf && bbhash_mphf_save(mphf, file) == 0);
+    BBHashDiskConfig disk_config = bbhash_disk_config_default();
+    check_disk(mphf, file, &disk_config, keys, n, out);
+    BBHashDisk *disk = bbhash_disk_open(file, NULL);
+    BBHashDiskStats stats;
+    bbhash_disk_stats(disk, &stats);
+    printf("  %zu levels, %zu bytes in memory, %zu on disk, %s, %s\n", stats.num_levels, stats.memory_bytes,
+           stats.disk_bytes, stats.direct_io ? "direct I/O" : "buffered", stats.uring ? "io_uring" : "pread");
+    assert(stats.cached_levels == 0 && stats.disk_bytes * 8 <= bbhash_size_in_bits(mphf));
+    bbhash_disk_close(disk);
+
+    // Buffered reads, pread() only, a queue deeper than the ring, and verification.
+    disk_config.direct_io = false;
+    check_disk(mphf, file, &disk_config, keys, n, out);
+    disk_config.use_uring = false;
+    disk_config.queue_depth = 5;
+    check_disk(mphf, file, &disk_config, keys, n, out);
+    disk_config = bbhash_disk_config_default();
+    disk_config.queue_depth = 1000;
+    disk_config.load_flags = BBHASH_LOAD_VERIFY;
+    check_disk(mphf, file, &disk_config, keys, n, out);
+
+    // Caching the deepest levels, then all of them.
+    disk_config = bbhash_disk_config_default();
+    disk_config.cache_bytes = 16384;
+    disk = bbhash_disk_open(file, &disk_config);
+    bbhash_disk_stats(disk, &stats);
+    assert(stats.cached_levels > 0 && stats.cached_levels < stats.num_levels);
+    bbhash_disk_close(disk);
+    check_disk(mphf, file, &disk_config, keys, n, out);
+    disk_config.cache_bytes = SIZE_MAX;
+    check_disk(mphf, file, &disk_config, keys, n, out);
+    bbhash_free(mphf);
+
+    // Base128 hashing with a compact tail and a weighted level 0, in format version 2 and 3.
+    config.hash_scheme = BBHASH_HASH_BASE128;
+    config.compact_from_level = 3;
+    config.hot_keys = keys;
+    config.num_hot_keys = n / 10;
+    mphf = bbhash_mphf_create_ex(keys, n, &config);
+    assert(mphf && bbhash_mphf_save(mphf, file) == 0);
+    check_disk(mphf, file, NULL, keys, n, out);
+    bbhash_free(mphf);
+    config = bbhash_config_default();
+    config.compact_from_level = 2;
+    mphf = bbhash_mphf_create_ex(keys, n, &config);
+    assert(mphf && bbhash_mphf_save_ex(mphf, file, 2) == 0);
+    check_disk(mphf, file, NULL, keys, n, out);
+
+    // An MPHF over 128-bit keys is refused.
+    BBHashKey128 *wide = malloc(sizeof(BBHashKey128) * 1000);
+    for (size_t i = 0; i < 1000; i++) wide[i] = (BBHashKey128) { .lo = keys[i], .hi = i };
+    config = bbhash_config_default();
+    BBHash *wide_mphf = bbhash_mphf_create128(wide, 1000, &config);
+    assert(wide_mphf && bbhash_mphf_save(wide_mphf, file) == 0);
+    assert(bbhash_disk_open(file, NULL) == NULL);
+    bbhash_free(wide_mphf);
+    free(wide);
+
+    // A truncated file is refused.
+    assert(bbhash_mphf_save(mphf, file) == 0);
+    static char head[4096];
+    FILE *fp = fopen(file, "rb");
+    assert(fp && fread(head, 1, sizeof(head), fp) == sizeof(head));
+    fclose(fp);
+    fp = fopen(file, "wb");
+    assert(fp && fwrite(head, 1, sizeof(head), fp) == sizeof(head));
+    fclose(fp);
+    assert(bbhash_disk_open(file, NULL) == NULL);
+    remove(file);
+    assert(bbhash_disk_open(file, NULL) == NULL);
+
+    bbhash_free(mphf);
+    free(keys);
+    free(out);
+    printf("All tests passed.\n");
+    return 0;
+}
@@ -0,0 +1,394 @@
+#define _POSIX_C_SOURCE 200809L  // pthread_rwlock_t under -std=c23
+
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <pthread.h>
+#include "bitarray.h"
+#include "dedup.h"
+#include "bbhash.h"
+#include "bbhash_dynamic.h"
+
+// Start a compaction when this many deltas are stacked, whatever their size,
+// since every delta costs an extra probe for keys that are not in the base.
+constexpr size_t MAX_DELTAS = 16;
+
+typedef struct {
+    BBHash *mphf;
+    size_t offset;     // first global index of this layer
+    size_t num_keys;
+} BBHashDelta;
+
+struct BBHashDynamic {
+    pthread_rwlock_t lock;       // readers: queries; writers: insert/remove/merge
+    double gamma;
+    double compact_ratio;
+
+    BBHash *base;
+    size_t base_keys;
+    BBHashDelta *deltas;
+    size_t num_deltas;
+    size_t cap_deltas;
+
+    uint64_t *keys;              // key stored at each global index
+    Bitarray *tombstones;        // one bit per global index
+    size_t num_slots;            // global index range in use
+    size_t cap_slots;
+    size_t num_removed;
+
+    pthread_mutex_t compact_mutex;  // guards the fields below
+    pthread_t compactor;
+    bool compactor_started;
+    bool compacting;
+    int compact_status;
+};
+
+/**
+ * @brief Makes room for at least `need` global indexes. Caller holds the write lock.
+ */
+static bool ensure_slots(BBHashDynamic *d, size_t need) {
+    if (need <= d->cap_slots) return true;
+
+    size_t cap = d->cap_slots ? d->cap_slots : 64;
+    while (cap < need) cap *= 2;
+
+    uint64_t *keys = realloc(d->keys, sizeof(uint64_t) * cap);
+    if (!keys) return false;
+    d->keys = keys;
+
+    Bitarray *tombstones = bitarray_new(cap);
+    if (!tombstones) return false;
+    if (d->tombstones) {
+        memcpy(tombstones->bits, d->tombstones->bits, ((d->cap_slots + 63) / 64) * sizeof(uint64_t));
+        bitarray_free(d->tombstones);
+    }
+    d->tombstones = tombstones;
+    d->cap_slots = cap;
+    return true;
+}
+
+/**
+ * @brief Global index of a live key, or (size_t)-1. Caller holds the lock.
+ *
+ * A key may occupy a tombstoned slot in one layer and a live slot in a later
+ * one if it was removed and inserted again, so a tombstone does not end the
+ * search.
+ */
+static size_t find_locked(const BBHashDynamic *d, uint64_t key) {
+    if (d->base) {
+        size_t idx = bbhash_mphf_query(d->base, key);
+        if (idx < d->base_keys && d->keys[idx] == key && !bitarray_get(d->tombstones, idx)) {
+            return idx;
+        }
+    }
+    for (size_t i = d->num_deltas; i-- > 0;) {
+        const BBHashDelta *delta = &d->deltas[i];
+        size_t idx = bbhash_mphf_query(delta->mphf, key);
+        if (idx < delta->num_keys) {
+            idx += delta->offset;
+            if (d->keys[idx] == key && !bitarray_get(d->tombstones, idx)) {
+                return idx;
+            }
+        }
+    }
+    return (size_t) -1;
+}
+
+static bool needs_compaction(const BBHashDynamic *d) {
+    size_t pending = (d->num_slots - d->base_keys) + d->num_removed;
+    return d->num_deltas >= MAX_DELTAS || (double)pending > d->compact_ratio * (double)d->base_keys;
+}
+
+BBHashDynamic *bbhash_dynamic_create(const uint64_t keys[], size_t n, double gamma, double compact_ratio) {
+    BBHashDynamic *d = calloc(1, sizeof(BBHashDynamic));
+    if (!d) return NULL;
+    d->gamma = gamma;
+    d->compact_ratio = compact_ratio;
+    pthread_rwlock_init(&d->lock, NULL);
+    pthread_mutex_init(&d->compact_mutex, NULL);
+
+    if (!ensure_slots(d, n)) goto failure;
+    if (n > 0) {
+        d->base = bbhash_mphf_create(keys, n, gamma, false);
+        if (!d->base) goto failure;
+        for (size_t i = 0; i < n; i++) {
+            d->keys[bbhash_mphf_query(d->base, keys[i])] = keys[i];
+        }
+    }
+    d->base_keys = n;
+    d->num_slots = n;
+    return d;
+
+failure:
+    bbhash_dynamic_free(d);
+    return NULL;
+}
+
+size_t bbhash_dynamic_insert(BBHashDynamic *d, const uint64_t keys[], size_t n) {
+    if (n == 0) return 0;
+
+    uint64_t *fresh = malloc(sizeof(uint64_t) * n);
+    if (!fresh) return (size_t) -1;
+    memcpy(fresh, keys, sizeof(uint64_t) * n);
+    n = dedup(fresh, n);
+
+    pthread_rwlock_wrlock(&d->lock);
+
+    size_t added = 0;
+    for (size_t i = 0; i < n; i++) {
+        if (find_locked(d, fresh[i]) == (size_t) -1) {
+            fresh[added++] = fresh[i];
+        }
+    }
+    if (added == 0) goto done;
+
+    if (d->num_deltas == d->cap_deltas) {
+        size_t cap = d->cap_deltas ? 2 * d->cap_deltas : 4;
+        BBHashDelta *deltas = realloc(d->deltas, sizeof(BBHashDelta) * cap);
+        if (!deltas) goto failure;
+        d->deltas = deltas;
+        d->cap_deltas = cap;
+    }
+    if (!ensure_slots(d, d->num_slots + added)) goto failure;
+
+    BBHash *mphf = bbhash_mphf_create(fresh, added, d->gamma, false);
+    if (!mphf) goto failure;
+
+    BBHashDelta *delta = &d->deltas[d->num_deltas++];
+    delta->mphf = mphf;
+    delta->offset = d->num_slots;
+    delta->num_keys = added;
+    for (size_t i = 0; i < added; i++) {
+        d->keys[delta->offset + bbhash_mphf_query(mphf, fresh[i])] = fresh[i];
+    }
+    d->num_slots += added;
+
+done:;
+    bool compact = needs_compaction(d);
+    pthread_rwlock_unlock(&d->lock);
+    free(fresh);
+
+    if (compact) bbhash_dynamic_compact_async(d);
+    return added;
+
+failure:
+    pthread_rwlock_unlock(&d->lock);
+    free(fresh);
+    fprintf(stderr, "bbhash_dynamic_insert: failed to build delta layer.\n");
+    return (size_t) -1;
+}
+
+bool bbhash_dynamic_remove(BBHashDynamic *d, uint64_t key) {
+    pthread_rwlock_wrlock(&d->lock);
+    size_t idx = find_locked(d, key);
+    if (idx != (size_t) -1) {
+        bitarray_set(d->tombstones, idx);
+        d->num_removed++;
+    }
+    bool compact = idx != (size_t) -1 && needs_compaction(d);
+    pthread_rwlock_unlock(&d->lock);
+
+    if (compact) bbhash_dynamic_compact_async(d);
+    return idx != (size_t) -1;
+}
+
+size_t bbhash_dynamic_query(BBHashDynamic *d, uint64_t key) {
+    pthread_rwlock_rdlock(&d->lock);
+    size_t idx = find_locked(d, key);
+    pthread_rwlock_unlock(&d->lock);
+    return idx;
+}
+
+size_t bbhash_dynamic_num_keys(BBHashDynamic *d) {
+    pthread_rwlock_rdlock(&d->lock);
+    size_t n = d->num_slots - d->num_removed;
+    pthread_rwlock_unlock(&d->lock);
+    return n;
+}
+
+size_t bbhash_dynamic_index_range(BBHashDynamic *d) {
+    pthread_rwlock_rdlock(&d->lock);
+    size_t n = d->num_slots;
+    pthread_rwlock_unlock(&d->lock);
+    return n;
+}
+
+size_t bbhash_dynamic_num_deltas(BBHashDynamic *d) {
+    pthread_rwlock_rdlock(&d->lock);
+    size_t n = d->num_deltas;
+    pthread_rwlock_unlock(&d->lock);
+    return n;
+}
+
+/**
+ * @brief Background compaction.
+ *
+ * 1. Under the read lock, snapshot the live keys and tombstones of all current
+ *    layers. Queries keep running; inserts and removes wait.
+ * 2. Without any lock, build the new base and its index -> key table.
+ * 3. Under the write lock, install the new base. Layers added while building
+ *    are kept and shifted down, and tombstones set while building are carried
+ *    over to the new indexes.
+ */
+static void *compact_thread(void *arg) {
+    BBHashDynamic *d = arg;
+    uint64_t *live = NULL;
+    uint64_t *new_keys = NULL;
+    Bitarray *snap_tombstones = NULL;
+    BBHash *new_base = NULL;
+    int status = -1;
+
+    // --- 1. Snapshot ---
+    pthread_rwlock_rdlock(&d->lock);
+    size_t snap_slots = d->num_slots;
+    size_t snap_deltas = d->num_deltas;
+    size_t num_live = d->num_slots - d->num_removed;
+    live = malloc(sizeof(uint64_t) * (num_live ? num_live : 1));
+    snap_tombstones = bitarray_new(snap_slots ? snap_slots : 1);
+    if (live && snap_tombstones) {
+        memcpy(snap_tombstones->bits, d->tombstones->bits, ((snap_slots + 63) / 64) * sizeof(uint64_t));
+        size_t j = 0;
+        for (size_t i = 0; i < snap_slots; i++) {
+            if (!bitarray_get(d->tombstones, i)) live[j++] = d->keys[i];
+        }
+    }
+    pthread_rwlock_unlock(&d->lock);
+    if (!live || !snap_tombstones) goto done;
+
+    // --- 2. Build ---
+    if (num_live > 0) {
+        new_base = bbhash_mphf_create(live, num_live, d->gamma, false);
+        if (!new_base) goto done;
+    }
+    new_keys = malloc(sizeof(uint64_t) * (num_live ? num_live : 1));
+    if (!new_keys) goto done;
+    for (size_t i = 0; i < num_live; i++) {
+        new_keys[bbhash_mphf_query(new_base, live[i])] = live[i];
+    }
+
+    // --- 3. Merge ---
+    pthread_rwlock_wrlock(&d->lock);
+    size_t tail_slots = d->num_slots - snap_slots;
+    size_t shift = snap_slots - num_live;
+    size_t cap = 64;
+    while (cap < num_live + tail_slots) cap *= 2;
+    uint64_t *keys = malloc(sizeof(uint64_t) * cap);
+    Bitarray *tombstones = bitarray_new(cap);
+    if (!keys || !tombstones) {
+        free(keys);
+        if (tombstones) bitarray_free(tombstones);
+        pthread_rwlock_unlock(&d->lock);
+        goto done;
+    }
+
+    memcpy(keys, new_keys, sizeof(uint64_t) * num_live);
+    memcpy(keys + num_live, d->keys + snap_slots, sizeof(uint64_t) * tail_slots);
+
+    size_t num_removed = 0;
+    for (size_t i = 0; i < snap_slots; i++) {
+        if (bitarray_get(d->tombstones, i) && !bitarray_get(snap_tombstones, i)) {
+            bitarray_set(tombstones, bbhash_mphf_query(new_base, d->keys[i]));
+            num_removed++;
+        }
+    }
+    for (size_t i = snap_slots; i < d->num_slots; i++) {
+        if (bitarray_get(d->tombstones, i)) {
+            bitarray_set(tombstones, i - shift);
+            num_removed++;
+        }
+    }
+
+    bbhash_free(d->base);
+    for (size_t i = 0; i < snap_deltas; i++) {
+        bbhash_free(d->deltas[i].mphf);
+    }
+    for (size_t i = snap_deltas; i < d->num_deltas; i++) {
+        d->deltas[i - snap_deltas] = d->deltas[i];
+        d->deltas[i - snap_deltas].offset -= shift;
+    }
+    d->num_deltas -= snap_deltas;
+
+    free(d->keys);
+    bitarray_free(d->tombstones);
+    d->keys = keys;
+    d->tombstones = tombstones;
+    d->cap_slots = cap;
+    d->base = new_base;
+    d->base_keys = num_live;
+    d->num_slots = num_live + tail_slots;
+    d->num_removed = num_removed;
+    new_base = NULL;
+    pthread_rwlock_unlock(&d->lock);
+    status = 0;
+
+done:
+    if (status != 0) fprintf(stderr, "bbhash_dynamic: compaction failed.\n");
+    free(live);
+    free(new_keys);
+    if (snap_tombstones) bitarray_free(snap_tombstones);
+    bbhash_free(new_base);
+
+    pthread_mutex_lock(&d->compact_mutex);
+    d->compact_status = status;
+    d->compacting = false;
+    pthread_mutex_unlock(&d->compact_mutex);
+    return NULL;
+}
+
+int bbhash_dynamic_compact_async(BBHashDynamic *d) {
+    pthread_mutex_lock(&d->compact_mutex);
+    if (d->compacting) {
+        pthread_mutex_unlock(&d->compact_mutex);
+        return 0;
+    }
+    if (d->compactor_started) {
+        pthread_join(d->compactor, NULL); // reap the previous, finished run
+        d->compactor_started = false;
+    }
+    d->compacting = true;
+    if (pthread_create(&d->compactor, NULL, compact_thread, d) != 0) {
+        d->compacting = false;
+        pthread_mutex_unlock(&d->compact_mutex);
+        return -1;
+    }
+    d->compactor_started = true;
+    pthread_mutex_unlock(&d->compact_mutex);
+    return 0;
+}
+
+void bbhash_dynamic_wait(BBHashDynamic *d) {
+    pthread_mutex_lock(&d->compact_mutex);
+    bool started = d->compactor_started;
+    pthread_t compactor = d->compactor;
+    d->compactor_started = false;
+    pthread_mutex_unlock(&d->compact_mutex);
+    if (started) pthread_join(compactor, NULL);
+}
+
+int bbhash_dynamic_compact(BBHashDynamic *d) {
+    bbhash_dynamic_wait(d);
+    if (bbhash_dynamic_compact_async(d) != 0) return -1;
+    bbhash_dynamic_wait(d);
+    // The compactor writes the status under the mutex.
+    pthread_mutex_lock(&d->compact_mutex);
+    int status = d->compact_status;
+    pthread_mutex_unlock(&d->compact_mutex);
+    return status;
+}
+
+void bbhash_dynamic_free(BBHashDynamic *d) {
+    if (d == NULL) {
+        return;
+    }
+    bbhash_dynamic_wait(d);
+    bbhash_free(d->base);
+    for (size_t i = 0; i < d->num_deltas; i++) {
+        bbhash_free(d->deltas[i].mphf);
+    }
+    free(d->deltas);
+    free(d->keys);
+    if (d->tombstones) bitarray_free(d->tombstones);
+    pthread_rwlock_destroy(&d->lock);
+    pthread_mutex_destroy(&d->compact_mutex);
+    free(d);
+}
@@ -0,0 +1,84 @@
+#ifndef BBHASH_DYNAMIC_H
+#define BBHASH_DYNAMIC_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+ * Updatable MPHF built from LSM-style layers.
+ *
+ * A large immutable base BBHash covers the original keys with indexes
+ * [0, base). Each call to bbhash_dynamic_insert() builds a small delta BBHash
+ * over the new keys and gives it the index range directly after the previous
+ * layer. Removals only set a tombstone. Once the deltas and tombstones exceed
+ * a threshold, a background thread merges all live keys into a fresh base,
+ * after which the index space is dense again: [0, bbhash_dynamic_num_keys()).
+ *
+ * Unlike a plain MPHF the structure keeps a copy of every key (8 bytes/key),
+ * which is needed both to rebuild the base and to answer membership queries.
+ * Indexes are stable between compactions only.
+ *
+ * All functions are thread safe; queries run concurrently with each other and
+ * with a background compaction.
+ */
+typedef struct BBHashDynamic BBHashDynamic;
+
+/**
+ * @brief Creates a dynamic MPHF with an initial set of unique keys.
+ * @param keys The initial keys (may be NULL if n is 0).
+ * @param n Number of initial keys.
+ * @param gamma Gamma used for the base and delta levels.
+ * @param compact_ratio Start a background compaction when the number of delta
+ *        keys plus tombstones exceeds compact_ratio * base keys (e.g. 0.1).
+ * @return A new structure, or NULL on failure.
+ */
+BBHashDynamic *bbhash_dynamic_create(const uint64_t keys[], size_t n, double gamma, double compact_ratio);
+
+/**
+ * @brief Adds keys as a new delta layer. Keys already present are skipped.
+ * @return The number of keys actually added, or (size_t)-1 on failure.
+ */
+size_t bbhash_dynamic_insert(BBHashDynamic *d, const uint64_t keys[], size_t n);
+
+/**
+ * @brief Removes a key by setting its tombstone.
+ * @return true if the key was present.
+ */
+bool bbhash_dynamic_remove(BBHashDynamic *d, uint64_t key);
+
+/**
+ * @brief Looks up the global index of a key.
+ * @return The index in [0, bbhash_dynamic_index_range()), or (size_t)-1 if
+ * the key is not a live member of the set.
+ */
+size_t bbhash_dynamic_query(BBHashDynamic *d, uint64_t key);
+
+/** @brief Number of live keys. */
+size_t bbhash_dynamic_num_keys(BBHashDynamic *d);
+
+/** @brief Upper bound (exclusive) of the global index space, including tombstoned slots. */
+size_t bbhash_dynamic_index_range(BBHashDynamic *d);
+
+/** @brief Number of delta layers currently stacked on the base. */
+size_t bbhash_dynamic_num_deltas(BBHashDynamic *d);
+
+/**
+ * @brief Starts a background compaction unless one is already running.
+ * @return 0 on success (or if already running), -1 on failure.
+ */
+int bbhash_dynamic_compact_async(BBHashDynamic *d);
+
+/** @brief Waits for a running background compaction to finish. */
+void bbhash_dynamic_wait(BBHashDynamic *d);
+
+/**
+ * @brief Merges all layers into a fresh base and waits for it to finish.
+ * @return 0 on success, -1 on failure.
+ */
+int bbhash_dynamic_compact(BBHashDynamic *d);
+
+/** @brief Waits for any compaction and frees all memory. */
+void bbhash_dynamic_free(BBHashDynamic *d);
+
+#endif
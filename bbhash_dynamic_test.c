@@ -0,0 +1,99 @@
+/* bbhash_dynamic_test.c - tests for the layered, updatable MPHF.
+ *
+ */
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "mt64.h"
+#include "dedup.h"
+#include "bitarray.h"
+#include "bbhash_dynamic.h"
+
+// Every live key maps to a distinct index below the index range.
+// Indexes change when a background compaction lands, so let it finish first.
+static void check_all(BBHashDynamic *d, const uint64_t keys[], const bool removed[], size_t n) {
+    bbhash_dynamic_wait(d);
+    size_t range = bbhash_dynamic_index_range(d);
+    Bitarray *seen = bitarray_new(range);
+    for (size_t i = 0; i < n; i++) {
+        size_t idx = bbhash_dynamic_query(d, keys[i]);
+        if (removed[i]) {
+            assert(idx == (size_t) -1);
+            continue;
+        }
+        assert(idx < range);
+        assert(bitarray_get(seen, idx) == 0);
+        bitarray_set(seen, idx);
+    }
+    bitarray_free(seen);
+}
+
+int main(void) {
+    const size_t nbase = 100000, nbatch = 2000, nbatches = 10;
+    const size_t n = nbase + nbatch * nbatches;
+
+    Mt64 *rng = mt64_create(7);
+    uint64_t *keys = malloc(sizeof(uint64_t) * (n + 100));
+    bool *removed = calloc(n, sizeof(bool));
+    for (size_t i = 0; i < n + 100; i++) keys[i] = mt64_gen_int64(rng);
+    assert(dedup(keys, n + 100) >= n);
+    // dedup sorts; shuffle so the batches are not ordered ranges
+    for (size_t i = n - 1; i > 0; i--) {
+        size_t j = mt64_gen_int64(rng) % (i + 1);
+        uint64_t t = keys[i];
+        keys[i] = keys[j];
+        keys[j] = t;
+    }
+
+    BBHashDynamic *d = bbhash_dynamic_create(keys, nbase, 2.0, 0.1);
+    assert(d != NULL);
+    assert(bbhash_dynamic_index_range(d) == nbase);
+    check_all(d, keys, removed, nbase);
+
+    // Re-inserting existing keys is a no-op.
+    assert(bbhash_dynamic_insert(d, keys, 10) == 0);
+
+    size_t live = nbase;
+    for (size_t b = 0; b < nbatches; b++) {
+        const uint64_t *batch = keys + nbase + b * nbatch;
+        assert(bbhash_dynamic_insert(d, batch, nbatch) == nbatch);
+        live += nbatch;
+        // remove a few keys from the base and from the new batch
+        for (size_t i = 0; i < 50; i++) {
+            size_t k = (b * 977 + i * 131) % nbase;
+            if (!removed[k]) {
+                assert(bbhash_dynamic_remove(d, keys[k]));
+                removed[k] = true;
+                live--;
+            }
+            k = nbase + b * nbatch + i;
+            assert(bbhash_dynamic_remove(d, keys[k]));
+            removed[k] = true;
+            live--;
+        }
+        assert(!bbhash_dynamic_remove(d, keys[nbase + b * nbatch]));
+        check_all(d, keys, removed, nbase + (b + 1) * nbatch);
+    }
+
+    // A removed key can come back.
+    assert(bbhash_dynamic_insert(d, &keys[nbase], 1) == 1);
+    removed[nbase] = false;
+    live++;
+    check_all(d, keys, removed, n);
+
+    // After compaction the index space is dense.
+    assert(bbhash_dynamic_compact(d) == 0);
+    assert(bbhash_dynamic_num_deltas(d) == 0);
+    assert(bbhash_dynamic_num_keys(d) == live);
+    assert(bbhash_dynamic_index_range(d) == live);
+    check_all(d, keys, removed, n);
+
+    bbhash_dynamic_free(d);
+    free(removed);
+    free(keys);
+    mt64_destroy(rng);
+    printf("bbhash_dynamic_test: OK\n");
+    return 0;
+}
@@ -0,0 +1,147 @@
+#define _POSIX_C_SOURCE 200809L  // nanosleep under -std=c23
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdalign.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+#include "bbhash.h"
+#include "bbhash_handle.h"
+
+// Own cache line per reader, so entering and leaving does not bounce
+// lines between reader threads.
+struct BBHashReader {
+    alignas(64) _Atomic uint64_t epoch;  // epoch at entry; 0 outside critical sections
+    BBHashHandle *handle;
+    BBHashReader *next;
+};
+
+struct BBHashHandle {
+    _Atomic(BBHash *) current;
+    _Atomic uint64_t epoch;       // advanced by every publish; starts at 1
+    _Atomic uint64_t generation;
+    pthread_mutex_t writer;       // serializes publishes
+    pthread_mutex_t readers_lock; // guards the reader list
+    BBHashReader *readers;
+};
+
+BBHashHandle *bbhash_handle_create(BBHash *mphf) {
+    BBHashHandle *h = calloc(1, sizeof(BBHashHandle));
+    if (!h) return NULL;
+    atomic_init(&h->current, mphf);
+    atomic_init(&h->epoch, 1);
+    atomic_init(&h->generation, 0);
+    pthread_mutex_init(&h->writer, NULL);
+    pthread_mutex_init(&h->readers_lock, NULL);
+    return h;
+}
+
+void bbhash_handle_free(BBHashHandle *h) {
+    if (!h) return;
+    if (h->readers) fprintf(stderr, "bbhash_handle_free: readers are still registered.\n");
+    bbhash_free(atomic_load(&h->current));
+    pthread_mutex_destroy(&h->writer);
+    pthread_mutex_destroy(&h->readers_lock);
+    free(h);
+}
+
+BBHashReader *bbhash_handle_register(BBHashHandle *h) {
+    BBHashReader *r = aligned_alloc(alignof(BBHashReader), sizeof(BBHashReader));
+    if (!r) return NULL;
+    atomic_init(&r->epoch, 0);
+    r->handle = h;
+    pthread_mutex_lock(&h->readers_lock);
+    r->next = h->readers;
+    h->readers = r;
+    pthread_mutex_unlock(&h->readers_lock);
+    return r;
+}
+
+void bbhash_handle_unregister(BBHashReader *r) {
+    if (!r) return;
+    BBHashHandle *h = r->handle;
+    pthread_mutex_lock(&h->readers_lock);
+    for (BBHashReader **p = &h->readers; *p; p = &(*p)->next) {
+        if (*p == r) {
+            *p = r->next;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&h->readers_lock);
+    free(r);
+}
+
+/*
+ * The reader stores its epoch before it loads the pointer, and the writer
+ * exchanges the pointer before it advances the epoch and scans the readers.
+ * All four are sequentially consistent. A reader that loaded the old pointer
+ * therefore stored an epoch below the new one before the writer's scan, and
+ * the writer waits for it. A reader the scan sees as idle loads the new
+ * pointer.
+ */
+const BBHash *bbhash_handle_acquire(BBHashReader *r) {
+    BBHashHandle *h = r->handle;
+    atomic_store(&r->epoch, atomic_load(&h->epoch));
+    return atomic_load(&h->current);
+}
+
+void bbhash_handle_release(BBHashReader *r) {
+    atomic_store_explicit(&r->epoch, 0, memory_order_release);
+}
+
+size_t bbhash_handle_query(BBHashReader *r, uint64_t key) {
+    const BBHash *mphf = bbhash_handle_acquire(r);
+    size_t idx = mphf ? bbhash_mphf_query(mphf, key) : (size_t) -1;
+    bbhash_handle_release(r);
+    return idx;
+}
+
+// Spins briefly, then yields, then sleeps while a reader is inside.
+static void backoff(unsigned *spins) {
+    if (++*spins < 64) return;
+    if (*spins < 1024) {
+        sched_yield();
+        return;
+    }
+    struct timespec pause = {.tv_sec = 0, .tv_nsec = 20000};
+    nanosleep(&pause, NULL);
+}
+
+// Waits until no reader is inside a critical section entered before `epoch`.
+static void wait_for_readers(BBHashHandle *h, uint64_t epoch) {
+    pthread_mutex_lock(&h->readers_lock);
+    for (BBHashReader *r = h->readers; r; r = r->next) {
+        unsigned spins = 0;
+        for (;;) {
+            uint64_t entered = atomic_load(&r->epoch);
+            if (entered == 0 || entered >= epoch) break;
+            backoff(&spins);
+        }
+    }
+    pthread_mutex_unlock(&h->readers_lock);
+}
+
+void bbhash_handle_publish(BBHashHandle *h, BBHash *mphf) {
+    pthread_mutex_lock(&h->writer);
+    BBHash *old = atomic_exchange(&h->current, mphf);
+    uint64_t epoch = atomic_fetch_add(&h->epoch, 1) + 1;
+    atomic_fetch_add(&h->generation, 1);
+    wait_for_readers(h, epoch);
+    pthread_mutex_unlock(&h->writer);
+    bbhash_free(old);
+}
+
+int bbhash_handle_reload(BBHashHandle *h, const char *filename, bool map, unsigned flags) {
+    BBHash *mphf = map ? bbhash_mphf_mmap(filename, flags) : bbhash_mphf_load_ex(filename, flags);
+    if (!mphf) return -1;
+    bbhash_handle_publish(h, mphf);
+    return 0;
+}
+
+uint64_t bbhash_handle_generation(const BBHashHandle *h) {
+    return atomic_load(&h->generation);
+}
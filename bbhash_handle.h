@@ -0,0 +1,87 @@
+#ifndef BBHASH_HANDLE_H
+#define BBHASH_HANDLE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "bbhash.h"
+
+/*
+ * Hot-swappable MPHF for live readers.
+ *
+ * A handle holds the current MPHF. Readers take no lock: each reader
+ * thread registers once, then brackets its queries with
+ * bbhash_handle_acquire() and bbhash_handle_release(), which only store to
+ * and load from the reader's own cache line and the handle's pointer.
+ *
+ * A writer publishes a new MPHF with one atomic exchange and then waits for
+ * a grace period before it frees the old one. This is epoch-based, as in
+ * RCU. Publishing advances a global epoch. A reader records the epoch it
+ * entered at, so the writer waits only for readers that were inside before
+ * the exchange. Readers never wait for writers. Publishes are serialized.
+ * A grace period lasts as long as the longest critical section that was
+ * open at the time, so keep them short.
+ */
+typedef struct BBHashHandle BBHashHandle;
+
+/* A registered reader; used by one thread at a time. */
+typedef struct BBHashReader BBHashReader;
+
+/**
+ * @brief Creates a handle.
+ * @param mphf The initial MPHF, or NULL. The handle takes ownership.
+ * @return The new handle, or NULL on failure.
+ */
+BBHashHandle *bbhash_handle_create(BBHash *mphf);
+
+/**
+ * @brief Frees the handle and its current MPHF.
+ *
+ * All readers must have been unregistered.
+ */
+void bbhash_handle_free(BBHashHandle *h);
+
+/** @brief Registers a reader, or returns NULL on failure. */
+BBHashReader *bbhash_handle_register(BBHashHandle *h);
+
+/** @brief Unregisters a reader outside of any critical section. */
+void bbhash_handle_unregister(BBHashReader *r);
+
+/**
+ * @brief Enters a read-side critical section.
+ *
+ * Critical sections do not nest.
+ * @return The current MPHF (possibly NULL), valid until bbhash_handle_release().
+ */
+const BBHash *bbhash_handle_acquire(BBHashReader *r);
+
+/** @brief Leaves the critical section. */
+void bbhash_handle_release(BBHashReader *r);
+
+/**
+ * @brief Queries the current MPHF in its own critical section.
+ * @return As bbhash_mphf_query(); (size_t)-1 if the handle is empty.
+ */
+size_t bbhash_handle_query(BBHashReader *r, uint64_t key);
+
+/**
+ * @brief Publishes a new MPHF and frees the previous one after a grace period.
+ *
+ * Must not be called from inside a critical section.
+ * @param mphf The new MPHF, or NULL. The handle takes ownership.
+ */
+void bbhash_handle_publish(BBHashHandle *h, BBHash *mphf);
+
+/**
+ * @brief Loads or maps an MPHF file and publishes it.
+ * @param map Use bbhash_mphf_mmap() instead of bbhash_mphf_load_ex().
+ * @param flags Zero or more BBHASH_LOAD_* flags.
+ * @return 0 on success; -1 if the file could not be read, in which case the
+ * current MPHF stays published.
+ */
+int bbhash_handle_reload(BBHashHandle *h, const char *filename, bool map, unsigned flags);
+
+/** @brief Number of MPHFs published after the initial one. */
+uint64_t bbhash_handle_generation(const BBHashHandle *h);
+
+#endif // BBHASH_HANDLE_H
@@ -0,0 +1,156 @@
+/* bbhash_handle_test.c - stress test for hot-swapping an MPHF under load.
+ *
+ * Reader threads query continuously while a writer alternately reloads two
+ * MPHF files, loaded and mapped in turn. Every critical section must see
+ * one complete MPHF: either all sampled keys of set A map to their
+ * precomputed indexes, or all sampled keys of set B do. A use after free
+ * shows up as a mismatch (or a crash under a sanitizer).
+ */
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <time.h>
+#include "mt64.h"
+#include "dedup.h"
+#include "bbhash.h"
+#include "bbhash_handle.h"
+
+constexpr size_t NUM_SAMPLES = 1024;
+constexpr size_t KEYS_PER_SECTION = 8;
+constexpr unsigned NUM_READERS = 4;
+constexpr unsigned NUM_RELOADS = 400;
+
+typedef struct {
+    const uint64_t *keys;       // sampled keys of one set
+    const size_t *expected;     // their indexes in that set's MPHF
+} Sample;
+
+typedef struct {
+    BBHashHandle *handle;
+    const Sample *a, *b;
+    atomic_bool *stop;
+    uint64_t seed;
+    size_t sections;
+    size_t failures;
+    size_t empty;
+    pthread_t tid;
+} Reader;
+
+// True if the keys from `first` on all map to their expected indexes.
+static bool matches(const BBHash *mphf, const Sample *s, size_t first) {
+    for (size_t k = 0; k < KEYS_PER_SECTION; k++) {
+        size_t i = (first + k) % NUM_SAMPLES;
+        if (bbhash_mphf_query(mphf, s->keys[i]) != s->expected[i]) return false;
+    }
+    return true;
+}
+
+static void *reader_thread(void *arg) {
+    Reader *reader = arg;
+    BBHashReader *r = bbhash_handle_register(reader->handle);
+    assert(r != NULL);
+    Mt64 *rng = mt64_create(reader->seed);
+    while (!atomic_load_explicit(reader->stop, memory_order_relaxed)) {
+        size_t first = mt64_gen_int64(rng) % NUM_SAMPLES;
+        const BBHash *mphf = bbhash_handle_acquire(r);
+        if (!mphf) {
+            reader->empty++;
+        } else if (!matches(mphf, reader->a, first) && !matches(mphf, reader->b, first)) {
+            reader->failures++;
+        }
+        bbhash_handle_release(r);
+        reader->sections++;
+    }
+    mt64_destroy(rng);
+    bbhash_handle_unregister(r);
+    return NULL;
+}
+
+static uint64_t *make_keys(uint64_t seed, size_t *n) {
+    uint64_t *keys = malloc(sizeof(uint64_t) * *n);
+    Mt64 *rng = mt64_create(seed);
+    for (size_t i = 0; i < *n; i++) keys[i] = mt64_gen_int64(rng);
+    mt64_destroy(rng);
+    *n = dedup(keys, *n);
+    return keys;
+}
+
+// Builds an MPHF over the keys, saves it, and records the sampled indexes.
+static void prepare(const uint64_t keys[], size_t n, const char *path, uint64_t sample_keys[],
+                    size_t expected[]) {
+    BBHash *mphf = bbhash_mphf_create(keys, n, 2.0, false);
+    assert(mphf != NULL);
+    assert(bbhash_mphf_save(mphf, path) == 0);
+    for (size_t i = 0; i < NUM_SAMPLES; i++) {
+        sample_keys[i] = keys[(i * 7919) % n];
+        expected[i] = bbhash_mphf_query(mphf, sample_keys[i]);
+    }
+    bbhash_free(mphf);
+}
+
+int main(void) {
+    printf("bbhash_handle_test\n");
+
+    // An empty handle answers every query with (size_t)-1.
+    BBHashHandle *empty = bbhash_handle_create(NULL);
+    BBHashReader *r = bbhash_handle_register(empty);
+    assert(bbhash_handle_query(r, 42) == (size_t) -1);
+    bbhash_handle_unregister(r);
+    assert(bbhash_handle_reload(empty, "does-not-exist.bbh", false, 0) == -1);
+    assert(bbhash_handle_generation(empty) == 0);
+    bbhash_handle_free(empty);
+
+    size_t na = 300000, nb = 200000;
+    uint64_t *keys_a = make_keys(1, &na), *keys_b = make_keys(2, &nb);
+    uint64_t sample_a[NUM_SAMPLES], sample_b[NUM_SAMPLES];
+    size_t expected_a[NUM_SAMPLES], expected_b[NUM_SAMPLES];
+    const char *path_a = "bbhash_handle_test_a.bbh", *path_b = "bbhash_handle_test_b.bbh";
+    prepare(keys_a, na, path_a, sample_a, expected_a);
+    prepare(keys_b, nb, path_b, sample_b, expected_b);
+    const Sample a = {sample_a, expected_a}, b = {sample_b, expected_b};
+
+    BBHashHandle *h = bbhash_handle_create(bbhash_mphf_load(path_a));
+    atomic_bool stop;
+    atomic_init(&stop, false);
+    Reader readers[NUM_READERS];
+    for (unsigned t = 0; t < NUM_READERS; t++) {
+        readers[t] = (Reader) {.handle = h, .a = &a, .b = &b, .stop = &stop, .seed = 100 + t};
+        assert(pthread_create(&readers[t].tid, NULL, reader_thread, &readers[t]) == 0);
+    }
+
+    struct timespec t0, t1;
+    timespec_get(&t0, TIME_UTC);
+    for (unsigned i = 0; i < NUM_RELOADS; i++) {
+        const char *path = i % 2 ? path_a : path_b;
+        bool map = (i / 2) % 2;
+        unsigned flags = i % 3 == 0 ? BBHASH_LOAD_VERIFY : 0;
+        assert(bbhash_handle_reload(h, path, map, flags) == 0);
+        if (i % 50 == 49) bbhash_handle_publish(h, NULL);
+    }
+    timespec_get(&t1, TIME_UTC);
+    atomic_store(&stop, true);
+
+    size_t sections = 0, failures = 0;
+    for (unsigned t = 0; t < NUM_READERS; t++) {
+        pthread_join(readers[t].tid, NULL);
+        assert(readers[t].sections > 0);
+        sections += readers[t].sections;
+        failures += readers[t].failures;
+    }
+    double seconds = (double)(t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) * 1e-9;
+    printf("  %u reloads in %.2f s under %u readers, %zu critical sections\n", NUM_RELOADS, seconds,
+           NUM_READERS, sections);
+    assert(failures == 0);
+    assert(bbhash_handle_generation(h) == NUM_RELOADS + NUM_RELOADS / 50);
+
+    bbhash_handle_free(h);
+    remove(path_a);
+    remove(path_b);
+    free(keys_a);
+    free(keys_b);
+    printf("All tests passed.\n");
+    return 0;
+}
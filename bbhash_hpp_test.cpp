@@ -0,0 +1,143 @@
+/* bbhash_hpp_test.cpp - tests for the C++ wrapper in bbhash.hpp.
+ *
+ * Build the library as C and link it in, e.g.
+ *   clang -std=c23 -O2 -pthread -c $(COMMON_SRC)
+ *   clang++ -std=c++20 -O2 -pthread bbhash_hpp_test.cpp *.o
+ */
+
+#include <algorithm>
+#include <cassert>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include "mt64.h"
+#include "bbhash.hpp"
+#include "example_vocab.h"
+
+using bbhash::Mphf;
+
+struct Uuid {
+    uint64_t lo, hi;
+};
+
+struct Point {
+    uint16_t x, y, z;
+};
+
+struct Record {
+    uint64_t a, b, c;
+};
+
+enum class Color : uint8_t { red, green, blue };
+
+static_assert(!std::is_copy_constructible_v<Mphf<uint64_t>>);
+static_assert(!std::is_copy_assignable_v<Mphf<uint64_t>>);
+static_assert(std::is_nothrow_move_constructible_v<Mphf<uint64_t>>);
+static_assert(std::is_nothrow_move_assignable_v<Mphf<uint64_t>>);
+static_assert(!Mphf<uint64_t>::wide && !Mphf<std::string_view>::wide && !Mphf<Point>::wide);
+static_assert(Mphf<Uuid>::wide && Mphf<BBHashKey128>::wide);
+static_assert(!Mphf<Record>::wide);
+static_assert(bbhash::KeyAdaptor<Color>::convert(Color::blue) == 2);
+static_assert(bbhash::KeyAdaptor<int32_t>::convert(-1) == UINT64_MAX);
+
+// Every key gets its own index in [0, n), one at a time and batched.
+template <class Key>
+static void check_bijection(const Mphf<Key> &mphf, std::span<const Key> keys) {
+    size_t n = keys.size();
+    assert(mphf && mphf.size() == n);
+    std::vector<size_t> out(n);
+    mphf.query(keys, out);
+    std::vector<bool> seen(n);
+    for (size_t i = 0; i < n; i++) {
+        size_t idx = mphf(keys[i]);
+        assert(idx < n && idx == out[i]);
+        assert(!seen[idx]);
+        seen[idx] = true;
+    }
+}
+
+int main() {
+    std::printf("bbhash_hpp_test\n");
+    Mt64 *rng = mt64_create(44);
+    std::vector<uint64_t> keys(200000);
+    for (auto &key : keys) key = mt64_gen_int64(rng);
+    mt64_destroy(rng);
+    std::ranges::sort(keys);
+    keys.erase(std::ranges::unique(keys).begin(), keys.end());
+    size_t n = keys.size();
+
+    // 64-bit keys go to the C API as they are; the result is the same MPHF.
+    auto mphf = Mphf<uint64_t>::build(keys);
+    check_bijection<uint64_t>(mphf, keys);
+    BBHash *plain = bbhash_mphf_create(keys.data(), n, 2.0, false);
+    assert(bbhash_size_in_bits(plain) == mphf.size_in_bits());
+    for (size_t i = 0; i < n; i += 7) assert(bbhash_mphf_query(plain, keys[i]) == mphf(keys[i]));
+    bbhash_free(plain);
+
+    // Move-only ownership.
+    Mphf<uint64_t> moved(std::move(mphf));
+    assert(!mphf && moved);
+    mphf = std::move(moved);
+    assert(mphf && !moved);
+    moved = Mphf<uint64_t>(bbhash_mphf_clone(mphf.get()));
+    assert(moved(keys[0]) == mphf(keys[0]));
+    BBHash *raw = moved.release();
+    assert(!moved);
+    bbhash_free(raw);
+
+    // Files and buffers.
+    const char *file = "bbhash_hpp_test.bbh";
+    assert(mphf.save(file));
+    auto loaded = Mphf<uint64_t>::load(file, BBHASH_LOAD_VERIFY);
+    auto mapped = Mphf<uint64_t>::map(file);
+    check_bijection<uint64_t>(mapped, keys);
+    for (size_t i = 0; i < n; i += 13) assert(loaded(keys[i]) == mphf(keys[i]));
+    assert(!Mphf<uint64_t>::load("bbhash_hpp_test.missing"));
+    std::vector<std::byte> garbage(64, std::byte{0x5a});
+    assert(!Mphf<uint64_t>::from_buffer(garbage));
+    std::remove(file);
+
+    // Narrower integers and enums widen to 64 bits.
+    std::vector<int32_t> small;
+    for (int32_t i = -5000; i < 5000; i++) small.push_back(i * 3);
+    check_bijection<int32_t>(Mphf<int32_t>::build(small), small);
+    std::vector<Color> colors = {Color::red, Color::green, Color::blue};
+    check_bijection<Color>(Mphf<Color>::build(colors), colors);
+
+    // Strings hash as the CLI's text keys; no terminator is needed.
+    size_t num_words = sizeof(vocab) / sizeof(vocab[0]);
+    std::vector<std::string_view> words(vocab, vocab + num_words);
+    auto by_word = Mphf<std::string_view>::build(words);
+    check_bijection<std::string_view>(by_word, words);
+    std::vector<uint64_t> hashed;
+    for (const char *word : vocab) hashed.push_back(murmur3_string(word, 0));
+    BBHash *c_words = bbhash_mphf_create(hashed.data(), hashed.size(), 2.0, false);
+    for (size_t i = 0; i < num_words; i++) assert(bbhash_mphf_query(c_words, hashed[i]) == by_word(words[i]));
+    bbhash_free(c_words);
+    std::string line = std::string(vocab[3]) + "\n";
+    assert(by_word(std::string_view(line).substr(0, line.size() - 1)) == by_word(vocab[3]));
+    std::vector<std::string> owned(words.begin(), words.end());
+    auto by_string = Mphf<std::string>::build(owned);
+    for (size_t i = 0; i < num_words; i++) assert(by_string(owned[i]) == by_word(words[i]));
+
+    // 16-byte structs are 128-bit keys.
+    std::vector<Uuid> uuids(n / 2);
+    for (size_t i = 0; i < uuids.size(); i++) uuids[i] = {keys[2 * i], keys[2 * i + 1]};
+    auto by_uuid = Mphf<Uuid>::build(uuids);
+    check_bijection<Uuid>(by_uuid, uuids);
+    assert(bbhash_mphf_query128(by_uuid.get(), {uuids[1].lo, uuids[1].hi}) == by_uuid(uuids[1]));
+    BBHashConfig config = bbhash_config_default();
+    config.hash_scheme = BBHASH_HASH_BASE128;
+    assert(!Mphf<Uuid>::build(uuids, config));
+
+    // Short structs are zero-extended, long ones hashed.
+    std::vector<Point> points;
+    for (uint16_t i = 0; i < 3000; i++) points.push_back({i, static_cast<uint16_t>(i * 7), 1});
+    check_bijection<Point>(Mphf<Point>::build(points), points);
+    std::vector<Record> records;
+    for (size_t i = 0; i + 2 < n; i += 3) records.push_back({keys[i], keys[i + 1], keys[i + 2]});
+    check_bijection<Record>(Mphf<Record>::build(records), records);
+
+    std::printf("All tests passed.\n");
+    return 0;
+}
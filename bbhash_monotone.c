@@ -0,0 +1,122 @@
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include "bitarray.h"
+#include "bbhash.h"
+#include "bbhash_monotone.h"
+
+// Aim for this many keys per bucket. Larger buckets shrink the offsets table
+// (64 bits per bucket) but widen the packed local ranks.
+constexpr size_t TARGET_BUCKET_SIZE = 64;
+
+struct BBHashMonotone {
+    size_t num_keys;
+    uint64_t min_key, max_key;
+    unsigned shift;            // bucket = (key - min_key) >> shift
+    size_t num_buckets;
+    uint64_t *bucket_offsets;  // num_buckets + 1 entries; rank of each bucket's first key
+    unsigned rank_width;       // bits per packed local rank
+    Bitarray *local_ranks;     // indexed by MPHF value
+    BBHash *mphf;
+};
+
+// Bucket of a key in [min_key, max_key]. A shift of 64 (a range of 2^63 or
+// more over fewer than 128 keys) means one bucket; shifting by 64 is undefined.
+static inline size_t bucket_of(const BBHashMonotone *m, uint64_t key) {
+    return m->shift < 64 ? (size_t)((key - m->min_key) >> m->shift) : 0;
+}
+
+static unsigned bit_width(uint64_t x) {
+    unsigned w = 0;
+    while (x) {
+        w++;
+        x >>= 1;
+    }
+    return w;
+}
+
+BBHashMonotone *bbhash_monotone_create(const uint64_t sorted_keys[], size_t n, double gamma) {
+    if (n == 0) return NULL;
+    for (size_t i = 1; i < n; i++) {
+        if (sorted_keys[i - 1] >= sorted_keys[i]) {
+            fprintf(stderr, "bbhash_monotone_create: keys must be strictly increasing (position %zu).\n", i);
+            return NULL;
+        }
+    }
+
+    BBHashMonotone *m = calloc(1, sizeof(BBHashMonotone));
+    if (!m) return NULL;
+    m->num_keys = n;
+    m->min_key = sorted_keys[0];
+    m->max_key = sorted_keys[n - 1];
+
+    // Smallest shift giving at most n / TARGET_BUCKET_SIZE buckets.
+    uint64_t range = m->max_key - m->min_key;
+    size_t target = n / TARGET_BUCKET_SIZE ? n / TARGET_BUCKET_SIZE : 1;
+    while (m->shift < 64 && (range >> m->shift) >= target) {
+        m->shift++;
+    }
+    m->num_buckets = bucket_of(m, m->max_key) + 1;
+
+    m->bucket_offsets = malloc(sizeof(uint64_t) * (m->num_buckets + 1));
+    if (!m->bucket_offsets) goto failure;
+
+    // Keys are sorted, so each bucket is a contiguous run.
+    size_t largest = 0, i = 0;
+    for (size_t b = 0; b < m->num_buckets; b++) {
+        m->bucket_offsets[b] = i;
+        size_t begin = i;
+        while (i < n && bucket_of(m, sorted_keys[i]) == b) i++;
+        if (i - begin > largest) largest = i - begin;
+    }
+    m->bucket_offsets[m->num_buckets] = n;
+
+    m->rank_width = largest > 1 ? bit_width(largest - 1) : 1;
+    m->local_ranks = bitarray_new(n * m->rank_width);
+    if (!m->local_ranks) goto failure;
+
+    m->mphf = bbhash_mphf_create(sorted_keys, n, gamma, false);
+    if (!m->mphf) goto failure;
+
+    for (size_t b = 0; b < m->num_buckets; b++) {
+        for (size_t r = m->bucket_offsets[b]; r < m->bucket_offsets[b + 1]; r++) {
+            size_t idx = bbhash_mphf_query(m->mphf, sorted_keys[r]);
+            bitarray_set_field(m->local_ranks, idx * m->rank_width, m->rank_width, r - m->bucket_offsets[b]);
+        }
+    }
+    return m;
+
+failure:
+    bbhash_monotone_free(m);
+    return NULL;
+}
+
+size_t bbhash_monotone_query(const BBHashMonotone *m, uint64_t key) {
+    if (key < m->min_key || key > m->max_key) return (size_t) -1;
+
+    size_t bucket = bucket_of(m, key);
+    size_t idx = bbhash_mphf_query(m->mphf, key);
+    if (idx >= m->num_keys) return (size_t) -1;
+
+    size_t rank = m->bucket_offsets[bucket] + bitarray_get_field(m->local_ranks, idx * m->rank_width, m->rank_width);
+    return rank < m->bucket_offsets[bucket + 1] ? rank : (size_t) -1;
+}
+
+size_t bbhash_monotone_size_in_bits(const BBHashMonotone *m) {
+    if (m == NULL) {
+        return 0;
+    }
+    return bbhash_size_in_bits(m->mphf)
+           + ((m->local_ranks->nbits + 63) / 64) * 64
+           + (m->num_buckets + 1) * sizeof(uint64_t) * 8;
+}
+
+void bbhash_monotone_free(BBHashMonotone *m) {
+    if (m == NULL) {
+        return;
+    }
+    free(m->bucket_offsets);
+    if (m->local_ranks) bitarray_free(m->local_ranks);
+    bbhash_free(m->mphf);
+    free(m);
+}
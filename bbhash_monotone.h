@@ -0,0 +1,45 @@
+#ifndef BBHASH_MONOTONE_H
+#define BBHASH_MONOTONE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Monotone (order-preserving) minimal perfect hash function.
+ *
+ * For a strictly increasing key array, bbhash_monotone_query(m, keys[i])
+ * returns i. That keeps value arrays in key order, so range scans still work,
+ * without the log2(N) cache misses of a binary search.
+ *
+ * Keys are split into buckets by value, using (key - min) >> shift. A
+ * plain BBHash over all keys indexes a packed table that stores each key's
+ * rank within its bucket. The bucket's first rank comes from a small
+ * offsets table, so a query costs the BBHash probes plus two lookups.
+ * Skewed key distributions still give correct results, only with wider
+ * packed ranks.
+ */
+typedef struct BBHashMonotone BBHashMonotone;
+
+/**
+ * @brief Builds a monotone MPHF.
+ * @param sorted_keys Strictly increasing keys (e.g. the output of dedup()).
+ * @param n Number of keys.
+ * @param gamma Gamma for the underlying BBHash.
+ * @return The new structure, or NULL on failure or unsorted input.
+ */
+BBHashMonotone *bbhash_monotone_create(const uint64_t sorted_keys[], size_t n, double gamma);
+
+/**
+ * @brief Returns the rank of a key in the sorted key set.
+ * @return The rank in [0, n) for keys in the set. Keys outside [min, max] and
+ * many other non-members return (size_t)-1; otherwise the result for a
+ * non-member is undefined, as with bbhash_mphf_query().
+ */
+size_t bbhash_monotone_query(const BBHashMonotone *m, uint64_t key);
+
+/** @brief Memory footprint in bits (BBHash + packed ranks + bucket offsets). */
+size_t bbhash_monotone_size_in_bits(const BBHashMonotone *m);
+
+void bbhash_monotone_free(BBHashMonotone *m);
+
+#endif
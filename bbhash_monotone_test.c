@@ -0,0 +1,91 @@
+/* bbhash_monotone_test.c - tests for the order-preserving MPHF.
+ *
+ */
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "mt64.h"
+#include "dedup.h"
+#include "bbhash_monotone.h"
+
+static size_t binary_search(const uint64_t keys[], size_t n, uint64_t key) {
+    size_t lo = 0, hi = n;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (keys[mid] < key) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo;
+}
+
+static double seconds_since(const struct timespec *t0) {
+    struct timespec t1;
+    timespec_get(&t1, TIME_UTC);
+    return (double)(t1.tv_sec - t0->tv_sec) + (t1.tv_nsec - t0->tv_nsec) * 1e-9;
+}
+
+static void test_ranks(const uint64_t keys[], size_t n) {
+    BBHashMonotone *m = bbhash_monotone_create(keys, n, 2.0);
+    assert(m != NULL);
+    for (size_t i = 0; i < n; i++) {
+        assert(bbhash_monotone_query(m, keys[i]) == i);
+    }
+    if (keys[0] > 0) assert(bbhash_monotone_query(m, keys[0] - 1) == (size_t) -1);
+    printf("  n = %zu: %.2f bits/key\n", n, (double)bbhash_monotone_size_in_bits(m) / n);
+    bbhash_monotone_free(m);
+}
+
+int main(void) {
+    const size_t n = 4000000;
+    Mt64 *rng = mt64_create(11);
+    uint64_t *keys = malloc(sizeof(uint64_t) * n);
+    for (size_t i = 0; i < n; i++) keys[i] = mt64_gen_int64(rng);
+    size_t unique = dedup(keys, n);
+
+    printf("bbhash_monotone_test\n");
+    test_ranks(keys, unique);
+    test_ranks(keys, 1);
+    test_ranks(keys, 1000);
+
+    // Skewed: a dense run plus one far outlier puts almost everything in one bucket.
+    uint64_t skewed[5000];
+    for (size_t i = 0; i < 4999; i++) skewed[i] = 1000 + 3 * i;
+    skewed[4999] = UINT64_MAX;
+    test_ranks(skewed, 5000);
+
+    // Ranges of 2^63 or more over few keys: a single bucket.
+    uint64_t full_range[3] = {0, 1, UINT64_MAX};
+    test_ranks(full_range, 3);
+    uint64_t wide[5] = {1, 5, UINT64_C(1) << 62, (UINT64_C(1) << 63) + 1, UINT64_MAX};
+    test_ranks(wide, 5);
+
+    // Unsorted input is rejected.
+    uint64_t unsorted[3] = {1, 3, 2};
+    assert(bbhash_monotone_create(unsorted, 3, 2.0) == NULL);
+
+    // Lookup time against binary search over the sorted array.
+    BBHashMonotone *m = bbhash_monotone_create(keys, unique, 2.0);
+    uint64_t *queries = malloc(sizeof(uint64_t) * unique);
+    for (size_t i = 0; i < unique; i++) queries[i] = keys[mt64_gen_int64(rng) % unique];
+
+    struct timespec t0;
+    size_t sum = 0;
+    timespec_get(&t0, TIME_UTC);
+    for (size_t i = 0; i < unique; i++) sum += bbhash_monotone_query(m, queries[i]);
+    double t_mono = seconds_since(&t0);
+    timespec_get(&t0, TIME_UTC);
+    for (size_t i = 0; i < unique; i++) sum -= binary_search(keys, unique, queries[i]);
+    double t_bsearch = seconds_since(&t0);
+    assert(sum == 0);
+    printf("  lookup: monotone MPHF %.1f ns, binary search %.1f ns\n",
+           t_mono * 1e9 / unique, t_bsearch * 1e9 / unique);
+
+    bbhash_monotone_free(m);
+    free(queries);
+    free(keys);
+    mt64_destroy(rng);
+    printf("bbhash_monotone_test: OK\n");
+    return 0;
+}
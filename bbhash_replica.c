@@ -0,0 +1,236 @@
+#define _GNU_SOURCE  // sched_getaffinity, pthread_setaffinity_np
+
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <sched.h>
+#include "bbhash.h"
+#include "bbhash_replica.h"
+
+constexpr unsigned MAX_NODES = 1024;
+
+struct BBHashReplicas {
+    unsigned num_threads;
+    unsigned *cpus;            // CPU of each query thread
+    const BBHash **by_thread;  // MPHF used by each query thread
+    size_t num_copies;
+    BBHash **copies;           // owned clones
+};
+
+/*
+ * CPU topology: the CPUs this process may run on, and the node of each.
+ */
+typedef struct {
+    unsigned num_cpus;
+    unsigned cpus[CPU_SETSIZE];
+    unsigned node_of[CPU_SETSIZE];  // indexed by CPU number
+    unsigned num_nodes;
+} Topology;
+
+// Parses a sysfs CPU list such as "0-3,8-11" and tags those CPUs with `node`.
+static void parse_cpulist(const char *list, unsigned node, Topology *topo) {
+    const char *p = list;
+    while (*p) {
+        char *end;
+        unsigned long lo = strtoul(p, &end, 10), hi = lo;
+        if (end == p) break;
+        if (*end == '-') {
+            p = end + 1;
+            hi = strtoul(p, &end, 10);
+        }
+        for (unsigned long cpu = lo; cpu <= hi && cpu < CPU_SETSIZE; cpu++) {
+            topo->node_of[cpu] = node;
+        }
+        p = *end == ',' ? end + 1 : end;
+        if (*p == '\n') break;
+    }
+}
+
+static void read_topology(Topology *topo) {
+    memset(topo, 0, sizeof(*topo));
+
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) == 0) {
+        for (unsigned cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+            if (CPU_ISSET(cpu, &allowed)) topo->cpus[topo->num_cpus++] = cpu;
+        }
+    }
+    if (topo->num_cpus == 0) {
+        topo->cpus[topo->num_cpus++] = 0;
+    }
+
+    // Node ids may be sparse; stop after a run of missing ones.
+    char path[64], line[4096];
+    for (unsigned node = 0, missing = 0; node < MAX_NODES && missing < 64; node++) {
+        snprintf(path, sizeof(path), "/sys/devices/system/node/node%u/cpulist", node);
+        FILE *fp = fopen(path, "r");
+        if (!fp) {
+            missing++;
+            continue;
+        }
+        missing = 0;
+        if (fgets(line, sizeof(line), fp)) parse_cpulist(line, node, topo);
+        fclose(fp);
+    }
+
+    // Count distinct nodes among the allowed CPUs.
+    bool seen[MAX_NODES];
+    memset(seen, 0, sizeof(seen));
+    for (unsigned i = 0; i < topo->num_cpus; i++) {
+        unsigned node = topo->node_of[topo->cpus[i]];
+        if (!seen[node]) {
+            seen[node] = true;
+            topo->num_nodes++;
+        }
+    }
+}
+
+unsigned bbhash_numa_nodes(void) {
+    Topology *topo = malloc(sizeof(Topology));
+    if (!topo) return 1;
+    read_topology(topo);
+    unsigned nodes = topo->num_nodes;
+    free(topo);
+    return nodes;
+}
+
+int bbhash_pin_thread(unsigned cpu) {
+    if (cpu >= CPU_SETSIZE) return -1;
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0 ? 0 : -1;
+}
+
+typedef struct {
+    const BBHash *source;
+    unsigned cpu;
+    BBHash *copy;
+} CloneTask;
+
+// Clones on a thread pinned to the target CPU so the pages land on its node.
+static void *clone_worker(void *arg) {
+    CloneTask *task = arg;
+    bbhash_pin_thread(task->cpu);
+    task->copy = bbhash_mphf_clone(task->source);
+    return NULL;
+}
+
+// Makes one copy per task, all in parallel.
+static bool clone_all(CloneTask tasks[], size_t n) {
+    pthread_t *tids = malloc(sizeof(pthread_t) * n);
+    bool *started = calloc(n, sizeof(bool));
+    if (!tids || !started) {
+        free(tids);
+        free(started);
+        return false;
+    }
+    for (size_t i = 0; i < n; i++) {
+        started[i] = pthread_create(&tids[i], NULL, clone_worker, &tasks[i]) == 0;
+        if (!started[i]) clone_worker(&tasks[i]);  // copy here, unpinned
+    }
+    bool ok = true;
+    for (size_t i = 0; i < n; i++) {
+        if (started[i]) pthread_join(tids[i], NULL);
+        if (!tasks[i].copy) ok = false;
+    }
+    free(tids);
+    free(started);
+    return ok;
+}
+
+BBHashReplicas *bbhash_replicas_create(const BBHash *mphf, BBHashReplicaMode mode, unsigned threads) {
+    if (!mphf || threads == 0) return NULL;
+
+    BBHashReplicas *r = calloc(1, sizeof(BBHashReplicas));
+    Topology *topo = malloc(sizeof(Topology));
+    CloneTask *tasks = calloc(threads, sizeof(CloneTask));
+    size_t *copy_of = calloc(threads, sizeof(size_t));  // copy index per thread
+    if (!r || !topo || !tasks || !copy_of) goto failure;
+
+    read_topology(topo);
+    r->num_threads = threads;
+    r->cpus = malloc(sizeof(unsigned) * threads);
+    r->by_thread = malloc(sizeof(BBHash *) * threads);
+    if (!r->cpus || !r->by_thread) goto failure;
+    for (unsigned t = 0; t < threads; t++) {
+        r->cpus[t] = topo->cpus[t % topo->num_cpus];
+        r->by_thread[t] = mphf;
+    }
+
+    if (mode == BBHASH_REPLICA_PER_NODE && topo->num_nodes < 2) {
+        mode = BBHASH_REPLICA_SHARED;  // nothing to gain from a copy
+    }
+
+    size_t n = 0;
+    if (mode == BBHASH_REPLICA_PER_THREAD) {
+        for (unsigned t = 0; t < threads; t++) {
+            tasks[n] = (CloneTask) {.source = mphf, .cpu = r->cpus[t]};
+            copy_of[t] = n++;
+        }
+    } else if (mode == BBHASH_REPLICA_PER_NODE) {
+        // One task per node, run on the node's first query CPU.
+        for (unsigned t = 0; t < threads; t++) {
+            unsigned node = topo->node_of[r->cpus[t]];
+            size_t i = 0;
+            while (i < n && topo->node_of[tasks[i].cpu] != node) i++;
+            if (i == n) tasks[n++] = (CloneTask) {.source = mphf, .cpu = r->cpus[t]};
+            copy_of[t] = i;
+        }
+    }
+
+    if (n > 0) {
+        bool ok = clone_all(tasks, n);
+        r->copies = malloc(sizeof(BBHash *) * n);
+        if (!r->copies) ok = false;
+        for (size_t i = 0; i < n; i++) {
+            if (r->copies) r->copies[r->num_copies++] = tasks[i].copy;
+            else bbhash_free(tasks[i].copy);
+        }
+        if (!ok) goto failure;
+        for (unsigned t = 0; t < threads; t++) {
+            r->by_thread[t] = r->copies[copy_of[t]];
+        }
+    }
+
+    free(topo);
+    free(tasks);
+    free(copy_of);
+    return r;
+
+failure:
+    fprintf(stderr, "bbhash_replicas_create: failed to create replicas.\n");
+    free(topo);
+    free(tasks);
+    free(copy_of);
+    bbhash_replicas_free(r);
+    return NULL;
+}
+
+const BBHash *bbhash_replicas_get(const BBHashReplicas *r, unsigned thread) {
+    return r->by_thread[thread % r->num_threads];
+}
+
+unsigned bbhash_replicas_cpu(const BBHashReplicas *r, unsigned thread) {
+    return r->cpus[thread % r->num_threads];
+}
+
+size_t bbhash_replicas_count(const BBHashReplicas *r) {
+    return r ? r->num_copies : 0;
+}
+
+void bbhash_replicas_free(BBHashReplicas *r) {
+    if (r == NULL) {
+        return;
+    }
+    for (size_t i = 0; i < r->num_copies; i++) {
+        bbhash_free(r->copies[i]);
+    }
+    free(r->copies);
+    free(r->cpus);
+    free(r->by_thread);
+    free(r);
+}
@@ -0,0 +1,61 @@
+#ifndef BBHASH_REPLICA_H
+#define BBHASH_REPLICA_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "bbhash.h"
+
+/*
+ * Query-side replication of an MPHF.
+ *
+ * Queries only read the MPHF, so any number of threads can share one copy.
+ * On multi-socket hosts the remote threads then pay cross-node latency on
+ * every probe; giving each node (or each thread) its own copy trades memory
+ * for local access. Thread t of a replica set runs on the t-th CPU the
+ * process may use (wrapping around), and each copy is made by a helper
+ * thread pinned to a CPU of its node so first-touch allocation puts it there.
+ *
+ * Node topology comes from /sys/devices/system/node. Without it every CPU is
+ * treated as node 0, and per-node replication degrades to sharing the
+ * original. Pinning failures are ignored.
+ */
+typedef struct BBHashReplicas BBHashReplicas;
+
+typedef enum {
+    BBHASH_REPLICA_SHARED,      // every thread queries the original
+    BBHASH_REPLICA_PER_NODE,    // one copy per NUMA node that has threads
+    BBHASH_REPLICA_PER_THREAD,  // one copy per thread
+} BBHashReplicaMode;
+
+/**
+ * @brief Creates replicas of an MPHF for a number of query threads.
+ * @param mphf The MPHF to replicate. It must outlive the replica set.
+ * @param mode How to share copies between threads.
+ * @param threads Number of query threads.
+ * @return A new replica set, or NULL on failure.
+ */
+BBHashReplicas *bbhash_replicas_create(const BBHash *mphf, BBHashReplicaMode mode, unsigned threads);
+
+/** @brief Returns the MPHF that query thread `thread` should use. */
+const BBHash *bbhash_replicas_get(const BBHashReplicas *r, unsigned thread);
+
+/** @brief Returns the CPU that query thread `thread` is meant to run on. */
+unsigned bbhash_replicas_cpu(const BBHashReplicas *r, unsigned thread);
+
+/** @brief Returns the number of copies made (0 when sharing the original). */
+size_t bbhash_replicas_count(const BBHashReplicas *r);
+
+/** @brief Frees the copies and the replica set (not the original MPHF). */
+void bbhash_replicas_free(BBHashReplicas *r);
+
+/** @brief Returns the number of NUMA nodes with usable CPUs (at least 1). */
+unsigned bbhash_numa_nodes(void);
+
+/**
+ * @brief Pins the calling thread to one CPU.
+ * @return 0 on success, -1 on failure.
+ */
+int bbhash_pin_thread(unsigned cpu);
+
+#endif // BBHASH_REPLICA_H
@@ -0,0 +1,72 @@
+/* bbhash_replica_test.c - tests for MPHF cloning and replica sets.
+ *
+ */
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "mt64.h"
+#include "dedup.h"
+#include "bbhash.h"
+#include "bbhash_replica.h"
+
+static void check_same(const BBHash *a, const BBHash *b, const uint64_t keys[], size_t n) {
+    assert(bbhash_size_in_bits(a) == bbhash_size_in_bits(b));
+    for (size_t i = 0; i < n; i++) {
+        assert(bbhash_mphf_query(a, keys[i]) == bbhash_mphf_query(b, keys[i]));
+    }
+}
+
+int main(void) {
+    const size_t n = 200000;
+    Mt64 *rng = mt64_create(21);
+    uint64_t *keys = malloc(sizeof(uint64_t) * n);
+    for (size_t i = 0; i < n; i++) keys[i] = mt64_gen_int64(rng);
+    size_t unique = dedup(keys, n);
+
+    // Clones are deep copies, with and without a compact tail.
+    BBHashConfig config = bbhash_config_default();
+    config.compact_from_level = 2;
+    BBHash *mphfs[2] = {bbhash_mphf_create(keys, unique, 2.0, false), bbhash_mphf_create_ex(keys, unique, &config)};
+    for (int m = 0; m < 2; m++) {
+        BBHash *copy = bbhash_mphf_clone(mphfs[m]);
+        assert(copy != NULL);
+        check_same(mphfs[m], copy, keys, unique);
+        bbhash_free(copy);
+    }
+
+    // A clone of a mapped MPHF owns its memory and outlives the mapping.
+    assert(bbhash_mphf_save(mphfs[1], "replica_test.bin") == 0);
+    BBHash *mapped = bbhash_mphf_mmap("replica_test.bin", BBHASH_LOAD_VERIFY);
+    assert(mapped != NULL);
+    BBHash *copy = bbhash_mphf_clone(mapped);
+    bbhash_free(mapped);
+    remove("replica_test.bin");
+    assert(bbhash_mphf_verify(copy, keys, unique, 2) == 0);
+    bbhash_free(copy);
+
+    // Replica sets hand every thread an equivalent MPHF.
+    printf("bbhash_replica_test: %u NUMA node(s)\n", bbhash_numa_nodes());
+    const unsigned threads = 4;
+    for (int mode = BBHASH_REPLICA_SHARED; mode <= BBHASH_REPLICA_PER_THREAD; mode++) {
+        BBHashReplicas *r = bbhash_replicas_create(mphfs[0], mode, threads);
+        assert(r != NULL);
+        for (unsigned t = 0; t < threads; t++) {
+            check_same(mphfs[0], bbhash_replicas_get(r, t), keys, 1000);
+        }
+        if (mode == BBHASH_REPLICA_SHARED) assert(bbhash_replicas_count(r) == 0);
+        if (mode == BBHASH_REPLICA_PER_NODE) assert(bbhash_replicas_count(r) <= bbhash_numa_nodes());
+        if (mode == BBHASH_REPLICA_PER_THREAD) {
+            assert(bbhash_replicas_count(r) == threads);
+            assert(bbhash_replicas_get(r, 0) != bbhash_replicas_get(r, 1));
+        }
+        bbhash_replicas_free(r);
+    }
+
+    bbhash_free(mphfs[0]);
+    bbhash_free(mphfs[1]);
+    free(keys);
+    mt64_destroy(rng);
+    printf("bbhash_replica_test: OK\n");
+    return 0;
+}
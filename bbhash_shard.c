@@ -0,0 +1,321 @@
+#define _POSIX_C_SOURCE 200809L  // mmap, open, fstat under -std=c23
+
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "hashing.h"
+#include "crc32c.h"
+#include "bbhash_shard.h"
+
+constexpr uint64_t SHARD_SEED = 0x5ba4d3c1e0f2a697;
+constexpr size_t SHARD_FIXED_HEADER = 24;  // magic, flags, num_shards, total_keys
+constexpr size_t COPY_CHUNK = 1 << 20;
+
+typedef struct {
+    uint64_t offset;      // byte offset of the shard image in the file
+    uint64_t length;      // bytes of the image, before padding
+    uint64_t key_offset;  // global index of the shard's first key
+} ShardEntry;
+
+struct BBHashSharded {
+    uint32_t num_shards;
+    size_t num_keys;
+    BBHash **shards;          // borrow their images from the file
+    uint64_t *key_offsets;
+    void *mapping;            // mmap()ed file, or NULL
+    size_t mapping_len;
+    void *buffer;             // file read into memory, or NULL
+};
+
+uint32_t bbhash_shard_of(uint64_t key, uint32_t num_shards) {
+    return (uint32_t)(hash_with_seed(key, SHARD_SEED) % num_shards);
+}
+
+size_t bbhash_shard_select(const uint64_t keys[], size_t n, uint32_t shard, uint32_t num_shards, uint64_t out[]) {
+    size_t count = 0;
+    for (size_t i = 0; i < n; i++) {
+        out[count] = keys[i];
+        count += bbhash_shard_of(keys[i], num_shards) == shard;
+    }
+    return count;
+}
+
+static size_t header_bytes(size_t num_shards) {
+    return SHARD_FIXED_HEADER + num_shards * sizeof(ShardEntry) + sizeof(uint64_t);
+}
+
+// Checks that a shard file is a valid version 3 image of shard `shard` of
+// `num_shards`; returns its length and key count.
+static bool inspect_shard(const char *path, size_t shard, size_t num_shards, uint64_t *length,
+                          uint64_t *num_keys) {
+    FILE *fp = fopen(path, "rb");
+    if (!fp) {
+        perror(path);
+        return false;
+    }
+    char magic[4];
+    bool v3 = fread(magic, 1, 4, fp) == 4 && memcmp(magic, "BBH3", 4) == 0;
+    long len = fseek(fp, 0, SEEK_END) == 0 ? ftell(fp) : -1;
+    fclose(fp);
+    if (!v3) {
+        fprintf(stderr, "Error: shard '%s' is not a version 3 MPHF file (see bbhash convert).\n", path);
+        return false;
+    }
+    BBHash *mphf = bbhash_mphf_mmap(path, BBHASH_LOAD_VERIFY);
+    if (!mphf || len <= 0) {
+        fprintf(stderr, "Error: shard '%s' is corrupt.\n", path);
+        bbhash_free(mphf);
+        return false;
+    }
+    BBHashStats stats;
+    bbhash_mphf_stats(mphf, &stats);
+    bbhash_free(mphf);
+    // Any MPHF is the one shard of one; otherwise the file must say which it is.
+    if (num_shards > 1 && stats.num_shards == 0) {
+        fprintf(stderr, "Error: '%s' was not built as a shard (see build --shard).\n", path);
+        return false;
+    }
+    if (stats.num_shards != 0 && (stats.num_shards != num_shards || stats.shard != shard)) {
+        fprintf(stderr, "Error: '%s' is shard %u/%u, but was given as shard %zu/%zu.\n", path, stats.shard,
+                stats.num_shards, shard, num_shards);
+        return false;
+    }
+    *length = (uint64_t)len;
+    *num_keys = stats.num_keys;
+    return true;
+}
+
+static bool copy_file(FILE *out, const char *path, uint64_t length, char *chunk) {
+    FILE *in = fopen(path, "rb");
+    if (!in) {
+        perror(path);
+        return false;
+    }
+    uint64_t copied = 0;
+    while (copied < length) {
+        size_t want = length - copied < COPY_CHUNK ? (size_t)(length - copied) : COPY_CHUNK;
+        size_t got = fread(chunk, 1, want, in);
+        if (got == 0 || fwrite(chunk, 1, got, out) != got) break;
+        copied += got;
+    }
+    fclose(in);
+    if (copied != length) {
+        fprintf(stderr, "Error: failed to copy shard '%s'.\n", path);
+        return false;
+    }
+    return true;
+}
+
+int bbhash_shard_merge(const char *const shard_files[], size_t num_shards, const char *out_path) {
+    if (!shard_files || !out_path || num_shards == 0 || num_shards > UINT32_MAX) {
+        fprintf(stderr, "Error: merge needs between 1 and 2^32-1 shards.\n");
+        return -1;
+    }
+    int status = -1;
+    FILE *out = NULL;
+    char *chunk = NULL;
+    size_t header_len = header_bytes(num_shards);
+    uint8_t *header = calloc(1, header_len);
+    if (!header) return -1;
+    ShardEntry *dir = (ShardEntry *)(header + SHARD_FIXED_HEADER);
+
+    uint64_t offset = header_len, total_keys = 0;
+    for (size_t i = 0; i < num_shards; i++) {
+        uint64_t num_keys;
+        if (!inspect_shard(shard_files[i], i, num_shards, &dir[i].length, &num_keys)) goto cleanup;
+        dir[i].offset = offset;
+        dir[i].key_offset = total_keys;
+        offset += (dir[i].length + 7) & ~(uint64_t)7;
+        total_keys += num_keys;
+    }
+    memcpy(header, "BBS1", 4);
+    uint64_t count = num_shards;
+    memcpy(header + 8, &count, sizeof(count));
+    memcpy(header + 16, &total_keys, sizeof(total_keys));
+    uint64_t crc = crc32c(0, header, header_len - sizeof(uint64_t));
+    memcpy(header + header_len - sizeof(uint64_t), &crc, sizeof(crc));
+
+    out = fopen(out_path, "wb");
+    chunk = malloc(COPY_CHUNK);
+    if (!out || !chunk) {
+        perror(out_path);
+        goto cleanup;
+    }
+    if (fwrite(header, 1, header_len, out) != header_len) goto write_error;
+    static const char padding[8] = {0};
+    for (size_t i = 0; i < num_shards; i++) {
+        if (!copy_file(out, shard_files[i], dir[i].length, chunk)) goto cleanup;
+        size_t pad = (size_t)((8 - dir[i].length % 8) % 8);
+        if (fwrite(padding, 1, pad, out) != pad) goto write_error;
+    }
+    status = 0;
+    goto cleanup;
+
+write_error:
+    fprintf(stderr, "Error: failed to write '%s'.\n", out_path);
+cleanup:
+    if (out && fclose(out) != 0 && status == 0) {
+        fprintf(stderr, "Error: failed to write '%s'.\n", out_path);
+        status = -1;
+    }
+    free(chunk);
+    free(header);
+    return status;
+}
+
+// Opens the shards of a sharded image that stays valid for the lifetime of `s`.
+static bool open_shards(BBHashSharded *s, const uint8_t *image, size_t len, unsigned flags) {
+    uint32_t file_flags;
+    uint64_t num_shards, total_keys;
+    if (len < SHARD_FIXED_HEADER || memcmp(image, "BBS1", 4) != 0) {
+        fprintf(stderr, "Error: not a sharded MPHF file.\n");
+        return false;
+    }
+    memcpy(&file_flags, image + 4, sizeof(file_flags));
+    memcpy(&num_shards, image + 8, sizeof(num_shards));
+    memcpy(&total_keys, image + 16, sizeof(total_keys));
+    if (file_flags != 0 || num_shards == 0 || num_shards > UINT32_MAX
+            || num_shards > len / sizeof(ShardEntry) || header_bytes(num_shards) > len) {
+        fprintf(stderr, "Error: sharded MPHF header is corrupt or truncated.\n");
+        return false;
+    }
+    // The directory is small, so its checksum is always checked.
+    size_t header_len = header_bytes(num_shards);
+    uint64_t crc;
+    memcpy(&crc, image + header_len - sizeof(uint64_t), sizeof(crc));
+    if (crc != crc32c(0, image, header_len - sizeof(uint64_t))) {
+        fprintf(stderr, "Error: sharded MPHF directory checksum mismatch.\n");
+        return false;
+    }
+
+    s->num_shards = (uint32_t)num_shards;
+    s->num_keys = total_keys;
+    s->shards = calloc(num_shards, sizeof(BBHash *));
+    s->key_offsets = malloc(sizeof(uint64_t) * num_shards);
+    if (!s->shards || !s->key_offsets) return false;
+
+    const ShardEntry *dir = (const ShardEntry *)(image + SHARD_FIXED_HEADER);
+    uint64_t expected_offset = 0;
+    for (size_t i = 0; i < num_shards; i++) {
+        if (dir[i].offset % 8 != 0 || dir[i].offset > len || dir[i].length > len - dir[i].offset
+                || dir[i].key_offset != expected_offset) {
+            fprintf(stderr, "Error: sharded MPHF directory entry %zu is corrupt.\n", i);
+            return false;
+        }
+        s->shards[i] = bbhash_mphf_from_buffer(image + dir[i].offset, dir[i].length, flags);
+        if (!s->shards[i]) {
+            fprintf(stderr, "Error: shard %zu of the sharded MPHF is corrupt.\n", i);
+            return false;
+        }
+        BBHashStats stats;
+        bbhash_mphf_stats(s->shards[i], &stats);
+        if (stats.num_shards != 0 && (stats.num_shards != num_shards || stats.shard != i)) {
+            fprintf(stderr, "Error: shard %zu of the sharded MPHF records another position.\n", i);
+            return false;
+        }
+        s->key_offsets[i] = dir[i].key_offset;
+        expected_offset += stats.num_keys;
+    }
+    if (expected_offset != total_keys) {
+        fprintf(stderr, "Error: sharded MPHF key count does not match its shards.\n");
+        return false;
+    }
+    return true;
+}
+
+BBHashSharded *bbhash_sharded_mmap(const char *filename, unsigned flags) {
+    if (!filename) return NULL;
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0) {
+        perror("bbhash_sharded_mmap: open");
+        return NULL;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+        fprintf(stderr, "Error: cannot map empty or unreadable sharded MPHF file.\n");
+        close(fd);
+        return NULL;
+    }
+    size_t len = (size_t)st.st_size;
+    void *map = mmap(NULL, len, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        perror("bbhash_sharded_mmap: mmap");
+        return NULL;
+    }
+    BBHashSharded *s = calloc(1, sizeof(BBHashSharded));
+    if (!s) {
+        munmap(map, len);
+        return NULL;
+    }
+    s->mapping = map;
+    s->mapping_len = len;
+    if (!open_shards(s, map, len, flags)) {
+        bbhash_sharded_free(s);
+        return NULL;
+    }
+    return s;
+}
+
+BBHashSharded *bbhash_sharded_load(const char *filename, unsigned flags) {
+    if (!filename) return NULL;
+    FILE *fp = fopen(filename, "rb");
+    if (!fp) {
+        perror("bbhash_sharded_load: fopen");
+        return NULL;
+    }
+    long len = fseek(fp, 0, SEEK_END) == 0 ? ftell(fp) : -1;
+    BBHashSharded *s = calloc(1, sizeof(BBHashSharded));
+    // malloc() memory is 8-byte aligned, so the shards use it in place.
+    void *buf = len > 0 ? malloc((size_t)len) : NULL;
+    if (!s || !buf || fseek(fp, 0, SEEK_SET) != 0 || fread(buf, 1, (size_t)len, fp) != (size_t)len) {
+        fprintf(stderr, "Error: cannot read sharded MPHF file '%s'.\n", filename);
+        fclose(fp);
+        free(buf);
+        free(s);
+        return NULL;
+    }
+    fclose(fp);
+    s->buffer = buf;
+    if (!open_shards(s, buf, (size_t)len, flags)) {
+        bbhash_sharded_free(s);
+        return NULL;
+    }
+    return s;
+}
+
+size_t bbhash_sharded_query(const BBHashSharded *s, uint64_t key) {
+    uint32_t shard = bbhash_shard_of(key, s->num_shards);
+    size_t idx = bbhash_mphf_query(s->shards[shard], key);
+    return idx == (size_t) -1 ? idx : s->key_offsets[shard] + idx;
+}
+
+size_t bbhash_sharded_num_keys(const BBHashSharded *s) {
+    return s->num_keys;
+}
+
+size_t bbhash_sharded_num_shards(const BBHashSharded *s) {
+    return s->num_shards;
+}
+
+const BBHash *bbhash_sharded_shard(const BBHashSharded *s, size_t i, size_t *key_offset) {
+    if (i >= s->num_shards) return NULL;
+    if (key_offset) *key_offset = s->key_offsets[i];
+    return s->shards[i];
+}
+
+void bbhash_sharded_free(BBHashSharded *s) {
+    if (!s) return;
+    if (s->shards) {
+        for (size_t i = 0; i < s->num_shards; i++) bbhash_free(s->shards[i]);
+    }
+    free(s->shards);
+    free(s->key_offsets);
+    if (s->mapping) munmap(s->mapping, s->mapping_len);
+    free(s->buffer);
+    free(s);
+}
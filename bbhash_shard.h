@@ -0,0 +1,88 @@
+#ifndef BBHASH_SHARD_H
+#define BBHASH_SHARD_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "bbhash.h"
+
+/*
+ * Sharded builds: one MPHF per hash partition, merged into one file.
+ *
+ * Each worker process keeps the keys with bbhash_shard_of(key, N) == i,
+ * builds an MPHF over them with config.shard = i and config.num_shards = N,
+ * and saves it with bbhash_mphf_save(). The file records i/N, so the merge
+ * can check that every shard is there and in order. The merge
+ * step copies the shard files, unchanged, into one 'BBS1' file. It puts a
+ * directory in front that records where each shard starts and the global
+ * index of its first key. A query computes the key's shard, queries that
+ * shard's MPHF in place, and adds the shard's key offset. Together the
+ * shards map the whole key set onto [0, total keys).
+ *
+ * Format 'BBS1': magic, 32-bit flags (0), num_shards, total_keys, then per
+ * shard its byte offset in the file, its length and its key offset, then
+ * the CRC-32C of everything before it. The shard images follow, each a
+ * version 3 MPHF image starting 8-byte aligned and carrying its own
+ * checksums. Integers are little-endian 64-bit unless noted.
+ */
+typedef struct BBHashSharded BBHashSharded;
+
+/**
+ * @brief Returns the shard in [0, num_shards) that a key belongs to.
+ *
+ * This is hash_with_seed() with a fixed seed, far from the level seeds,
+ * taken modulo num_shards. It is part of the file format and never changes.
+ */
+uint32_t bbhash_shard_of(uint64_t key, uint32_t num_shards);
+
+/**
+ * @brief Copies the keys of one shard, in input order.
+ * @param out Receives the selected keys; room for n keys is always enough.
+ *        It may be `keys` itself.
+ * @return The number of keys copied.
+ */
+size_t bbhash_shard_select(const uint64_t keys[], size_t n, uint32_t shard, uint32_t num_shards, uint64_t out[]);
+
+/**
+ * @brief Merges shard files into one sharded file without rebuilding.
+ *
+ * Shard i must hold the MPHF of the keys of partition i out of num_shards,
+ * built with that shard recorded (BBHashConfig.shard and num_shards), so a
+ * missing or misplaced file is refused. A single MPHF without a record
+ * merges as shard 0 of 1. Shards must be in format version 3 (see bbhash
+ * convert); their checksums are verified while they are read.
+ * @return 0 on success, -1 on failure.
+ */
+int bbhash_shard_merge(const char *const shard_files[], size_t num_shards, const char *out_path);
+
+/**
+ * @brief Maps a sharded file and serves queries from it in place.
+ * @param flags Zero or more BBHASH_LOAD_* flags; BBHASH_LOAD_VERIFY checks
+ *        the directory and every shard.
+ * @return The sharded MPHF, or NULL on failure.
+ */
+BBHashSharded *bbhash_sharded_mmap(const char *filename, unsigned flags);
+
+/** @brief As bbhash_sharded_mmap(), but reads the file into memory. */
+BBHashSharded *bbhash_sharded_load(const char *filename, unsigned flags);
+
+/**
+ * @brief Returns the global index of a key in [0, total keys).
+ * @return As bbhash_mphf_query(): arbitrary or (size_t)-1 for non-members.
+ */
+size_t bbhash_sharded_query(const BBHashSharded *s, uint64_t key);
+
+/** @brief Total number of keys over all shards. */
+size_t bbhash_sharded_num_keys(const BBHashSharded *s);
+
+size_t bbhash_sharded_num_shards(const BBHashSharded *s);
+
+/**
+ * @brief Returns shard i and, through key_offset, the global index of its first key.
+ * @return The shard's MPHF, owned by the sharded MPHF, or NULL if i is out of range.
+ */
+const BBHash *bbhash_sharded_shard(const BBHashSharded *s, size_t i, size_t *key_offset);
+
+void bbhash_sharded_free(BBHashSharded *s);
+
+#endif // BBHASH_SHARD_H
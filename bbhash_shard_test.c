@@ -0,0 +1,131 @@
+/* bbhash_shard_test.c - tests for sharded builds and the shard merge.
+ *
+ */
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "mt64.h"
+#include "dedup.h"
+#include "bitarray.h"
+#include "bbhash.h"
+#include "bbhash_shard.h"
+
+constexpr uint32_t NUM_SHARDS = 5;
+
+static void check_bijection(const BBHashSharded *s, const uint64_t keys[], size_t n) {
+    assert(bbhash_sharded_num_keys(s) == n);
+    assert(bbhash_sharded_num_shards(s) == NUM_SHARDS);
+    Bitarray *seen = bitarray_new(n);
+    for (size_t i = 0; i < n; i++) {
+        size_t idx = bbhash_sharded_query(s, keys[i]);
+        assert(idx < n);
+        assert(bitarray_get(seen, idx) == 0);
+        bitarray_set(seen, idx);
+    }
+    bitarray_free(seen);
+}
+
+int main(void) {
+    size_t n = 1000000;
+    Mt64 *rng = mt64_create(21);
+    uint64_t *keys = malloc(sizeof(uint64_t) * n);
+    uint64_t *part = malloc(sizeof(uint64_t) * n);
+    for (size_t i = 0; i < n; i++) keys[i] = mt64_gen_int64(rng);
+    mt64_destroy(rng);
+    n = dedup(keys, n);
+
+    printf("bbhash_shard_test\n");
+
+    // Each "worker" builds and saves its own partition.
+    char names[NUM_SHARDS][64];
+    const char *files[NUM_SHARDS];
+    size_t total = 0;
+    for (uint32_t i = 0; i < NUM_SHARDS; i++) {
+        size_t count = bbhash_shard_select(keys, n, i, NUM_SHARDS, part);
+        for (size_t k = 0; k < count; k++) assert(bbhash_shard_of(part[k], NUM_SHARDS) == i);
+        BBHashConfig config = bbhash_config_default();
+        config.shard = i;
+        config.num_shards = NUM_SHARDS;
+        BBHash *mphf = bbhash_mphf_create_ex(part, count, &config);
+        assert(mphf != NULL);
+        BBHashStats stats;
+        bbhash_mphf_stats(mphf, &stats);
+        assert(stats.shard == i && stats.num_shards == NUM_SHARDS);
+        snprintf(names[i], sizeof(names[i]), "bbhash_shard_test_%u.bbh", i);
+        files[i] = names[i];
+        assert(bbhash_mphf_save(mphf, files[i]) == 0);
+        bbhash_free(mphf);
+        printf("  shard %u: %zu keys\n", i, count);
+        total += count;
+    }
+    assert(total == n);
+
+    const char *merged = "bbhash_shard_test.bbs";
+    // Missing, reordered or untagged shards are refused.
+    assert(bbhash_shard_merge(files, NUM_SHARDS - 1, merged) == -1);
+    const char *swapped[NUM_SHARDS];
+    for (uint32_t i = 0; i < NUM_SHARDS; i++) swapped[i] = files[i];
+    swapped[0] = files[1];
+    swapped[1] = files[0];
+    assert(bbhash_shard_merge(swapped, NUM_SHARDS, merged) == -1);
+    BBHash *plain = bbhash_mphf_create(keys, 1000, 2.0, false);
+    assert(plain && bbhash_mphf_save(plain, "bbhash_shard_test_plain.bbh") == 0);
+    bbhash_free(plain);
+    swapped[0] = "bbhash_shard_test_plain.bbh";
+    swapped[1] = files[1];
+    assert(bbhash_shard_merge(swapped, NUM_SHARDS, merged) == -1);
+    assert(bbhash_shard_merge(swapped, 1, merged) == 0);  // any MPHF is shard 0 of 1
+    remove("bbhash_shard_test_plain.bbh");
+    BBHashConfig bad = bbhash_config_default();
+    bad.shard = NUM_SHARDS;
+    bad.num_shards = NUM_SHARDS;
+    assert(bbhash_mphf_create_ex(keys, 1000, &bad) == NULL);
+
+    assert(bbhash_shard_merge(files, NUM_SHARDS, merged) == 0);
+    BBHashSharded *mapped = bbhash_sharded_mmap(merged, BBHASH_LOAD_VERIFY);
+    BBHashSharded *loaded = bbhash_sharded_load(merged, 0);
+    assert(mapped != NULL && loaded != NULL);
+    check_bijection(mapped, keys, n);
+    for (size_t i = 0; i < n; i += 97) {
+        assert(bbhash_sharded_query(loaded, keys[i]) == bbhash_sharded_query(mapped, keys[i]));
+    }
+    size_t offset;
+    assert(bbhash_sharded_shard(mapped, 0, &offset) != NULL && offset == 0);
+    assert(bbhash_sharded_shard(mapped, NUM_SHARDS, NULL) == NULL);
+    bbhash_sharded_free(mapped);
+    bbhash_sharded_free(loaded);
+
+    // A corrupt shard is caught with verification; a corrupt directory always.
+    FILE *fp = fopen(merged, "r+b");
+    assert(fp);
+    fseek(fp, -100, SEEK_END);
+    int c = fgetc(fp);
+    fseek(fp, -100, SEEK_END);
+    fputc(c ^ 0x40, fp);
+    fclose(fp);
+    assert(bbhash_sharded_mmap(merged, BBHASH_LOAD_VERIFY) == NULL);
+    fp = fopen(merged, "r+b");
+    assert(fp);
+    fseek(fp, 30, SEEK_SET);
+    fputc(0xff, fp);
+    fclose(fp);
+    assert(bbhash_sharded_mmap(merged, 0) == NULL);
+
+    // Older formats cannot record a shard, and are refused even as the only one.
+    BBHash *v1 = bbhash_mphf_load(files[0]);
+    assert(bbhash_mphf_save_ex(v1, files[0], 1) == -1);
+    bbhash_free(v1);
+    v1 = bbhash_mphf_create(keys, 1000, 2.0, false);
+    assert(bbhash_mphf_save_ex(v1, files[0], 1) == 0);
+    bbhash_free(v1);
+    assert(bbhash_shard_merge(files, 1, merged) == -1);
+
+    for (uint32_t i = 0; i < NUM_SHARDS; i++) remove(files[i]);
+    remove(merged);
+    free(keys);
+    free(part);
+    printf("All tests passed.\n");
+    return 0;
+}
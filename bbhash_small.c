@@ -0,0 +1,565 @@
+#define _POSIX_C_SOURCE 200809L  // mmap, open, fstat under -std=c23
+
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdalign.h>
+#include <pthread.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "bitarray.h"
+#include "hashing.h"
+#include "crc32c.h"
+#include "bbhash.h"
+#include "bbhash_small.h"
+
+// Level l hashes with seed SMALL_FIRST_SEED + l, like the levels of BBHash.
+constexpr uint64_t SMALL_FIRST_SEED = 42;
+constexpr size_t SMALL_MIN_LEVEL_SIZE = 8;
+constexpr size_t SMALL_BLOCK_BITS = 512;
+// Distinct keys are all placed long before this; duplicates never are.
+constexpr size_t SMALL_MAX_LEVELS = 64;
+
+enum {
+    SMALL_WIDE_RANKS = 1u << 0,  // 32-bit rank checkpoints
+};
+
+struct BBHashSmall {
+    uint32_t num_keys;
+    uint32_t num_bits;     // all levels, back to back
+    uint16_t num_levels;
+    uint16_t flags;
+    float gamma;
+    uint64_t words[];      // level bits, then one rank checkpoint per block after the first
+};
+
+static_assert(sizeof(BBHashSmall) == 16, "BBHashSmall header must stay 16 bytes");
+
+struct BBHashSmallBuilder {
+    float gamma;
+    uint64_t *keys;        // keys not yet placed
+    size_t keys_cap;
+    uint64_t *slots;       // occupancy of the current level: seen, then multi
+    size_t slots_cap;      // in words
+    uint64_t *bits;        // levels built so far
+    size_t bits_cap;       // in words
+};
+
+static size_t small_level_size(size_t unplaced, float gamma) {
+    size_t n = (size_t)((double)unplaced * gamma);
+    return n < SMALL_MIN_LEVEL_SIZE ? SMALL_MIN_LEVEL_SIZE : n;
+}
+
+static size_t small_num_checkpoints(size_t num_bits) {
+    return num_bits ? (num_bits - 1) / SMALL_BLOCK_BITS : 0;
+}
+
+// Size of the flat image described by a header, padded to 8 bytes.
+static size_t small_image_bytes(const BBHashSmall *hdr) {
+    size_t width = hdr->flags & SMALL_WIDE_RANKS ? sizeof(uint32_t) : sizeof(uint16_t);
+    size_t bytes = sizeof(BBHashSmall) + (hdr->num_bits + 63) / 64 * sizeof(uint64_t)
+                   + small_num_checkpoints(hdr->num_bits) * width;
+    return (bytes + 7) & ~(size_t)7;
+}
+
+// Number of set bits before `pos`, which must be below num_bits.
+static size_t small_rank(const BBHashSmall *s, size_t pos) {
+    size_t block = pos / SMALL_BLOCK_BITS, word = pos / 64, rank = 0;
+    if (block > 0) {
+        const void *table = s->words + (s->num_bits + 63) / 64;
+        rank = s->flags & SMALL_WIDE_RANKS ? ((const uint32_t *)table)[block - 1]
+               : ((const uint16_t *)table)[block - 1];
+    }
+    for (size_t i = block * (SMALL_BLOCK_BITS / 64); i < word; i++) {
+        rank += stdc_count_ones(s->words[i]);
+    }
+    if (pos & 63) rank += stdc_count_ones(s->words[word] & ((UINT64_C(1) << (pos & 63)) - 1));
+    return rank;
+}
+
+size_t bbhash_small_query(const BBHashSmall *s, uint64_t key) {
+    size_t start = 0, unplaced = s->num_keys;
+    for (size_t l = 0; l < s->num_levels; l++) {
+        size_t level_size = small_level_size(unplaced, s->gamma);
+        if (start + level_size > s->num_bits) break;
+        size_t idx = start + hash_with_seed(key, SMALL_FIRST_SEED + l) % level_size;
+        if ((s->words[idx / 64] >> (idx % 64)) & 1) return small_rank(s, idx);
+        start += level_size;
+        if (start >= s->num_bits) break;
+        unplaced = s->num_keys - small_rank(s, start);
+    }
+    return (size_t) -1;
+}
+
+size_t bbhash_small_num_keys(const BBHashSmall *s) {
+    return s->num_keys;
+}
+
+size_t bbhash_small_bytes(const BBHashSmall *s) {
+    return small_image_bytes(s);
+}
+
+void bbhash_small_free(BBHashSmall *s) {
+    free(s);
+}
+
+BBHashSmallBuilder *bbhash_small_builder_create(double gamma) {
+    if (!(gamma >= 1.0)) {
+        fprintf(stderr, "bbhash_small_builder_create: gamma must be at least 1.0.\n");
+        return NULL;
+    }
+    BBHashSmallBuilder *b = calloc(1, sizeof(BBHashSmallBuilder));
+    if (b) b->gamma = (float)gamma;
+    return b;
+}
+
+void bbhash_small_builder_free(BBHashSmallBuilder *b) {
+    if (!b) return;
+    free(b->keys);
+    free(b->slots);
+    free(b->bits);
+    free(b);
+}
+
+// Grows a scratch array to at least `words` elements; the contents are kept.
+static bool reserve(uint64_t **array, size_t *cap, size_t words) {
+    if (words <= *cap) return true;
+    size_t new_cap = *cap ? *cap : 64;
+    while (new_cap < words) new_cap *= 2;
+    uint64_t *p = realloc(*array, new_cap * sizeof(uint64_t));
+    if (!p) {
+        fprintf(stderr, "bbhash_small: failed to grow scratch memory to %zu words.\n", new_cap);
+        return false;
+    }
+    *array = p;
+    *cap = new_cap;
+    return true;
+}
+
+// Places the keys level by level into b->bits and fills in the header.
+static bool build_levels(BBHashSmallBuilder *b, const uint64_t keys[], size_t n, BBHashSmall *hdr) {
+    if (n > UINT32_MAX) {
+        fprintf(stderr, "bbhash_small_build: %zu keys is too many for a small MPHF.\n", n);
+        return false;
+    }
+    memset(hdr, 0, sizeof(*hdr));
+    hdr->num_keys = (uint32_t)n;
+    hdr->flags = n > UINT16_MAX ? SMALL_WIDE_RANKS : 0;
+    hdr->gamma = b->gamma;
+    if (n == 0) return true;
+    if (!reserve(&b->keys, &b->keys_cap, n)) return false;
+    memcpy(b->keys, keys, n * sizeof(uint64_t));
+
+    size_t unplaced = n, start = 0, num_levels = 0, zeroed = 0;
+    while (unplaced > 0) {
+        if (num_levels == SMALL_MAX_LEVELS) {
+            fprintf(stderr, "bbhash_small_build: %zu keys unplaced after %zu levels (duplicate keys?).\n",
+                    unplaced, num_levels);
+            return false;
+        }
+        size_t level_size = small_level_size(unplaced, b->gamma);
+        if (start + level_size > UINT32_MAX) {
+            fprintf(stderr, "bbhash_small_build: levels exceed 2^32 bits.\n");
+            return false;
+        }
+        size_t words = (level_size + 63) / 64;
+        size_t total_words = (start + level_size + 63) / 64;
+        if (!reserve(&b->slots, &b->slots_cap, 2 * words)) return false;
+        if (!reserve(&b->bits, &b->bits_cap, total_words)) return false;
+        uint64_t *seen = b->slots, *multi = b->slots + words;
+        memset(b->slots, 0, 2 * words * sizeof(uint64_t));
+        for (; zeroed < total_words; zeroed++) b->bits[zeroed] = 0;
+
+        const uint64_t seed = SMALL_FIRST_SEED + num_levels;
+        for (size_t i = 0; i < unplaced; i++) {
+            size_t idx = hash_with_seed(b->keys[i], seed) % level_size;
+            uint64_t bit = UINT64_C(1) << (idx % 64);
+            multi[idx / 64] |= seen[idx / 64] & bit;
+            seen[idx / 64] |= bit;
+        }
+        size_t kept = 0;
+        for (size_t i = 0; i < unplaced; i++) {
+            uint64_t key = b->keys[i];
+            size_t idx = hash_with_seed(key, seed) % level_size;
+            if ((multi[idx / 64] >> (idx % 64)) & 1) {
+                b->keys[kept++] = key;
+            } else {
+                size_t pos = start + idx;
+                b->bits[pos / 64] |= UINT64_C(1) << (pos % 64);
+            }
+        }
+        unplaced = kept;
+        start += level_size;
+        num_levels++;
+    }
+    hdr->num_bits = (uint32_t)start;
+    hdr->num_levels = (uint16_t)num_levels;
+    return true;
+}
+
+// Writes the image for `hdr` and the levels in b->bits to 8-byte aligned `dst`.
+static void write_image(const BBHashSmallBuilder *b, const BBHashSmall *hdr, void *dst) {
+    memset(dst, 0, small_image_bytes(hdr));
+    BBHashSmall *s = dst;
+    *s = *hdr;
+    size_t words = (hdr->num_bits + 63) / 64;
+    if (words) memcpy(s->words, b->bits, words * sizeof(uint64_t));
+
+    void *table = s->words + words;
+    size_t rank = 0;
+    for (size_t k = 0; k < small_num_checkpoints(hdr->num_bits); k++) {
+        for (size_t i = k * (SMALL_BLOCK_BITS / 64); i < (k + 1) * (SMALL_BLOCK_BITS / 64); i++) {
+            rank += stdc_count_ones(s->words[i]);
+        }
+        if (hdr->flags & SMALL_WIDE_RANKS) ((uint32_t *)table)[k] = (uint32_t)rank;
+        else ((uint16_t *)table)[k] = (uint16_t)rank;
+    }
+}
+
+BBHashSmall *bbhash_small_build(BBHashSmallBuilder *b, const uint64_t keys[], size_t n) {
+    BBHashSmall hdr;
+    if (!b || (n > 0 && !keys) || !build_levels(b, keys, n, &hdr)) return NULL;
+    BBHashSmall *s = malloc(small_image_bytes(&hdr));
+    if (!s) {
+        fprintf(stderr, "bbhash_small_build: out of memory.\n");
+        return NULL;
+    }
+    write_image(b, &hdr, s);
+    return s;
+}
+
+/*
+ * Containers.
+ */
+
+constexpr size_t SET_FIXED_HEADER = 24;  // magic, flags, num_sets, data_bytes
+
+struct BBHashSmallSet {
+    size_t num_sets;
+    const uint64_t *directory;  // num_sets + 1 byte offsets into data
+    const uint8_t *data;
+    const uint8_t *image;
+    size_t image_len;
+    void *owned;                // image allocated here, or NULL
+    void *mapping;              // mmap()ed file, or NULL
+    size_t mapping_len;
+};
+
+static size_t set_header_bytes(size_t num_sets) {
+    return SET_FIXED_HEADER + (num_sets + 1) * sizeof(uint64_t) + sizeof(uint64_t);
+}
+
+typedef struct {
+    const uint64_t *keys;  // keys of set `first`
+    const size_t *counts;
+    size_t first, end;     // sets [first, end)
+    double gamma;
+    uint64_t *sizes;       // image bytes of each set, indexed by set
+    uint8_t *arena;        // images of this range, back to back
+    size_t arena_len, arena_cap;
+    bool ok;
+    pthread_t tid;
+    bool started;          // running on its own thread
+} ManyTask;
+
+static void *many_worker(void *arg) {
+    ManyTask *task = arg;
+    task->ok = false;
+    BBHashSmallBuilder *b = bbhash_small_builder_create(task->gamma);
+    if (!b) return NULL;
+    const uint64_t *keys = task->keys;
+    for (size_t i = task->first; i < task->end; i++) {
+        BBHashSmall hdr;
+        if (!build_levels(b, keys, task->counts[i], &hdr)) goto done;
+        size_t bytes = small_image_bytes(&hdr);
+        if (task->arena_len + bytes > task->arena_cap) {
+            size_t cap = task->arena_cap ? task->arena_cap : 4096;
+            while (cap < task->arena_len + bytes) cap *= 2;
+            uint8_t *p = realloc(task->arena, cap);
+            if (!p) {
+                fprintf(stderr, "bbhash_small_build_many: out of memory.\n");
+                goto done;
+            }
+            task->arena = p;
+            task->arena_cap = cap;
+        }
+        write_image(b, &hdr, task->arena + task->arena_len);
+        task->arena_len += bytes;
+        task->sizes[i] = bytes;
+        keys += task->counts[i];
+    }
+    task->ok = true;
+done:
+    bbhash_small_builder_free(b);
+    return NULL;
+}
+
+// Points the container at an image whose header and directory were checked.
+static void set_attach(BBHashSmallSet *set, const uint8_t *image, size_t len, size_t num_sets) {
+    set->num_sets = num_sets;
+    set->image = image;
+    set->image_len = len;
+    set->directory = (const uint64_t *)(image + SET_FIXED_HEADER);
+    set->data = image + set_header_bytes(num_sets);
+}
+
+BBHashSmallSet *bbhash_small_build_many(const uint64_t keys[], const size_t counts[], size_t num_sets,
+                                        double gamma, unsigned threads) {
+    if ((num_sets > 0 && (!keys || !counts)) || !(gamma >= 1.0)) return NULL;
+    size_t total_keys = 0;
+    for (size_t i = 0; i < num_sets; i++) total_keys += counts[i];
+    if (threads == 0) threads = 1;
+    if (threads > num_sets) threads = num_sets ? (unsigned)num_sets : 1;
+
+    BBHashSmallSet *set = NULL;
+    uint8_t *image = NULL;
+    uint64_t *sizes = calloc(num_sets + 1, sizeof(uint64_t));
+    ManyTask *tasks = calloc(threads, sizeof(ManyTask));
+    if (!sizes || !tasks) goto failure;
+
+    // Contiguous ranges of about total_keys / threads keys each.
+    size_t set_index = 0, key_index = 0;
+    for (unsigned t = 0; t < threads; t++) {
+        size_t target = t + 1 == threads ? total_keys : total_keys / threads * (t + 1);
+        tasks[t] = (ManyTask) {
+            .keys = keys + key_index, .counts = counts, .first = set_index,
+            .gamma = gamma, .sizes = sizes,
+        };
+        while (set_index < num_sets && (key_index < target || t + 1 == threads)) {
+            key_index += counts[set_index++];
+        }
+        tasks[t].end = set_index;
+    }
+
+    for (unsigned t = 0; t + 1 < threads; t++) {
+        tasks[t].started = pthread_create(&tasks[t].tid, NULL, many_worker, &tasks[t]) == 0;
+        if (!tasks[t].started) many_worker(&tasks[t]);
+    }
+    many_worker(&tasks[threads - 1]);
+    bool ok = true;
+    for (unsigned t = 0; t < threads; t++) {
+        if (t + 1 < threads && tasks[t].started) pthread_join(tasks[t].tid, NULL);
+        ok = ok && tasks[t].ok;
+    }
+    if (!ok) goto failure;
+
+    size_t data_bytes = 0;
+    for (unsigned t = 0; t < threads; t++) data_bytes += tasks[t].arena_len;
+    size_t header_bytes = set_header_bytes(num_sets);
+    size_t len = header_bytes + data_bytes + sizeof(uint64_t);
+    image = malloc(len);
+    set = calloc(1, sizeof(BBHashSmallSet));
+    if (!image || !set) {
+        fprintf(stderr, "bbhash_small_build_many: out of memory for a %zu byte container.\n", len);
+        goto failure;
+    }
+
+    memcpy(image, "BBM1", 4);
+    uint32_t flags = 0;
+    memcpy(image + 4, &flags, sizeof(flags));
+    uint64_t *fields = (uint64_t *)(image + 8);
+    fields[0] = num_sets;
+    fields[1] = data_bytes;
+    uint64_t *directory = fields + 2;
+    directory[0] = 0;
+    for (size_t i = 0; i < num_sets; i++) directory[i + 1] = directory[i] + sizes[i];
+    directory[num_sets + 1] = crc32c(0, image, header_bytes - sizeof(uint64_t));
+
+    uint8_t *data = image + header_bytes;
+    for (unsigned t = 0; t < threads; t++) {
+        if (tasks[t].arena_len) memcpy(data, tasks[t].arena, tasks[t].arena_len);
+        data += tasks[t].arena_len;
+    }
+    uint64_t data_crc = crc32c(0, image + header_bytes, data_bytes);
+    memcpy(data, &data_crc, sizeof(data_crc));
+
+    set_attach(set, image, len, num_sets);
+    set->owned = image;
+    image = NULL;
+
+failure:
+    if (tasks) {
+        for (unsigned t = 0; t < threads; t++) free(tasks[t].arena);
+    }
+    free(tasks);
+    free(sizes);
+    if (image) {
+        free(image);
+        free(set);
+        set = NULL;
+    }
+    return set;
+}
+
+size_t bbhash_small_set_count(const BBHashSmallSet *set) {
+    return set->num_sets;
+}
+
+const BBHashSmall *bbhash_small_set_get(const BBHashSmallSet *set, size_t i) {
+    if (i >= set->num_sets) return NULL;
+    return (const BBHashSmall *)(set->data + set->directory[i]);
+}
+
+size_t bbhash_small_set_bytes(const BBHashSmallSet *set) {
+    return set->image_len;
+}
+
+int bbhash_small_set_save(const BBHashSmallSet *set, const char *filename) {
+    if (!set || !filename) return -1;
+    FILE *fp = fopen(filename, "wb");
+    if (!fp) {
+        perror("bbhash_small_set_save: fopen");
+        return -1;
+    }
+    bool ok = fwrite(set->image, 1, set->image_len, fp) == set->image_len;
+    if (fclose(fp) != 0) ok = false;
+    if (!ok) {
+        fprintf(stderr, "bbhash_small_set_save: failed to write '%s'.\n", filename);
+        return -1;
+    }
+    return 0;
+}
+
+// Checks that every directory entry covers exactly one well-formed table.
+static bool check_directory(const uint64_t *directory, size_t num_sets, const uint8_t *data,
+                            uint64_t data_bytes) {
+    if (directory[0] != 0 || directory[num_sets] != data_bytes) return false;
+    for (size_t i = 0; i < num_sets; i++) {
+        uint64_t begin = directory[i], end = directory[i + 1];
+        if (end < begin || end - begin < sizeof(BBHashSmall) || begin % 8 != 0 || end > data_bytes) {
+            return false;
+        }
+        const BBHashSmall *s = (const BBHashSmall *)(data + begin);
+        bool wide = s->num_keys > UINT16_MAX;
+        if ((s->flags & ~SMALL_WIDE_RANKS) != 0 || wide != ((s->flags & SMALL_WIDE_RANKS) != 0)
+                || !(s->gamma >= 1.0f) || s->num_levels > SMALL_MAX_LEVELS
+                || small_image_bytes(s) != end - begin) {
+            return false;
+        }
+    }
+    return true;
+}
+
+BBHashSmallSet *bbhash_small_set_from_buffer(const void *buf, size_t len, unsigned flags) {
+    if (!buf) return NULL;
+    const uint8_t *p = buf;
+    uint32_t file_flags;
+    uint64_t num_sets, data_bytes;
+    if (len < SET_FIXED_HEADER || memcmp(p, "BBM1", 4) != 0) {
+        fprintf(stderr, "Error: not a small MPHF container.\n");
+        return NULL;
+    }
+    memcpy(&file_flags, p + 4, sizeof(file_flags));
+    memcpy(&num_sets, p + 8, sizeof(num_sets));
+    memcpy(&data_bytes, p + 16, sizeof(data_bytes));
+    if (file_flags != 0 || num_sets > len / sizeof(uint64_t) || data_bytes > len
+            || set_header_bytes(num_sets) + data_bytes + sizeof(uint64_t) > len) {
+        fprintf(stderr, "Error: small MPHF container is truncated or has unknown flags.\n");
+        return NULL;
+    }
+    size_t header_bytes = set_header_bytes(num_sets);
+    size_t image_len = header_bytes + data_bytes + sizeof(uint64_t);
+
+    BBHashSmallSet *set = calloc(1, sizeof(BBHashSmallSet));
+    if (!set) return NULL;
+    if ((uintptr_t)p % alignof(uint64_t) != 0) {
+        set->owned = malloc(image_len);
+        if (!set->owned) goto failure;
+        memcpy(set->owned, p, image_len);
+        p = set->owned;
+    }
+
+    if (flags & BBHASH_LOAD_VERIFY) {
+        uint64_t header_crc, data_crc;
+        memcpy(&header_crc, p + header_bytes - sizeof(uint64_t), sizeof(header_crc));
+        memcpy(&data_crc, p + header_bytes + data_bytes, sizeof(data_crc));
+        if (header_crc != crc32c(0, p, header_bytes - sizeof(uint64_t))
+                || data_crc != crc32c(0, p + header_bytes, data_bytes)) {
+            fprintf(stderr, "Error: small MPHF container checksum mismatch.\n");
+            goto failure;
+        }
+    }
+    set_attach(set, p, image_len, num_sets);
+    if (!check_directory(set->directory, num_sets, set->data, data_bytes)) {
+        fprintf(stderr, "Error: small MPHF container has a corrupt directory.\n");
+        goto failure;
+    }
+    return set;
+
+failure:
+    free(set->owned);
+    free(set);
+    return NULL;
+}
+
+BBHashSmallSet *bbhash_small_set_mmap(const char *filename, unsigned flags) {
+    if (!filename) return NULL;
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0) {
+        perror("bbhash_small_set_mmap: open");
+        return NULL;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+        fprintf(stderr, "Error: cannot map empty or unreadable container file.\n");
+        close(fd);
+        return NULL;
+    }
+    size_t len = (size_t)st.st_size;
+    void *map = mmap(NULL, len, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        perror("bbhash_small_set_mmap: mmap");
+        return NULL;
+    }
+    BBHashSmallSet *set = bbhash_small_set_from_buffer(map, len, flags);
+    if (set) {
+        set->mapping = map;
+        set->mapping_len = len;
+    } else {
+        munmap(map, len);
+    }
+    return set;
+}
+
+BBHashSmallSet *bbhash_small_set_load(const char *filename, unsigned flags) {
+    if (!filename) return NULL;
+    FILE *fp = fopen(filename, "rb");
+    if (!fp) {
+        perror("bbhash_small_set_load: fopen");
+        return NULL;
+    }
+    BBHashSmallSet *set = NULL;
+    uint8_t *buf = NULL;
+    long len = -1;
+    if (fseek(fp, 0, SEEK_END) == 0) len = ftell(fp);
+    if (len <= 0 || fseek(fp, 0, SEEK_SET) != 0) {
+        fprintf(stderr, "Error: cannot read container file '%s'.\n", filename);
+        goto done;
+    }
+    buf = malloc((size_t)len);
+    if (!buf || fread(buf, 1, (size_t)len, fp) != (size_t)len) {
+        fprintf(stderr, "Error: cannot read container file '%s'.\n", filename);
+        goto done;
+    }
+    // malloc() memory is aligned, so the container uses it in place.
+    set = bbhash_small_set_from_buffer(buf, (size_t)len, flags);
+    if (set) {
+        set->owned = buf;
+        buf = NULL;
+    }
+done:
+    free(buf);
+    fclose(fp);
+    return set;
+}
+
+void bbhash_small_set_free(BBHashSmallSet *set) {
+    if (!set) return;
+    if (set->mapping) munmap(set->mapping, set->mapping_len);
+    free(set->owned);
+    free(set);
+}
@@ -0,0 +1,126 @@
+#ifndef BBHASH_SMALL_H
+#define BBHASH_SMALL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Minimal perfect hash functions for small key sets.
+ *
+ * A BBHash over a few hundred keys is dominated by per-level overhead: each
+ * level is its own allocation, padded to 64 bits, with a rank table and a
+ * header. A BBHashSmall is one flat block of memory: a 16-byte header, the
+ * bits of all levels back to back (levels of at least 8 bits), and a rank
+ * checkpoint per further 512-bit block. Checkpoints are 16 bits wide when
+ * the set has fewer than 65536 keys and 32 bits otherwise. A set whose bits
+ * fit in one block has no rank table at all. As in the compact tail of
+ * BBHash, level sizes are recomputed from ranks at query time, so no level
+ * offsets are stored.
+ *
+ * The layout has no pointers, so it can be copied, written to a file or
+ * used in place inside a larger image. BBHashSmallSet stores many of them
+ * in one such image behind a directory of offsets.
+ */
+typedef struct BBHashSmall BBHashSmall;
+
+/*
+ * Reusable scratch memory for building small MPHFs. Building many sets with
+ * one builder allocates only while the largest set seen so far grows.
+ */
+typedef struct BBHashSmallBuilder BBHashSmallBuilder;
+
+/**
+ * @brief Creates a builder.
+ * @param gamma Bits per unplaced key in each level (at least 1.0).
+ * @return The new builder, or NULL on failure.
+ */
+BBHashSmallBuilder *bbhash_small_builder_create(double gamma);
+
+void bbhash_small_builder_free(BBHashSmallBuilder *b);
+
+/**
+ * @brief Builds a small MPHF in a single allocation.
+ * @param b The builder whose scratch memory is used.
+ * @param keys Distinct keys; at most UINT32_MAX of them.
+ * @param n Number of keys (may be 0).
+ * @return The MPHF, freed with bbhash_small_free(), or NULL on failure.
+ */
+BBHashSmall *bbhash_small_build(BBHashSmallBuilder *b, const uint64_t keys[], size_t n);
+
+/**
+ * @brief Returns the index of a key in [0, n).
+ * @return The index for keys in the set; (size_t)-1 or an arbitrary index for
+ * other keys, as with bbhash_mphf_query().
+ */
+size_t bbhash_small_query(const BBHashSmall *s, uint64_t key);
+
+/** @brief Returns the number of keys. */
+size_t bbhash_small_num_keys(const BBHashSmall *s);
+
+/** @brief Returns the size of the flat image in bytes (a multiple of 8). */
+size_t bbhash_small_bytes(const BBHashSmall *s);
+
+void bbhash_small_free(BBHashSmall *s);
+
+/*
+ * Many small MPHFs in one image.
+ *
+ * Format 'BBM1': magic, 32-bit flags (0), num_sets, data_bytes, then
+ * num_sets + 1 byte offsets of the tables from the start of the data, and
+ * the CRC-32C of all of the above. The tables follow back to back, then the
+ * CRC-32C of the data. Integers are little-endian 64-bit unless noted, and
+ * every table starts 8-byte aligned.
+ */
+typedef struct BBHashSmallSet BBHashSmallSet;
+
+/**
+ * @brief Builds one small MPHF per key set.
+ *
+ * The key sets are split into contiguous ranges of about equal key count,
+ * one per thread, and each thread builds its range with its own builder.
+ * The result does not depend on the thread count.
+ * @param keys All key sets, concatenated.
+ * @param counts Number of keys in each set.
+ * @param num_sets Number of sets.
+ * @param gamma Bits per unplaced key in each level (at least 1.0).
+ * @param threads Number of threads (0 means 1).
+ * @return The container, or NULL on failure.
+ */
+BBHashSmallSet *bbhash_small_build_many(const uint64_t keys[], const size_t counts[], size_t num_sets,
+                                        double gamma, unsigned threads);
+
+/** @brief Returns the number of MPHFs in the container. */
+size_t bbhash_small_set_count(const BBHashSmallSet *set);
+
+/** @brief Returns MPHF `i`, which lives inside the container. */
+const BBHashSmall *bbhash_small_set_get(const BBHashSmallSet *set, size_t i);
+
+/** @brief Returns the size of the container image in bytes. */
+size_t bbhash_small_set_bytes(const BBHashSmallSet *set);
+
+/**
+ * @brief Writes the container image to a file.
+ * @return 0 on success, -1 on failure.
+ */
+int bbhash_small_set_save(const BBHashSmallSet *set, const char *filename);
+
+/**
+ * @brief Opens a container image in memory.
+ *
+ * An 8-byte aligned buffer is used in place and must outlive the container;
+ * otherwise the image is copied. The directory and table headers are always
+ * checked against the buffer size.
+ * @param flags Zero or more BBHASH_LOAD_* flags (see bbhash.h).
+ * @return The container, or NULL on failure.
+ */
+BBHashSmallSet *bbhash_small_set_from_buffer(const void *buf, size_t len, unsigned flags);
+
+/** @brief Maps a container file and queries it in place. */
+BBHashSmallSet *bbhash_small_set_mmap(const char *filename, unsigned flags);
+
+/** @brief Reads a container file into memory. */
+BBHashSmallSet *bbhash_small_set_load(const char *filename, unsigned flags);
+
+void bbhash_small_set_free(BBHashSmallSet *set);
+
+#endif // BBHASH_SMALL_H
@@ -0,0 +1,164 @@
+/* bbhash_small_test.c - tests for small-set MPHFs and their containers.
+ *
+ */
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "mt64.h"
+#include "dedup.h"
+#include "hashing.h"
+#include "bbhash.h"
+#include "bbhash_small.h"
+#include "example_vocab.h"
+
+static double seconds_since(const struct timespec *t0) {
+    struct timespec t1;
+    timespec_get(&t1, TIME_UTC);
+    return (double)(t1.tv_sec - t0->tv_sec) + (t1.tv_nsec - t0->tv_nsec) * 1e-9;
+}
+
+static void check_bijection(const BBHashSmall *s, const uint64_t keys[], size_t n) {
+    assert(bbhash_small_num_keys(s) == n);
+    unsigned char *seen = calloc(n ? n : 1, 1);
+    for (size_t i = 0; i < n; i++) {
+        size_t idx = bbhash_small_query(s, keys[i]);
+        assert(idx < n);
+        assert(!seen[idx]);
+        seen[idx] = 1;
+    }
+    free(seen);
+}
+
+static void test_vocab(void) {
+    uint64_t keys[VOCAB_SIZE];
+    for (size_t i = 0; i < VOCAB_SIZE; i++) keys[i] = murmur3_string(vocab[i], 42);
+
+    BBHashSmallBuilder *b = bbhash_small_builder_create(2.0);
+    BBHashSmall *s = bbhash_small_build(b, keys, VOCAB_SIZE);
+    assert(s != NULL);
+    check_bijection(s, keys, VOCAB_SIZE);
+
+    BBHashConfig config = bbhash_config_default();
+    config.compact_from_level = 1;
+    BBHash *mphf = bbhash_mphf_create_ex(keys, VOCAB_SIZE, &config);
+    assert(mphf != NULL);
+    printf("  vocabulary (%zu words): %.2f bits/key small, %.2f bits/key BBHash with compact tail\n",
+           (size_t)VOCAB_SIZE, 8.0 * bbhash_small_bytes(s) / VOCAB_SIZE,
+           (double)bbhash_size_in_bits(mphf) / VOCAB_SIZE);
+    bbhash_free(mphf);
+    bbhash_small_free(s);
+
+    // Duplicate keys cannot be placed.
+    keys[1] = keys[0];
+    assert(bbhash_small_build(b, keys, VOCAB_SIZE) == NULL);
+    bbhash_small_builder_free(b);
+}
+
+static void test_sizes(const uint64_t keys[]) {
+    BBHashSmallBuilder *b = bbhash_small_builder_create(2.0);
+    const size_t sizes[] = {0, 1, 2, 7, 100, 255, 256, 1000, 70000};
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+        BBHashSmall *s = bbhash_small_build(b, keys, sizes[i]);
+        assert(s != NULL);
+        check_bijection(s, keys, sizes[i]);
+        assert(bbhash_small_bytes(s) % 8 == 0);
+        bbhash_small_free(s);
+    }
+    BBHashSmall *empty = bbhash_small_build(b, NULL, 0);
+    assert(bbhash_small_query(empty, 123) == (size_t) -1);
+    bbhash_small_free(empty);
+    bbhash_small_builder_free(b);
+}
+
+static void test_container(const uint64_t keys[]) {
+    const size_t num_sets = 20000;
+    size_t *counts = malloc(sizeof(size_t) * num_sets);
+    Mt64 *rng = mt64_create(7);
+    size_t total = 0;
+    for (size_t i = 0; i < num_sets; i++) {
+        counts[i] = mt64_gen_int64(rng) % 600;
+        total += counts[i];
+    }
+    mt64_destroy(rng);
+
+    struct timespec t0;
+    timespec_get(&t0, TIME_UTC);
+    BBHashSmallSet *set = bbhash_small_build_many(keys, counts, num_sets, 2.0, 1);
+    double seconds = seconds_since(&t0);
+    assert(set != NULL);
+    assert(bbhash_small_set_count(set) == num_sets);
+    printf("  %zu sets, %zu keys: %.3f s, %.2f bits/key including the directory\n", num_sets, total, seconds,
+           8.0 * bbhash_small_set_bytes(set) / total);
+
+    // The image does not depend on the thread count.
+    BBHashSmallSet *threaded = bbhash_small_build_many(keys, counts, num_sets, 2.0, 3);
+    assert(threaded != NULL);
+    assert(bbhash_small_set_bytes(threaded) == bbhash_small_set_bytes(set));
+    const char *path = "bbhash_small_test.bbm";
+    assert(bbhash_small_set_save(threaded, path) == 0);
+    bbhash_small_set_free(threaded);
+
+    BBHashSmallSet *mapped = bbhash_small_set_mmap(path, BBHASH_LOAD_VERIFY);
+    BBHashSmallSet *loaded = bbhash_small_set_load(path, BBHASH_LOAD_VERIFY);
+    assert(mapped != NULL && loaded != NULL);
+    const uint64_t *first = keys;
+    for (size_t i = 0; i < num_sets; i++) {
+        const BBHashSmall *s = bbhash_small_set_get(set, i);
+        check_bijection(s, first, counts[i]);
+        for (size_t k = 0; k < counts[i]; k++) {
+            size_t idx = bbhash_small_query(s, first[k]);
+            assert(bbhash_small_query(bbhash_small_set_get(mapped, i), first[k]) == idx);
+            assert(bbhash_small_query(bbhash_small_set_get(loaded, i), first[k]) == idx);
+        }
+        first += counts[i];
+    }
+    assert(bbhash_small_set_get(set, num_sets) == NULL);
+    bbhash_small_set_free(mapped);
+    bbhash_small_set_free(loaded);
+
+    // An unaligned copy still opens; a flipped bit is caught by the checksum.
+    size_t len = bbhash_small_set_bytes(set);
+    unsigned char *copy = malloc(len + 1);
+    FILE *fp = fopen(path, "rb");
+    assert(fp && fread(copy + 1, 1, len, fp) == len);
+    fclose(fp);
+    BBHashSmallSet *unaligned = bbhash_small_set_from_buffer(copy + 1, len, BBHASH_LOAD_VERIFY);
+    assert(unaligned != NULL);
+    assert(bbhash_small_query(bbhash_small_set_get(unaligned, 0), keys[0])
+           == bbhash_small_query(bbhash_small_set_get(set, 0), keys[0]));
+    bbhash_small_set_free(unaligned);
+    copy[1 + len / 2] ^= 0x10;
+    assert(bbhash_small_set_from_buffer(copy + 1, len, BBHASH_LOAD_VERIFY) == NULL);
+    assert(bbhash_small_set_from_buffer(copy + 1, len - 8, 0) == NULL);
+    free(copy);
+    remove(path);
+
+    BBHashSmallSet *none = bbhash_small_build_many(NULL, NULL, 0, 2.0, 4);
+    assert(none != NULL && bbhash_small_set_count(none) == 0);
+    bbhash_small_set_free(none);
+
+    bbhash_small_set_free(set);
+    free(counts);
+}
+
+int main(void) {
+    const size_t n = 7000000;
+    Mt64 *rng = mt64_create(3);
+    uint64_t *keys = malloc(sizeof(uint64_t) * n);
+    for (size_t i = 0; i < n; i++) keys[i] = mt64_gen_int64(rng);
+    mt64_destroy(rng);
+    size_t unique = dedup(keys, n);
+    assert(unique > 6000000);
+
+    printf("bbhash_small_test\n");
+    test_vocab();
+    test_sizes(keys);
+    test_container(keys);
+
+    free(keys);
+    printf("All tests passed.\n");
+    return 0;
+}
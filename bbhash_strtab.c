@@ -0,0 +1,342 @@
+#define _POSIX_C_SOURCE 200809L  // mmap, open, fstat under -std=c23
+
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "hashing.h"
+#include "crc32c.h"
+#include "bbhash_strtab.h"
+
+// Header words: magic and flags, num_strings, seed, offset width, arena
+// bytes, MPHF bytes, data CRC, header CRC.
+enum { HEADER_WORDS = 8 };
+constexpr size_t HEADER_BYTES = HEADER_WORDS * sizeof(uint64_t);
+constexpr uint64_t MAX_SEED_TRIES = 16;
+
+struct BBHashStrtab {
+    size_t num_strings;
+    uint64_t seed;
+    unsigned offset_width;    // 4 or 8 bytes
+    const void *offsets;      // num_strings + 1 entries
+    const char *arena;
+    size_t arena_len;
+    BBHash *mphf;
+    void *mapping;            // mmap()ed file, or NULL
+    size_t mapping_len;
+    void *buffer;             // offsets and arena of a built table, or the file read into memory
+};
+
+typedef struct {
+    uint64_t hash;
+    size_t index;
+} HashedString;
+
+static inline uint64_t offset_at(const BBHashStrtab *t, size_t i) {
+    return t->offset_width == 4 ? ((const uint32_t *)t->offsets)[i] : ((const uint64_t *)t->offsets)[i];
+}
+
+static size_t offsets_bytes(size_t num_strings, unsigned width) {
+    return ((num_strings + 1) * width + 7) & ~(size_t)7;
+}
+
+static int compare_hashed(const void *a, const void *b) {
+    uint64_t x = ((const HashedString *)a)->hash, y = ((const HashedString *)b)->hash;
+    return (x > y) - (x < y);
+}
+
+// Returns 1 if the hashes are distinct, 0 if two strings collide and -1 if
+// a string appears twice.
+static int check_distinct(const uint64_t hashes[], const char *const strs[], const size_t lengths[], size_t n,
+                          HashedString sorted[]) {
+    for (size_t i = 0; i < n; i++) sorted[i] = (HashedString) {hashes[i], i};
+    qsort(sorted, n, sizeof(HashedString), compare_hashed);
+    int status = 1;
+    for (size_t i = 1; i < n; i++) {
+        if (sorted[i].hash != sorted[i - 1].hash) continue;
+        size_t a = sorted[i - 1].index, b = sorted[i].index;
+        if (lengths[a] == lengths[b] && memcmp(strs[a], strs[b], lengths[a]) == 0) {
+            fprintf(stderr, "Error: string %zu is a duplicate of string %zu.\n", b, a);
+            return -1;
+        }
+        status = 0;
+    }
+    return status;
+}
+
+BBHashStrtab *bbhash_strtab_create(const char *const strs[], const size_t lens[], size_t n,
+                                   const BBHashConfig *config) {
+    if (!strs || n == 0) {
+        fprintf(stderr, "Error: a string table needs at least one string.\n");
+        return NULL;
+    }
+    BBHashConfig defaults = bbhash_config_default();
+    if (!config) config = &defaults;
+    if (config->hot_keys) {
+        fprintf(stderr, "Error: string tables take no hot key list (use weights).\n");
+        return NULL;
+    }
+
+    BBHashStrtab *t = NULL;
+    BBHash *mphf = NULL;
+    size_t *lengths = malloc(sizeof(size_t) * n);
+    uint64_t *hashes = malloc(sizeof(uint64_t) * n);
+    HashedString *sorted = malloc(sizeof(HashedString) * n);
+    size_t *ids = malloc(sizeof(size_t) * n);
+    if (!lengths || !hashes || !sorted || !ids) goto cleanup;
+
+    uint64_t arena_len = 0;
+    for (size_t i = 0; i < n; i++) {
+        lengths[i] = lens ? lens[i] : strlen(strs[i]);
+        arena_len += lengths[i] + 1;
+    }
+    uint64_t seed = 0;
+    for (;; seed++) {
+        if (seed == MAX_SEED_TRIES) {
+            fprintf(stderr, "Error: no hash seed separates the strings.\n");
+            goto cleanup;
+        }
+        for (size_t i = 0; i < n; i++) hashes[i] = murmur3_bytes(strs[i], lengths[i], seed);
+        int distinct = check_distinct(hashes, strs, lengths, n, sorted);
+        if (distinct < 0) goto cleanup;
+        if (distinct) break;
+    }
+
+    mphf = bbhash_mphf_create_ex(hashes, n, config);
+    if (!mphf) goto cleanup;
+    bbhash_mphf_query_batch(mphf, hashes, n, ids);
+
+    unsigned width = arena_len <= UINT32_MAX ? 4 : 8;
+    size_t head = offsets_bytes(n, width);
+    t = calloc(1, sizeof(BBHashStrtab));
+    uint8_t *buffer = t ? malloc(head + arena_len) : NULL;
+    if (!buffer) {
+        free(t);
+        t = NULL;
+        goto cleanup;
+    }
+    // The hashes are no longer needed; they become the string starts by ID.
+    uint64_t *starts = hashes;
+    for (size_t i = 0; i < n; i++) starts[ids[i]] = lengths[i] + 1;
+    uint64_t pos = 0;
+    for (size_t id = 0; id <= n; id++) {
+        uint64_t size = id < n ? starts[id] : 0;
+        if (id < n) starts[id] = pos;
+        if (width == 4) {
+            ((uint32_t *)buffer)[id] = (uint32_t)pos;
+        } else {
+            ((uint64_t *)buffer)[id] = pos;
+        }
+        pos += size;
+    }
+    memset(buffer + (n + 1) * width, 0, head - (n + 1) * width);
+    char *arena = (char *)buffer + head;
+    for (size_t i = 0; i < n; i++) {
+        memcpy(arena + starts[ids[i]], strs[i], lengths[i]);
+        arena[starts[ids[i]] + lengths[i]] = '\0';
+    }
+
+    *t = (BBHashStrtab) {
+        .num_strings = n, .seed = seed, .offset_width = width,
+        .offsets = buffer, .arena = arena, .arena_len = arena_len,
+        .mphf = mphf, .buffer = buffer,
+    };
+    mphf = NULL;
+
+cleanup:
+    bbhash_free(mphf);
+    free(lengths);
+    free(hashes);
+    free(sorted);
+    free(ids);
+    return t;
+}
+
+size_t bbhash_strtab_lookup(const BBHashStrtab *t, const char *str, size_t len) {
+    size_t id = bbhash_mphf_query(t->mphf, murmur3_bytes(str, len, t->seed));
+    if (id >= t->num_strings) return BBHASH_STRTAB_NOT_FOUND;
+    uint64_t start = offset_at(t, id), end = offset_at(t, id + 1);
+    if (end - start != len + 1 || memcmp(t->arena + start, str, len) != 0) return BBHASH_STRTAB_NOT_FOUND;
+    return id;
+}
+
+const char *bbhash_strtab_str(const BBHashStrtab *t, size_t id, size_t *len) {
+    if (id >= t->num_strings) return NULL;
+    uint64_t start = offset_at(t, id);
+    if (len) *len = (size_t)(offset_at(t, id + 1) - start - 1);
+    return t->arena + start;
+}
+
+size_t bbhash_strtab_size(const BBHashStrtab *t) {
+    return t->num_strings;
+}
+
+const BBHash *bbhash_strtab_mphf(const BBHashStrtab *t) {
+    return t->mphf;
+}
+
+static uint32_t data_crc(const BBHashStrtab *t) {
+    uint32_t crc = crc32c(0, t->offsets, (t->num_strings + 1) * t->offset_width);
+    return crc32c(crc, t->arena, t->arena_len);
+}
+
+int bbhash_strtab_save(const BBHashStrtab *t, const char *filename) {
+    if (!t || !filename) return -1;
+    FILE *fp = fopen(filename, "wb");
+    if (!fp) {
+        perror("bbhash_strtab_save: fopen");
+        return -1;
+    }
+    // The header goes last, once the MPHF image length is known.
+    uint64_t header[HEADER_WORDS] = {0};
+    bool ok = fwrite(header, 1, HEADER_BYTES, fp) == HEADER_BYTES && bbhash_mphf_write(t->mphf, fp) == 0;
+    long mphf_end = ok ? ftell(fp) : -1;
+    size_t head = offsets_bytes(t->num_strings, t->offset_width);
+    ok = ok && mphf_end > 0 && fwrite(t->offsets, 1, head, fp) == head
+         && fwrite(t->arena, 1, t->arena_len, fp) == t->arena_len;
+
+    memcpy(header, "BBT1", 4);
+    header[1] = t->num_strings;
+    header[2] = t->seed;
+    header[3] = t->offset_width;
+    header[4] = t->arena_len;
+    header[5] = (uint64_t)mphf_end - HEADER_BYTES;
+    header[6] = data_crc(t);
+    header[7] = crc32c(0, header, HEADER_BYTES - sizeof(uint64_t));
+    ok = ok && fseek(fp, 0, SEEK_SET) == 0 && fwrite(header, 1, HEADER_BYTES, fp) == HEADER_BYTES;
+    if (fclose(fp) != 0) ok = false;
+    if (!ok) {
+        fprintf(stderr, "Error: failed to write '%s'.\n", filename);
+        return -1;
+    }
+    return 0;
+}
+
+// Sets up `t` over an image that stays valid for its lifetime.
+static bool open_image(BBHashStrtab *t, const uint8_t *image, size_t len, unsigned flags) {
+    uint64_t header[HEADER_WORDS];
+    uint32_t file_flags;
+    if (len < HEADER_BYTES || memcmp(image, "BBT1", 4) != 0) {
+        fprintf(stderr, "Error: not a string table file.\n");
+        return false;
+    }
+    memcpy(header, image, HEADER_BYTES);
+    memcpy(&file_flags, image + 4, sizeof(file_flags));
+    if (header[7] != crc32c(0, image, HEADER_BYTES - sizeof(uint64_t))) {
+        fprintf(stderr, "Error: string table header checksum mismatch.\n");
+        return false;
+    }
+    uint64_t n = header[1], width = header[3], arena_len = header[4], mphf_len = header[5];
+    size_t rest = len - HEADER_BYTES;
+    if (file_flags != 0 || n == 0 || (width != 4 && width != 8) || mphf_len % 8 != 0 || mphf_len > rest
+            || n >= (rest - mphf_len) / width || offsets_bytes(n, (unsigned)width) > rest - mphf_len
+            || arena_len > rest - mphf_len - offsets_bytes(n, (unsigned)width)) {
+        fprintf(stderr, "Error: string table header is corrupt or truncated.\n");
+        return false;
+    }
+
+    t->mphf = bbhash_mphf_from_buffer(image + HEADER_BYTES, mphf_len, flags);
+    if (!t->mphf) {
+        fprintf(stderr, "Error: the MPHF of the string table is corrupt.\n");
+        return false;
+    }
+    BBHashStats stats;
+    bbhash_mphf_stats(t->mphf, &stats);
+    t->num_strings = n;
+    t->seed = header[2];
+    t->offset_width = (unsigned)width;
+    t->offsets = image + HEADER_BYTES + mphf_len;
+    t->arena = (const char *)t->offsets + offsets_bytes(n, t->offset_width);
+    t->arena_len = arena_len;
+    if (stats.num_keys != n || offset_at(t, 0) != 0 || offset_at(t, n) != arena_len) {
+        fprintf(stderr, "Error: string table is inconsistent.\n");
+        return false;
+    }
+    // Queries index the arena through the offsets, so they are always
+    // checked: each string ends after it starts, inside the arena, with its
+    // terminating NUL.
+    for (size_t i = 0; i < n; i++) {
+        uint64_t start = offset_at(t, i), end = offset_at(t, i + 1);
+        if (end <= start || end > arena_len || t->arena[end - 1] != '\0') {
+            fprintf(stderr, "Error: string table offset %zu is corrupt.\n", i);
+            return false;
+        }
+    }
+    if ((flags & BBHASH_LOAD_VERIFY) && data_crc(t) != header[6]) {
+        fprintf(stderr, "Error: string table data checksum mismatch.\n");
+        return false;
+    }
+    return true;
+}
+
+BBHashStrtab *bbhash_strtab_mmap(const char *filename, unsigned flags) {
+    if (!filename) return NULL;
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0) {
+        perror("bbhash_strtab_mmap: open");
+        return NULL;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+        fprintf(stderr, "Error: cannot map empty or unreadable string table file.\n");
+        close(fd);
+        return NULL;
+    }
+    size_t len = (size_t)st.st_size;
+    void *map = mmap(NULL, len, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        perror("bbhash_strtab_mmap: mmap");
+        return NULL;
+    }
+    BBHashStrtab *t = calloc(1, sizeof(BBHashStrtab));
+    if (!t) {
+        munmap(map, len);
+        return NULL;
+    }
+    t->mapping = map;
+    t->mapping_len = len;
+    if (!open_image(t, map, len, flags)) {
+        bbhash_strtab_free(t);
+        return NULL;
+    }
+    return t;
+}
+
+BBHashStrtab *bbhash_strtab_load(const char *filename, unsigned flags) {
+    if (!filename) return NULL;
+    FILE *fp = fopen(filename, "rb");
+    if (!fp) {
+        perror("bbhash_strtab_load: fopen");
+        return NULL;
+    }
+    long len = fseek(fp, 0, SEEK_END) == 0 ? ftell(fp) : -1;
+    BBHashStrtab *t = calloc(1, sizeof(BBHashStrtab));
+    // malloc() memory is 8-byte aligned, so the MPHF uses it in place.
+    void *buf = len > 0 ? malloc((size_t)len) : NULL;
+    if (!t || !buf || fseek(fp, 0, SEEK_SET) != 0 || fread(buf, 1, (size_t)len, fp) != (size_t)len) {
+        fprintf(stderr, "Error: cannot read string table file '%s'.\n", filename);
+        fclose(fp);
+        free(buf);
+        free(t);
+        return NULL;
+    }
+    fclose(fp);
+    t->buffer = buf;
+    if (!open_image(t, buf, (size_t)len, flags)) {
+        bbhash_strtab_free(t);
+        return NULL;
+    }
+    return t;
+}
+
+void bbhash_strtab_free(BBHashStrtab *t) {
+    if (!t) return;
+    bbhash_free(t->mphf);
+    if (t->mapping) munmap(t->mapping, t->mapping_len);
+    free(t->buffer);
+    free(t);
+}
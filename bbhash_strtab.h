@@ -0,0 +1,87 @@
+#ifndef BBHASH_STRTAB_H
+#define BBHASH_STRTAB_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "bbhash.h"
+
+/*
+ * Static string interning: a fixed set of strings mapped to dense IDs in
+ * [0, n) and back.
+ *
+ * The ID of a string is the MPHF index of its 64-bit hash. The strings sit
+ * in one arena in ID order, each followed by a NUL, and an offsets array
+ * gives where string i starts. Offsets are 32-bit while the arena is below
+ * 4 GiB and 64-bit above. A lookup hashes the string, queries the MPHF and
+ * compares against the one stored string, so strings outside the set are
+ * always reported as not found.
+ *
+ * Format 'BBT1', one file that can be mapped and used in place:
+ *   64-byte header: magic, 32-bit flags (0), num_strings, hash seed,
+ *     offset width (4 or 8), arena bytes, MPHF image bytes, CRC-32C of the
+ *     offsets and arena, CRC-32C of the header before it;
+ *   the MPHF as a version 3 image;
+ *   num_strings + 1 offsets, padded to 8 bytes;
+ *   the arena.
+ * Integers are little-endian 64-bit unless noted.
+ */
+typedef struct BBHashStrtab BBHashStrtab;
+
+/** @brief Returned by bbhash_strtab_lookup() for strings outside the set. */
+#define BBHASH_STRTAB_NOT_FOUND ((size_t)-1)
+
+/**
+ * @brief Builds the table over n distinct strings.
+ *
+ * Strings are hashed with murmur3_bytes() and seed 0, as the CLI hashes
+ * text keys; if two strings collide on 64 bits, the next seed is tried.
+ * @param strs The strings; they need not be NUL terminated if `lens` is given.
+ * @param lens Their lengths in bytes, or NULL to use strlen().
+ * @param config Build options, or NULL for bbhash_config_default().
+ *        Weights follow the order of `strs`; hot keys are not supported.
+ * @return The table, or NULL on failure or if a string appears twice.
+ */
+BBHashStrtab *bbhash_strtab_create(const char *const strs[], const size_t lens[], size_t n,
+                                   const BBHashConfig *config);
+
+/**
+ * @brief Returns the ID of a string, or BBHASH_STRTAB_NOT_FOUND.
+ * @param str The string; it need not be NUL terminated.
+ * @param len Its length in bytes.
+ */
+size_t bbhash_strtab_lookup(const BBHashStrtab *t, const char *str, size_t len);
+
+/**
+ * @brief Returns the NUL-terminated string with ID `id`, owned by the table.
+ * @param len Receives its length (it may itself hold NULs), or NULL.
+ * @return The string, or NULL if id is out of range.
+ */
+const char *bbhash_strtab_str(const BBHashStrtab *t, size_t id, size_t *len);
+
+/** @brief Number of strings. */
+size_t bbhash_strtab_size(const BBHashStrtab *t);
+
+/** @brief The MPHF over the string hashes, owned by the table. */
+const BBHash *bbhash_strtab_mphf(const BBHashStrtab *t);
+
+/** @brief Saves the table as one 'BBT1' file. @return 0 on success, -1 on failure. */
+int bbhash_strtab_save(const BBHashStrtab *t, const char *filename);
+
+/**
+ * @brief Maps a table file and serves it in place.
+ *
+ * Loading checks the header and the MPHF's shape, and scans the offsets so
+ * that every string lies inside the arena, even in a damaged file.
+ * @param flags Zero or more BBHASH_LOAD_* flags; BBHASH_LOAD_VERIFY also
+ *        checks the checksums of the MPHF, the offsets and the arena.
+ * @return The table, or NULL on failure.
+ */
+BBHashStrtab *bbhash_strtab_mmap(const char *filename, unsigned flags);
+
+/** @brief As bbhash_strtab_mmap(), but reads the file into memory. */
+BBHashStrtab *bbhash_strtab_load(const char *filename, unsigned flags);
+
+void bbhash_strtab_free(BBHashStrtab *t);
+
+#endif // BBHASH_STRTAB_H
@@ -0,0 +1,132 @@
+/* bbhash_strtab_test.c - tests for the string interning table.
+ *
+ */
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "mt64.h"
+#include "bitarray.h"
+#include "hashing.h"
+#include "bbhash_strtab.h"
+#include "example_vocab.h"
+
+constexpr size_t NUM_RANDOM = 300000;
+
+// Every string maps to its own ID and back.
+static void check_table(const BBHashStrtab *t, const char *const strs[], const size_t lens[], size_t n) {
+    assert(bbhash_strtab_size(t) == n);
+    Bitarray *seen = bitarray_new(n);
+    for (size_t i = 0; i < n; i++) {
+        size_t len = lens ? lens[i] : strlen(strs[i]);
+        size_t id = bbhash_strtab_lookup(t, strs[i], len);
+        assert(id < n);
+        assert(bitarray_get(seen, id) == 0);
+        bitarray_set(seen, id);
+        size_t stored_len;
+        const char *stored = bbhash_strtab_str(t, id, &stored_len);
+        assert(stored_len == len && memcmp(stored, strs[i], len) == 0 && stored[len] == '\0');
+    }
+    bitarray_free(seen);
+    assert(bbhash_strtab_str(t, n, NULL) == NULL);
+}
+
+int main(void) {
+    printf("bbhash_strtab_test\n");
+    size_t num_words = sizeof(vocab) / sizeof(vocab[0]);
+    BBHashStrtab *words = bbhash_strtab_create(vocab, NULL, num_words, NULL);
+    assert(words != NULL);
+    check_table(words, vocab, NULL, num_words);
+
+    // Non-members: other case, prefixes, extensions, unterminated slices.
+    assert(bbhash_strtab_lookup(words, "XYZZY", 5) == BBHASH_STRTAB_NOT_FOUND);
+    assert(bbhash_strtab_lookup(words, "cav", 3) == BBHASH_STRTAB_NOT_FOUND);
+    assert(bbhash_strtab_lookup(words, "caves", 5) == BBHASH_STRTAB_NOT_FOUND);
+    assert(bbhash_strtab_lookup(words, "", 0) == BBHASH_STRTAB_NOT_FOUND);
+    const char *line = "cave\ncavern\n";
+    size_t cave = bbhash_strtab_lookup(words, line, 4);
+    assert(cave != BBHASH_STRTAB_NOT_FOUND && strcmp(bbhash_strtab_str(words, cave, NULL), "cave") == 0);
+    // The MPHF is built over the same keys as `bbhash build -f text`.
+    assert(bbhash_mphf_query(bbhash_strtab_mphf(words), murmur3_bytes("cave", 4, 0)) == cave);
+
+    // A duplicate string is refused.
+    const char *dup[] = {"north", "south", "north"};
+    assert(bbhash_strtab_create(dup, NULL, 3, NULL) == NULL);
+    assert(bbhash_strtab_create(dup, NULL, 0, NULL) == NULL);
+
+    // Random byte strings of varied lengths, some holding NULs.
+    Mt64 *rng = mt64_create(45);
+    char **strs = malloc(sizeof(char *) * NUM_RANDOM);
+    size_t *lens = malloc(sizeof(size_t) * NUM_RANDOM);
+    for (size_t i = 0; i < NUM_RANDOM; i++) {
+        lens[i] = 8 + mt64_gen_int64(rng) % 40;
+        strs[i] = malloc(lens[i]);
+        memcpy(strs[i], &i, sizeof(i));  // distinct
+        for (size_t j = 8; j < lens[i]; j++) strs[i][j] = (char)(mt64_gen_int64(rng) % 4 == 0 ? 0 : 'a' + j % 26);
+    }
+    mt64_destroy(rng);
+    BBHashConfig config = bbhash_config_default();
+    config.threads = 2;
+    BBHashStrtab *table = bbhash_strtab_create((const char *const *)strs, lens, NUM_RANDOM, &config);
+    assert(table != NULL);
+    check_table(table, (const char *const *)strs, lens, NUM_RANDOM);
+
+    // Saved, mapped and loaded tables give the same IDs.
+    const char *file = "bbhash_strtab_test.bbt";
+    assert(bbhash_strtab_save(table, file) == 0);
+    BBHashStrtab *mapped = bbhash_strtab_mmap(file, BBHASH_LOAD_VERIFY);
+    BBHashStrtab *loaded = bbhash_strtab_load(file, 0);
+    assert(mapped != NULL && loaded != NULL);
+    check_table(mapped, (const char *const *)strs, lens, NUM_RANDOM);
+    for (size_t i = 0; i < NUM_RANDOM; i += 11) {
+        size_t id = bbhash_strtab_lookup(table, strs[i], lens[i]);
+        assert(bbhash_strtab_lookup(mapped, strs[i], lens[i]) == id);
+        assert(bbhash_strtab_lookup(loaded, strs[i], lens[i]) == id);
+    }
+    bbhash_strtab_free(mapped);
+    bbhash_strtab_free(loaded);
+
+    // A damaged arena is caught with verification, a damaged header always.
+    FILE *fp = fopen(file, "r+b");
+    assert(fp);
+    fseek(fp, -10, SEEK_END);
+    int c = fgetc(fp);
+    fseek(fp, -10, SEEK_END);
+    fputc(c ^ 0x20, fp);
+    fclose(fp);
+    mapped = bbhash_strtab_mmap(file, 0);
+    assert(mapped != NULL);
+    bbhash_strtab_free(mapped);
+    assert(bbhash_strtab_mmap(file, BBHASH_LOAD_VERIFY) == NULL);
+
+    // Offsets pointing out of the arena are refused without verification.
+    assert(bbhash_strtab_save(table, file) == 0);
+    fp = fopen(file, "r+b");
+    assert(fp);
+    uint64_t header[6];
+    assert(fread(header, sizeof(uint64_t), 6, fp) == 6);
+    uint64_t far = UINT64_MAX / 2;
+    fseek(fp, (long)(64 + header[5] + header[3] * 5), SEEK_SET);  // offset of string 5
+    fwrite(&far, (size_t)header[3], 1, fp);
+    fclose(fp);
+    assert(bbhash_strtab_mmap(file, 0) == NULL);
+    assert(bbhash_strtab_load(file, 0) == NULL);
+
+    assert(bbhash_strtab_save(table, file) == 0);
+    fp = fopen(file, "r+b");
+    assert(fp);
+    fseek(fp, 20, SEEK_SET);
+    fputc(0x7f, fp);
+    fclose(fp);
+    assert(bbhash_strtab_load(file, 0) == NULL);
+    remove(file);
+
+    for (size_t i = 0; i < NUM_RANDOM; i++) free(strs[i]);
+    free(strs);
+    free(lens);
+    bbhash_strtab_free(table);
+    bbhash_strtab_free(words);
+    printf("All tests passed.\n");
+    return 0;
+}
@@ -0,0 +1,200 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+
+#include "mt64.h"
+#include "dedup.h"
+#include "bbhash.h"
+#include "bbhash_blocked.h"
+#include "perf_counters.h"
+
+/*
+ * Locality-blocked layout against the level-per-array layout.
+ *
+ * Both are built over the same keys with the same gamma. For each the
+ * benchmark reports build time and bits/key, then the time per query three
+ * ways over the same shuffled stream of member keys: dependent (each key is
+ * derived from the previous result, so misses cannot overlap: latency),
+ * independent (a plain loop, which the CPU can overlap: throughput) and
+ * batched (the library's batch query with prefetching). With -P, hardware
+ * counters are reported per dependent query.
+ */
+
+constexpr size_t NUM_QUERIES = 1 << 22;
+
+typedef enum { LAYOUT_LEVELS, LAYOUT_BLOCKED } Layout;
+
+static volatile size_t sink;  // keeps the query loops from being optimized out
+
+static double seconds_between(const struct timespec *t0, const struct timespec *t1) {
+    return (double)(t1->tv_sec - t0->tv_sec) + (t1->tv_nsec - t0->tv_nsec) * 1e-9;
+}
+
+static inline size_t query(Layout layout, const void *mphf, uint64_t key) {
+    return layout == LAYOUT_BLOCKED ? bbhash_blocked_query(mphf, key) : bbhash_mphf_query(mphf, key);
+}
+
+// Prints one result row; returns false if the MPHF could not be built.
+static bool run(Layout layout, const uint64_t keys[], size_t n, const uint64_t queries[], unsigned rounds,
+                const BBHashConfig *config, bool perf) {
+    struct timespec t0, t1;
+    timespec_get(&t0, TIME_UTC);
+    void *mphf = layout == LAYOUT_BLOCKED ? (void *)bbhash_blocked_create(keys, n, config)
+                 : (void *)bbhash_mphf_create_ex(keys, n, config);
+    timespec_get(&t1, TIME_UTC);
+    if (!mphf) {
+        fprintf(stderr, "Error: Failed to create the MPHF.\n");
+        return false;
+    }
+    double build = seconds_between(&t0, &t1);
+    size_t bits = layout == LAYOUT_BLOCKED ? bbhash_blocked_size_in_bits(mphf) : bbhash_size_in_bits(mphf);
+    double total = (double)NUM_QUERIES * rounds;
+
+    // Dependent: the next key is only known once this query returns. Members
+    // never return (size_t)-1, so the xor is always 0.
+    PerfCounters counters;
+    if (perf) {
+        perf_counters_open(&counters, false);
+        perf_counters_start(&counters);
+    }
+    size_t last = 0, sum = 0;
+    timespec_get(&t0, TIME_UTC);
+    for (unsigned round = 0; round < rounds; round++) {
+        for (size_t i = 0; i < NUM_QUERIES; i++) {
+            last = query(layout, mphf, queries[i] ^ (last >> 63));
+            sum += last;
+        }
+    }
+    timespec_get(&t1, TIME_UTC);
+    if (perf) perf_counters_stop(&counters);
+    double dependent = seconds_between(&t0, &t1) * 1e9 / total;
+
+    timespec_get(&t0, TIME_UTC);
+    for (unsigned round = 0; round < rounds; round++) {
+        for (size_t i = 0; i < NUM_QUERIES; i++) sum += query(layout, mphf, queries[i]);
+    }
+    timespec_get(&t1, TIME_UTC);
+    double independent = seconds_between(&t0, &t1) * 1e9 / total;
+
+    size_t out[256];
+    timespec_get(&t0, TIME_UTC);
+    for (unsigned round = 0; round < rounds; round++) {
+        for (size_t i = 0; i < NUM_QUERIES; i += 256) {
+            if (layout == LAYOUT_BLOCKED) {
+                bbhash_blocked_query_batch(mphf, queries + i, 256, out);
+            } else {
+                bbhash_mphf_query_batch(mphf, queries + i, 256, out);
+            }
+            sum += out[0] + out[255];
+        }
+    }
+    timespec_get(&t1, TIME_UTC);
+    double batched = seconds_between(&t0, &t1) * 1e9 / total;
+
+    char extra[64] = "";
+    if (layout == LAYOUT_BLOCKED) {
+        BBHashBlockedStats stats;
+        bbhash_blocked_stats(mphf, &stats);
+        snprintf(extra, sizeof(extra), "   %.2f%% overflow", 100.0 * stats.overflow_keys / n);
+        bbhash_blocked_free(mphf);
+    } else {
+        bbhash_free(mphf);
+    }
+    sink = sum;
+    printf("%-8s %9.2f %9.3f %11.1f %12.1f %9.1f%s\n", layout == LAYOUT_BLOCKED ? "blocked" : "levels", build,
+           (double)bits / n, dependent, independent, batched, extra);
+    if (perf) {
+        perf_counters_print(&counters, "per dependent query", total);
+        perf_counters_close(&counters);
+    }
+    return true;
+}
+
+// Parses a count with an optional k, M or G suffix.
+static size_t parse_count(const char *arg) {
+    char *end;
+    double v = strtod(arg, &end);
+    if (*end == 'k' || *end == 'K') v *= 1e3;
+    else if (*end == 'M' || *end == 'm') v *= 1e6;
+    else if (*end == 'G' || *end == 'g') v *= 1e9;
+    return (size_t)v;
+}
+
+void print_usage(const char* prog_name);
+
+int main(int argc, char* argv[]) {
+    size_t n = 10000000;
+    unsigned rounds = 2;
+    bool perf = false;
+    BBHashConfig config = bbhash_config_default();
+
+    for (int i = 1; i < argc; ++i) {
+        const char *value = i + 1 < argc ? argv[i + 1] : NULL;
+        if (strcmp(argv[i], "-h") == 0 || strcmp(argv[i], "--help") == 0) {
+            print_usage(argv[0]);
+            return EXIT_SUCCESS;
+        }
+        if (strcmp(argv[i], "-P") == 0 || strcmp(argv[i], "--perf") == 0) {
+            perf = true;
+            continue;
+        }
+        if (!value) {
+            fprintf(stderr, "Error: Missing value for '%s'.\n", argv[i]);
+            return EXIT_FAILURE;
+        }
+        if (strcmp(argv[i], "-n") == 0 || strcmp(argv[i], "--keys") == 0) {
+            n = parse_count(value);
+        } else if (strcmp(argv[i], "-g") == 0 || strcmp(argv[i], "--gamma") == 0) {
+            config.gamma = strtod(value, NULL);
+        } else if (strcmp(argv[i], "-R") == 0 || strcmp(argv[i], "--rounds") == 0) {
+            rounds = (unsigned)strtoul(value, NULL, 0);
+        } else if (strcmp(argv[i], "-t") == 0 || strcmp(argv[i], "--threads") == 0) {
+            config.threads = (unsigned)strtoul(value, NULL, 0);
+        } else {
+            fprintf(stderr, "Error: Unknown argument '%s'.\n", argv[i]);
+            print_usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+        i++;
+    }
+    if (n == 0 || rounds == 0 || !(config.gamma >= 1.0)) {
+        print_usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    size_t buffer_size = n + n / 100 + 100;
+    uint64_t *keys = malloc(sizeof(uint64_t) * buffer_size);
+    uint64_t *queries = malloc(sizeof(uint64_t) * NUM_QUERIES);
+    if (!keys || !queries) {
+        fprintf(stderr, "Error: Failed to allocate %zu keys.\n", n);
+        return EXIT_FAILURE;
+    }
+    mt64_fill_u64_parallel(5489, keys, buffer_size, 1);
+    size_t unique = dedup(keys, buffer_size);
+    if (unique < n) n = unique;
+    Mt64 *rng = mt64_create(1234);
+    for (size_t q = 0; q < NUM_QUERIES; q++) queries[q] = keys[mt64_gen_int64(rng) % n];
+    mt64_destroy(rng);
+
+    printf("keys: %zu, gamma: %.2f, %zu queries x %u rounds\n\n", n, config.gamma, (size_t)NUM_QUERIES, rounds);
+    printf("%-8s %9s %9s %11s %12s %9s\n", "layout", "build (s)", "bits/key", "ns latency", "ns/query",
+           "ns batch");
+    bool ok = run(LAYOUT_LEVELS, keys, n, queries, rounds, &config, perf)
+              && run(LAYOUT_BLOCKED, keys, n, queries, rounds, &config, perf);
+    free(keys);
+    free(queries);
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+void print_usage(const char* prog_name) {
+    fprintf(stderr, "Usage: %s [options]\n\n", prog_name);
+    fprintf(stderr, "Options:\n");
+    fprintf(stderr, "  -n, --keys <count>     Keys, e.g. 10M or 100M. Default: 10M\n");
+    fprintf(stderr, "  -g, --gamma <f>        Bits per key in each level. Default: 2.0\n");
+    fprintf(stderr, "  -R, --rounds <n>       Passes over the 4M query stream. Default: 2\n");
+    fprintf(stderr, "  -t, --threads <n>      Construction threads. Default: 1\n");
+    fprintf(stderr, "  -P, --perf             Report hardware counters per dependent query.\n");
+    fprintf(stderr, "  -h, --help             Show this help message.\n");
+}
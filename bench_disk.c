@@ -0,0 +1,224 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+
+#include "mt64.h"
+#include "dedup.h"
+#include "bbhash.h"
+
+/*
+ * Query rate of an MPHF file queried on disk.
+ *
+ * Builds an MPHF, saves it to a local file and queries it four ways: loaded
+ * into memory (for reference), on disk with one pread() per probe, on disk
+ * with batches issued through io_uring, and the same with the deepest levels
+ * cached. For each the benchmark reports queries per second, device reads
+ * per query, the median and 99th percentile time of one call (a single
+ * query, or a batch of -b keys), and the memory held. Reads use direct I/O
+ * unless -B is given, so they go to the device however often the file has
+ * been read before.
+ */
+
+constexpr size_t NUM_QUERIES_DEFAULT = 200000;
+
+static double seconds_between(const struct timespec *t0, const struct timespec *t1) {
+    return (double)(t1->tv_sec - t0->tv_sec) + (t1->tv_nsec - t0->tv_nsec) * 1e-9;
+}
+
+static int compare_doubles(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+typedef struct {
+    const char *name;
+    const BBHash *mphf;          // query this in memory, or
+    BBHashDiskConfig config;     // open the file with this
+} Mode;
+
+// Runs the queries in calls of `batch` keys; prints one row.
+static bool run(const Mode *mode, const char *file, const uint64_t queries[], size_t num_queries, size_t batch,
+                size_t *out, double *call_us) {
+    BBHashDisk *disk = NULL;
+    if (!mode->mphf) {
+        disk = bbhash_disk_open(file, &mode->config);
+        if (!disk) {
+            fprintf(stderr, "Error: Failed to open '%s' for disk queries.\n", file);
+            return false;
+        }
+    }
+    size_t calls = 0;
+    struct timespec t0, t1, c0, c1;
+    timespec_get(&t0, TIME_UTC);
+    for (size_t first = 0; first < num_queries; first += batch, calls++) {
+        size_t count = num_queries - first < batch ? num_queries - first : batch;
+        timespec_get(&c0, TIME_UTC);
+        if (mode->mphf) {
+            bbhash_mphf_query_batch(mode->mphf, queries + first, count, out + first);
+        } else if (bbhash_disk_query_batch(disk, queries + first, count, out + first) != 0) {
+            bbhash_disk_close(disk);
+            return false;
+        }
+        timespec_get(&c1, TIME_UTC);
+        call_us[calls] = seconds_between(&c0, &c1) * 1e6;
+    }
+    timespec_get(&t1, TIME_UTC);
+    double seconds = seconds_between(&t0, &t1);
+    qsort(call_us, calls, sizeof(double), compare_doubles);
+
+    double reads = 0, memory = bbhash_size_in_bits(mode->mphf) / 8.0;
+    if (disk) {
+        BBHashDiskStats stats;
+        bbhash_disk_stats(disk, &stats);
+        reads = (double)stats.reads / num_queries;
+        memory = (double)stats.memory_bytes;
+        bbhash_disk_close(disk);
+    }
+    printf("%-32s %11.0f %12.2f %10.1f %10.1f %12.2f\n", mode->name, num_queries / seconds, reads,
+           call_us[calls / 2], call_us[calls * 99 / 100], memory / 1e6);
+    return true;
+}
+
+// Parses a count with an optional k, M or G suffix.
+static size_t parse_count(const char *arg) {
+    char *end;
+    double v = strtod(arg, &end);
+    if (*end == 'k' || *end == 'K') v *= 1e3;
+    else if (*end == 'M' || *end == 'm') v *= 1e6;
+    else if (*end == 'G' || *end == 'g') v *= 1e9;
+    return (size_t)v;
+}
+
+void print_usage(const char* prog_name);
+
+int main(int argc, char* argv[]) {
+    size_t n = 10000000;
+    size_t num_queries = NUM_QUERIES_DEFAULT;
+    size_t batch = 0;            // default: the queue depth
+    size_t cache_mb = 1;
+    const char *file = "bench_disk.bbh";
+    bool keep = false;
+    BBHashDiskConfig disk_config = bbhash_disk_config_default();
+
+    for (int i = 1; i < argc; ++i) {
+        const char *value = i + 1 < argc ? argv[i + 1] : NULL;
+        if (strcmp(argv[i], "-h") == 0 || strcmp(argv[i], "--help") == 0) {
+            print_usage(argv[0]);
+            return EXIT_SUCCESS;
+        }
+        if (strcmp(argv[i], "-B") == 0 || strcmp(argv[i], "--buffered") == 0) {
+            disk_config.direct_io = false;
+            continue;
+        }
+        if (strcmp(argv[i], "-k") == 0 || strcmp(argv[i], "--keep") == 0) {
+            keep = true;
+            continue;
+        }
+        if (!value) {
+            fprintf(stderr, "Error: Missing value for '%s'.\n", argv[i]);
+            return EXIT_FAILURE;
+        }
+        if (strcmp(argv[i], "-n") == 0 || strcmp(argv[i], "--keys") == 0) {
+            n = parse_count(value);
+        } else if (strcmp(argv[i], "-Q") == 0 || strcmp(argv[i], "--queries") == 0) {
+            num_queries = parse_count(value);
+        } else if (strcmp(argv[i], "-q") == 0 || strcmp(argv[i], "--queue-depth") == 0) {
+            disk_config.queue_depth = (unsigned)strtoul(value, NULL, 0);
+        } else if (strcmp(argv[i], "-b") == 0 || strcmp(argv[i], "--batch") == 0) {
+            batch = parse_count(value);
+        } else if (strcmp(argv[i], "-c") == 0 || strcmp(argv[i], "--cache") == 0) {
+            cache_mb = strtoul(value, NULL, 0);
+        } else if (strcmp(argv[i], "-f") == 0 || strcmp(argv[i], "--file") == 0) {
+            file = value;
+        } else {
+            fprintf(stderr, "Error: Unknown argument '%s'.\n", argv[i]);
+            print_usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+        i++;
+    }
+    if (batch == 0) batch = disk_config.queue_depth;
+    if (n == 0 || num_queries == 0 || disk_config.queue_depth == 0) {
+        print_usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    size_t buffer_size = n + n / 100 + 100;
+    uint64_t *keys = malloc(sizeof(uint64_t) * buffer_size);
+    uint64_t *queries = malloc(sizeof(uint64_t) * num_queries);
+    size_t *out = malloc(sizeof(size_t) * num_queries);
+    double *call_us = malloc(sizeof(double) * num_queries);
+    if (!keys || !queries || !out || !call_us) {
+        fprintf(stderr, "Error: Failed to allocate %zu keys.\n", n);
+        return EXIT_FAILURE;
+    }
+    mt64_fill_u64_parallel(5489, keys, buffer_size, 1);
+    size_t unique = dedup(keys, buffer_size);
+    if (unique < n) n = unique;
+    Mt64 *rng = mt64_create(1234);
+    for (size_t q = 0; q < num_queries; q++) queries[q] = keys[mt64_gen_int64(rng) % n];
+    mt64_destroy(rng);
+
+    BBHash *mphf = bbhash_mphf_create(keys, n, 2.0, false);
+    if (!mphf || bbhash_mphf_save(mphf, file) != 0) {
+        fprintf(stderr, "Error: Failed to build or save the MPHF to '%s'.\n", file);
+        return EXIT_FAILURE;
+    }
+    BBHashDisk *probe = bbhash_disk_open(file, &disk_config);
+    BBHashDiskStats stats = {0};
+    if (probe) bbhash_disk_stats(probe, &stats);
+    bbhash_disk_close(probe);
+    printf("keys: %zu, file: %s (%.1f MB of bit arrays), %s, %s, queue depth %u, %zu queries\n\n", n, file,
+           stats.disk_bytes / 1e6, stats.direct_io ? "direct I/O" : "buffered", stats.uring ? "io_uring" : "no io_uring",
+           disk_config.queue_depth, num_queries);
+    printf("%-32s %11s %12s %10s %10s %12s\n", "mode", "queries/s", "reads/query", "p50 (us)", "p99 (us)",
+           "memory (MB)");
+
+    char uring_name[64], cached_name[64];
+    snprintf(uring_name, sizeof(uring_name), "disk, batch %zu", batch);
+    snprintf(cached_name, sizeof(cached_name), "disk, batch %zu, %zu MB cache", batch, cache_mb);
+    Mode modes[4] = {
+        {.name = "memory, batch", .mphf = mphf},
+        {.name = "disk, one pread() per probe", .config = disk_config},
+        {.name = uring_name, .config = disk_config},
+        {.name = cached_name, .config = disk_config},
+    };
+    modes[1].config.use_uring = false;
+    modes[1].config.queue_depth = 1;
+    modes[3].config.cache_bytes = cache_mb << 20;
+
+    bool ok = true;
+    size_t *expected = malloc(sizeof(size_t) * num_queries);
+    bbhash_mphf_query_batch(mphf, queries, num_queries, expected);
+    for (size_t m = 0; m < 4 && ok; m++) {
+        ok = run(&modes[m], file, queries, num_queries, m == 1 ? 1 : batch, out, call_us);
+        if (ok && memcmp(out, expected, sizeof(size_t) * num_queries) != 0) {
+            fprintf(stderr, "Error: %s returned different indexes.\n", modes[m].name);
+            ok = false;
+        }
+    }
+    if (!keep) remove(file);
+    bbhash_free(mphf);
+    free(expected);
+    free(keys);
+    free(queries);
+    free(out);
+    free(call_us);
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+void print_usage(const char* prog_name) {
+    fprintf(stderr, "Usage: %s [options]\n\n", prog_name);
+    fprintf(stderr, "Options:\n");
+    fprintf(stderr, "  -n, --keys <count>         Keys, e.g. 10M or 100M. Default: 10M\n");
+    fprintf(stderr, "  -Q, --queries <count>      Queries per mode. Default: 200k\n");
+    fprintf(stderr, "  -q, --queue-depth <n>      Reads in flight per batch. Default: 64\n");
+    fprintf(stderr, "  -b, --batch <count>        Keys per batch call. Default: the queue depth\n");
+    fprintf(stderr, "  -c, --cache <MB>           Memory for the deepest levels. Default: 1\n");
+    fprintf(stderr, "  -f, --file <path>          File to save the MPHF to. Default: bench_disk.bbh\n");
+    fprintf(stderr, "  -B, --buffered             Read through the OS page cache.\n");
+    fprintf(stderr, "  -k, --keep                 Keep the file afterwards.\n");
+    fprintf(stderr, "  -h, --help                 Show this help message.\n");
+}
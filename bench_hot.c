@@ -0,0 +1,223 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+
+#include "mt64.h"
+#include "dedup.h"
+#include "bbhash.h"
+#include "perf_counters.h"
+
+/*
+ * Frequency-aware construction under a Zipf workload.
+ *
+ * Key i (in the order the keys are stored) has query frequency proportional
+ * to 1 / (i + 1)^s. The benchmark builds the MPHF three ways: plain, with
+ * the Zipf weights, and with only the most frequent keys given as hot keys.
+ * For each it reports the weighted average number of levels a query probes,
+ * the share of queries answered by level 0, and the measured latency of a
+ * Zipf-distributed query stream. With -P, hardware counters are also
+ * reported per key for the build and per query for the stream.
+ */
+
+constexpr size_t NUM_QUERIES = 1 << 20;
+
+static double seconds_between(const struct timespec *t0, const struct timespec *t1) {
+    return (double)(t1->tv_sec - t0->tv_sec) + (t1->tv_nsec - t0->tv_nsec) * 1e-9;
+}
+
+// Prints one result row; returns false if the MPHF could not be built.
+static bool run(const char *name, const uint64_t keys[], size_t n, const double weights[],
+                const uint64_t queries[], unsigned rounds, const BBHashConfig *config, bool perf) {
+    PerfCounters build_counters, query_counters;
+    if (perf) {
+        // Build threads start after this, so they are counted too.
+        perf_counters_open(&build_counters, true);
+        perf_counters_open(&query_counters, false);
+    }
+    struct timespec t0, t1;
+    if (perf) perf_counters_start(&build_counters);
+    timespec_get(&t0, TIME_UTC);
+    BBHash *mphf = bbhash_mphf_create_ex(keys, n, config);
+    timespec_get(&t1, TIME_UTC);
+    if (perf) perf_counters_stop(&build_counters);
+    if (!mphf) {
+        fprintf(stderr, "Error: Failed to create the %s MPHF.\n", name);
+        if (perf) {
+            perf_counters_close(&build_counters);
+            perf_counters_close(&query_counters);
+        }
+        return false;
+    }
+    double build = seconds_between(&t0, &t1);
+
+    double total = 0, probes = 0, first = 0;
+    for (size_t i = 0; i < n; i++) {
+        size_t level = bbhash_mphf_query_level(mphf, keys[i]);
+        total += weights[i];
+        probes += weights[i] * (double)(level + 1);
+        if (level == 0) first += weights[i];
+    }
+
+    size_t sum = 0;
+    if (perf) perf_counters_start(&query_counters);
+    timespec_get(&t0, TIME_UTC);
+    for (unsigned round = 0; round < rounds; round++) {
+        for (size_t i = 0; i < NUM_QUERIES; i++) {
+            sum += bbhash_mphf_query(mphf, queries[i]);
+        }
+    }
+    timespec_get(&t1, TIME_UTC);
+    if (perf) perf_counters_stop(&query_counters);
+    double ns = seconds_between(&t0, &t1) * 1e9 / ((double)NUM_QUERIES * rounds);
+
+    printf("%-8s %9.2f %9.3f %12.4f %10.1f%% %10.1f   (%zx)\n", name, build,
+           (double)bbhash_size_in_bits(mphf) / n, probes / total, 100.0 * first / total, ns, sum & 0xfff);
+    if (perf) {
+        perf_counters_print(&build_counters, "build per key", (double)n);
+        perf_counters_print(&query_counters, "per query", (double)NUM_QUERIES * rounds);
+        perf_counters_close(&build_counters);
+        perf_counters_close(&query_counters);
+    }
+    bbhash_free(mphf);
+    return true;
+}
+
+// Parses a count with an optional k, M or G suffix.
+static size_t parse_count(const char *arg) {
+    char *end;
+    double v = strtod(arg, &end);
+    if (*end == 'k' || *end == 'K') v *= 1e3;
+    else if (*end == 'M' || *end == 'm') v *= 1e6;
+    else if (*end == 'G' || *end == 'g') v *= 1e9;
+    return (size_t)v;
+}
+
+void print_usage(const char* prog_name);
+
+int main(int argc, char* argv[]) {
+    size_t n = 10000000;
+    double exponent = 1.0;
+    double hot_fraction = 0.01;
+    unsigned rounds = 4;
+    bool perf = false;
+    BBHashConfig config = bbhash_config_default();
+
+    for (int i = 1; i < argc; ++i) {
+        const char *value = i + 1 < argc ? argv[i + 1] : NULL;
+        if (strcmp(argv[i], "-h") == 0 || strcmp(argv[i], "--help") == 0) {
+            print_usage(argv[0]);
+            return EXIT_SUCCESS;
+        }
+        if (strcmp(argv[i], "-P") == 0 || strcmp(argv[i], "--perf") == 0) {
+            perf = true;
+            continue;
+        }
+        if (!value) {
+            fprintf(stderr, "Error: Missing value for '%s'.\n", argv[i]);
+            return EXIT_FAILURE;
+        }
+        if (strcmp(argv[i], "-n") == 0 || strcmp(argv[i], "--keys") == 0) {
+            n = parse_count(value);
+        } else if (strcmp(argv[i], "-s") == 0 || strcmp(argv[i], "--zipf") == 0) {
+            exponent = strtod(value, NULL);
+        } else if (strcmp(argv[i], "-p") == 0 || strcmp(argv[i], "--hot") == 0) {
+            hot_fraction = strtod(value, NULL);
+        } else if (strcmp(argv[i], "-T") == 0 || strcmp(argv[i], "--tries") == 0) {
+            config.hot_seed_tries = (unsigned)strtoul(value, NULL, 0);
+        } else if (strcmp(argv[i], "-t") == 0 || strcmp(argv[i], "--threads") == 0) {
+            config.threads = (unsigned)strtoul(value, NULL, 0);
+        } else if (strcmp(argv[i], "-g") == 0 || strcmp(argv[i], "--gamma") == 0) {
+            config.gamma = strtod(value, NULL);
+        } else if (strcmp(argv[i], "-R") == 0 || strcmp(argv[i], "--rounds") == 0) {
+            rounds = (unsigned)strtoul(value, NULL, 0);
+        } else {
+            fprintf(stderr, "Error: Unknown argument '%s'.\n", argv[i]);
+            print_usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+        i++;
+    }
+    if (n == 0 || rounds == 0 || !(config.gamma >= 1.0)) {
+        print_usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    size_t buffer_size = n + n / 100 + 100;
+    uint64_t *keys = malloc(sizeof(uint64_t) * buffer_size);
+    double *weights = malloc(sizeof(double) * buffer_size);
+    double *cdf = malloc(sizeof(double) * buffer_size);
+    uint64_t *queries = malloc(sizeof(uint64_t) * NUM_QUERIES);
+    if (!keys || !weights || !cdf || !queries) {
+        fprintf(stderr, "Error: Failed to allocate %zu keys.\n", n);
+        return EXIT_FAILURE;
+    }
+    mt64_fill_u64_parallel(5489, keys, buffer_size, 1);
+    size_t unique = dedup(keys, buffer_size);
+    if (unique < n) n = unique;
+
+    // dedup() sorts the keys; shuffle them so that rank and key value are unrelated.
+    Mt64 *rng = mt64_create(1234);
+    for (size_t i = n - 1; i > 0; i--) {
+        size_t j = mt64_gen_int64(rng) % (i + 1);
+        uint64_t tmp = keys[i];
+        keys[i] = keys[j];
+        keys[j] = tmp;
+    }
+
+    double sum = 0;
+    for (size_t i = 0; i < n; i++) {
+        weights[i] = pow((double)(i + 1), -exponent);
+        sum += weights[i];
+        cdf[i] = sum;
+    }
+    for (size_t q = 0; q < NUM_QUERIES; q++) {
+        double u = (double)(mt64_gen_int64(rng) >> 11) * 0x1p-53 * sum;
+        size_t lo = 0, hi = n - 1;
+        while (lo < hi) {
+            size_t mid = lo + (hi - lo) / 2;
+            if (cdf[mid] < u) lo = mid + 1;
+            else hi = mid;
+        }
+        queries[q] = keys[lo];
+    }
+    mt64_destroy(rng);
+    free(cdf);
+
+    size_t num_hot = (size_t)(hot_fraction * (double)n);
+    printf("keys: %zu, zipf s = %.2f, hot keys: %zu (top %.2f%%), seed tries: %u, %zu queries x %u rounds\n\n",
+           n, exponent, num_hot, 100.0 * hot_fraction, config.hot_seed_tries, (size_t)NUM_QUERIES, rounds);
+    printf("%-8s %9s %9s %12s %11s %10s\n", "build", "seconds", "bits/key", "avg probes", "at level 0", "ns/query");
+
+    bool ok = run("plain", keys, n, weights, queries, rounds, &config, perf);
+
+    BBHashConfig weighted = config;
+    weighted.weights = weights;
+    ok = ok && run("weights", keys, n, weights, queries, rounds, &weighted, perf);
+
+    BBHashConfig hot = config;
+    hot.hot_keys = keys;
+    hot.num_hot_keys = num_hot;
+    ok = ok && run("hot", keys, n, weights, queries, rounds, &hot, perf);
+
+    free(keys);
+    free(weights);
+    free(queries);
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+void print_usage(const char* prog_name) {
+    fprintf(stderr, "Usage: %s [options]\n\n", prog_name);
+    fprintf(stderr, "Options:\n");
+    fprintf(stderr, "  -n, --keys <n>         Number of keys (k/M/G suffix). Default: 10M\n");
+    fprintf(stderr, "  -s, --zipf <s>         Zipf exponent of the query distribution. Default: 1.0\n");
+    fprintf(stderr, "  -p, --hot <f>          Fraction of most frequent keys passed as hot keys. Default: 0.01\n");
+    fprintf(stderr, "  -T, --tries <n>        Seeds tried per level 0 block (1-256). Default: 16\n");
+    fprintf(stderr, "  -t, --threads <n>      Build threads. Default: 1\n");
+    fprintf(stderr, "  -g, --gamma <f>        Bits per key in each level. Default: 2.0\n");
+    fprintf(stderr, "  -R, --rounds <n>       Passes over the 1M query stream. Default: 4\n");
+    fprintf(stderr, "  -P, --perf             Report hardware counters per key and per query.\n");
+    fprintf(stderr, "  -h, --help             Show this help message.\n");
+}
@@ -0,0 +1,317 @@
+#define _GNU_SOURCE  // pthread_barrier_t
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <pthread.h>
+#include <time.h>
+
+#include "mt64.h"
+#include "dedup.h"
+#include "bbhash.h"
+#include "bbhash_replica.h"
+#include "perf_counters.h"
+
+/*
+ * Concurrent query throughput.
+ *
+ * For every working-set size, builds one MPHF and then, for every thread
+ * count and replica mode, runs pinned query threads over pregenerated query
+ * streams. Hits are keys from the set, misses are fresh random keys.
+ * With -P, hardware counters are read around the build and around every
+ * query thread's timed loop, and reported per key and per query. With
+ * -H key128 the keys and queries are 128 bits wide.
+ */
+
+constexpr size_t QUERIES_PER_THREAD = 1 << 20;
+constexpr size_t BATCH_SIZE = 1024;
+
+typedef struct {
+    const BBHash *mphf;
+    unsigned cpu;
+    const uint64_t *keys;      // (lo, hi) pairs if wide
+    size_t num_keys;
+    bool wide;                 // 128-bit keys
+    double hit_ratio;
+    uint64_t seed;
+    unsigned rounds;
+    bool batch;                // use bbhash_mphf_query_batch()
+    bool perf;                 // read hardware counters around the timed loop
+    pthread_barrier_t *barrier;
+    double seconds;
+    size_t checksum;
+    PerfCounters counters;
+} QueryTask;
+
+static double seconds_between(const struct timespec *t0, const struct timespec *t1) {
+    return (double)(t1->tv_sec - t0->tv_sec) + (t1->tv_nsec - t0->tv_nsec) * 1e-9;
+}
+
+static void *query_worker(void *arg) {
+    QueryTask *task = arg;
+    bbhash_pin_thread(task->cpu);
+
+    // Generate the stream on the pinned thread so it is node local.
+    const size_t words = task->wide ? 2 : 1;
+    uint64_t *queries = malloc(sizeof(uint64_t) * words * QUERIES_PER_THREAD);
+    Mt64 *rng = mt64_create(task->seed);
+    const uint64_t hit_threshold = task->hit_ratio >= 1.0 ? UINT64_MAX : (uint64_t)(task->hit_ratio * 0x1p64);
+    for (size_t i = 0; i < QUERIES_PER_THREAD; i++) {
+        uint64_t r = mt64_gen_int64(rng);
+        size_t k = mt64_gen_int64(rng) % task->num_keys;
+        for (size_t w = 0; w < words; w++) {
+            queries[i * words + w] = r < hit_threshold ? task->keys[k * words + w] : mt64_gen_int64(rng);
+        }
+    }
+    mt64_destroy(rng);
+    if (task->perf) perf_counters_open(&task->counters, false);
+
+    pthread_barrier_wait(task->barrier);
+    if (task->perf) perf_counters_start(&task->counters);
+    struct timespec t0, t1;
+    timespec_get(&t0, TIME_UTC);
+    size_t sum = 0;
+    size_t indexes[BATCH_SIZE];
+    const BBHashKey128 *wide_queries = (const BBHashKey128 *)queries;
+    for (unsigned round = 0; round < task->rounds; round++) {
+        if (task->wide && task->batch) {
+            for (size_t first = 0; first < QUERIES_PER_THREAD; first += BATCH_SIZE) {
+                bbhash_mphf_query128_batch(task->mphf, wide_queries + first, BATCH_SIZE, indexes);
+                for (size_t i = 0; i < BATCH_SIZE; i++) sum += indexes[i];
+            }
+            continue;
+        }
+        if (task->wide) {
+            for (size_t i = 0; i < QUERIES_PER_THREAD; i++) {
+                sum += bbhash_mphf_query128(task->mphf, wide_queries[i]);
+            }
+            continue;
+        }
+        if (task->batch) {
+            for (size_t first = 0; first < QUERIES_PER_THREAD; first += BATCH_SIZE) {
+                bbhash_mphf_query_batch(task->mphf, queries + first, BATCH_SIZE, indexes);
+                for (size_t i = 0; i < BATCH_SIZE; i++) sum += indexes[i];
+            }
+            continue;
+        }
+        for (size_t i = 0; i < QUERIES_PER_THREAD; i++) {
+            sum += bbhash_mphf_query(task->mphf, queries[i]);
+        }
+    }
+    timespec_get(&t1, TIME_UTC);
+    if (task->perf) {
+        perf_counters_stop(&task->counters);
+        perf_counters_close(&task->counters);
+    }
+    task->seconds = seconds_between(&t0, &t1);
+    task->checksum = sum;
+    free(queries);
+    return NULL;
+}
+
+static const char *mode_name(BBHashReplicaMode mode) {
+    switch (mode) {
+    case BBHASH_REPLICA_SHARED:
+        return "shared";
+    case BBHASH_REPLICA_PER_NODE:
+        return "node";
+    case BBHASH_REPLICA_PER_THREAD:
+        return "thread";
+    }
+    return "?";
+}
+
+// Runs one configuration and prints a result row.
+static bool run(const BBHash *mphf, const uint64_t keys[], size_t n, bool wide, unsigned threads,
+                BBHashReplicaMode mode, double hit_ratio, unsigned rounds, bool batch, bool perf) {
+    BBHashReplicas *replicas = bbhash_replicas_create(mphf, mode, threads);
+    QueryTask *tasks = calloc(threads, sizeof(QueryTask));
+    pthread_t *tids = malloc(sizeof(pthread_t) * threads);
+    pthread_barrier_t barrier;
+    if (!replicas || !tasks || !tids || pthread_barrier_init(&barrier, NULL, threads) != 0) {
+        fprintf(stderr, "Error: failed to set up %u query threads.\n", threads);
+        bbhash_replicas_free(replicas);
+        free(tasks);
+        free(tids);
+        return false;
+    }
+
+    for (unsigned t = 0; t < threads; t++) {
+        tasks[t] = (QueryTask) {
+            .mphf = bbhash_replicas_get(replicas, t),
+            .cpu = bbhash_replicas_cpu(replicas, t),
+            .keys = keys, .num_keys = n, .wide = wide,
+            .hit_ratio = hit_ratio, .seed = 1000 + t, .rounds = rounds, .batch = batch, .perf = perf,
+            .barrier = &barrier,
+        };
+        pthread_create(&tids[t], NULL, query_worker, &tasks[t]);
+    }
+    double slowest = 0;
+    size_t checksum = 0;
+    PerfCounters counters;
+    perf_counters_init_sum(&counters);
+    for (unsigned t = 0; t < threads; t++) {
+        pthread_join(tids[t], NULL);
+        if (tasks[t].seconds > slowest) slowest = tasks[t].seconds;
+        checksum += tasks[t].checksum;
+        perf_counters_add(&counters, &tasks[t].counters);
+    }
+
+    double total = (double)QUERIES_PER_THREAD * rounds * threads;
+    printf("%12zu %8u %8s %7zu %12.1f %10.1f   (%zx)\n", n, threads, mode_name(mode),
+           bbhash_replicas_count(replicas), total / slowest / 1e6, slowest * 1e9 / (total / threads),
+           checksum & 0xfff);
+    if (perf) perf_counters_print(&counters, "per query", total);
+
+    pthread_barrier_destroy(&barrier);
+    bbhash_replicas_free(replicas);
+    free(tasks);
+    free(tids);
+    return true;
+}
+
+// Parses a comma separated list of numbers; returns the count.
+static size_t parse_list(const char *arg, size_t values[], size_t max) {
+    size_t count = 0;
+    const char *p = arg;
+    while (*p && count < max) {
+        char *end;
+        double v = strtod(p, &end);
+        if (end == p) break;
+        if (*end == 'k' || *end == 'K') v *= 1e3, end++;
+        else if (*end == 'M' || *end == 'm') v *= 1e6, end++;
+        else if (*end == 'G' || *end == 'g') v *= 1e9, end++;
+        values[count++] = (size_t)v;
+        p = *end == ',' ? end + 1 : end;
+    }
+    return count;
+}
+
+void print_usage(const char* prog_name);
+
+int main(int argc, char* argv[]) {
+    size_t sizes[16] = {1000000, 10000000}, num_sizes = 2;
+    size_t thread_counts[64] = {1}, num_thread_counts = 1;
+    bool modes[3] = {true, true, true};
+    double hit_ratio = 1.0;
+    unsigned rounds = 4;
+    bool batch = false;
+    bool perf = false;
+    bool wide = false;
+    BBHashConfig config = bbhash_config_default();
+
+    for (int i = 1; i < argc; ++i) {
+        const char *value = i + 1 < argc ? argv[i + 1] : NULL;
+        if (strcmp(argv[i], "-h") == 0 || strcmp(argv[i], "--help") == 0) {
+            print_usage(argv[0]);
+            return EXIT_SUCCESS;
+        }
+        if (strcmp(argv[i], "-b") == 0 || strcmp(argv[i], "--batch") == 0) {
+            batch = true;
+            continue;
+        }
+        if (strcmp(argv[i], "-P") == 0 || strcmp(argv[i], "--perf") == 0) {
+            perf = true;
+            continue;
+        }
+        if (!value) {
+            fprintf(stderr, "Error: Missing value for '%s'.\n", argv[i]);
+            return EXIT_FAILURE;
+        }
+        if (strcmp(argv[i], "-n") == 0 || strcmp(argv[i], "--keys") == 0) {
+            num_sizes = parse_list(value, sizes, 16);
+        } else if (strcmp(argv[i], "-t") == 0 || strcmp(argv[i], "--threads") == 0) {
+            num_thread_counts = parse_list(value, thread_counts, 64);
+        } else if (strcmp(argv[i], "-m") == 0 || strcmp(argv[i], "--mode") == 0) {
+            modes[BBHASH_REPLICA_SHARED] = strstr(value, "shared") || strcmp(value, "all") == 0;
+            modes[BBHASH_REPLICA_PER_NODE] = strstr(value, "node") || strcmp(value, "all") == 0;
+            modes[BBHASH_REPLICA_PER_THREAD] = strstr(value, "thread") || strcmp(value, "all") == 0;
+        } else if (strcmp(argv[i], "-r") == 0 || strcmp(argv[i], "--hit-ratio") == 0) {
+            hit_ratio = strtod(value, NULL);
+        } else if (strcmp(argv[i], "-R") == 0 || strcmp(argv[i], "--rounds") == 0) {
+            rounds = (unsigned)strtoul(value, NULL, 0);
+        } else if (strcmp(argv[i], "-H") == 0 || strcmp(argv[i], "--hash") == 0) {
+            wide = strcmp(value, "key128") == 0;
+            config.hash_scheme = strcmp(value, "base128") == 0 ? BBHASH_HASH_BASE128 : BBHASH_HASH_SEEDED;
+        } else {
+            fprintf(stderr, "Error: Unknown argument '%s'.\n", argv[i]);
+            print_usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+        i++;
+    }
+    if (num_sizes == 0 || num_thread_counts == 0 || rounds == 0) {
+        print_usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    printf("NUMA nodes: %u, hit ratio: %.2f, %zu queries/thread x %u rounds, %s hash, %s queries\n\n",
+           bbhash_numa_nodes(), hit_ratio, (size_t)QUERIES_PER_THREAD, rounds,
+           wide ? "key128" : config.hash_scheme == BBHASH_HASH_BASE128 ? "base128" : "seeded",
+           batch ? "batched" : "single");
+    printf("%12s %8s %8s %7s %12s %10s\n", "keys", "threads", "layout", "copies", "Mqueries/s", "ns/query");
+
+    Mt64 *rng = mt64_create_default();
+    for (size_t s = 0; s < num_sizes; s++) {
+        size_t n = sizes[s];
+        size_t buffer_size = n + n / 100 + 100;
+        size_t words = wide ? 2 : 1;
+        uint64_t *keys = malloc(sizeof(uint64_t) * words * buffer_size);
+        if (!keys) {
+            fprintf(stderr, "Error: Failed to allocate %zu keys.\n", n);
+            return EXIT_FAILURE;
+        }
+        for (size_t i = 0; i < buffer_size * words; i++) keys[i] = mt64_gen_int64(rng);
+        size_t unique = wide ? dedup_pairs(keys, buffer_size) : dedup(keys, buffer_size);
+        if (unique < n) n = unique;
+
+        PerfCounters build;
+        if (perf) {
+            perf_counters_open(&build, true);
+            perf_counters_start(&build);
+        }
+        struct timespec t0, t1;
+        timespec_get(&t0, TIME_UTC);
+        BBHash *mphf = wide ? bbhash_mphf_create128((const BBHashKey128 *)keys, n, &config)
+                            : bbhash_mphf_create_ex(keys, n, &config);
+        timespec_get(&t1, TIME_UTC);
+        if (!mphf) {
+            fprintf(stderr, "Error: Failed to create MPHF.\n");
+            free(keys);
+            return EXIT_FAILURE;
+        }
+        printf("%12zu keys built in %.1f ns/key\n", n, seconds_between(&t0, &t1) * 1e9 / (double)n);
+        if (perf) {
+            perf_counters_stop(&build);
+            perf_counters_close(&build);
+            perf_counters_print(&build, "build per key", (double)n);
+        }
+        for (size_t t = 0; t < num_thread_counts; t++) {
+            for (int mode = 0; mode < 3; mode++) {
+                if (modes[mode]) {
+                    run(mphf, keys, n, wide, (unsigned)thread_counts[t], mode, hit_ratio, rounds, batch, perf);
+                }
+            }
+        }
+        printf("\n");
+        bbhash_free(mphf);
+        free(keys);
+    }
+    mt64_destroy(rng);
+    return EXIT_SUCCESS;
+}
+
+void print_usage(const char* prog_name) {
+    fprintf(stderr, "Usage: %s [options]\n\n", prog_name);
+    fprintf(stderr, "Options:\n");
+    fprintf(stderr, "  -n, --keys <list>      Working-set sizes in keys, e.g. 1M,10M,100M. Default: 1M,10M\n");
+    fprintf(stderr, "  -t, --threads <list>   Query thread counts, e.g. 1,2,4,8,16,32,64. Default: 1\n");
+    fprintf(stderr, "  -m, --mode <modes>     Replica layouts: shared,node,thread or all. Default: all\n");
+    fprintf(stderr, "  -r, --hit-ratio <f>    Fraction of queries that are keys in the set. Default: 1.0\n");
+    fprintf(stderr, "  -R, --rounds <n>       Passes over each thread's 1M query stream. Default: 4\n");
+    fprintf(stderr, "  -H, --hash <scheme>    Hash scheme: seeded, base128, or key128 for 128-bit keys. Default: seeded\n");
+    fprintf(stderr, "  -b, --batch            Query in batches with bbhash_mphf_query_batch().\n");
+    fprintf(stderr, "  -P, --perf             Report hardware counters per key and per query.\n");
+    fprintf(stderr, "  -h, --help             Show this help message.\n");
+}
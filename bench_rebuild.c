@@ -0,0 +1,174 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+#include <sys/resource.h>
+
+#include "mt64.h"
+#include "dedup.h"
+#include "bbhash.h"
+#include "perf_counters.h"
+
+/*
+ * Back-to-back rebuilds of similar size, as an indexer that rebuilds its
+ * MPHFs in a loop does.
+ *
+ * Each round builds over a different window of the key pool, with sizes
+ * varying by up to 2%. The rounds run once with bbhash_mphf_create_ex(),
+ * which allocates and frees its scratch memory every build, and once with
+ * one BBHashBuilder that keeps it. For each, the benchmark reports the
+ * first build, the mean of the later (steady-state) builds and their minor
+ * page faults. With -P, hardware counters are reported per key over the
+ * steady-state builds.
+ */
+
+static double seconds_between(const struct timespec *t0, const struct timespec *t1) {
+    return (double)(t1->tv_sec - t0->tv_sec) + (t1->tv_nsec - t0->tv_nsec) * 1e-9;
+}
+
+static long minor_faults(void) {
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_minflt;
+}
+
+// Runs all rounds, with `builder` or without; prints one row.
+static bool run(const char *name, BBHashBuilder *builder, const uint64_t pool[], size_t n, unsigned rounds,
+                const BBHashConfig *config, bool perf) {
+    double first = 0, steady = 0;
+    long steady_faults = 0;
+    size_t steady_keys = 0;
+    PerfCounters sum;
+    perf_counters_init_sum(&sum);
+    for (unsigned round = 0; round < rounds; round++) {
+        const uint64_t *keys = pool + (size_t)round * n / rounds;
+        size_t count = n - (round % 3) * (n / 100);
+        PerfCounters counters;
+        if (perf) {
+            // Build threads start after this, so they are counted too.
+            perf_counters_open(&counters, true);
+            perf_counters_start(&counters);
+        }
+        long faults = minor_faults();
+        struct timespec t0, t1;
+        timespec_get(&t0, TIME_UTC);
+        BBHash *mphf = builder ? bbhash_builder_build(builder, keys, count, config)
+                               : bbhash_mphf_create_ex(keys, count, config);
+        timespec_get(&t1, TIME_UTC);
+        faults = minor_faults() - faults;
+        if (perf) {
+            perf_counters_stop(&counters);
+            perf_counters_close(&counters);
+        }
+        if (!mphf) {
+            fprintf(stderr, "Error: Failed to create the MPHF in round %u.\n", round);
+            return false;
+        }
+        bbhash_free(mphf);
+        double seconds = seconds_between(&t0, &t1);
+        if (round == 0) {
+            first = seconds;
+            continue;
+        }
+        steady += seconds;
+        steady_faults += faults;
+        steady_keys += count;
+        if (perf) perf_counters_add(&sum, &counters);
+    }
+    unsigned later = rounds - 1;
+    printf("%-9s %10.3f %11.3f %12.1f %13ld %13.1f\n", name, first, steady / later, steady * 1e9 / steady_keys,
+           steady_faults / later, builder ? bbhash_builder_scratch_bytes(builder) / 1e6 : 0.0);
+    if (perf) perf_counters_print(&sum, "steady build per key", (double)steady_keys);
+    return true;
+}
+
+// Parses a count with an optional k, M or G suffix.
+static size_t parse_count(const char *arg) {
+    char *end;
+    double v = strtod(arg, &end);
+    if (*end == 'k' || *end == 'K') v *= 1e3;
+    else if (*end == 'M' || *end == 'm') v *= 1e6;
+    else if (*end == 'G' || *end == 'g') v *= 1e9;
+    return (size_t)v;
+}
+
+void print_usage(const char* prog_name);
+
+int main(int argc, char* argv[]) {
+    size_t n = 10000000;
+    unsigned rounds = 6;
+    bool perf = false;
+    BBHashConfig config = bbhash_config_default();
+
+    for (int i = 1; i < argc; ++i) {
+        const char *value = i + 1 < argc ? argv[i + 1] : NULL;
+        if (strcmp(argv[i], "-h") == 0 || strcmp(argv[i], "--help") == 0) {
+            print_usage(argv[0]);
+            return EXIT_SUCCESS;
+        }
+        if (strcmp(argv[i], "-P") == 0 || strcmp(argv[i], "--perf") == 0) {
+            perf = true;
+            continue;
+        }
+        if (!value) {
+            fprintf(stderr, "Error: Missing value for '%s'.\n", argv[i]);
+            return EXIT_FAILURE;
+        }
+        if (strcmp(argv[i], "-n") == 0 || strcmp(argv[i], "--keys") == 0) {
+            n = parse_count(value);
+        } else if (strcmp(argv[i], "-R") == 0 || strcmp(argv[i], "--rounds") == 0) {
+            rounds = (unsigned)strtoul(value, NULL, 0);
+        } else if (strcmp(argv[i], "-t") == 0 || strcmp(argv[i], "--threads") == 0) {
+            config.threads = (unsigned)strtoul(value, NULL, 0);
+        } else if (strcmp(argv[i], "-g") == 0 || strcmp(argv[i], "--gamma") == 0) {
+            config.gamma = strtod(value, NULL);
+        } else if (strcmp(argv[i], "-H") == 0 || strcmp(argv[i], "--hash") == 0) {
+            config.hash_scheme = strcmp(value, "base128") == 0 ? BBHASH_HASH_BASE128 : BBHASH_HASH_SEEDED;
+        } else {
+            fprintf(stderr, "Error: Unknown argument '%s'.\n", argv[i]);
+            print_usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+        i++;
+    }
+    if (n < 100 || rounds < 2 || !(config.gamma >= 1.0)) {
+        print_usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    // Round r builds over the window starting at r * n / rounds.
+    size_t buffer_size = 2 * n + n / 100 + 100;
+    uint64_t *pool = malloc(sizeof(uint64_t) * buffer_size);
+    if (!pool) {
+        fprintf(stderr, "Error: Failed to allocate %zu keys.\n", buffer_size);
+        return EXIT_FAILURE;
+    }
+    mt64_fill_u64_parallel(5489, pool, buffer_size, 1);
+    size_t unique = dedup(pool, buffer_size);
+    if (unique < 2 * n) n = unique / 2;
+
+    printf("keys: %zu (up to 2%% fewer in some rounds), %u rounds, %s hash, %u threads\n\n", n, rounds,
+           config.hash_scheme == BBHASH_HASH_BASE128 ? "base128" : "seeded", config.threads);
+    printf("%-9s %10s %11s %12s %13s %13s\n", "build", "first (s)", "steady (s)", "ns/key", "faults/build",
+           "scratch (MB)");
+
+    bool ok = run("one-shot", NULL, pool, n, rounds, &config, perf);
+    BBHashBuilder *builder = bbhash_builder_create();
+    ok = ok && builder && run("builder", builder, pool, n, rounds, &config, perf);
+    bbhash_builder_free(builder);
+    free(pool);
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+void print_usage(const char* prog_name) {
+    fprintf(stderr, "Usage: %s [options]\n\n", prog_name);
+    fprintf(stderr, "Options:\n");
+    fprintf(stderr, "  -n, --keys <count>     Keys per build, e.g. 10M or 100M. Default: 10M\n");
+    fprintf(stderr, "  -R, --rounds <n>       Builds per mode; the first is reported apart. Default: 6\n");
+    fprintf(stderr, "  -t, --threads <n>      Construction threads. Default: 1\n");
+    fprintf(stderr, "  -g, --gamma <f>        Bits per key in each level. Default: 2.0\n");
+    fprintf(stderr, "  -H, --hash <scheme>    Hash scheme: seeded or base128. Default: seeded\n");
+    fprintf(stderr, "  -P, --perf             Report hardware counters per key.\n");
+    fprintf(stderr, "  -h, --help             Show this help message.\n");
+}
@@ -6,7 +6,10 @@
 #include <stdbool.h> // For bool type
 #include <stdlib.h>
 #include <stdio.h>   // fprintf
+#include <string.h>  // memset, memcpy
 #include <assert.h>
+#include <stdatomic.h>
+#include "bbhash_alloc.h"
 
 
 #if defined(__has_include) && __has_include(<stdbit.h>)
@@ -33,12 +36,13 @@ typedef struct {
 /**
  * Creates a new, zero-initialized bit array.
  * @param nbits The number of bits the array should hold.
+ * @param a The allocator, or NULL for calloc().
  * @return A pointer to the new Bitarray, or NULL on allocation failure.
  */
-static inline Bitarray *bitarray_new(size_t nbits) {
+static inline Bitarray *bitarray_new_with(size_t nbits, const BBHashAllocator *a) {
     size_t nwords = (nbits + 63) / 64;
     size_t total_size = sizeof(Bitarray) + nwords * sizeof(uint64_t);
-    Bitarray *ba = calloc(1, total_size);
+    Bitarray *ba = bbhash_zalloc(a, total_size, alignof(Bitarray));
     if (ba == NULL) {
         fprintf(stderr, "Memory allocation failed for Bitarray!\n");
         return NULL;
@@ -47,6 +51,32 @@ static inline Bitarray *bitarray_new(size_t nbits) {
     return ba;
 }
 
+static inline Bitarray *bitarray_new(size_t nbits) {
+    return bitarray_new_with(nbits, NULL);
+}
+
+/**
+ * Creates a bit array without clearing it, for callers that overwrite every
+ * word (e.g. with bitarray_andnot()) before reading it.
+ * @param nbits The number of bits the array should hold.
+ * @param a The allocator, or NULL for malloc().
+ * @return A pointer to the new Bitarray, or NULL on allocation failure.
+ */
+static inline Bitarray *bitarray_new_uninit_with(size_t nbits, const BBHashAllocator *a) {
+    size_t nwords = (nbits + 63) / 64;
+    Bitarray *ba = bbhash_alloc(a, sizeof(Bitarray) + nwords * sizeof(uint64_t), alignof(Bitarray));
+    if (ba == NULL) {
+        fprintf(stderr, "Memory allocation failed for Bitarray!\n");
+        return NULL;
+    }
+    ba->nbits = nbits;
+    return ba;
+}
+
+static inline Bitarray *bitarray_new_uninit(size_t nbits) {
+    return bitarray_new_uninit_with(nbits, NULL);
+}
+
 /**
  * Shrinks the array.
  * @param nbits The reduced number of bits the array should hold.
@@ -56,12 +86,38 @@ static inline void bitarray_shrink(Bitarray* ba, size_t nbits) {
     ba->nbits = nbits;
 }
 
+/**
+ * Copies a bit array into a fresh allocation (placed on the calling thread's
+ * NUMA node under the usual first-touch policy).
+ * @param ba A pointer to the Bitarray to copy.
+ * @param a The allocator, or NULL for malloc().
+ * @return A pointer to the new Bitarray, or NULL on allocation failure.
+ */
+static inline Bitarray *bitarray_clone_with(const Bitarray *ba, const BBHashAllocator *a) {
+    assert(ba != NULL);
+    Bitarray *copy = bitarray_new_uninit_with(ba->nbits, a);
+    if (copy == NULL) {
+        return NULL;
+    }
+    memcpy(copy->bits, ba->bits, ((ba->nbits + 63) / 64) * sizeof(uint64_t));
+    return copy;
+}
+
+static inline Bitarray *bitarray_clone(const Bitarray *ba) {
+    return bitarray_clone_with(ba, NULL);
+}
+
 /**
  * Frees the memory allocated for the Bitarray.
  * @param ba A pointer to the Bitarray to be freed.
+ * @param a The allocator it came from, or NULL.
  */
+static inline void bitarray_free_with(Bitarray *ba, const BBHashAllocator *a) {
+    bbhash_dealloc(a, ba);
+}
+
 static inline void bitarray_free(Bitarray *ba) {
-    free(ba);
+    bitarray_free_with(ba, NULL);
 }
 
 /**
@@ -77,6 +133,19 @@ static inline void bitarray_set(Bitarray *ba, size_t pos) {
     ba->bits[word] |= (1ULL << bit_in_word);
 }
 
+/**
+ * Atomically sets a bit, so several threads can update the same array.
+ * @param ba A pointer to the Bitarray.
+ * @param pos The zero-based index of the bit to set.
+ * @return The previous value of the bit (0 or 1).
+ */
+static inline int bitarray_set_atomic(Bitarray *ba, size_t pos) {
+    assert(ba != NULL && pos < ba->nbits);
+    uint64_t mask = 1ULL << (pos & 63);
+    uint64_t old = atomic_fetch_or_explicit((_Atomic uint64_t *)&ba->bits[pos >> 6], mask, memory_order_relaxed);
+    return (old & mask) != 0;
+}
+
 /**
  * Gets the value of a bit at a specific position.
  * @param ba A pointer to the Bitarray.
@@ -91,6 +160,44 @@ static inline int bitarray_get(const Bitarray *ba, size_t pos) {
     return (ba->bits[word] >> bit_in_word) & 1;
 }
 
+/**
+ * Reads a `width`-bit unsigned field that starts at bit `pos`.
+ * Fields may straddle a word boundary. Used for packed integer arrays.
+ * @param ba A pointer to the Bitarray.
+ * @param pos The bit position of the field's least significant bit.
+ * @param width The field width in bits (1..64).
+ * @return The field value.
+ */
+static inline uint64_t bitarray_get_field(const Bitarray *ba, size_t pos, unsigned width) {
+    assert(ba != NULL && width >= 1 && width <= 64 && pos + width <= ba->nbits);
+    size_t word = pos >> 6;
+    unsigned shift = pos & 63;
+    uint64_t value = ba->bits[word] >> shift;
+    if (shift + width > 64) {
+        value |= ba->bits[word + 1] << (64 - shift);
+    }
+    return width == 64 ? value : value & ((1ULL << width) - 1);
+}
+
+/**
+ * Writes a `width`-bit unsigned field at bit `pos`. The field must be zero
+ * beforehand (as it is in a new array); bits of value above width are ignored.
+ * @param ba A pointer to the Bitarray.
+ * @param pos The bit position of the field's least significant bit.
+ * @param width The field width in bits (1..64).
+ * @param value The value to store.
+ */
+static inline void bitarray_set_field(Bitarray *ba, size_t pos, unsigned width, uint64_t value) {
+    assert(ba != NULL && width >= 1 && width <= 64 && pos + width <= ba->nbits);
+    if (width < 64) value &= (1ULL << width) - 1;
+    size_t word = pos >> 6;
+    unsigned shift = pos & 63;
+    ba->bits[word] |= value << shift;
+    if (shift + width > 64) {
+        ba->bits[word + 1] |= value >> (64 - shift);
+    }
+}
+
 /**
  * Clears a bit at a specific position to 0.
  * @param ba A pointer to the Bitarray.
@@ -112,6 +219,24 @@ static inline void bitarray_clear_all(Bitarray *ba) {
     memset(ba->bits, 0, nwords * sizeof(uint64_t));
 }
 
+/**
+ * Counts the set bits. Ignores unused bits in the final word.
+ * @param ba A pointer to the Bitarray.
+ * @return The number of bits set.
+ */
+static inline size_t bitarray_count(const Bitarray *ba) {
+    assert(ba != NULL);
+
+    size_t full = ba->nbits / 64, count = 0;
+    for (size_t i = 0; i < full; i++) {
+        count += stdc_count_ones(ba->bits[i]);
+    }
+    if (ba->nbits % 64) {
+        count += stdc_count_ones(ba->bits[full] & ((1ULL << (ba->nbits % 64)) - 1));
+    }
+    return count;
+}
+
 /**
  * Checks if no bits are set. Ignores unused bits in the final word.
  * @param ba A pointer to the Bitarray.
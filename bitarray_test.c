@@ -31,5 +31,15 @@ int main() {
     // Clean up
     bitarray_free(my_bits);
 
+    // Packed fields, including ones that straddle a word boundary
+    Bitarray *packed = bitarray_new(7 * 20);
+    for (size_t i = 0; i < 20; i++) {
+        bitarray_set_field(packed, i * 7, 7, (i * 37) & 127);
+    }
+    for (size_t i = 0; i < 20; i++) {
+        assert(bitarray_get_field(packed, i * 7, 7) == ((i * 37) & 127));
+    }
+    bitarray_free(packed);
+
     return 0;
 }
@@ -0,0 +1,301 @@
+#define _POSIX_C_SOURCE 200809L  // fsync, fileno, mkdir under -std=c23
+
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <errno.h>
+#include <pthread.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "crc32c.h"
+#include "checkpoint.h"
+
+/*
+ * File layouts, in host byte order (a checkpoint is resumed on the machine,
+ * or at least the architecture, that wrote it):
+ *   state:      'BBC1', u32 0, CheckpointState
+ *   level-NNNN: 'BBL1', u32 0, seed, offset, nbits, num_blocks, bit words,
+ *               one seed byte per block
+ *   keys-NNNN:  'BBK1', u32 0, num_arrays, words per array, the arrays
+ * Each is followed by the CRC-32C of everything before it, in a 64-bit field.
+ */
+enum { PATH_MAX_LEN = 4096 };
+
+typedef struct {
+    const void *data;
+    size_t len;
+} Part;
+
+struct CheckpointWriter {
+    char dir[PATH_MAX_LEN];
+    pthread_t tid;
+    bool threaded;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    bool pending;              // a job is queued or being written
+    bool stop;
+    bool failed;               // sticky: later jobs are dropped
+    CheckpointState state;
+    CheckpointLevel level;
+    const uint64_t *keys[2];
+};
+
+static void file_path(char *out, const char *dir, const char *name) {
+    snprintf(out, PATH_MAX_LEN, "%s/%s", dir, name);
+}
+
+// Writes name.tmp, syncs it and renames it to name.
+static bool write_file(const char *dir, const char *name, const char magic[4], const Part parts[], size_t count) {
+    char path[PATH_MAX_LEN], tmp[PATH_MAX_LEN + 4];
+    file_path(path, dir, name);
+    snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+    FILE *fp = fopen(tmp, "wb");
+    if (!fp) {
+        perror(tmp);
+        return false;
+    }
+    const uint32_t flags = 0;
+    uint32_t crc = crc32c(0, magic, 4);
+    crc = crc32c(crc, &flags, sizeof(flags));
+    bool ok = fwrite(magic, 1, 4, fp) == 4 && fwrite(&flags, sizeof(flags), 1, fp) == 1;
+    for (size_t i = 0; ok && i < count; i++) {
+        if (parts[i].len == 0) continue;  // e.g. no block seeds: data may be NULL
+        ok = fwrite(parts[i].data, 1, parts[i].len, fp) == parts[i].len;
+        crc = crc32c(crc, parts[i].data, parts[i].len);
+    }
+    uint64_t crc64 = crc;
+    ok = ok && fwrite(&crc64, sizeof(crc64), 1, fp) == 1 && fflush(fp) == 0 && fsync(fileno(fp)) == 0;
+    ok = fclose(fp) == 0 && ok;
+    if (!ok || rename(tmp, path) != 0) {
+        fprintf(stderr, "Error: failed to write checkpoint file '%s': %s\n", path, strerror(errno));
+        remove(tmp);
+        return false;
+    }
+    return true;
+}
+
+static bool write_checkpoint(const char *dir, const CheckpointState *state, const CheckpointLevel *level,
+                             const uint64_t *const keys[2]) {
+    char name[32];
+    size_t level_no = state->num_levels - 1;
+    uint64_t header[4] = {level->seed, level->offset, level->bits->nbits, level->num_blocks};
+    Part level_parts[] = {
+        {header, sizeof(header)},
+        {level->bits->bits, (level->bits->nbits + 63) / 64 * sizeof(uint64_t)},
+        {level->block_seeds, level->block_seeds ? level->num_blocks : 0},
+    };
+    snprintf(name, sizeof(name), "level-%04zu", level_no);
+    if (!write_file(dir, name, "BBL1", level_parts, 3)) return false;
+
+    uint64_t words = state->unplaced * state->words_per_key;
+    uint64_t keys_header[2] = {state->num_arrays, words};
+    Part key_parts[3] = {{keys_header, sizeof(keys_header)}};
+    for (uint32_t a = 0; a < state->num_arrays; a++) {
+        key_parts[1 + a] = (Part) {keys[a], words * sizeof(uint64_t)};
+    }
+    snprintf(name, sizeof(name), "keys-%04zu", level_no);
+    if (!write_file(dir, name, "BBK1", key_parts, 1 + state->num_arrays)) return false;
+
+    Part state_part = {state, sizeof(*state)};
+    if (!write_file(dir, "state", "BBC1", &state_part, 1)) return false;
+
+    // The previous keys are no longer needed once the state names these.
+    if (level_no > 0) {
+        char path[PATH_MAX_LEN];
+        snprintf(name, sizeof(name), "keys-%04zu", level_no - 1);
+        file_path(path, dir, name);
+        remove(path);
+    }
+    return true;
+}
+
+static void *writer_thread(void *arg) {
+    CheckpointWriter *w = arg;
+    pthread_mutex_lock(&w->lock);
+    for (;;) {
+        while (!w->pending && !w->stop) pthread_cond_wait(&w->cond, &w->lock);
+        if (!w->pending) break;
+        pthread_mutex_unlock(&w->lock);
+        bool ok = !w->failed && write_checkpoint(w->dir, &w->state, &w->level, w->keys);
+        pthread_mutex_lock(&w->lock);
+        w->failed = !ok;
+        w->pending = false;
+        pthread_cond_broadcast(&w->cond);
+    }
+    pthread_mutex_unlock(&w->lock);
+    return NULL;
+}
+
+CheckpointWriter *checkpoint_writer_start(const char *dir) {
+    if (!dir || strlen(dir) + 32 >= PATH_MAX_LEN) return NULL;
+    if (mkdir(dir, 0755) != 0 && errno != EEXIST) {
+        perror(dir);
+        return NULL;
+    }
+    CheckpointWriter *w = calloc(1, sizeof(CheckpointWriter));
+    if (!w) return NULL;
+    strcpy(w->dir, dir);
+    pthread_mutex_init(&w->lock, NULL);
+    pthread_cond_init(&w->cond, NULL);
+    w->threaded = pthread_create(&w->tid, NULL, writer_thread, w) == 0;
+    return w;
+}
+
+void checkpoint_writer_submit(CheckpointWriter *w, const CheckpointState *state, const CheckpointLevel *level,
+                              const uint64_t *const keys[2]) {
+    checkpoint_writer_wait(w);
+    if (!w->threaded) {
+        w->failed = w->failed || !write_checkpoint(w->dir, state, level, keys);
+        return;
+    }
+    pthread_mutex_lock(&w->lock);
+    w->state = *state;
+    w->level = *level;
+    w->keys[0] = keys[0];
+    w->keys[1] = state->num_arrays > 1 ? keys[1] : NULL;
+    w->pending = true;
+    pthread_cond_broadcast(&w->cond);
+    pthread_mutex_unlock(&w->lock);
+}
+
+bool checkpoint_writer_wait(CheckpointWriter *w) {
+    pthread_mutex_lock(&w->lock);
+    while (w->pending) pthread_cond_wait(&w->cond, &w->lock);
+    bool ok = !w->failed;
+    pthread_mutex_unlock(&w->lock);
+    return ok;
+}
+
+bool checkpoint_writer_finish(CheckpointWriter *w) {
+    if (!w) return true;
+    bool ok = checkpoint_writer_wait(w);
+    if (w->threaded) {
+        pthread_mutex_lock(&w->lock);
+        w->stop = true;
+        pthread_cond_broadcast(&w->cond);
+        pthread_mutex_unlock(&w->lock);
+        pthread_join(w->tid, NULL);
+    }
+    pthread_mutex_destroy(&w->lock);
+    pthread_cond_destroy(&w->cond);
+    free(w);
+    return ok;
+}
+
+typedef struct {
+    FILE *fp;
+    uint32_t crc;
+    bool ok;
+} Reader;
+
+static bool reader_open(Reader *r, const char *dir, const char *name, const char magic[4]) {
+    char path[PATH_MAX_LEN];
+    file_path(path, dir, name);
+    *r = (Reader) {.fp = fopen(path, "rb"), .ok = true};
+    if (!r->fp) {
+        fprintf(stderr, "Error: cannot open checkpoint file '%s': %s\n", path, strerror(errno));
+        return false;
+    }
+    char head[8];
+    if (fread(head, 1, 8, r->fp) != 8 || memcmp(head, magic, 4) != 0) {
+        fprintf(stderr, "Error: '%s' is not a checkpoint file.\n", path);
+        fclose(r->fp);
+        return false;
+    }
+    r->crc = crc32c(0, head, 8);
+    return true;
+}
+
+static void reader_read(Reader *r, void *dst, size_t len) {
+    if (!r->ok) return;
+    r->ok = fread(dst, 1, len, r->fp) == len;
+    if (r->ok) r->crc = crc32c(r->crc, dst, len);
+}
+
+// Checks the trailing checksum and closes the file.
+static bool reader_close(Reader *r, const char *name) {
+    uint64_t stored;
+    bool ok = r->ok && fread(&stored, sizeof(stored), 1, r->fp) == 1 && stored == r->crc && fgetc(r->fp) == EOF;
+    fclose(r->fp);
+    if (!ok) fprintf(stderr, "Error: checkpoint file '%s' is corrupt or truncated.\n", name);
+    return ok;
+}
+
+bool checkpoint_read_state(const char *dir, CheckpointState *state) {
+    Reader r;
+    if (!reader_open(&r, dir, "state", "BBC1")) return false;
+    reader_read(&r, state, sizeof(*state));
+    if (!reader_close(&r, "state")) return false;
+    if (state->num_levels == 0 || state->placed + state->unplaced != state->num_keys
+            || state->num_arrays < 1 || state->num_arrays > 2
+            || state->words_per_key < 1 || state->words_per_key > 2) {
+        fprintf(stderr, "Error: checkpoint state in '%s' is inconsistent.\n", dir);
+        return false;
+    }
+    return true;
+}
+
+bool checkpoint_read_level(const char *dir, size_t level_no, uint64_t *seed, uint64_t *offset, Bitarray **bits,
+                           uint8_t **block_seeds, size_t *num_blocks, const BBHashAllocator *a) {
+    char name[32];
+    snprintf(name, sizeof(name), "level-%04zu", level_no);
+    Reader r;
+    if (!reader_open(&r, dir, name, "BBL1")) return false;
+    uint64_t header[4];
+    reader_read(&r, header, sizeof(header));
+    Bitarray *ba = r.ok && header[2] > 0 ? bitarray_new_with(header[2], a) : NULL;
+    uint8_t *seeds = r.ok && header[3] > 0 ? bbhash_alloc(a, header[3], 1) : NULL;
+    if (ba) reader_read(&r, ba->bits, (header[2] + 63) / 64 * sizeof(uint64_t));
+    if (seeds) reader_read(&r, seeds, header[3]);
+    if (!reader_close(&r, name) || !ba || (header[3] > 0 && !seeds)) {
+        if (ba) bitarray_free_with(ba, a);
+        bbhash_dealloc(a, seeds);
+        return false;
+    }
+    *seed = header[0];
+    *offset = header[1];
+    *bits = ba;
+    *block_seeds = seeds;
+    *num_blocks = seeds ? header[3] : 0;
+    return true;
+}
+
+bool checkpoint_read_keys(const char *dir, const CheckpointState *state, uint64_t *const keys[2]) {
+    char name[32];
+    snprintf(name, sizeof(name), "keys-%04zu", (size_t)state->num_levels - 1);
+    Reader r;
+    if (!reader_open(&r, dir, name, "BBK1")) return false;
+    uint64_t header[2];
+    reader_read(&r, header, sizeof(header));
+    uint64_t words = state->unplaced * state->words_per_key;
+    if (r.ok && (header[0] != state->num_arrays || header[1] != words)) {
+        fprintf(stderr, "Error: checkpoint keys do not match the state.\n");
+        fclose(r.fp);
+        return false;
+    }
+    for (uint32_t a = 0; a < state->num_arrays; a++) {
+        reader_read(&r, keys[a], words * sizeof(uint64_t));
+    }
+    return reader_close(&r, name);
+}
+
+int checkpoint_remove(const char *dir) {
+    DIR *d = opendir(dir);
+    if (!d) return errno == ENOENT ? 0 : -1;
+    int status = 0;
+    char path[PATH_MAX_LEN];
+    struct dirent *entry;
+    while ((entry = readdir(d)) != NULL) {
+        const char *name = entry->d_name;
+        if (strncmp(name, "level-", 6) != 0 && strncmp(name, "keys-", 5) != 0 && strncmp(name, "state", 5) != 0) {
+            continue;
+        }
+        file_path(path, dir, name);
+        if (remove(path) != 0) status = -1;
+    }
+    closedir(d);
+    // Leave the directory if it holds anything else.
+    if (rmdir(dir) != 0 && errno != ENOTEMPTY && errno != EEXIST) status = -1;
+    return status;
+}
@@ -0,0 +1,97 @@
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "bitarray.h"
+
+/*
+ * Build checkpoints.
+ *
+ * A checkpoint directory holds one file per finished level ("level-NNNN"),
+ * the keys still unplaced after the last finished level ("keys-NNNN") and
+ * a "state" file naming that level. Every file is written under a temporary
+ * name, synced and renamed into place, and the state file goes last. A crash
+ * at any point therefore leaves the previous checkpoint usable. Each file
+ * ends with the CRC-32C of its contents, which is always checked on read.
+ *
+ * The files are written by a background thread while the builder hashes the
+ * next level. The builder must not modify the level or the keys it handed
+ * over until checkpoint_writer_wait() returns.
+ */
+
+/** @brief Where a build stands after its last finished level. */
+typedef struct {
+    uint64_t num_keys;        // keys of the whole build
+    uint64_t num_levels;      // levels finished
+    uint64_t placed;          // keys placed by those levels
+    uint64_t unplaced;        // keys left
+    uint64_t compact_from;    // as BBHashConfig.compact_from_level
+    double gamma;
+    uint32_t hash_scheme;     // a BBHashScheme
+    uint32_t key_form;        // how the builder holds the keys left (opaque here)
+    uint32_t num_arrays;      // key arrays, 1 or 2
+    uint32_t words_per_key;   // words per key in each array, 1 or 2
+} CheckpointState;
+
+/** @brief A finished level as handed to the writer. */
+typedef struct {
+    uint64_t seed;
+    uint64_t offset;                // index of its first key
+    const Bitarray *bits;
+    const uint8_t *block_seeds;     // or NULL
+    size_t num_blocks;
+} CheckpointLevel;
+
+typedef struct CheckpointWriter CheckpointWriter;
+
+/**
+ * @brief Creates the directory if needed and starts the writer thread.
+ *
+ * Without a thread, checkpoint_writer_submit() writes inline.
+ * @return The writer, or NULL if the directory cannot be created.
+ */
+CheckpointWriter *checkpoint_writer_start(const char *dir);
+
+/**
+ * @brief Queues level `state->num_levels - 1` and the keys left after it.
+ *
+ * Waits for the previous checkpoint first. `keys` holds state->num_arrays
+ * arrays of state->unplaced * state->words_per_key words each.
+ */
+void checkpoint_writer_submit(CheckpointWriter *w, const CheckpointState *state, const CheckpointLevel *level,
+                              const uint64_t *const keys[2]);
+
+/**
+ * @brief Waits until the last submitted checkpoint is on disk.
+ * @return false if any checkpoint write has failed; the build can go on
+ *         without checkpoints.
+ */
+bool checkpoint_writer_wait(CheckpointWriter *w);
+
+/** @brief Waits for the writer and stops it. @return As checkpoint_writer_wait(). */
+bool checkpoint_writer_finish(CheckpointWriter *w);
+
+/** @brief Reads the state file of a checkpoint directory. */
+bool checkpoint_read_state(const char *dir, CheckpointState *state);
+
+/**
+ * @brief Reads finished level `level_no`.
+ * @param bits Receives the level's bit array; free with bitarray_free_with(bits, a).
+ * @param block_seeds Receives its block seeds, allocated from `a`, or NULL.
+ * @param a The allocator, or NULL for malloc().
+ */
+bool checkpoint_read_level(const char *dir, size_t level_no, uint64_t *seed, uint64_t *offset, Bitarray **bits,
+                           uint8_t **block_seeds, size_t *num_blocks, const BBHashAllocator *a);
+
+/**
+ * @brief Reads the keys left after the state's last level into `keys`,
+ *        state->num_arrays arrays with room for all of them.
+ */
+bool checkpoint_read_keys(const char *dir, const CheckpointState *state, uint64_t *const keys[2]);
+
+/** @brief Removes the checkpoint files and then the directory if it is empty. */
+int checkpoint_remove(const char *dir);
+
+#endif // CHECKPOINT_H
@@ -0,0 +1,143 @@
+/* checkpoint_test.c - tests for checkpointed builds and resuming them.
+ *
+ * A child process builds with checkpoints and is killed with SIGKILL as soon
+ * as it reports its third level, like a preempted job. The resumed build
+ * must give the same MPHF as a build that never stopped.
+ */
+
+#define _POSIX_C_SOURCE 200809L  // fork, kill
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include "mt64.h"
+#include "dedup.h"
+#include "bbhash.h"
+#include "checkpoint.h"
+
+constexpr size_t NUM_KEYS = 2000000;
+
+static const char *const DIR_NAME = "checkpoint_test.d";
+
+static void check_same(const BBHash *a, const BBHash *b, const uint64_t keys[], size_t n, bool wide) {
+    assert(a != NULL && b != NULL);
+    assert(bbhash_size_in_bits(a) == bbhash_size_in_bits(b));
+    for (size_t i = 0; i < n; i++) {
+        if (wide) {
+            BBHashKey128 key = {keys[2 * i], keys[2 * i + 1]};
+            assert(bbhash_mphf_query128(a, key) == bbhash_mphf_query128(b, key));
+        } else {
+            assert(bbhash_mphf_query(a, keys[i]) == bbhash_mphf_query(b, keys[i]));
+        }
+    }
+}
+
+static BBHash *build(const uint64_t keys[], size_t n, const BBHashConfig *config, bool wide) {
+    return wide ? bbhash_mphf_create128((const BBHashKey128 *)keys, n, config) : bbhash_mphf_create_ex(keys, n, config);
+}
+
+// Builds in a child that is killed after it reports level 2, then resumes.
+static void crash_and_resume(const uint64_t keys[], size_t n, BBHashConfig config, bool wide, const char *name) {
+    BBHash *reference = build(keys, n, &config, wide);
+    assert(bbhash_checkpoint_remove(DIR_NAME) == 0);
+
+    int fds[2];
+    assert(pipe(fds) == 0);
+    fflush(stdout);
+    pid_t pid = fork();
+    assert(pid >= 0);
+    if (pid == 0) {
+        close(fds[0]);
+        dup2(fds[1], STDOUT_FILENO);
+        setvbuf(stdout, NULL, _IONBF, 0);
+        config.checkpoint_dir = DIR_NAME;
+        config.verbose = true;
+        build(keys, n, &config, wide);
+        _exit(0);
+    }
+    close(fds[1]);
+    FILE *child = fdopen(fds[0], "r");
+    char line[256];
+    while (fgets(line, sizeof(line), child)) {
+        if (strncmp(line, "Level 2;", 8) == 0) {
+            kill(pid, SIGKILL);
+            break;
+        }
+    }
+    fclose(child);
+    waitpid(pid, NULL, 0);
+
+    CheckpointState state;
+    assert(checkpoint_read_state(DIR_NAME, &state));
+    assert(state.unplaced > 0);
+    printf("  %-10s killed after level %zu with %zu of %zu keys left\n", name, (size_t)state.num_levels - 1,
+           (size_t)state.unplaced, n);
+
+    config.checkpoint_dir = DIR_NAME;
+    BBHash *resumed = bbhash_mphf_resume(&config);
+    check_same(reference, resumed, keys, n, wide);
+
+    // A checkpoint of a finished build gives the same MPHF again.
+    BBHash *again = bbhash_mphf_resume(&config);
+    check_same(reference, again, keys, n, wide);
+
+    bbhash_free(reference);
+    bbhash_free(resumed);
+    bbhash_free(again);
+}
+
+int main(void) {
+    printf("checkpoint_test\n");
+    Mt64 *rng = mt64_create(43);
+    uint64_t *keys = malloc(sizeof(uint64_t) * 2 * NUM_KEYS);
+    for (size_t i = 0; i < 2 * NUM_KEYS; i++) keys[i] = mt64_gen_int64(rng);
+    mt64_destroy(rng);
+    size_t n = dedup(keys, NUM_KEYS);
+    size_t wide_n = NUM_KEYS;  // random 128-bit keys, distinct in practice
+
+    // gamma 1.0 gives many levels, so the kill lands mid-build.
+    BBHashConfig config = bbhash_config_default();
+    config.gamma = 1.0;
+    crash_and_resume(keys, n, config, false, "seeded");
+    config.hash_scheme = BBHASH_HASH_BASE128;
+    config.memory_budget = n * 20;  // recomputes the slots
+    crash_and_resume(keys, n, config, false, "base128");
+    config = bbhash_config_default();
+    config.gamma = 1.0;
+    config.compact_from_level = 4;
+    config.threads = 2;
+    crash_and_resume(keys, wide_n, config, true, "key128");
+    double *weights = malloc(sizeof(double) * n);
+    for (size_t i = 0; i < n; i++) weights[i] = i % 100 == 0 ? 50.0 : 1.0;
+    config = bbhash_config_default();
+    config.gamma = 1.0;
+    config.weights = weights;
+    crash_and_resume(keys, n, config, false, "weighted");
+    free(weights);
+
+    // A damaged checkpoint is refused.
+    FILE *fp = fopen("checkpoint_test.d/level-0001", "r+b");
+    assert(fp);
+    fseek(fp, 100, SEEK_SET);
+    int c = fgetc(fp);
+    fseek(fp, 100, SEEK_SET);
+    fputc(c ^ 1, fp);
+    fclose(fp);
+    config = bbhash_config_default();
+    config.checkpoint_dir = DIR_NAME;
+    assert(bbhash_mphf_resume(&config) == NULL);
+    config.checkpoint_dir = NULL;
+    assert(bbhash_mphf_resume(&config) == NULL);
+
+    assert(bbhash_checkpoint_remove(DIR_NAME) == 0);
+    assert(access(DIR_NAME, F_OK) != 0);
+    config.checkpoint_dir = DIR_NAME;
+    assert(bbhash_mphf_resume(&config) == NULL);
+    free(keys);
+    printf("All tests passed.\n");
+    return 0;
+}
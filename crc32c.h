@@ -0,0 +1,24 @@
+#ifndef CRC32C_H
+#define CRC32C_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @brief CRC-32C (Castagnoli), as used by iSCSI, ext4 and SSE4.2.
+ *
+ * Uses the SSE4.2 `crc32` instruction or the ARMv8 CRC32 extension when
+ * available, otherwise a slicing-by-8 table implementation.
+ * Calls chain: crc32c(crc32c(0, a, na), b, nb) == crc32c(0, a || b, na + nb).
+ *
+ * @param crc The CRC of the preceding data, or 0 to start.
+ * @param data The bytes to checksum.
+ * @param len Number of bytes.
+ * @return The updated CRC.
+ */
+uint32_t crc32c(uint32_t crc, const void *data, size_t len);
+
+/** @brief The portable table-driven implementation (for testing and fallback). */
+uint32_t crc32c_sw(uint32_t crc, const void *data, size_t len);
+
+#endif // CRC32C_H
@@ -47,3 +47,35 @@ size_t dedup(uint64_t arr[], size_t size) {
     return j;
 }
 
+
+int compare_pairs(const void *a, const void *b) {
+    const uint64_t *pa = a, *pb = b;
+    if (pa[1] != pb[1]) return (pa[1] > pb[1]) - (pa[1] < pb[1]);
+    return (pa[0] > pb[0]) - (pa[0] < pb[0]);
+}
+
+/**
+ * @brief De-duplicates an array of 128-bit keys in-place.
+ *
+ * @param arr The keys, each stored as two words (low half first).
+ * @param size The number of keys, half the number of words.
+ * @return The new number of keys.
+ */
+size_t dedup_pairs(uint64_t arr[], size_t size) {
+    if (size <= 1) {
+        return size;
+    }
+
+    qsort(arr, size, 2 * sizeof(uint64_t), compare_pairs);
+
+    size_t j = 1;
+    for (size_t i = 1; i < size; i++) {
+        if (arr[2 * i] != arr[2 * j - 2] || arr[2 * i + 1] != arr[2 * j - 1]) {
+            arr[2 * j] = arr[2 * i];
+            arr[2 * j + 1] = arr[2 * i + 1];
+            j++;
+        }
+    }
+
+    return j;
+}
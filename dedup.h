@@ -1 +1,4 @@
 size_t dedup(uint64_t arr[], size_t size);
+
+// As dedup, for 128-bit keys stored as (lo, hi) word pairs; size counts pairs
+size_t dedup_pairs(uint64_t arr[], size_t size);
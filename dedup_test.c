@@ -29,7 +29,20 @@ int test_dedup(void) {
     return 0;
 }
 
+int test_dedup_pairs(void) {
+    uint64_t data[] = {5, 1, 5, 0, 5, 1, 7, 0, 5, 0, 0, 2};
+    size_t new_size = dedup_pairs(data, 6);
+
+    uint64_t dedup_data[] = {5, 0, 7, 0, 5, 1, 0, 2};
+
+    assert(new_size == 4);
+    assert(memcmp(data, dedup_data, 2 * new_size * sizeof(uint64_t)) == 0);
+
+    return 0;
+}
+
 int main() {
     test_dedup();
+    test_dedup_pairs();
     return 0;
 }
@@ -17,6 +17,8 @@ int main(int argc, char* argv[]) {
     size_t nelem = 10000000;
     double gamma = 2.0; // 1.0 => smaller mphf, 2.0 larger, but faster construction.
     bool validate = false;
+    unsigned threads = 1;
+    size_t compact_from = SIZE_MAX;
     bool nelem_set = false;
     bool verbose = true;
 
@@ -36,6 +38,18 @@ int main(int argc, char* argv[]) {
                 return EXIT_FAILURE;
             }
             gamma = strtod(argv[i], NULL);
+        } else if (strcmp(argv[i], "-t") == 0 || strcmp(argv[i], "--threads") == 0) {
+            if (++i >= argc) {
+                fprintf(stderr, "Error: Missing value for threads.\n");
+                return EXIT_FAILURE;
+            }
+            threads = (unsigned)strtoul(argv[i], NULL, 0);
+        } else if (strcmp(argv[i], "-c") == 0 || strcmp(argv[i], "--compact-from") == 0) {
+            if (++i >= argc) {
+                fprintf(stderr, "Error: Missing value for compact-from.\n");
+                return EXIT_FAILURE;
+            }
+            compact_from = strtoul(argv[i], NULL, 0);
         } else if (strcmp(argv[i], "-v") == 0 || strcmp(argv[i], "--validate") == 0) {
             validate = true;
         } else {
@@ -65,7 +79,6 @@ int main(int argc, char* argv[]) {
 
     // --- Data Generation ---
     printf("Generating and de-duplicating initial key set...\n");
-    Mt64 *rng = mt64_create_default();
     size_t buffer_size = nelem + (nelem / 100) + 100; // Generate 1% extra to account for duplicates
     uint64_t *data = calloc(buffer_size, sizeof(uint64_t));
     if (!data) {
@@ -73,8 +86,12 @@ int main(int argc, char* argv[]) {
         return EXIT_FAILURE;
     }
 
-    for (size_t i = 0; i < buffer_size; i++) {
-        data[i] = mt64_gen_int64(rng);
+    // One thread gives the mt64_create_default() sequence; more threads use
+    // one stream per thread, so the keys depend on the thread count.
+    if (mt64_fill_u64_parallel(5489, data, buffer_size, threads) != 0) {
+        fprintf(stderr, "Failed to generate keys.\n");
+        free(data);
+        return EXIT_FAILURE;
     }
     size_t unique_count = dedup(data, buffer_size);
 
@@ -82,14 +99,17 @@ int main(int argc, char* argv[]) {
     if (unique_count < nelem) {
         fprintf(stderr, "Error: Failed to generate %zu unique elements (only got %zu).\n", nelem, unique_count);
         free(data);
-        mt64_destroy(rng);
         return EXIT_FAILURE;
     }
 
     // --- MPHF Construction & Timing ---
     printf("\nConstructing MPHF...\n");
     clock_t start = clock();
-    BBHash *mphf = bbhash_mphf_create(data, nelem, gamma, verbose);
+    BBHashConfig config = bbhash_config_default();
+    config.gamma = gamma;
+    config.verbose = verbose;
+    config.compact_from_level = compact_from;
+    BBHash *mphf = bbhash_mphf_create_ex(data, nelem, &config);
     clock_t end = clock();
     double cpu_time_used = ((double)(end - start)) / CLOCKS_PER_SEC;
 
@@ -100,7 +120,6 @@ int main(int argc, char* argv[]) {
     if (!mphf) {
         fprintf(stderr, "Error: Failed to create MPHF.\n");
         free(data);
-        mt64_destroy(rng);
         return EXIT_FAILURE;
     }
     printf("BBHash constructed perfect hash for %zu keys in %.2f seconds (CPU time).\n", nelem, cpu_time_used);
@@ -115,42 +134,20 @@ int main(int argc, char* argv[]) {
     // --- Validation (Optional) ---
     if (validate) {
         printf("Validating MPHF...\n");
-        bool *seen = calloc(nelem, sizeof(bool));
-        if (seen == NULL) {
-            fprintf(stderr, "Failed to allocate 'seen' array for validation.\n");
-        } else {
-            bool success = true;
-            for (size_t i = 0; i < nelem; i++) {
-                size_t idx = bbhash_mphf_query(mphf, data[i]);
-                if (idx >= nelem || seen[idx]) {
-                    fprintf(stderr, "Validation failed! Key %" PRIu64 " -> index %zu (out of bounds or duplicate).\n", data[i], idx);
-                    success = false;
-                    break;
-                }
-                seen[idx] = true;
-            }
-
-            if (success) {
-                // Check if all indices were hit
-                for (size_t i = 0; i < nelem; i++) {
-                    if (!seen[i]) {
-                        fprintf(stderr, "Validation failed! Index %zu was not mapped.\n", i);
-                        success = false;
-                        break;
-                    }
-                }
-            }
-            if (success) {
-                printf("Validation successful: all keys map to a unique index in [0, %zu).\n", nelem);
-            }
-            free(seen);
+        struct timespec t0, t1;
+        timespec_get(&t0, TIME_UTC);
+        int status = bbhash_mphf_verify(mphf, data, nelem, threads);
+        timespec_get(&t1, TIME_UTC);
+        if (status == 0) {
+            printf("Validation successful: all keys map to a unique index in [0, %zu).\n", nelem);
         }
+        printf("Validation took %.2f seconds (wall time, %u threads).\n",
+               (double)(t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) * 1e-9, threads);
     }
 
     // --- Cleanup ---
     free(data);
     bbhash_free(mphf);
-    mt64_destroy(rng);
 
     return EXIT_SUCCESS;
 }
@@ -162,5 +159,7 @@ void print_usage(const char* prog_name) {
     fprintf(stderr, "  -g, --gamma <f>  Set the gamma parameter (bits/key ratio). Default: 2.0\n");
     fprintf(stderr, "                   Lower values (e.g., 1.0) save space but are slower to build.\n");
     fprintf(stderr, "  -v, --validate   Verify that the generated MPHF is correct.\n");
+    fprintf(stderr, "  -t, --threads <n> Threads for key generation and validation. Default: 1\n");
+    fprintf(stderr, "  -c, --compact-from <l> Pack level l and deeper into a compact tail. Default: off\n");
     fprintf(stderr, "  -h, --help       Show this help message.\n");
 }
@@ -50,7 +50,12 @@ int main() {
     // --- MPHF Construction ---
     printf("\nConstructing MPHF...\n");
     clock_t start = clock();
-    BBHash *mphf = bbhash_mphf_create(data_for_build, nelem, gamma, verbose);
+    // Small set: nearly all levels are deep levels, so pack them from level 1 on.
+    BBHashConfig config = bbhash_config_default();
+    config.gamma = gamma;
+    config.verbose = verbose;
+    config.compact_from_level = 1;
+    BBHash *mphf = bbhash_mphf_create_ex(data_for_build, nelem, &config);
     free(data_for_build);
     clock_t end = clock();
     double cpu_time_used = ((double)(end - start)) / CLOCKS_PER_SEC;
@@ -68,8 +73,11 @@ int main() {
 
     // --- Validation ---
     printf("Validating MPHF...\n");
-    bool *seen = calloc(nelem, sizeof(bool));
-    free(seen);
+    if (bbhash_mphf_verify(mphf, data, nelem, 1) != 0) {
+        free(data);
+        bbhash_free(mphf);
+        return EXIT_FAILURE;
+    }
     printf("Validation successful.\n");
 
     // --- Final Lookup Example ---
@@ -1,5 +1,6 @@
 #include <string.h>
 #include <stdlib.h>
+#include "hashing.h"
 
 uint64_t fnv1a_string(const char *key, uint64_t seed) {
     uint64_t hash = 0xcbf29ce484222325ULL ^ seed; // FNV offset basis
@@ -14,9 +15,12 @@ uint64_t fnv1a_string(const char *key, uint64_t seed) {
 }
 
 uint64_t murmur3_string(const char *key, uint64_t seed) {
-    size_t len = strlen(key);
+    return murmur3_bytes(key, strlen(key), seed);
+}
+
+uint64_t murmur3_bytes(const void *key, size_t len, uint64_t seed) {
     const uint8_t *data = (const uint8_t *)key;
-    const int nblocks = len / 16;
+    const size_t nblocks = len / 16;
 
     uint64_t h1 = seed;
     uint64_t h2 = seed;
@@ -24,11 +28,11 @@ uint64_t murmur3_string(const char *key, uint64_t seed) {
     const uint64_t c1 = 0x87c37b91114253d5;
     const uint64_t c2 = 0x4cf5ad432745937f;
 
-    // Process 16-byte blocks
-    const uint64_t *blocks = (const uint64_t *)data;
-    for(int i = 0; i < nblocks; i++) {
-        uint64_t k1 = blocks[i * 2 + 0];
-        uint64_t k2 = blocks[i * 2 + 1];
+    // Process 16-byte blocks (lines in a mapped file are not aligned)
+    for(size_t i = 0; i < nblocks; i++) {
+        uint64_t k1, k2;
+        memcpy(&k1, data + i * 16, 8);
+        memcpy(&k2, data + i * 16 + 8, 8);
 
         k1 *= c1;
         k1 = (k1 << 31) | (k1 >> 33);
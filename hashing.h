@@ -2,6 +2,11 @@
 #define HASHING_H
 
 #include <stdint.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
 
 // simple string-to-uint64 hash function
 uint64_t fnv1a_string(const char *key, uint64_t seed);
@@ -9,6 +14,9 @@ uint64_t fnv1a_string(const char *key, uint64_t seed);
 // MurmurHash3 128-bit for strings, return 64 bits
 uint64_t murmur3_string(const char *key, uint64_t seed);
 
+// As murmur3_string, for a key of known length (need not be NUL terminated)
+uint64_t murmur3_bytes(const void *key, size_t len, uint64_t seed);
+
 /**
  * @brief fmix64 function from MurmurHash3 by Austin Appleby.
  *
@@ -24,4 +32,19 @@ static inline uint64_t hash_with_seed(uint64_t key, uint64_t seed) {
     return key;
 }
 
+/**
+ * @brief Level hash of a 128-bit key: fmix64 of the low half, seeded with
+ *        the fmix64 of the high half and the seed.
+ *
+ * Keys that differ only in the low half never collide. Other pairs collide
+ * with probability about 2^-64, independently for every seed.
+ */
+static inline uint64_t hash128_with_seed(uint64_t lo, uint64_t hi, uint64_t seed) {
+    return hash_with_seed(lo, hash_with_seed(hi, seed));
+}
+
+#ifdef __cplusplus
+}
+#endif
+
 #endif // HASHING_H
@@ -0,0 +1,172 @@
+#define _POSIX_C_SOURCE 200809L  // mmap, posix_madvise, open, fstat under -std=c23
+
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <pthread.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "hashing.h"
+#include "ingest.h"
+
+// Below this many bytes per thread the thread start-up costs more than it saves.
+constexpr size_t MIN_BYTES_PER_THREAD = 1 << 20;
+
+typedef struct {
+    const char *data;        // whole input
+    size_t begin, end;       // this chunk; begin is at a line start
+    uint64_t seed;
+    size_t count;            // key lines in the chunk (pass 1)
+    size_t first;            // index of the chunk's first key (pass 2)
+    uint64_t *keys;
+    uint64_t *offsets;       // NULL if not wanted
+    pthread_t tid;
+    bool started;            // running on its own thread
+} ChunkTask;
+
+// Both passes split lines the same way: up to '\n', minus a trailing '\r'.
+static void *count_worker(void *arg) {
+    ChunkTask *task = arg;
+    const char *p = task->data + task->begin, *end = task->data + task->end;
+    size_t count = 0;
+    while (p < end) {
+        const char *nl = memchr(p, '\n', (size_t)(end - p));
+        const char *eol = nl ? nl : end;
+        size_t n = (size_t)(eol - p);
+        if (n > 0 && p[n - 1] == '\r') n--;
+        count += n > 0;
+        p = eol + 1;
+    }
+    task->count = count;
+    return NULL;
+}
+
+static void *hash_worker(void *arg) {
+    ChunkTask *task = arg;
+    const char *p = task->data + task->begin, *end = task->data + task->end;
+    uint64_t *keys = task->keys + task->first;
+    uint64_t *offsets = task->offsets ? task->offsets + task->first : NULL;
+    size_t j = 0;
+    while (p < end) {
+        const char *nl = memchr(p, '\n', (size_t)(end - p));
+        const char *eol = nl ? nl : end;
+        size_t n = (size_t)(eol - p);
+        if (n > 0 && p[n - 1] == '\r') n--;
+        if (n > 0) {
+            if (offsets) offsets[j] = (uint64_t)(p - task->data);
+            keys[j++] = murmur3_bytes(p, n, task->seed);
+        }
+        p = eol + 1;
+    }
+    return NULL;
+}
+
+// Runs fn on every task, the last one on the calling thread.
+static void run_tasks(ChunkTask tasks[], unsigned n, void *(*fn)(void *)) {
+    for (unsigned t = 0; t + 1 < n; t++) {
+        tasks[t].started = pthread_create(&tasks[t].tid, NULL, fn, &tasks[t]) == 0;
+        if (!tasks[t].started) fn(&tasks[t]);
+    }
+    fn(&tasks[n - 1]);
+    for (unsigned t = 0; t + 1 < n; t++) {
+        if (tasks[t].started) pthread_join(tasks[t].tid, NULL);
+    }
+}
+
+int ingest_text_buffer(const char *data, size_t len, uint64_t seed, unsigned threads, bool line_offsets,
+                       TextKeys *out) {
+    memset(out, 0, sizeof(*out));
+    out->num_bytes = len;
+    if (threads == 0) threads = 1;
+    if (threads > len / MIN_BYTES_PER_THREAD) {
+        threads = len >= MIN_BYTES_PER_THREAD ? (unsigned)(len / MIN_BYTES_PER_THREAD) : 1;
+    }
+
+    struct timespec t0, t1;
+    timespec_get(&t0, TIME_UTC);
+
+    // Chunk boundaries: equal shares, each moved to just past a newline.
+    ChunkTask *tasks = calloc(threads, sizeof(ChunkTask));
+    if (!tasks) return -1;
+    size_t begin = 0;
+    for (unsigned t = 0; t < threads; t++) {
+        size_t end = t + 1 == threads ? len : (len / threads) * (t + 1);
+        if (end < begin) end = begin;
+        if (end < len) {
+            const char *nl = memchr(data + end, '\n', len - end);
+            end = nl ? (size_t)(nl - data) + 1 : len;
+        }
+        tasks[t] = (ChunkTask) {.data = data, .begin = begin, .end = end, .seed = seed};
+        begin = end;
+    }
+
+    run_tasks(tasks, threads, count_worker);
+    size_t total = 0;
+    for (unsigned t = 0; t < threads; t++) {
+        tasks[t].first = total;
+        total += tasks[t].count;
+    }
+
+    out->keys = malloc(sizeof(uint64_t) * (total ? total : 1));
+    out->line_offsets = line_offsets ? malloc(sizeof(uint64_t) * (total ? total : 1)) : NULL;
+    if (!out->keys || (line_offsets && !out->line_offsets)) {
+        fprintf(stderr, "Memory allocation failed for %zu text keys.\n", total);
+        free(tasks);
+        text_keys_free(out);
+        return -1;
+    }
+    for (unsigned t = 0; t < threads; t++) {
+        tasks[t].keys = out->keys;
+        tasks[t].offsets = out->line_offsets;
+    }
+    run_tasks(tasks, threads, hash_worker);
+    out->num_keys = total;
+
+    timespec_get(&t1, TIME_UTC);
+    out->seconds = (double)(t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) * 1e-9;
+    free(tasks);
+    return 0;
+}
+
+int ingest_text_file(const char *path, uint64_t seed, unsigned threads, bool line_offsets, TextKeys *out) {
+    memset(out, 0, sizeof(*out));
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        perror(path);
+        return -1;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        perror(path);
+        close(fd);
+        return -1;
+    }
+    size_t len = (size_t)st.st_size;
+    if (len == 0) {
+        close(fd);
+        return ingest_text_buffer("", 0, seed, threads, line_offsets, out);
+    }
+    void *map = mmap(NULL, len, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        perror(path);
+        return -1;
+    }
+    // Both passes stream through the file front to back in every chunk.
+    posix_madvise(map, len, POSIX_MADV_SEQUENTIAL);
+
+    int status = ingest_text_buffer(map, len, seed, threads, line_offsets, out);
+    munmap(map, len);
+    return status;
+}
+
+void text_keys_free(TextKeys *tk) {
+    free(tk->keys);
+    free(tk->line_offsets);
+    tk->keys = NULL;
+    tk->line_offsets = NULL;
+    tk->num_keys = 0;
+}
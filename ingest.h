@@ -0,0 +1,44 @@
+#ifndef INGEST_H
+#define INGEST_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+ * Parallel ingestion of newline-delimited text keys.
+ *
+ * The input is split into one chunk per thread at newline boundaries. A first
+ * pass counts the lines in every chunk, so that the second pass can hash each
+ * line with murmur3_bytes() straight into its final slot in the key array.
+ * Every non-empty line is one key; a trailing '\r' is not part of the key.
+ * Keys come out in file order, equal to murmur3_string() of each line, and do
+ * not depend on the thread count.
+ */
+typedef struct {
+    uint64_t *keys;          // hash of each key line, in file order
+    size_t num_keys;
+    uint64_t *line_offsets;  // byte offset of each key's line, or NULL
+    size_t num_bytes;        // bytes of input
+    double seconds;          // wall time of the counting and hashing passes
+} TextKeys;
+
+/**
+ * @brief Hashes the lines of a text file, which is read through mmap.
+ * @param path The file to read.
+ * @param seed murmur3 seed.
+ * @param threads Number of threads (0 means 1).
+ * @param line_offsets Also record the byte offset of every key's line.
+ * @param out Receives the keys; free with text_keys_free().
+ * @return 0 on success, -1 on failure.
+ */
+int ingest_text_file(const char *path, uint64_t seed, unsigned threads, bool line_offsets, TextKeys *out);
+
+/** @brief As ingest_text_file(), for text already in memory. */
+int ingest_text_buffer(const char *data, size_t len, uint64_t seed, unsigned threads, bool line_offsets,
+                       TextKeys *out);
+
+/** @brief Frees the arrays of a TextKeys. */
+void text_keys_free(TextKeys *tk);
+
+#endif // INGEST_H
@@ -0,0 +1,73 @@
+/* ingest_test.c - tests for parallel text key ingestion.
+ *
+ */
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "hashing.h"
+#include "ingest.h"
+
+// Splits the text the slow way and checks every key and offset.
+static void check(const char *text, size_t len, unsigned threads) {
+    TextKeys tk;
+    assert(ingest_text_buffer(text, len, 7, threads, true, &tk) == 0);
+    char line[256];
+    size_t k = 0, start = 0;
+    for (size_t i = 0; i <= len; i++) {
+        if (i < len && text[i] != '\n') continue;
+        size_t n = i - start;
+        if (n > 0 && text[start + n - 1] == '\r') n--;
+        if (n > 0) {
+            memcpy(line, text + start, n);
+            line[n] = '\0';
+            assert(k < tk.num_keys);
+            assert(tk.keys[k] == murmur3_string(line, 7));
+            assert(tk.line_offsets[k] == start);
+            k++;
+        }
+        start = i + 1;
+    }
+    assert(k == tk.num_keys);
+    text_keys_free(&tk);
+}
+
+int main(void) {
+    const char *cases[] = {
+        "", "\n", "a", "a\n", "a\nb", "a\r\nb\r\n", "\n\nx\n\n", "no newline at the end",
+        "exactly sixteen!\nand a much longer line spanning several murmur blocks\n",
+    };
+    for (size_t c = 0; c < sizeof(cases) / sizeof(cases[0]); c++) {
+        check(cases[c], strlen(cases[c]), 1);
+    }
+
+    // Large input: several chunks, with lines of varying length.
+    size_t len = 24u << 20;
+    char *text = malloc(len);
+    size_t pos = 0;
+    for (size_t i = 0; pos < len; i++) {
+        int n = snprintf(text + pos, len - pos, "key-%zu%s\n", i * 2654435761u, i % 7 ? "" : "-with-a-longer-suffix");
+        if (n < 0 || (size_t)n >= len - pos) break;
+        pos += (size_t)n;
+        if (i % 1000 == 0 && pos < len) text[pos++] = '\n';  // empty line
+    }
+    for (unsigned threads = 1; threads <= 4; threads++) {
+        check(text, pos, threads);
+    }
+
+    // Throughput through a file.
+    FILE *fp = fopen("ingest_test.txt", "wb");
+    assert(fp && fwrite(text, 1, pos, fp) == pos);
+    fclose(fp);
+    TextKeys tk;
+    assert(ingest_text_file("ingest_test.txt", 0, 4, false, &tk) == 0);
+    assert(tk.num_bytes == pos && tk.line_offsets == NULL);
+    printf("ingest: %zu keys, %.2f GB/s\n", tk.num_keys, tk.num_bytes / tk.seconds / 1e9);
+    text_keys_free(&tk);
+    remove("ingest_test.txt");
+    free(text);
+
+    printf("ingest_test: OK\n");
+    return 0;
+}
@@ -64,6 +64,8 @@
 
 
 #include <stdlib.h> // Required for malloc() and free()
+#include <stdbool.h>
+#include <pthread.h>
 #include "mt64.h"
 
 #define MM 156
@@ -157,39 +159,143 @@ void mt64_destroy(Mt64 *state) {
     }
 }
 
-/* generates a random number on [0, 2^64-1]-interval */
-uint64_t mt64_gen_int64(Mt64 *state)
+/*
+ * Regenerates all NN words of the state.
+ *
+ * The matrix multiply is done with a mask instead of the mag01[] table
+ * lookup, so each loop is a straight-line function of the state words and
+ * the compiler can vectorize it: the first loop only reads words it has not
+ * written yet, the second reads words written at least NN - MM iterations
+ * earlier.
+ */
+static void mt64_regenerate(Mt64 *state)
 {
+    uint64_t *mt = state->mt;
     int i;
-    uint64_t x;
-    static uint64_t mag01[2] = {0ULL, MATRIX_A};
-
-    if (state->mti >= MT64_NN) { /* generate NN words at one time */
-
-        for (i = 0; i < MT64_NN - MM; i++) {
-            x = (state->mt[i] & UM) | (state->mt[i + 1] & LM);
-            state->mt[i] = state->mt[i + MM] ^ (x >> 1) ^ mag01[(int)(x & 1ULL)];
-        }
-        for (; i < MT64_NN - 1; i++) {
-            x = (state->mt[i] & UM) | (state->mt[i + 1] & LM);
-            state->mt[i] = state->mt[i + (MM - MT64_NN)] ^ (x >> 1) ^ mag01[(int)(x & 1ULL)];
-        }
-        x = (state->mt[MT64_NN - 1] & UM) | (state->mt[0] & LM);
-        state->mt[MT64_NN - 1] = state->mt[MM - 1] ^ (x >> 1) ^ mag01[(int)(x & 1ULL)];
-
-        state->mti = 0;
+    for (i = 0; i < MT64_NN - MM; i++) {
+        uint64_t x = (mt[i] & UM) | (mt[i + 1] & LM);
+        mt[i] = mt[i + MM] ^ (x >> 1) ^ ((0ULL - (x & 1ULL)) & MATRIX_A);
+    }
+    for (; i < MT64_NN - 1; i++) {
+        uint64_t x = (mt[i] & UM) | (mt[i + 1] & LM);
+        mt[i] = mt[i + (MM - MT64_NN)] ^ (x >> 1) ^ ((0ULL - (x & 1ULL)) & MATRIX_A);
     }
+    uint64_t x = (mt[MT64_NN - 1] & UM) | (mt[0] & LM);
+    mt[MT64_NN - 1] = mt[MM - 1] ^ (x >> 1) ^ ((0ULL - (x & 1ULL)) & MATRIX_A);
 
-    x = state->mt[state->mti++];
+    state->mti = 0;
+}
 
+static inline uint64_t temper(uint64_t x)
+{
     x ^= (x >> 29) & 0x5555555555555555ULL;
     x ^= (x << 17) & 0x71D67FFFEDA60000ULL;
     x ^= (x << 37) & 0xFFF7EEE000000000ULL;
     x ^= (x >> 43);
-
     return x;
 }
 
+// The output buffer never aliases the state, which lets this loop vectorize.
+static void temper_block(uint64_t *restrict out, const uint64_t *restrict src, size_t n)
+{
+    for (size_t i = 0; i < n; i++) {
+        out[i] = temper(src[i]);
+    }
+}
+
+/* generates a random number on [0, 2^64-1]-interval */
+uint64_t mt64_gen_int64(Mt64 *state)
+{
+    if (state->mti >= MT64_NN) { /* generate NN words at one time */
+        mt64_regenerate(state);
+    }
+    return temper(state->mt[state->mti++]);
+}
+
+void mt64_fill_u64(Mt64 *state, uint64_t *buf, size_t n)
+{
+    while (n > 0) {
+        if (state->mti >= MT64_NN) {
+            mt64_regenerate(state);
+        }
+        size_t chunk = (size_t)(MT64_NN - state->mti);
+        if (chunk > n) chunk = n;
+        temper_block(buf, state->mt + state->mti, chunk);
+        state->mti += (int)chunk;
+        buf += chunk;
+        n -= chunk;
+    }
+}
+
+Mt64 *mt64_create_stream(uint64_t seed, uint64_t stream)
+{
+    uint64_t key[2] = {seed, stream};
+    return mt64_create_by_array(key, 2);
+}
+
+typedef struct {
+    uint64_t seed;
+    uint64_t stream;
+    uint64_t *buf;
+    size_t n;
+    bool started;   // running on its own thread
+    int status;
+} FillTask;
+
+static void *fill_worker(void *arg)
+{
+    FillTask *task = arg;
+    Mt64 *state = task->stream == UINT64_MAX ? mt64_create(task->seed)
+                  : mt64_create_stream(task->seed, task->stream);
+    if (state == NULL) {
+        task->status = -1;
+        return NULL;
+    }
+    mt64_fill_u64(state, task->buf, task->n);
+    mt64_destroy(state);
+    task->status = 0;
+    return NULL;
+}
+
+int mt64_fill_u64_parallel(uint64_t seed, uint64_t *buf, size_t n, unsigned threads)
+{
+    if (threads <= 1) {
+        // A single stream is the plain mt64_create(seed) sequence.
+        FillTask task = {.seed = seed, .stream = UINT64_MAX, .buf = buf, .n = n};
+        fill_worker(&task);
+        return task.status;
+    }
+
+    FillTask *tasks = calloc(threads, sizeof(FillTask));
+    pthread_t *tids = calloc(threads, sizeof(pthread_t));
+    if (tasks == NULL || tids == NULL) {
+        free(tasks);
+        free(tids);
+        return -1;
+    }
+    // Part t (of equal size, the last one takes the remainder) is stream t.
+    size_t part = n / threads;
+    for (unsigned t = 0; t < threads; t++) {
+        tasks[t] = (FillTask) {
+            .seed = seed, .stream = t, .buf = buf + t * part,
+            .n = t + 1 == threads ? n - t * part : part,
+        };
+    }
+    for (unsigned t = 1; t < threads; t++) {
+        tasks[t].started = pthread_create(&tids[t], NULL, fill_worker, &tasks[t]) == 0;
+        if (!tasks[t].started) fill_worker(&tasks[t]);
+    }
+    fill_worker(&tasks[0]);
+    int status = tasks[0].status;
+    for (unsigned t = 1; t < threads; t++) {
+        if (tasks[t].started) pthread_join(tids[t], NULL);
+        if (tasks[t].status != 0) status = -1;
+    }
+    free(tasks);
+    free(tids);
+    return status;
+}
+
 /* generates a random number on [0, 2^63-1]-interval */
 int64_t mt64_gen_int63(Mt64* state)
 {
@@ -11,6 +11,7 @@
 #define MT64_H
 
 #include <stdint.h>
+#include <stddef.h>
 
 typedef struct Mt64 Mt64;
 
@@ -22,6 +23,10 @@ extern "C" {
 Mt64 *mt64_create(uint64_t seed);
 Mt64 *mt64_create_default(void);
 Mt64 *mt64_create_by_array(uint64_t init_key[], uint64_t key_length);
+// Independent stream `stream` for a seed (init_by_array64 with {seed, stream}).
+// Streams are not provably disjoint, but overlap within the 2^19937 - 1
+// period is vanishingly unlikely.
+Mt64 *mt64_create_stream(uint64_t seed, uint64_t stream);
 void mt64_destroy(Mt64* state);
 
 
@@ -32,6 +37,14 @@ double   mt64_gen_real1(Mt64* state); // [0,1]-real-interval */
 double   mt64_gen_real2(Mt64* state); // [0,1)-real-interval
 double   mt64_gen_real3(Mt64* state); // (0,1)-real-interval
 
+// --- Bulk Generation API ---
+// Writes the next n outputs of mt64_gen_int64(state) to buf.
+void mt64_fill_u64(Mt64* state, uint64_t* buf, size_t n);
+// Fills buf using `threads` threads: part t of `threads` equal parts is
+// stream t of `seed`, so the output depends only on seed and thread count.
+// With threads <= 1 it is the mt64_create(seed) sequence. Returns 0 or -1.
+int mt64_fill_u64_parallel(uint64_t seed, uint64_t* buf, size_t n, unsigned threads);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,150 @@
+#define _GNU_SOURCE  // syscall
+
+#include <string.h>
+#include <stdio.h>
+#include <errno.h>
+#include <unistd.h>
+#include "perf_counters.h"
+
+#ifdef __linux__
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+
+static const char *const COUNTER_NAMES[PERF_NUM_COUNTERS] = {
+    "cycles", "instructions", "LLC misses", "dTLB misses", "branch misses",
+};
+
+#ifdef __linux__
+#define CACHE_READ_MISS(cache) \
+    ((cache) | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16))
+
+static const struct {
+    uint32_t type;
+    uint64_t config;
+} EVENTS[PERF_NUM_COUNTERS] = {
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+    {PERF_TYPE_HW_CACHE, CACHE_READ_MISS(PERF_COUNT_HW_CACHE_LL)},
+    {PERF_TYPE_HW_CACHE, CACHE_READ_MISS(PERF_COUNT_HW_CACHE_DTLB)},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+};
+
+static int open_event(PerfCounterId id, bool inherit) {
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = EVENTS[id].type;
+    attr.config = EVENTS[id].config;
+    attr.disabled = 1;
+    attr.inherit = inherit;
+    // User space only, which perf_event_paranoid = 2 still allows.
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    return (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+#endif
+
+unsigned perf_counters_open(PerfCounters *pc, bool inherit) {
+    memset(pc, 0, sizeof(*pc));
+    unsigned opened = 0;
+    for (int id = 0; id < PERF_NUM_COUNTERS; id++) {
+#ifdef __linux__
+        pc->fds[id] = open_event(id, inherit);
+        if (pc->fds[id] < 0 && pc->error == 0) pc->error = errno;
+#else
+        (void)inherit;
+        pc->fds[id] = -1;
+        pc->error = ENOSYS;
+#endif
+        pc->available[id] = pc->fds[id] >= 0;
+        opened += pc->available[id];
+    }
+    return opened;
+}
+
+void perf_counters_start(PerfCounters *pc) {
+    for (int id = 0; id < PERF_NUM_COUNTERS; id++) {
+        pc->values[id] = 0;
+#ifdef __linux__
+        if (pc->fds[id] < 0) continue;
+        ioctl(pc->fds[id], PERF_EVENT_IOC_RESET, 0);
+        ioctl(pc->fds[id], PERF_EVENT_IOC_ENABLE, 0);
+#endif
+    }
+}
+
+void perf_counters_stop(PerfCounters *pc) {
+#ifdef __linux__
+    for (int id = 0; id < PERF_NUM_COUNTERS; id++) {
+        if (pc->fds[id] >= 0) ioctl(pc->fds[id], PERF_EVENT_IOC_DISABLE, 0);
+    }
+    for (int id = 0; id < PERF_NUM_COUNTERS; id++) {
+        if (pc->fds[id] < 0) continue;
+        // value, time enabled, time running
+        uint64_t data[3];
+        if (read(pc->fds[id], data, sizeof(data)) != (ssize_t)sizeof(data)) {
+            pc->available[id] = false;
+            continue;
+        }
+        // When more events are open than the PMU has counters, the kernel
+        // time-slices them; scale up to the whole enabled time.
+        double value = (double)data[0];
+        if (data[2] > 0 && data[2] < data[1]) value *= (double)data[1] / (double)data[2];
+        pc->values[id] = data[2] > 0 ? (uint64_t)value : 0;
+    }
+#else
+    (void)pc;
+#endif
+}
+
+bool perf_counters_available(const PerfCounters *pc, PerfCounterId id) {
+    return pc->available[id];
+}
+
+void perf_counters_init_sum(PerfCounters *sum) {
+    memset(sum, 0, sizeof(*sum));
+    for (int id = 0; id < PERF_NUM_COUNTERS; id++) {
+        sum->fds[id] = -1;
+        sum->available[id] = true;
+    }
+}
+
+void perf_counters_add(PerfCounters *sum, const PerfCounters *pc) {
+    for (int id = 0; id < PERF_NUM_COUNTERS; id++) {
+        sum->values[id] += pc->values[id];
+        sum->available[id] = sum->available[id] && pc->available[id];
+    }
+    if (sum->error == 0) sum->error = pc->error;
+}
+
+void perf_counters_print(const PerfCounters *pc, const char *label, double per) {
+    unsigned shown = 0;
+    for (int id = 0; id < PERF_NUM_COUNTERS; id++) shown += pc->available[id];
+    if (shown == 0) {
+        printf("    %s: counters unavailable (%s)\n", label, pc->error ? strerror(pc->error) : "not opened");
+        return;
+    }
+    printf("    %s:", label);
+    for (int id = 0; id < PERF_NUM_COUNTERS; id++) {
+        if (pc->available[id]) {
+            printf("  %.2f %s", (double)pc->values[id] / per, COUNTER_NAMES[id]);
+        } else {
+            printf("  n/a %s", COUNTER_NAMES[id]);
+        }
+    }
+    if (pc->available[PERF_CYCLES] && pc->available[PERF_INSTRUCTIONS] && pc->values[PERF_CYCLES] > 0) {
+        printf("  (IPC %.2f)", (double)pc->values[PERF_INSTRUCTIONS] / (double)pc->values[PERF_CYCLES]);
+    }
+    if (shown < PERF_NUM_COUNTERS && pc->error != 0) printf("  [%s]", strerror(pc->error));
+    printf("\n");
+}
+
+void perf_counters_close(PerfCounters *pc) {
+    for (int id = 0; id < PERF_NUM_COUNTERS; id++) {
+        if (pc->fds[id] >= 0) close(pc->fds[id]);
+        pc->fds[id] = -1;
+    }
+}
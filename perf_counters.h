@@ -0,0 +1,72 @@
+#ifndef PERF_COUNTERS_H
+#define PERF_COUNTERS_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+ * Hardware performance counters around benchmark phases.
+ *
+ * Wraps Linux perf_event_open() to count cycles, instructions, last-level
+ * cache misses, data TLB misses and branch mispredicts in user space, for
+ * the calling thread (and, with `inherit`, the threads it starts later).
+ * Each counter is opened on its own, so a host that lacks one event still
+ * reports the others. Without perf support (other systems, containers
+ * that block the syscall, perf_event_paranoid > 2) every counter is
+ * simply unavailable and is printed as "n/a"; nothing fails.
+ */
+typedef enum {
+    PERF_CYCLES,
+    PERF_INSTRUCTIONS,
+    PERF_LLC_MISSES,
+    PERF_DTLB_MISSES,
+    PERF_BRANCH_MISSES,
+    PERF_NUM_COUNTERS
+} PerfCounterId;
+
+typedef struct {
+    int fds[PERF_NUM_COUNTERS];          // -1 where unavailable or closed
+    bool available[PERF_NUM_COUNTERS];   // opened (kept after perf_counters_close)
+    uint64_t values[PERF_NUM_COUNTERS];  // counts of the last start/stop, scaled if multiplexed
+    int error;                           // errno of the first counter that failed to open, or 0
+} PerfCounters;
+
+/**
+ * @brief Opens the counters, disabled and zeroed.
+ * @param pc The counter set to initialize.
+ * @param inherit Also count threads created by the calling thread after this call.
+ * @return The number of counters that could be opened (0 if none).
+ */
+unsigned perf_counters_open(PerfCounters *pc, bool inherit);
+
+/** @brief Resets and enables the counters. */
+void perf_counters_start(PerfCounters *pc);
+
+/** @brief Disables the counters and reads their values. */
+void perf_counters_stop(PerfCounters *pc);
+
+/** @brief Returns true if counter `id` was opened. */
+bool perf_counters_available(const PerfCounters *pc, PerfCounterId id);
+
+/**
+ * @brief Adds the values of `pc` to `sum`.
+ *
+ * A counter stays available in `sum` only while it is available in every
+ * set added. `sum` has no counters of its own; see perf_counters_init_sum().
+ */
+void perf_counters_add(PerfCounters *sum, const PerfCounters *pc);
+
+/** @brief Initializes an empty set for perf_counters_add(), with every counter available. */
+void perf_counters_init_sum(PerfCounters *sum);
+
+/**
+ * @brief Prints one line with the counts divided by `per`.
+ * @param label Printed first, e.g. "per query".
+ */
+void perf_counters_print(const PerfCounters *pc, const char *label, double per);
+
+/** @brief Closes the counters; the values read so far remain. */
+void perf_counters_close(PerfCounters *pc);
+
+#endif // PERF_COUNTERS_H
@@ -0,0 +1,55 @@
+/* perf_counters_test.c - tests for the perf_event_open wrapper.
+ *
+ * Counters may be unavailable (containers, perf_event_paranoid); the
+ * wrapper must then report them as such without failing.
+ */
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "perf_counters.h"
+
+static uint64_t busy_loop(size_t n) {
+    uint64_t x = 1;
+    for (size_t i = 0; i < n; i++) x = x * 6364136223846793005ULL + i;
+    return x;
+}
+
+int main(void) {
+    printf("perf_counters_test\n");
+    PerfCounters pc;
+    unsigned opened = perf_counters_open(&pc, false);
+    printf("  %u of %d counters available\n", opened, PERF_NUM_COUNTERS);
+    assert(opened <= PERF_NUM_COUNTERS);
+    assert((opened < PERF_NUM_COUNTERS) == (pc.error != 0));
+
+    perf_counters_start(&pc);
+    uint64_t x = busy_loop(10000000);
+    perf_counters_stop(&pc);
+    perf_counters_print(&pc, "per iteration", 1e7);
+    if (perf_counters_available(&pc, PERF_INSTRUCTIONS)) {
+        // The loop body is at least a multiply and an add.
+        assert(pc.values[PERF_INSTRUCTIONS] >= 20000000);
+    }
+    uint64_t first = pc.values[PERF_INSTRUCTIONS];
+
+    // Restarting resets the counts.
+    perf_counters_start(&pc);
+    x += busy_loop(1000000);
+    perf_counters_stop(&pc);
+    assert(pc.values[PERF_INSTRUCTIONS] <= first);
+
+    PerfCounters sum;
+    perf_counters_init_sum(&sum);
+    perf_counters_add(&sum, &pc);
+    perf_counters_add(&sum, &pc);
+    for (int id = 0; id < PERF_NUM_COUNTERS; id++) {
+        assert(sum.available[id] == pc.available[id]);
+        assert(sum.values[id] == 2 * pc.values[id]);
+    }
+    perf_counters_close(&pc);
+    assert(pc.fds[PERF_CYCLES] == -1);
+
+    printf("All tests passed. (%llx)\n", (unsigned long long)(x & 0xff));
+    return 0;
+}
@@ -0,0 +1,245 @@
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdalign.h>
+#include "bitarray.h"
+#include "pilot_table.h"
+
+constexpr double TABLE_LOAD = 0.99;          // keys per position
+constexpr double DENSE_BUCKET_SHARE = 0.3;   // share of buckets that take 60% of the keys
+constexpr uint64_t FIRST_SEED = 0x2545f4914f6cdd1d;
+constexpr unsigned SEED_TRIES = 8;
+constexpr uint64_t MAX_PILOT = UINT64_C(1) << 24;  // tries per bucket before a new seed
+
+// Keys per group in pilot_table_query_batch().
+enum { BATCH_GROUP = 32 };
+
+// Bits needed for values up to `max`, at least 1.
+static size_t bit_width(uint64_t max) {
+    size_t width = 1;
+    while (width < 64 && (max >> width) != 0) width++;
+    return width;
+}
+
+// log2(n) to about 1%, so that the library needs no libm.
+static double log2_approx(size_t n) {
+    size_t e = bit_width(n) - 1;
+    double x = (double)n / (double)(UINT64_C(1) << e) - 1.0;
+    return (double)e + x * (1.4427 - 0.4427 * x);
+}
+
+// Packs the values into a fresh array, with one spare word so that it is
+// never empty.
+static uint64_t *pack(const uint64_t values[], size_t count, size_t width, const BBHashAllocator *a) {
+    uint64_t *words = bbhash_zalloc(a, sizeof(uint64_t) * (pilot_packed_words(count, width) + 1), alignof(uint64_t));
+    if (!words) return NULL;
+    for (size_t i = 0; i < count; i++) {
+        size_t bit = i * width;
+        words[bit / 64] |= values[i] << (bit % 64);
+        if (bit % 64 + width > 64) words[bit / 64 + 1] |= values[i] >> (64 - bit % 64);
+    }
+    return words;
+}
+
+/*
+ * One attempt with t->seed. Groups the key hashes by bucket, then places the
+ * buckets largest first. Returns false if some bucket finds no pilot, which
+ * for distinct keys means an unlucky seed.
+ */
+static bool place_buckets(PilotTable *t, const uint64_t keys[], size_t n, uint64_t pilots[], bool *duplicate,
+                          const BBHashAllocator *a) {
+    size_t num_buckets = t->num_buckets;
+    size_t *bucket_start = bbhash_zalloc(a, sizeof(size_t) * (num_buckets + 1), alignof(size_t));
+    uint64_t *hashes = bbhash_alloc(a, sizeof(uint64_t) * (n ? n : 1), alignof(uint64_t));
+    size_t *order = NULL, *size_start = NULL;
+    size_t *positions = NULL;
+    Bitarray *taken = bitarray_new_with(t->table_size, a);
+    bool ok = false;
+    if (!bucket_start || !hashes || !taken) goto done;
+
+    // Group the hashes by bucket (counting sort).
+    for (size_t i = 0; i < n; i++) bucket_start[pilot_bucket(t, hash_with_seed(keys[i], t->seed)) + 1]++;
+    size_t max_size = 0;
+    for (size_t b = 0; b < num_buckets; b++) {
+        if (bucket_start[b + 1] > max_size) max_size = bucket_start[b + 1];
+        bucket_start[b + 1] += bucket_start[b];
+    }
+    for (size_t i = 0; i < n; i++) {
+        uint64_t hash = hash_with_seed(keys[i], t->seed);
+        hashes[bucket_start[pilot_bucket(t, hash)]++] = hash;
+    }
+    for (size_t b = num_buckets; b > 0; b--) bucket_start[b] = bucket_start[b - 1];
+    bucket_start[0] = 0;
+
+    // Order the buckets by size, largest first (counting sort again).
+    order = bbhash_alloc(a, sizeof(size_t) * num_buckets, alignof(size_t));
+    size_start = bbhash_zalloc(a, sizeof(size_t) * (max_size + 2), alignof(size_t));
+    positions = bbhash_alloc(a, sizeof(size_t) * (max_size + 1), alignof(size_t));
+    if (!order || !size_start || !positions) goto done;
+    for (size_t b = 0; b < num_buckets; b++) size_start[max_size - (bucket_start[b + 1] - bucket_start[b]) + 1]++;
+    for (size_t s = 0; s <= max_size; s++) size_start[s + 1] += size_start[s];
+    for (size_t b = 0; b < num_buckets; b++) {
+        order[size_start[max_size - (bucket_start[b + 1] - bucket_start[b])]++] = b;
+    }
+
+    for (size_t o = 0; o < num_buckets; o++) {
+        size_t b = order[o];
+        const uint64_t *bucket = hashes + bucket_start[b];
+        size_t size = bucket_start[b + 1] - bucket_start[b];
+        pilots[b] = 0;
+        if (size == 0) continue;
+        for (size_t k = 1; k < size; k++) {
+            for (size_t j = 0; j < k; j++) {
+                if (bucket[j] == bucket[k]) {
+                    *duplicate = true;
+                    goto done;
+                }
+            }
+        }
+        uint64_t pilot = 0;
+        for (;; pilot++) {
+            if (pilot == MAX_PILOT) goto done;
+            size_t k = 0;
+            for (; k < size; k++) {
+                size_t pos = pilot_position(t, bucket[k], pilot);
+                if (bitarray_get(taken, pos)) break;
+                size_t j = 0;
+                while (j < k && positions[j] != pos) j++;
+                if (j < k) break;
+                positions[k] = pos;
+            }
+            if (k == size) break;
+        }
+        for (size_t k = 0; k < size; k++) bitarray_set(taken, positions[k]);
+        pilots[b] = pilot;
+    }
+
+    // Positions past n are remapped, in order, to the free positions below n.
+    size_t num_remap = t->table_size - n;
+    uint64_t *remap = bbhash_zalloc(a, sizeof(uint64_t) * (num_remap ? num_remap : 1), alignof(uint64_t));
+    if (!remap) goto done;
+    size_t free_pos = 0;
+    for (size_t pos = n; pos < t->table_size; pos++) {
+        if (!bitarray_get(taken, pos)) continue;
+        while (bitarray_get(taken, free_pos)) free_pos++;
+        remap[pos - n] = free_pos++;
+    }
+    t->remap_width = bit_width(n ? n - 1 : 0);
+    t->remap = pack(remap, num_remap, t->remap_width, a);
+    bbhash_dealloc(a, remap);
+    ok = t->remap != NULL;
+
+done:
+    bbhash_dealloc(a, bucket_start);
+    bbhash_dealloc(a, hashes);
+    bbhash_dealloc(a, order);
+    bbhash_dealloc(a, size_start);
+    bbhash_dealloc(a, positions);
+    if (taken) bitarray_free_with(taken, a);
+    return ok;
+}
+
+PilotTable *pilot_table_build(const uint64_t keys[], size_t n, double c, bool verbose, const BBHashAllocator *a) {
+    if (!(c > 0)) {
+        fprintf(stderr, "pilot_table_build: the bucket density must be positive.\n");
+        return NULL;
+    }
+    PilotTable *t = bbhash_zalloc(a, sizeof(PilotTable), alignof(PilotTable));
+    if (!t) return NULL;
+    double log2n = n > 2 ? log2_approx(n) : 1.0;
+    size_t num_buckets = (size_t)(c * n / log2n) + 1;
+    t->num_keys = n;
+    t->table_size = (size_t)(n / TABLE_LOAD) + 1;
+    t->num_buckets = num_buckets < 2 ? 2 : num_buckets;
+    t->dense_buckets = (size_t)(DENSE_BUCKET_SHARE * t->num_buckets);
+    if (t->dense_buckets == 0) t->dense_buckets = 1;
+    uint64_t *pilots = bbhash_alloc(a, sizeof(uint64_t) * t->num_buckets, alignof(uint64_t));
+    if (!pilots) goto failure;
+
+    bool duplicate = false;
+    for (unsigned attempt = 0; attempt < SEED_TRIES; attempt++) {
+        t->seed = hash_with_seed(attempt, FIRST_SEED);
+        if (place_buckets(t, keys, n, pilots, &duplicate, a)) break;
+        if (duplicate) {
+            fprintf(stderr, "pilot_table_build: the keys are not distinct.\n");
+            goto failure;
+        }
+    }
+    if (!t->remap) {
+        fprintf(stderr, "pilot_table_build: no seed placed every bucket.\n");
+        goto failure;
+    }
+    uint64_t max_pilot = 0, sum = 0;
+    for (size_t b = 0; b < t->num_buckets; b++) {
+        if (pilots[b] > max_pilot) max_pilot = pilots[b];
+        sum += pilots[b];
+    }
+    t->pilot_width = bit_width(max_pilot);
+    t->pilots = pack(pilots, t->num_buckets, t->pilot_width, a);
+    if (!t->pilots) goto failure;
+    if (verbose) {
+        printf("Pilots: %zu buckets (%zu dense), mean pilot %.1f, max %llu (%zu bits); %zu positions, "
+               "%zu remapped (%zu bits)\n", (size_t)t->num_buckets, (size_t)t->dense_buckets,
+               (double)sum / t->num_buckets, (unsigned long long)max_pilot, (size_t)t->pilot_width,
+               (size_t)t->table_size, (size_t)(t->table_size - n), (size_t)t->remap_width);
+    }
+    bbhash_dealloc(a, pilots);
+    return t;
+
+failure:
+    bbhash_dealloc(a, pilots);
+    pilot_table_free(t, a);
+    return NULL;
+}
+
+void pilot_table_query_batch(const PilotTable *t, const uint64_t keys[], size_t n, size_t out[]) {
+    uint64_t hashes[BATCH_GROUP];
+    size_t buckets[BATCH_GROUP];
+    for (size_t first = 0; first < n; first += BATCH_GROUP) {
+        size_t count = n - first < BATCH_GROUP ? n - first : BATCH_GROUP;
+        // Start loading every pilot of the group before reading any of them.
+        for (size_t i = 0; i < count; i++) {
+            hashes[i] = hash_with_seed(keys[first + i], t->seed);
+            buckets[i] = pilot_bucket(t, hashes[i]);
+            __builtin_prefetch(&t->pilots[buckets[i] * t->pilot_width / 64]);
+        }
+        for (size_t i = 0; i < count; i++) {
+            uint64_t pilot = pilot_packed_get(t->pilots, buckets[i], t->pilot_width);
+            size_t pos = pilot_position(t, hashes[i], pilot);
+            out[first + i] = pos < t->num_keys ? pos : pilot_packed_get(t->remap, pos - t->num_keys, t->remap_width);
+        }
+    }
+}
+
+size_t pilot_table_size_in_bits(const PilotTable *t) {
+    return (pilot_packed_words(t->num_buckets, t->pilot_width)
+            + pilot_packed_words(t->table_size - t->num_keys, t->remap_width)) * 64;
+}
+
+PilotTable *pilot_table_clone(const PilotTable *t, const BBHashAllocator *a) {
+    PilotTable *copy = bbhash_alloc(a, sizeof(PilotTable), alignof(PilotTable));
+    if (!copy) return NULL;
+    *copy = *t;
+    copy->borrowed = false;
+    size_t pilot_words = pilot_packed_words(t->num_buckets, t->pilot_width);
+    size_t remap_words = pilot_packed_words(t->table_size - t->num_keys, t->remap_width);
+    copy->pilots = bbhash_alloc(a, sizeof(uint64_t) * (pilot_words + 1), alignof(uint64_t));
+    copy->remap = bbhash_alloc(a, sizeof(uint64_t) * (remap_words + 1), alignof(uint64_t));
+    if (!copy->pilots || !copy->remap) {
+        pilot_table_free(copy, a);
+        return NULL;
+    }
+    memcpy(copy->pilots, t->pilots, sizeof(uint64_t) * pilot_words);
+    memcpy(copy->remap, t->remap, sizeof(uint64_t) * remap_words);
+    return copy;
+}
+
+void pilot_table_free(PilotTable *t, const BBHashAllocator *a) {
+    if (!t) return;
+    if (!t->borrowed) {
+        bbhash_dealloc(a, t->pilots);
+        bbhash_dealloc(a, t->remap);
+    }
+    bbhash_dealloc(a, t);
+}
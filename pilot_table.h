@@ -0,0 +1,98 @@
+#ifndef PILOT_TABLE_H
+#define PILOT_TABLE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "hashing.h"
+#include "bbhash_alloc.h"
+
+/*
+ * Single-probe minimal perfect hashing by pilot search, after PTHash
+ * (Pibiri and Trani, SIGIR 2021). This is the engine behind
+ * BBHASH_ENGINE_PILOTS; the MPHF code in bbhash.c stores, saves and loads
+ * the table.
+ *
+ * Every key hashes to a bucket, and every bucket stores a pilot. The
+ * position of a key is a hash of its own hash and its bucket's pilot, scaled
+ * to a table of table_size = n / 0.99 slots. The builder places the buckets
+ * largest first and gives each the first pilot that puts all of its keys on
+ * free, distinct positions. Buckets are skewed, 60% of the keys going to 30%
+ * of them, so that the large buckets meet an empty table.
+ *
+ * A query costs one memory access for the pilot. The few keys (about 1%)
+ * whose position is n or more are remapped to the free positions below n,
+ * which costs one more. Pilots and remap entries are packed at the width of
+ * the largest one.
+ */
+typedef struct {
+    uint64_t seed;
+    uint64_t num_keys;
+    uint64_t table_size;      // positions, num_keys / 0.99 rounded up
+    uint64_t num_buckets;
+    uint64_t dense_buckets;   // the first buckets, which take 60% of the keys
+    uint64_t pilot_width;     // bits per pilot, 1 to 64
+    uint64_t remap_width;     // bits per remap entry, 1 to 64
+    uint64_t *pilots;         // num_buckets pilots, packed
+    uint64_t *remap;          // table_size - num_keys entries, packed
+    bool borrowed;            // the arrays point into memory owned elsewhere
+} PilotTable;
+
+/** @brief Words holding `count` packed values of `width` bits. */
+static inline size_t pilot_packed_words(size_t count, size_t width) {
+    return (count * width + 63) / 64;
+}
+
+static inline uint64_t pilot_packed_get(const uint64_t *words, size_t i, size_t width) {
+    size_t bit = i * width;
+    uint64_t value = words[bit / 64] >> (bit % 64);
+    if (bit % 64 + width > 64) value |= words[bit / 64 + 1] << (64 - bit % 64);
+    return width == 64 ? value : value & ((UINT64_C(1) << width) - 1);
+}
+
+// High half of a * b: scales a uniform 64-bit hash to [0, b).
+static inline uint64_t pilot_scale(uint64_t a, uint64_t b) {
+    return (uint64_t)(((unsigned __int128)a * b) >> 64);
+}
+
+static inline size_t pilot_bucket(const PilotTable *t, uint64_t hash) {
+    // The high bits choose the dense or sparse buckets, the low bits the bucket.
+    uint64_t low = hash << 32 | hash >> 32;
+    if (hash < UINT64_MAX / 5 * 3) return pilot_scale(low, t->dense_buckets);
+    return t->dense_buckets + pilot_scale(low, t->num_buckets - t->dense_buckets);
+}
+
+static inline size_t pilot_position(const PilotTable *t, uint64_t hash, uint64_t pilot) {
+    return pilot_scale(hash_with_seed(hash, hash_with_seed(pilot, t->seed)), t->table_size);
+}
+
+/** @brief Returns the index of a member key; arbitrary in [0, n) for others. */
+static inline size_t pilot_table_query(const PilotTable *t, uint64_t key) {
+    uint64_t hash = hash_with_seed(key, t->seed);
+    uint64_t pilot = pilot_packed_get(t->pilots, pilot_bucket(t, hash), t->pilot_width);
+    size_t pos = pilot_position(t, hash, pilot);
+    return pos < t->num_keys ? pos : pilot_packed_get(t->remap, pos - t->num_keys, t->remap_width);
+}
+
+/**
+ * @brief Builds a table over distinct keys.
+ * @param c Bucket density: there are c * n / log2(n) buckets. A larger c
+ *        builds faster and takes more bits per key.
+ * @param a Allocator for the table and the build scratch, or NULL.
+ * @return The table, or NULL on failure (including duplicate keys).
+ */
+PilotTable *pilot_table_build(const uint64_t keys[], size_t n, double c, bool verbose, const BBHashAllocator *a);
+
+/** @brief Queries keys[i] into out[i], prefetching the pilots of each group. */
+void pilot_table_query_batch(const PilotTable *t, const uint64_t keys[], size_t n, size_t out[]);
+
+/** @brief Bits of the pilot and remap arrays. */
+size_t pilot_table_size_in_bits(const PilotTable *t);
+
+/** @brief Deep copy from `a`; the copy owns its arrays. @return NULL on failure. */
+PilotTable *pilot_table_clone(const PilotTable *t, const BBHashAllocator *a);
+
+/** @brief Frees a table built, cloned or loaded with allocator `a`. */
+void pilot_table_free(PilotTable *t, const BBHashAllocator *a);
+
+#endif // PILOT_TABLE_H
@@ -0,0 +1,151 @@
+/* pilot_table_test.c - tests for the pilot-search MPHF engine.
+ *
+ */
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "mt64.h"
+#include "dedup.h"
+#include "bitarray.h"
+#include "pilot_table.h"
+#include "bbhash.h"
+
+static void check_bijection(const BBHash *mphf, const uint64_t keys[], size_t n) {
+    size_t *out = malloc(sizeof(size_t) * (n ? n : 1));
+    bbhash_mphf_query_batch(mphf, keys, n, out);
+    Bitarray *seen = bitarray_new(n ? n : 1);
+    for (size_t i = 0; i < n; i++) {
+        size_t idx = bbhash_mphf_query(mphf, keys[i]);
+        assert(idx < n && idx == out[i]);
+        assert(bitarray_get(seen, idx) == 0);
+        bitarray_set(seen, idx);
+        assert(bbhash_mphf_query_level(mphf, keys[i]) == 0);
+    }
+    bitarray_free(seen);
+    free(out);
+}
+
+static void assert_same(const BBHash *a, const BBHash *b, const uint64_t keys[], size_t n) {
+    for (size_t i = 0; i < n; i++) assert(bbhash_mphf_query(a, keys[i]) == bbhash_mphf_query(b, keys[i]));
+    assert(bbhash_size_in_bits(a) == bbhash_size_in_bits(b));
+}
+
+int main(void) {
+    printf("pilot_table_test\n");
+    size_t n = 1000000;
+    Mt64 *rng = mt64_create(49);
+    uint64_t *keys = malloc(sizeof(uint64_t) * (n + 1));
+    for (size_t i = 0; i < n; i++) keys[i] = mt64_gen_int64(rng);
+    mt64_destroy(rng);
+    n = dedup(keys, n);
+
+    // The engine on its own, at several bucket densities.
+    const double densities[] = {3.0, 6.0, 10.0};
+    for (size_t d = 0; d < sizeof(densities) / sizeof(densities[0]); d++) {
+        PilotTable *t = pilot_table_build(keys, n, densities[d], false, NULL);
+        assert(t != NULL && t->num_keys == n && t->table_size > n);
+        Bitarray *seen = bitarray_new(n);
+        for (size_t i = 0; i < n; i++) {
+            size_t idx = pilot_table_query(t, keys[i]);
+            assert(idx < n && bitarray_get(seen, idx) == 0);
+            bitarray_set(seen, idx);
+        }
+        bitarray_free(seen);
+        printf("  c = %4.1f: %zu buckets, %zu-bit pilots, %.3f bits/key\n", densities[d], (size_t)t->num_buckets,
+               (size_t)t->pilot_width, (double)pilot_table_size_in_bits(t) / n);
+        pilot_table_free(t, NULL);
+    }
+    assert(pilot_table_build(keys, n, 0.0, false, NULL) == NULL);
+
+    // Behind the BBHash API.
+    BBHashConfig config = bbhash_config_default();
+    assert(config.engine == BBHASH_ENGINE_LEVELS);
+    config.engine = BBHASH_ENGINE_PILOTS;
+    BBHash *mphf = bbhash_mphf_create_ex(keys, n, &config);
+    assert(mphf != NULL);
+    check_bijection(mphf, keys, n);
+    assert(bbhash_mphf_verify(mphf, keys, n, 2) == 0);
+    BBHashStats stats;
+    bbhash_mphf_stats(mphf, &stats);
+    assert(stats.engine == BBHASH_ENGINE_PILOTS && stats.num_keys == n && stats.num_levels == 0);
+    assert(stats.num_buckets > 0 && stats.size_in_bits == bbhash_size_in_bits(mphf));
+    BBHashLevelInfo info;
+    assert(!bbhash_mphf_level_info(mphf, 0, &info));
+
+    BBHash *copy = bbhash_mphf_clone(mphf);
+    assert(copy != NULL);
+    assert_same(mphf, copy, keys, n);
+    bbhash_free(copy);
+
+    BBHashBuilder *builder = bbhash_builder_create();
+    copy = bbhash_builder_build(builder, keys, n, &config);
+    assert(copy != NULL);
+    assert_same(mphf, copy, keys, n);  // the build is deterministic
+    bbhash_free(copy);
+    bbhash_builder_free(builder);
+
+    // Save and load every way.
+    const char *file = "pilot_table_test.bbh";
+    assert(bbhash_mphf_save(mphf, file) == 0);
+    assert(bbhash_mphf_save_ex(mphf, file, 2) == -1);
+    assert(bbhash_mphf_save(mphf, file) == 0);
+    BBHash *loaded = bbhash_mphf_load_ex(file, BBHASH_LOAD_VERIFY);
+    assert(loaded != NULL);
+    assert_same(mphf, loaded, keys, n);
+    bbhash_free(loaded);
+    BBHash *mapped = bbhash_mphf_mmap(file, BBHASH_LOAD_VERIFY);
+    assert(mapped != NULL);
+    bbhash_mphf_stats(mapped, &stats);
+    assert(stats.mapped && stats.engine == BBHASH_ENGINE_PILOTS);
+    assert_same(mphf, mapped, keys, n);
+    copy = bbhash_mphf_clone(mapped);
+    bbhash_free(mapped);
+    assert_same(mphf, copy, keys, n);
+    bbhash_free(copy);
+    assert(bbhash_disk_open(file, NULL) == NULL);
+
+    // A flipped bit in the pilots fails the checksum.
+    FILE *fp = fopen(file, "r+b");
+    assert(fp != NULL);
+    fseek(fp, 200, SEEK_SET);
+    int byte = fgetc(fp);
+    fseek(fp, 200, SEEK_SET);
+    fputc(byte ^ 1, fp);
+    fclose(fp);
+    assert(bbhash_mphf_load_ex(file, BBHASH_LOAD_VERIFY) == NULL);
+    remove(file);
+
+    // Options the pilot engine does not take.
+    BBHashConfig bad = config;
+    bad.hash_scheme = BBHASH_HASH_BASE128;
+    assert(bbhash_mphf_create_ex(keys, n, &bad) == NULL);
+    bad = config;
+    bad.hot_keys = keys;
+    bad.num_hot_keys = 10;
+    assert(bbhash_mphf_create_ex(keys, n, &bad) == NULL);
+    bad = config;
+    bad.engine = (BBHashEngine)7;
+    assert(bbhash_mphf_create_ex(keys, n, &bad) == NULL);
+    BBHashKey128 wide[4] = {{1, 2}, {3, 4}, {5, 6}, {7, 8}};
+    assert(bbhash_mphf_create128(wide, 4, &config) == NULL);
+
+    // Duplicates are refused.
+    keys[n] = keys[0];
+    assert(bbhash_mphf_create_ex(keys, n + 1, &config) == NULL);
+
+    bbhash_free(mphf);
+
+    // Tiny sets.
+    for (size_t small = 0; small < 300; small += 37) {
+        BBHash *s = bbhash_mphf_create_ex(keys, small, &config);
+        assert(s != NULL);
+        check_bijection(s, keys, small);
+        bbhash_free(s);
+    }
+
+    free(keys);
+    printf("All tests passed.\n");
+    return 0;
+}
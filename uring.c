@@ -0,0 +1,199 @@
+#define _GNU_SOURCE  // syscall(), pread() under -std=c23
+
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+#include "uring.h"
+
+struct Uring {
+    int fd;
+    unsigned entries;
+    bool broken;               // io_uring_enter() failed; use pread() from now on
+    // Submission ring
+    void *sq_map;
+    size_t sq_map_len;
+    _Atomic unsigned *sq_head, *sq_tail;
+    unsigned sq_mask;
+    unsigned *sq_array;
+    struct io_uring_sqe *sqes;
+    // Completion ring
+    void *cq_map;              // == sq_map with IORING_FEAT_SINGLE_MMAP
+    size_t cq_map_len;
+    _Atomic unsigned *cq_head, *cq_tail;
+    unsigned cq_mask;
+    struct io_uring_cqe *cqes;
+};
+
+int uring_open(const char *filename, bool *direct) {
+    int fd = -1;
+    if (*direct) {
+        fd = open(filename, O_RDONLY | O_DIRECT);
+        if (fd < 0 && errno != EINVAL) return -1;
+    }
+    if (fd < 0) {
+        *direct = false;
+        fd = open(filename, O_RDONLY);
+        if (fd >= 0) posix_fadvise(fd, 0, 0, POSIX_FADV_RANDOM);
+    }
+    return fd;
+}
+
+static int sys_io_uring_setup(unsigned entries, struct io_uring_params *p) {
+    return (int)syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int sys_io_uring_enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags) {
+    return (int)syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, NULL, 0);
+}
+
+Uring *uring_create(unsigned entries) {
+    struct io_uring_params p;
+    memset(&p, 0, sizeof(p));
+    Uring *u = calloc(1, sizeof(Uring));
+    if (!u) return NULL;
+    u->sq_map = u->cq_map = MAP_FAILED;
+    u->sqes = MAP_FAILED;
+    u->fd = sys_io_uring_setup(entries, &p);
+    if (u->fd < 0) {
+        free(u);
+        return NULL;
+    }
+    u->entries = p.sq_entries;
+
+    u->sq_map_len = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    u->cq_map_len = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    bool single = (p.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if (single && u->cq_map_len > u->sq_map_len) u->sq_map_len = u->cq_map_len;
+    u->sq_map = mmap(NULL, u->sq_map_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, u->fd,
+                     IORING_OFF_SQ_RING);
+    if (u->sq_map == MAP_FAILED) goto failure;
+    u->cq_map = single ? u->sq_map
+                : mmap(NULL, u->cq_map_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, u->fd,
+                       IORING_OFF_CQ_RING);
+    if (u->cq_map == MAP_FAILED) goto failure;
+    u->sqes = mmap(NULL, p.sq_entries * sizeof(struct io_uring_sqe), PROT_READ | PROT_WRITE,
+                   MAP_SHARED | MAP_POPULATE, u->fd, IORING_OFF_SQES);
+    if (u->sqes == MAP_FAILED) goto failure;
+
+    char *sq = u->sq_map, *cq = u->cq_map;
+    u->sq_head = (_Atomic unsigned *)(sq + p.sq_off.head);
+    u->sq_tail = (_Atomic unsigned *)(sq + p.sq_off.tail);
+    u->sq_mask = *(unsigned *)(sq + p.sq_off.ring_mask);
+    u->sq_array = (unsigned *)(sq + p.sq_off.array);
+    u->cq_head = (_Atomic unsigned *)(cq + p.cq_off.head);
+    u->cq_tail = (_Atomic unsigned *)(cq + p.cq_off.tail);
+    u->cq_mask = *(unsigned *)(cq + p.cq_off.ring_mask);
+    u->cqes = (struct io_uring_cqe *)(cq + p.cq_off.cqes);
+    return u;
+
+failure:
+    uring_free(u);
+    return NULL;
+}
+
+// Reads the rest of a request with pread(); `done` bytes are already there.
+static bool pread_rest(int fd, const UringRead *r, size_t done) {
+    while (done < r->len) {
+        ssize_t got = pread(fd, (char *)r->buf + done, r->len - done, (off_t)(r->offset + done));
+        if (got < 0 && errno == EINTR) continue;
+        if (got == 0) return true;  // end of file
+        if (got < 0) return false;
+        done += (size_t)got;
+    }
+    return true;
+}
+
+static bool pread_all(int fd, const UringRead reads[], size_t n) {
+    bool ok = true;
+    for (size_t i = 0; i < n; i++) ok = pread_rest(fd, &reads[i], 0) && ok;
+    return ok;
+}
+
+// Waits for `pending` submitted reads and drops their results, so that none
+// of them can still land in a buffer once it is refilled. Returns false if
+// the ring cannot even be waited on.
+static bool uring_drain(Uring *u, size_t pending) {
+    while (pending > 0) {
+        unsigned head = atomic_load_explicit(u->cq_head, memory_order_relaxed);
+        unsigned cq_tail = atomic_load_explicit(u->cq_tail, memory_order_acquire);
+        pending -= cq_tail - head < pending ? cq_tail - head : pending;
+        atomic_store_explicit(u->cq_head, cq_tail, memory_order_release);
+        if (pending == 0) break;
+        if (sys_io_uring_enter(u->fd, 0, (unsigned)pending, IORING_ENTER_GETEVENTS) < 0 && errno != EINTR) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Submits reads[0..n), n <= u->entries, and waits for all of them.
+static bool uring_round(Uring *u, int fd, const UringRead reads[], size_t n) {
+    unsigned tail = atomic_load_explicit(u->sq_tail, memory_order_relaxed);
+    for (size_t i = 0; i < n; i++, tail++) {
+        unsigned idx = tail & u->sq_mask;
+        struct io_uring_sqe *sqe = &u->sqes[idx];
+        memset(sqe, 0, sizeof(*sqe));
+        sqe->opcode = IORING_OP_READ;
+        sqe->fd = fd;
+        sqe->addr = (uint64_t)(uintptr_t)reads[i].buf;
+        sqe->len = (uint32_t)reads[i].len;
+        sqe->off = reads[i].offset;
+        sqe->user_data = i;
+        u->sq_array[idx] = idx;
+    }
+    atomic_store_explicit(u->sq_tail, tail, memory_order_release);
+
+    bool ok = true;
+    size_t submitted = 0, completed = 0;
+    while (completed < n) {
+        int ret = sys_io_uring_enter(u->fd, (unsigned)(n - submitted), 1, IORING_ENTER_GETEVENTS);
+        if (ret < 0) {
+            if (errno == EINTR) continue;
+            // The ring is unusable; the whole round is read again below,
+            // once the reads already submitted are done with the buffers.
+            u->broken = true;
+            if (!uring_drain(u, submitted - completed)) return false;
+            break;
+        }
+        submitted += (size_t)ret;
+        unsigned head = atomic_load_explicit(u->cq_head, memory_order_relaxed);
+        unsigned cq_tail = atomic_load_explicit(u->cq_tail, memory_order_acquire);
+        for (; head != cq_tail; head++, completed++) {
+            const struct io_uring_cqe *cqe = &u->cqes[head & u->cq_mask];
+            const UringRead *r = &reads[cqe->user_data];
+            // Errors (such as an old kernel without IORING_OP_READ) and short
+            // reads are finished synchronously.
+            size_t done = cqe->res > 0 ? (size_t)cqe->res : 0;
+            if (done < r->len && !pread_rest(fd, r, done)) ok = false;
+        }
+        atomic_store_explicit(u->cq_head, head, memory_order_release);
+    }
+    return completed < n ? pread_all(fd, reads, n) : ok;
+}
+
+int uring_read_all(Uring *u, int fd, const UringRead reads[], size_t n) {
+    if (!u) return pread_all(fd, reads, n) ? 0 : -1;
+    bool ok = true;
+    for (size_t first = 0; first < n; first += u->entries) {
+        size_t count = n - first < u->entries ? n - first : u->entries;
+        ok = (u->broken ? pread_all(fd, reads + first, count) : uring_round(u, fd, reads + first, count)) && ok;
+    }
+    return ok ? 0 : -1;
+}
+
+void uring_free(Uring *u) {
+    if (!u) return;
+    if (u->sqes != MAP_FAILED) munmap(u->sqes, u->entries * sizeof(struct io_uring_sqe));
+    if (u->cq_map != MAP_FAILED && u->cq_map != u->sq_map) munmap(u->cq_map, u->cq_map_len);
+    if (u->sq_map != MAP_FAILED) munmap(u->sq_map, u->sq_map_len);
+    close(u->fd);
+    free(u);
+}
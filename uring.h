@@ -0,0 +1,61 @@
+#ifndef URING_H
+#define URING_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+ * Batched file reads through io_uring.
+ *
+ * The ring is set up with the raw system calls, so no liburing is needed.
+ * A batch of reads is queued and submitted with one io_uring_enter(), and
+ * the device serves them in parallel. Kernels without io_uring, or sandboxes
+ * that forbid it, make uring_create() return NULL. uring_read_all() then
+ * falls back to one pread() after another, so callers need no second path.
+ *
+ * A Uring is not thread-safe; give each thread its own.
+ */
+typedef struct Uring Uring;
+
+/** @brief One read of a batch. */
+typedef struct {
+    void *buf;
+    size_t len;
+    uint64_t offset;
+} UringRead;
+
+/** @brief Alignment of buffers, offsets and lengths for files opened with `direct`. */
+enum { URING_DIRECT_ALIGN = 4096 };
+
+/**
+ * @brief Opens a file read-only for uring_read_all().
+ *
+ * With `direct`, reads bypass the OS page cache (O_DIRECT), so each one goes
+ * to the device; every read must then be aligned to URING_DIRECT_ALIGN.
+ * File systems without O_DIRECT get an ordinary descriptor and *direct is
+ * cleared. Without it, the kernel is told not to read ahead.
+ * @return The descriptor, or -1 on failure.
+ */
+int uring_open(const char *filename, bool *direct);
+
+/**
+ * @brief Sets up a ring for up to `entries` reads in flight.
+ * @return The ring, or NULL if io_uring is unavailable.
+ */
+Uring *uring_create(unsigned entries);
+
+/**
+ * @brief Reads every request of the batch in full from `fd`.
+ *
+ * Batches larger than the ring are submitted in parts. Reads the kernel
+ * fails or shortens are retried with pread(). A read that reaches the end
+ * of the file stops there; the rest of its buffer is then undefined.
+ * @param u The ring, or NULL to use pread() only.
+ * @return 0 on success, -1 if any read failed.
+ */
+int uring_read_all(Uring *u, int fd, const UringRead reads[], size_t n);
+
+void uring_free(Uring *u);
+
+#endif // URING_H
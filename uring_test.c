@@ -0,0 +1,75 @@
+/* uring_test.c - tests for the batched io_uring reader.
+ *
+ */
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "uring.h"
+
+constexpr size_t NUM_WORDS = 1 << 20;
+constexpr size_t NUM_READS = 1000;
+
+// Reads NUM_READS scattered words and checks them; `u` may be NULL.
+static void check_reads(Uring *u, int fd, bool direct) {
+    uint8_t *buf = aligned_alloc(URING_DIRECT_ALIGN, NUM_READS * URING_DIRECT_ALIGN);
+    UringRead *reads = malloc(sizeof(UringRead) * NUM_READS);
+    assert(buf && reads);
+    for (size_t i = 0; i < NUM_READS; i++) {
+        uint64_t word = (i * 7919) % NUM_WORDS;
+        uint64_t at = direct ? word * 8 / URING_DIRECT_ALIGN * URING_DIRECT_ALIGN : word * 8;
+        reads[i] = (UringRead) {
+            .buf = buf + i * URING_DIRECT_ALIGN, .len = direct ? URING_DIRECT_ALIGN : 8, .offset = at,
+        };
+    }
+    assert(uring_read_all(u, fd, reads, NUM_READS) == 0);
+    for (size_t i = 0; i < NUM_READS; i++) {
+        uint64_t word = (i * 7919) % NUM_WORDS, got;
+        memcpy(&got, buf + i * URING_DIRECT_ALIGN + (direct ? word * 8 % URING_DIRECT_ALIGN : 0), 8);
+        assert(got == word * 3);
+    }
+    free(buf);
+    free(reads);
+}
+
+int main(void) {
+    printf("uring_test\n");
+    const char *file = "uring_test.bin";
+    FILE *fp = fopen(file, "wb");
+    assert(fp);
+    for (uint64_t w = 0; w < NUM_WORDS; w++) {
+        uint64_t value = w * 3;
+        fwrite(&value, sizeof(value), 1, fp);
+    }
+    uint32_t odd_tail = 0x12345678;  // the file does not end on a page
+    fwrite(&odd_tail, sizeof(odd_tail), 1, fp);
+    fclose(fp);
+
+    Uring *u = uring_create(64);
+    printf("  io_uring %s\n", u ? "available" : "unavailable, testing the pread() fallback only");
+    for (int direct_wanted = 0; direct_wanted < 2; direct_wanted++) {
+        bool direct = direct_wanted;
+        int fd = uring_open(file, &direct);
+        assert(fd >= 0);
+        check_reads(u, fd, direct);
+        check_reads(NULL, fd, direct);
+
+        // A read past the end stops there without an error.
+        uint8_t *page = aligned_alloc(URING_DIRECT_ALIGN, URING_DIRECT_ALIGN);
+        UringRead last = {.buf = page, .len = URING_DIRECT_ALIGN, .offset = NUM_WORDS * 8};
+        assert(uring_read_all(u, fd, &last, 1) == 0);
+        assert(memcmp(page, &odd_tail, 4) == 0);
+        free(page);
+        close(fd);
+    }
+    uring_free(u);
+
+    // Reading a closed descriptor fails.
+    UringRead bad = {.buf = &odd_tail, .len = 4, .offset = 0};
+    assert(uring_read_all(NULL, 1000, &bad, 1) == -1);
+    remove(file);
+    printf("All tests passed.\n");
+    return 0;
+}